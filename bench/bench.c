@@ -0,0 +1,750 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/* Bench
+ *
+ * Measure the throughput of Tokenize over a corpus written by Corpus.
+ *
+ * Syntax: Bench -tokenize <file> -corpus <dir> [<options>]
+ *
+ * Every program in the corpus is tokenized with each combination of the
+ * -link, -swi and -crunch options in turn, and the throughput, peak memory
+ * use and time taken are reported for each. The programs are passed to the
+ * tokenizer in batches, so that each sample is long enough for the time
+ * taken to start a process not to matter, and each batch is timed several
+ * times with the median being taken.
+ *
+ * If a reference tokenizer is given, it is timed alongside the one being
+ * tested, with the two taking turns on each batch so that both see the
+ * same conditions on the machine. If the throughput of any combination
+ * has fallen by more than the threshold against the reference, Bench exits
+ * with an error. The results can be written out as JSON.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* Local source headers. */
+
+#include "args.h"
+
+/**
+ * The path variable used by the corpus to link the library files.
+ */
+
+#define BENCH_PATH_NAME "Corpus"
+
+#define BENCH_LIST_NAME "Programs"
+#define BENCH_SWIS_NAME "Swis"
+#define BENCH_OUTPUT_NAME "Output"
+
+#define BENCH_DEFAULT_THRESHOLD 10
+#define BENCH_DEFAULT_REPEAT 5
+#define BENCH_MAX_FILENAME 1024
+#define BENCH_MAX_NAME 64
+#define BENCH_MAX_ARGS 16
+#define BENCH_MAX_BATCH 64
+#define BENCH_MAX_BATCH_LINES 60000
+#define BENCH_BUFFER_SIZE 65536
+
+/**
+ * The crunch options which are tried, from none to all of them.
+ */
+
+static char *bench_crunches[] = {NULL, "EIRTW", "ADEFILMNRTW"};
+
+#define BENCH_CRUNCHES (sizeof(bench_crunches) / sizeof(char *))
+
+/**
+ * The tokenizers which can be timed.
+ */
+
+enum bench_tokenizer {
+	BENCH_TEST = 0,				/**< The tokenizer being tested.			*/
+	BENCH_REFERENCE = 1,			/**< The reference tokenizer.				*/
+	BENCH_TOKENIZERS = 2
+};
+
+/**
+ * The number of combinations of options: -link on or off, -swi on or
+ * off, and each of the crunch options.
+ */
+
+#define BENCH_CONFIGS (2 * 2 * BENCH_CRUNCHES)
+
+/**
+ * A program from the corpus, with the sizes of its source.
+ */
+
+struct bench_program {
+	char			*name;		/**< The name of the program's main file.		*/
+	unsigned long long	main_bytes;	/**< The size of the main file.				*/
+	unsigned long long	main_lines;	/**< The number of lines in the main file.		*/
+	unsigned long long	all_bytes;	/**< The size of the main file and its libraries.	*/
+	unsigned long long	all_lines;	/**< The number of lines in the main file and libraries.*/
+
+	struct bench_program	*next;		/**< Pointer to the next program in the list.		*/
+};
+
+/**
+ * The results for a combination of options.
+ */
+
+struct bench_result {
+	char			name[BENCH_MAX_NAME];	/**< The name of the combination.		*/
+	bool			link;		/**< True if -link was used.				*/
+	bool			swi;		/**< True if -swi was used.				*/
+	char			*crunch;	/**< The -crunch options used, or NULL.			*/
+
+	unsigned long long	bytes;		/**< The number of source bytes processed.		*/
+	unsigned long long	lines;		/**< The number of source lines processed.		*/
+	double			wall[BENCH_TOKENIZERS];	/**< The total of the median wall clock times, in seconds. */
+	double			cpu[BENCH_TOKENIZERS];	/**< The total of the median CPU times, in seconds.	*/
+	long			peak_rss;	/**< The peak resident set size of the tested tokenizer, in KB. */
+};
+
+static struct bench_program	*bench_programs = NULL;
+static struct bench_result	bench_results[BENCH_CONFIGS];
+
+static bool bench_load_corpus(char *corpus);
+static bool bench_measure_file(char *filename, unsigned long long *bytes, unsigned long long *lines);
+static bool bench_run_config(char *tokenize[], char *corpus, struct bench_result *result, int repeat);
+static bool bench_run_batch(char *tokenize[], char *corpus, char *programs[], int count, struct bench_result *result, int repeat);
+static bool bench_run_tokenize(char *tokenize, char *corpus, char *programs[], int count, struct bench_result *result, double *cpu, long *peak_rss);
+static bool bench_write_results(char *file, unsigned long long bytes, unsigned long long lines, bool reference);
+static double bench_median(double *samples, int count);
+static int bench_compare_samples(const void *a, const void *b);
+static double bench_throughput(struct bench_result *result, enum bench_tokenizer tokenizer);
+static double bench_time(void);
+
+
+int main(int argc, char *argv[])
+{
+	bool			param_error = false;
+	bool			output_help = false;
+	bool			regression = false;
+	struct args_option	*options;
+	char			*tokenize[BENCH_TOKENIZERS] = {NULL, NULL}, *corpus = NULL, *output_file = NULL;
+	int			threshold = BENCH_DEFAULT_THRESHOLD, repeat = BENCH_DEFAULT_REPEAT;
+	unsigned		config;
+	unsigned long long	corpus_bytes = 0, corpus_lines = 0;
+	struct bench_program	*program;
+	struct bench_result	*result;
+	double			change;
+
+	/* Decode the command line options. */
+
+	options = args_process_line(argc, argv, "tokenize/AK,corpus/AK,reference/K,out/K,threshold/IK,repeat/IK,help/S");
+	if (options == NULL)
+		param_error = true;
+
+	while (options != NULL) {
+		if (strcmp(options->name, "corpus") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL)
+				corpus = options->data->value.string;
+			else
+				param_error = true;
+		} else if (strcmp(options->name, "help") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				output_help = true;
+		} else if (strcmp(options->name, "out") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.string != NULL)
+					output_file = options->data->value.string;
+				else
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "reference") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.string != NULL)
+					tokenize[BENCH_REFERENCE] = options->data->value.string;
+				else
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "repeat") == 0) {
+			if (options->data != NULL) {
+				repeat = options->data->value.integer;
+				if (repeat < 1)
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "threshold") == 0) {
+			if (options->data != NULL) {
+				threshold = options->data->value.integer;
+				if (threshold < 0 || threshold > 100)
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "tokenize") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL)
+				tokenize[BENCH_TEST] = options->data->value.string;
+			else
+				param_error = true;
+		}
+
+		options = options->next;
+	}
+
+	if (param_error || output_help) {
+		printf("Tokenize Throughput Benchmark -- Usage:\n");
+		printf("bench -tokenize <file> -corpus <folder> [<options>]\n\n");
+
+		printf(" -corpus <folder>       Tokenize the corpus in <folder>.\n");
+		printf(" -help                  Produce this help information.\n");
+		printf(" -out <file>            Write the results to <file> as JSON.\n");
+		printf(" -reference <file>      Compare the results with the tokenizer in <file>.\n");
+		printf(" -repeat <n>            Take the median of <n> runs of each batch.\n");
+		printf(" -threshold <n>         Fail if throughput drops by more than <n>%%.\n");
+		printf(" -tokenize <file>       Run the tokenizer in <file>.\n");
+
+		return (output_help) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (!bench_load_corpus(corpus))
+		return EXIT_FAILURE;
+
+	for (program = bench_programs; program != NULL; program = program->next) {
+		corpus_bytes += program->all_bytes;
+		corpus_lines += program->all_lines;
+	}
+
+	/* Set up the combinations of options. */
+
+	for (config = 0; config < BENCH_CONFIGS; config++) {
+		result = bench_results + config;
+
+		result->link = (config & 1) ? true : false;
+		result->swi = (config & 2) ? true : false;
+		result->crunch = bench_crunches[config / 4];
+
+		snprintf(result->name, BENCH_MAX_NAME, "%s%s%s%s%s",
+				(result->link || result->swi || result->crunch != NULL) ? "" : "plain",
+				(result->link) ? "link" : "",
+				(result->link && result->swi) ? "+" : "",
+				(result->swi) ? "swi" : "",
+				(result->crunch == NULL) ? "" : (result->link || result->swi) ? "+crunch=" : "crunch=");
+
+		if (result->crunch != NULL)
+			strncat(result->name, result->crunch, BENCH_MAX_NAME - strlen(result->name) - 1);
+	}
+
+	/* Run the benchmarks. */
+
+	printf("Corpus of %llu bytes in %llu lines\n\n", corpus_bytes, corpus_lines);
+	printf("%-28s %9s %11s %10s %8s %8s", "Options", "MB/s", "Lines/s", "Peak RSS", "Wall", "CPU");
+	if (tokenize[BENCH_REFERENCE] != NULL)
+		printf(" %9s %8s", "Reference", "Change");
+	printf("\n");
+
+	for (config = 0; config < BENCH_CONFIGS; config++) {
+		result = bench_results + config;
+
+		if (!bench_run_config(tokenize, corpus, result, repeat))
+			return EXIT_FAILURE;
+
+		printf("%-28s %9.2f %11.0f %9ldK %7.3fs %7.3fs", result->name, bench_throughput(result, BENCH_TEST),
+				(result->wall[BENCH_TEST] > 0) ? result->lines / result->wall[BENCH_TEST] : 0, result->peak_rss,
+				result->wall[BENCH_TEST], result->cpu[BENCH_TEST]);
+
+		if (tokenize[BENCH_REFERENCE] != NULL && bench_throughput(result, BENCH_REFERENCE) > 0) {
+			change = (bench_throughput(result, BENCH_TEST) / bench_throughput(result, BENCH_REFERENCE) - 1.0) * 100.0;
+			printf(" %9.2f %+7.1f%%", bench_throughput(result, BENCH_REFERENCE), change);
+
+			if (change < -threshold) {
+				printf("  REGRESSION");
+				regression = true;
+			}
+		}
+
+		printf("\n");
+		fflush(stdout);
+	}
+
+	if (output_file != NULL && !bench_write_results(output_file, corpus_bytes, corpus_lines, (tokenize[BENCH_REFERENCE] != NULL) ? true : false))
+		return EXIT_FAILURE;
+
+	if (regression) {
+		printf("\nThroughput fell by more than %d%% against '%s'\n", threshold, tokenize[BENCH_REFERENCE]);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+/**
+ * Load the list of programs in a corpus, and measure the size of each.
+ *
+ * \param *corpus	The folder holding the corpus.
+ * \return		True if successful; else False.
+ */
+
+static bool bench_load_corpus(char *corpus)
+{
+	char			filename[BENCH_MAX_FILENAME], name[BENCH_MAX_NAME], *end;
+	struct bench_program	*program, *tail = NULL;
+	unsigned long long	bytes, lines;
+	unsigned		library;
+	FILE			*list;
+
+	snprintf(filename, BENCH_MAX_FILENAME, "%s/%s", corpus, BENCH_LIST_NAME);
+
+	list = fopen(filename, "r");
+	if (list == NULL) {
+		fprintf(stderr, "Failed to open corpus list '%s'\n", filename);
+		return false;
+	}
+
+	while (fgets(name, BENCH_MAX_NAME, list) != NULL) {
+		end = strpbrk(name, "\r\n");
+		if (end != NULL)
+			*end = '\0';
+
+		if (*name == '\0')
+			continue;
+
+		program = malloc(sizeof(struct bench_program));
+		if (program == NULL) {
+			fclose(list);
+			return false;
+		}
+
+		program->name = strdup(name);
+		program->next = NULL;
+
+		snprintf(filename, BENCH_MAX_FILENAME, "%s/%s", corpus, name);
+		if (program->name == NULL || !bench_measure_file(filename, &program->main_bytes, &program->main_lines)) {
+			fprintf(stderr, "Failed to read corpus file '%s'\n", filename);
+			fclose(list);
+			return false;
+		}
+
+		/* The libraries are numbered from 1, with the chain ending at
+		 * the first one which doesn't exist.
+		 */
+
+		program->all_bytes = program->main_bytes;
+		program->all_lines = program->main_lines;
+
+		for (library = 1; ; library++) {
+			snprintf(filename, BENCH_MAX_FILENAME, "%s/%sL%u", corpus, name, library);
+			if (!bench_measure_file(filename, &bytes, &lines))
+				break;
+
+			program->all_bytes += bytes;
+			program->all_lines += lines;
+		}
+
+		if (tail == NULL)
+			bench_programs = program;
+		else
+			tail->next = program;
+
+		tail = program;
+	}
+
+	fclose(list);
+
+	if (bench_programs == NULL) {
+		fprintf(stderr, "No programs found in corpus '%s'\n", corpus);
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Find the size of a file, and the number of lines in it.
+ *
+ * \param *filename	The file to measure.
+ * \param *bytes	Pointer to a variable to take the size.
+ * \param *lines	Pointer to a variable to take the number of lines.
+ * \return		True if successful; False if the file couldn't be read.
+ */
+
+static bool bench_measure_file(char *filename, unsigned long long *bytes, unsigned long long *lines)
+{
+	FILE	*file;
+	char	buffer[BENCH_BUFFER_SIZE];
+	size_t	length, i;
+
+	file = fopen(filename, "r");
+	if (file == NULL)
+		return false;
+
+	*bytes = 0;
+	*lines = 0;
+
+	while ((length = fread(buffer, 1, BENCH_BUFFER_SIZE, file)) > 0) {
+		*bytes += length;
+
+		for (i = 0; i < length; i++) {
+			if (buffer[i] == '\n')
+				(*lines)++;
+		}
+	}
+
+	fclose(file);
+
+	return true;
+}
+
+
+/**
+ * Run the tokenizers over every program in the corpus for a combination of
+ * options. The programs are collected into batches of up to
+ * BENCH_MAX_BATCH_LINES lines, each of which is tokenized in one go.
+ *
+ * \param *tokenize[]	The tokenizers to run; the reference can be NULL.
+ * \param *corpus	The folder holding the corpus.
+ * \param *result	The combination of options, to take the results.
+ * \param repeat	The number of times to run each batch.
+ * \return		True if successful; else False.
+ */
+
+static bool bench_run_config(char *tokenize[], char *corpus, struct bench_result *result, int repeat)
+{
+	struct bench_program	*program;
+	char			*batch[BENCH_MAX_BATCH];
+	unsigned long long	lines, batch_lines = 0;
+	int			count = 0, tokenizer;
+
+	result->bytes = 0;
+	result->lines = 0;
+	result->peak_rss = 0;
+
+	for (tokenizer = 0; tokenizer < BENCH_TOKENIZERS; tokenizer++) {
+		result->wall[tokenizer] = 0;
+		result->cpu[tokenizer] = 0;
+	}
+
+	for (program = bench_programs; program != NULL; program = program->next) {
+		lines = (result->link) ? program->all_lines : program->main_lines;
+
+		result->bytes += (result->link) ? program->all_bytes : program->main_bytes;
+		result->lines += lines;
+
+		if (count > 0 && (count == BENCH_MAX_BATCH || batch_lines + lines > BENCH_MAX_BATCH_LINES)) {
+			if (!bench_run_batch(tokenize, corpus, batch, count, result, repeat))
+				return false;
+
+			count = 0;
+			batch_lines = 0;
+		}
+
+		batch[count++] = program->name;
+		batch_lines += lines;
+	}
+
+	if (count > 0 && !bench_run_batch(tokenize, corpus, batch, count, result, repeat))
+		return false;
+
+	return true;
+}
+
+
+/**
+ * Run the tokenizers over a batch of programs a number of times, adding the
+ * median times to the results. The tokenizers take turns, so that any load
+ * on the machine is shared between them.
+ *
+ * \param *tokenize[]	The tokenizers to run; the reference can be NULL.
+ * \param *corpus	The folder holding the corpus.
+ * \param *programs[]	The names of the programs' main files.
+ * \param count		The number of programs in the batch.
+ * \param *result	The combination of options, to take the results.
+ * \param repeat	The number of times to run the batch.
+ * \return		True if successful; else False.
+ */
+
+static bool bench_run_batch(char *tokenize[], char *corpus, char *programs[], int count, struct bench_result *result, int repeat)
+{
+	double			*walls, *cpus, start, cpu;
+	long			peak_rss;
+	int			run, tokenizer;
+
+	walls = malloc(BENCH_TOKENIZERS * repeat * sizeof(double));
+	cpus = malloc(BENCH_TOKENIZERS * repeat * sizeof(double));
+	if (walls == NULL || cpus == NULL) {
+		free(walls);
+		free(cpus);
+		return false;
+	}
+
+	for (run = 0; run < repeat; run++) {
+		for (tokenizer = 0; tokenizer < BENCH_TOKENIZERS; tokenizer++) {
+			if (tokenize[tokenizer] == NULL)
+				continue;
+
+			start = bench_time();
+
+			if (!bench_run_tokenize(tokenize[tokenizer], corpus, programs, count, result, &cpu, &peak_rss)) {
+				free(walls);
+				free(cpus);
+				return false;
+			}
+
+			walls[tokenizer * repeat + run] = bench_time() - start;
+			cpus[tokenizer * repeat + run] = cpu;
+
+			if (tokenizer == BENCH_TEST && peak_rss > result->peak_rss)
+				result->peak_rss = peak_rss;
+		}
+	}
+
+	for (tokenizer = 0; tokenizer < BENCH_TOKENIZERS; tokenizer++) {
+		if (tokenize[tokenizer] == NULL)
+			continue;
+
+		result->wall[tokenizer] += bench_median(walls + tokenizer * repeat, repeat);
+		result->cpu[tokenizer] += bench_median(cpus + tokenizer * repeat, repeat);
+	}
+
+	free(walls);
+	free(cpus);
+
+	return true;
+}
+
+
+/**
+ * Run a tokenizer over a batch of programs, and wait for it to finish. The
+ * lines are numbered in steps of one, so that as many programs as possible
+ * fit into the range of line numbers.
+ *
+ * \param *tokenize	The tokenizer to run.
+ * \param *corpus	The folder holding the corpus.
+ * \param *programs[]	The names of the programs' main files.
+ * \param count		The number of programs in the batch.
+ * \param *result	The combination of options to use.
+ * \param *cpu		Pointer to a variable to take the CPU time used.
+ * \param *peak_rss	Pointer to a variable to take the peak RSS, in KB.
+ * \return		True if successful; else False.
+ */
+
+static bool bench_run_tokenize(char *tokenize, char *corpus, char *programs[], int count, struct bench_result *result, double *cpu, long *peak_rss)
+{
+	char		sources[BENCH_MAX_BATCH][BENCH_MAX_FILENAME], output[BENCH_MAX_FILENAME], path[BENCH_MAX_FILENAME], swis[BENCH_MAX_FILENAME];
+	char		*args[BENCH_MAX_ARGS + BENCH_MAX_BATCH];
+	int		arg = 0, status, null, program;
+	pid_t		pid;
+	struct rusage	usage;
+
+	snprintf(output, BENCH_MAX_FILENAME, "%s/%s", corpus, BENCH_OUTPUT_NAME);
+	snprintf(path, BENCH_MAX_FILENAME, "%s:%s/", BENCH_PATH_NAME, corpus);
+	snprintf(swis, BENCH_MAX_FILENAME, "%s/%s", corpus, BENCH_SWIS_NAME);
+
+	args[arg++] = tokenize;
+
+	for (program = 0; program < count; program++) {
+		snprintf(sources[program], BENCH_MAX_FILENAME, "%s/%s", corpus, programs[program]);
+		args[arg++] = sources[program];
+	}
+
+	args[arg++] = "-out";
+	args[arg++] = output;
+	args[arg++] = "-increment";
+	args[arg++] = "1";
+
+	if (result->link) {
+		args[arg++] = "-link";
+		args[arg++] = "-path";
+		args[arg++] = path;
+	}
+
+	if (result->swi) {
+		args[arg++] = "-swi";
+		args[arg++] = "-swis";
+		args[arg++] = swis;
+	}
+
+	if (result->crunch != NULL) {
+		args[arg++] = "-crunch";
+		args[arg++] = result->crunch;
+	}
+
+	args[arg] = NULL;
+
+	pid = fork();
+
+	if (pid < 0) {
+		fprintf(stderr, "Failed to start '%s'\n", tokenize);
+		return false;
+	}
+
+	/* The tokenizer's messages are discarded, as warnings from the
+	 * corpus would swamp the results; if it fails, the command can be
+	 * repeated by hand to see why.
+	 */
+
+	if (pid == 0) {
+		null = open("/dev/null", O_WRONLY);
+		if (null >= 0) {
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+		}
+
+		execv(tokenize, args);
+		_exit(127);
+	}
+
+	while (wait4(pid, &status, 0, &usage) < 0) {
+		if (errno != EINTR) {
+			fprintf(stderr, "Failed to wait for '%s'\n", tokenize);
+			return false;
+		}
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "Tokenizing the batch starting '%s' with %s using '%s' failed\n", sources[0], result->name, tokenize);
+		return false;
+	}
+
+	*cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+			usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+	*peak_rss = usage.ru_maxrss;
+
+	return true;
+}
+
+
+/**
+ * Write the results out as JSON.
+ *
+ * \param *file		The file to write.
+ * \param bytes		The size of the corpus.
+ * \param lines		The number of lines in the corpus.
+ * \param reference	True to include the reference tokenizer's throughput.
+ * \return		True if successful; else False.
+ */
+
+static bool bench_write_results(char *file, unsigned long long bytes, unsigned long long lines, bool reference)
+{
+	FILE			*out;
+	unsigned		config;
+	struct bench_result	*result;
+
+	out = fopen(file, "w");
+	if (out == NULL) {
+		fprintf(stderr, "Failed to write results to '%s'\n", file);
+		return false;
+	}
+
+	fprintf(out, "{\n\t\"corpus_bytes\": %llu,\n\t\"corpus_lines\": %llu,\n\t\"results\": [\n", bytes, lines);
+
+	for (config = 0; config < BENCH_CONFIGS; config++) {
+		result = bench_results + config;
+
+		fprintf(out, "\t\t{\"name\": \"%s\", \"mb_per_s\": %.2f, \"lines_per_s\": %.0f, \"peak_rss_kb\": %ld, \"wall_s\": %.3f, \"cpu_s\": %.3f",
+				result->name, bench_throughput(result, BENCH_TEST),
+				(result->wall[BENCH_TEST] > 0) ? result->lines / result->wall[BENCH_TEST] : 0,
+				result->peak_rss, result->wall[BENCH_TEST], result->cpu[BENCH_TEST]);
+
+		if (reference)
+			fprintf(out, ", \"reference_mb_per_s\": %.2f", bench_throughput(result, BENCH_REFERENCE));
+
+		fprintf(out, "}%s\n", (config < BENCH_CONFIGS - 1) ? "," : "");
+	}
+
+	fprintf(out, "\t]\n}\n");
+	fclose(out);
+
+	return true;
+}
+
+
+/**
+ * Find the median of a set of samples, sorting them in the process.
+ *
+ * \param *samples	The samples.
+ * \param count		The number of samples.
+ * \return		The median value.
+ */
+
+static double bench_median(double *samples, int count)
+{
+	qsort(samples, count, sizeof(double), bench_compare_samples);
+
+	if (count % 2 == 0)
+		return (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+
+	return samples[count / 2];
+}
+
+
+/**
+ * Compare two samples, for qsort().
+ *
+ * \param *a		Pointer to the first sample.
+ * \param *b		Pointer to the second sample.
+ * \return		The result of the comparison.
+ */
+
+static int bench_compare_samples(const void *a, const void *b)
+{
+	double	first = *(const double *) a, second = *(const double *) b;
+
+	return (first > second) - (first < second);
+}
+
+
+/**
+ * Return the throughput of one of the tokenizers for a set of results.
+ *
+ * \param *result	The results to calculate the throughput for.
+ * \param tokenizer	The tokenizer to calculate the throughput of.
+ * \return		The throughput, in MB/s.
+ */
+
+static double bench_throughput(struct bench_result *result, enum bench_tokenizer tokenizer)
+{
+	if (result->wall[tokenizer] <= 0)
+		return 0;
+
+	return result->bytes / result->wall[tokenizer] / (1024.0 * 1024.0);
+}
+
+
+/**
+ * Read the monotonic clock.
+ *
+ * \return		The time, in seconds.
+ */
+
+static double bench_time(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
@@ -0,0 +1,1620 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/* Corpus
+ *
+ * Generate synthetic BASIC V source files for benchmarking Tokenize.
+ *
+ * Syntax: Corpus -out <dir> [<options>]
+ *
+ * The output is a set of programs, each made up of a main file and a chain
+ * of LIBRARY files, written into the output folder along with a Programs
+ * file listing the main files and a Swis header defining the SWIs which
+ * are called. The libraries are referenced through the Corpus: path, so
+ * each program can be tokenized with
+ *
+ *   tokenize <dir>/Prog00001 -link -path Corpus:<dir>/ -out <file>
+ *
+ * adding -swi -swis <dir>/Swis to convert the SYS names.
+ *
+ * The same seed and options always give the same files, on any platform.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Local source headers. */
+
+#include "args.h"
+
+/**
+ * The maximum number of lines in a linked program, so that it can be
+ * tokenized with the default AUTO numbering of 10, 10.
+ */
+
+#define CORPUS_MAX_LINES 6000
+
+/**
+ * The number of lines to leave spare at the end of a file, so that the
+ * block which crosses the limit can be completed.
+ */
+
+#define CORPUS_SPARE_LINES 40
+
+/**
+ * The path variable used to link the library files.
+ */
+
+#define CORPUS_PATH_NAME "Corpus"
+
+/**
+ * The name of the file listing the programs in the corpus.
+ */
+
+#define CORPUS_LIST_NAME "Programs"
+
+/**
+ * The name of the header file defining the SWIs used by the corpus.
+ */
+
+#define CORPUS_SWIS_NAME "Swis"
+
+#define CORPUS_DEFAULT_SIZE (1024 * 1024)
+#define CORPUS_DEFAULT_PROGRAM (128 * 1024)
+#define CORPUS_DEFAULT_LIBRARIES 2
+#define CORPUS_DEFAULT_ABBREVIATIONS 10
+#define CORPUS_MAX_ROUTINES 4096
+#define CORPUS_MAX_PARAMETERS 3
+#define CORPUS_MAX_NAME 64
+#define CORPUS_MAX_FILENAME 1024
+
+/**
+ * The kinds of line which can be generated.
+ */
+
+enum corpus_kind {
+	CORPUS_KIND_KEYWORD = 0,	/**< Assignments, loops and other general statements.	*/
+	CORPUS_KIND_STRING,		/**< Statements built around string literals.		*/
+	CORPUS_KIND_REM,		/**< Comments and blank lines.				*/
+	CORPUS_KIND_DATA,		/**< DATA, READ and RESTORE statements.			*/
+	CORPUS_KIND_SYS,		/**< SYS calls.						*/
+	CORPUS_KIND_CALL,		/**< Calls to other PROCs and FNs.			*/
+	CORPUS_KIND_ASM,		/**< Assembler blocks.					*/
+	CORPUS_KIND_PROC,		/**< The start of a new DEF PROC or DEF FN.		*/
+	CORPUS_KINDS			/**< The number of kinds of line.			*/
+};
+
+/**
+ * The names of the kinds of line, as used by -mix.
+ */
+
+static char *corpus_kind_names[] = {"keyword", "string", "rem", "data", "sys", "call", "asm", "proc"};
+
+/**
+ * The relative weights of the kinds of line.
+ */
+
+static unsigned corpus_weights[CORPUS_KINDS] = {40, 12, 8, 5, 6, 10, 2, 4};
+
+/**
+ * A keyword which can be written in abbreviated form.
+ */
+
+struct corpus_abbreviation {
+	char		*name;			/**< The full keyword.				*/
+	char		*abbreviation;		/**< The abbreviated keyword.			*/
+};
+
+static struct corpus_abbreviation corpus_abbreviations[] = {
+	{"DRAW",	"DR."},
+	{"ENDPROC",	"E."},
+	{"ENDWHILE",	"ENDW."},
+	{"FOR",		"F."},
+	{"GCOL",	"GC."},
+	{"LOCAL",	"LOC."},
+	{"NEXT",	"N."},
+	{"PRINT",	"P."},
+	{"READ",	"REA."},
+	{"REPEAT",	"REP."},
+	{"RESTORE",	"RES."},
+	{"UNTIL",	"U."},
+	{"VDU",		"V."},
+	{NULL,		NULL}
+};
+
+/**
+ * A SWI which can be called, with its number and the number of registers
+ * that it takes.
+ */
+
+struct corpus_swi {
+	char		*name;			/**< The name of the SWI.			*/
+	unsigned	number;			/**< The number of the SWI.			*/
+	int		inputs;			/**< The number of input registers.		*/
+	int		outputs;		/**< The number of output registers.		*/
+};
+
+static struct corpus_swi corpus_swis[] = {
+	{"OS_Byte",			0x06,		3,	3},
+	{"OS_Word",			0x07,		2,	0},
+	{"OS_File",			0x08,		6,	6},
+	{"OS_GBPB",			0x0c,		5,	5},
+	{"OS_Find",			0x0d,		2,	1},
+	{"OS_Module",			0x1e,		4,	4},
+	{"OS_ReadVarVal",		0x23,		5,	5},
+	{"OS_ReadModeVariable",		0x35,		2,	3},
+	{"OS_ReadMonotonicTime",	0x42,		0,	1},
+	{"Wimp_CreateIcon",		0x400c2,	2,	1},
+	{"Wimp_OpenWindow",		0x400c5,	2,	0},
+	{"Wimp_Poll",			0x400c7,	2,	1},
+	{"Wimp_GetWindowState",		0x400cb,	2,	0},
+	{"Wimp_SetIconState",		0x400cd,	2,	0},
+	{"Wimp_ReportError",		0x400df,	3,	2},
+	{"Wimp_SendMessage",		0x400e7,	4,	3},
+	{"Hourglass_On",		0x406c0,	0,	0},
+	{"Hourglass_Off",		0x406c1,	0,	0},
+	{"ColourTrans_SetGCOL",		0x40743,	5,	1},
+	{"Territory_ConvertDateAndTime", 0x4304b,	5,	2},
+	{NULL,				0,		0,	0}
+};
+
+/**
+ * The words used to make up names, strings and comments.
+ */
+
+static char *corpus_words[] = {
+	"window", "icon", "menu", "redraw", "poll", "file", "buffer", "block",
+	"count", "index", "title", "width", "height", "flags", "handle", "scale",
+	"colour", "limit", "offset", "result", "string", "name", "task", "message",
+	"draw", "load", "save", "open", "close", "update", "error", "report",
+	NULL
+};
+
+static char *corpus_integers[] = {"count%", "index%", "x%", "y%", "width%", "height%", "flags%", "handle%", "result%", "size%", NULL};
+static char *corpus_reals[] = {"scale", "angle", "total", "ratio", "step", NULL};
+static char *corpus_strings[] = {"name$", "text$", "buffer$", "title$", "path$", NULL};
+
+/**
+ * A DEF PROC or DEF FN which has been generated, and so can be called.
+ */
+
+struct corpus_routine {
+	char		name[CORPUS_MAX_NAME];	/**< The name, including the PROC or FN.	*/
+	char		parameters[CORPUS_MAX_PARAMETERS + 1];	/**< The types of the parameters, as i, r or s.	*/
+};
+
+/**
+ * A growing buffer holding a file's text as it is generated.
+ */
+
+struct corpus_buffer {
+	char		*text;			/**< The text in the buffer.			*/
+	size_t		length;			/**< The length of the text.			*/
+	size_t		size;			/**< The size of the buffer.			*/
+	unsigned	lines;			/**< The number of complete lines.		*/
+};
+
+static unsigned long long	corpus_random_state;
+static unsigned			corpus_abbreviation_rate = CORPUS_DEFAULT_ABBREVIATIONS;
+static bool			corpus_tabs = false;
+static unsigned			corpus_indent = 0;
+static unsigned			corpus_labels = 0;
+
+static struct corpus_routine	corpus_routines[CORPUS_MAX_ROUTINES];
+static unsigned			corpus_routine_count = 0;
+
+static bool corpus_write_program(char *folder, unsigned program, unsigned libraries, size_t size, size_t *written);
+static bool corpus_write_swis(char *folder);
+static bool corpus_write_file(char *folder, char *name, struct corpus_buffer *buffer, size_t *written);
+static void corpus_write_header(struct corpus_buffer *buffer, unsigned program, unsigned file, unsigned libraries, unsigned first_routine);
+static void corpus_write_body(struct corpus_buffer *buffer, unsigned file, size_t size, unsigned lines);
+static void corpus_write_kind(struct corpus_buffer *buffer, enum corpus_kind kind);
+static void corpus_write_keyword_line(struct corpus_buffer *buffer);
+static void corpus_write_string_line(struct corpus_buffer *buffer);
+static void corpus_write_rem_line(struct corpus_buffer *buffer);
+static void corpus_write_data_line(struct corpus_buffer *buffer);
+static void corpus_write_sys_line(struct corpus_buffer *buffer);
+static void corpus_write_call_line(struct corpus_buffer *buffer);
+static void corpus_write_asm_block(struct corpus_buffer *buffer);
+static void corpus_write_simple_statement(struct corpus_buffer *buffer);
+static void corpus_start_routine(struct corpus_buffer *buffer, char *name, bool function, unsigned parameters);
+static void corpus_end_routine(struct corpus_buffer *buffer);
+static void corpus_write_call(struct corpus_buffer *buffer, struct corpus_routine *routine);
+static void corpus_write_expression(struct corpus_buffer *buffer, int depth);
+static void corpus_write_string_expression(struct corpus_buffer *buffer);
+static void corpus_write_literal(struct corpus_buffer *buffer);
+static void corpus_write_number(struct corpus_buffer *buffer);
+static void corpus_write_words(struct corpus_buffer *buffer, unsigned min, unsigned max);
+static void corpus_keyword(struct corpus_buffer *buffer, char *keyword);
+static void corpus_start_line(struct corpus_buffer *buffer);
+static void corpus_end_line(struct corpus_buffer *buffer);
+static void corpus_printf(struct corpus_buffer *buffer, char *format, ...);
+static char *corpus_pick(char *list[]);
+static unsigned corpus_random(unsigned range);
+static bool corpus_chance(unsigned percent);
+static bool corpus_read_size(char *text, size_t *size);
+static bool corpus_read_mix(char *text);
+
+
+int main(int argc, char *argv[])
+{
+	bool			param_error = false;
+	bool			output_help = false;
+	struct args_option	*options;
+	char			*folder = NULL, filename[CORPUS_MAX_FILENAME];
+	unsigned long long	seed = 1;
+	size_t			size = CORPUS_DEFAULT_SIZE, program_size = CORPUS_DEFAULT_PROGRAM, written = 0, total = 0;
+	unsigned		libraries = CORPUS_DEFAULT_LIBRARIES, program = 0, kind;
+	FILE			*list;
+
+	/* Decode the command line options. */
+
+	options = args_process_line(argc, argv, "out/AK,seed/IK,size/K,program/K,libraries/IK,mix/K,abbreviate/IK,help/S");
+	if (options == NULL)
+		param_error = true;
+
+	while (options != NULL) {
+		if (strcmp(options->name, "abbreviate") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.integer < 0 || options->data->value.integer > 100)
+					param_error = true;
+				else
+					corpus_abbreviation_rate = options->data->value.integer;
+			}
+		} else if (strcmp(options->name, "help") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				output_help = true;
+		} else if (strcmp(options->name, "libraries") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.integer < 0 || options->data->value.integer > 99)
+					param_error = true;
+				else
+					libraries = options->data->value.integer;
+			}
+		} else if (strcmp(options->name, "mix") == 0) {
+			if (options->data != NULL && !corpus_read_mix(options->data->value.string))
+				param_error = true;
+		} else if (strcmp(options->name, "out") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL)
+				folder = options->data->value.string;
+			else
+				param_error = true;
+		} else if (strcmp(options->name, "program") == 0) {
+			if (options->data != NULL && !corpus_read_size(options->data->value.string, &program_size))
+				param_error = true;
+		} else if (strcmp(options->name, "seed") == 0) {
+			if (options->data != NULL)
+				seed = (unsigned) options->data->value.integer;
+		} else if (strcmp(options->name, "size") == 0) {
+			if (options->data != NULL && !corpus_read_size(options->data->value.string, &size))
+				param_error = true;
+		}
+
+		options = options->next;
+	}
+
+	if (param_error || output_help) {
+		printf("BASIC V Benchmark Corpus Generator -- Usage:\n");
+		printf("corpus -out <folder> [<options>]\n\n");
+
+		printf(" -abbreviate <n>        Abbreviate <n>%% of keywords which allow it.\n");
+		printf(" -help                  Produce this help information.\n");
+		printf(" -libraries <n>         Chain <n> LIBRARY files onto each program.\n");
+		printf(" -mix <kind>=<n>,...    Set the relative weight of each kind of line.\n");
+		printf("                        Kinds are");
+		for (kind = 0; kind < CORPUS_KINDS; kind++)
+			printf("%s %s", (kind == 0) ? "" : ",", corpus_kind_names[kind]);
+		printf(".\n");
+		printf(" -out <folder>          Write the corpus to <folder>.\n");
+		printf(" -program <n>[K|M]      Limit each program to <n> bytes.\n");
+		printf(" -seed <n>              Seed the generator with <n>.\n");
+		printf(" -size <n>[K|M]         Write <n> bytes of source in total.\n");
+
+		return (output_help) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	/* Seed the generator, mixing the seed so that nearby values give
+	 * unrelated sequences. The state must never be zero.
+	 */
+
+	corpus_random_state = (seed + 1) * 0x9e3779b97f4a7c15ULL;
+	corpus_random_state ^= corpus_random_state >> 31;
+	if (corpus_random_state == 0)
+		corpus_random_state = 1;
+
+	if (mkdir(folder, 0777) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Failed to create folder '%s'\n", folder);
+		return EXIT_FAILURE;
+	}
+
+	snprintf(filename, CORPUS_MAX_FILENAME, "%s/%s", folder, CORPUS_LIST_NAME);
+	list = fopen(filename, "w");
+	if (list == NULL) {
+		fprintf(stderr, "Failed to create file '%s'\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	/* Write programs until the corpus is big enough. */
+
+	while (total < size || program == 0) {
+		program++;
+
+		if (!corpus_write_program(folder, program, libraries, (size - total < program_size) ? size - total : program_size, &written)) {
+			fclose(list);
+			return EXIT_FAILURE;
+		}
+
+		fprintf(list, "Prog%05u\n", program);
+		total += written;
+	}
+
+	fclose(list);
+
+	if (!corpus_write_swis(folder))
+		return EXIT_FAILURE;
+
+	printf("Wrote %u programs, with %zu bytes of source, to '%s'\n", program, total, folder);
+
+	return EXIT_SUCCESS;
+}
+
+
+/**
+ * Write a program, made up of a main file and a chain of library files.
+ *
+ * \param *folder	The folder to write the files into.
+ * \param program	The number of the program.
+ * \param libraries	The number of library files to chain on.
+ * \param size		The approximate size of the program, in bytes.
+ * \param *written	Pointer to a variable to take the number of bytes written.
+ * \return		True if successful; else False.
+ */
+
+static bool corpus_write_program(char *folder, unsigned program, unsigned libraries, size_t size, size_t *written)
+{
+	struct corpus_buffer	body, file;
+	char			name[CORPUS_MAX_NAME];
+	unsigned		index, first_routine;
+	bool			success = true;
+
+	*written = 0;
+	corpus_routine_count = 0;
+	corpus_labels = 0;
+
+	body.text = NULL;
+	body.size = 0;
+	file.text = NULL;
+	file.size = 0;
+
+	/* Each file's routines are generated before its header, so that the
+	 * main file can call them. The libraries are written first, so that
+	 * their entry points are known.
+	 */
+
+	for (index = libraries + 1; success && index-- > 0; ) {
+		body.length = 0;
+		body.lines = 0;
+		file.length = 0;
+		file.lines = 0;
+
+		corpus_tabs = corpus_chance(25);
+
+		first_routine = corpus_routine_count;
+		corpus_write_body(&body, index, size / (libraries + 1), CORPUS_MAX_LINES / (libraries + 1));
+		corpus_write_header(&file, program, index, libraries, first_routine);
+		corpus_printf(&file, "%.*s", (int) body.length, body.text);
+
+		if (index == 0)
+			snprintf(name, CORPUS_MAX_NAME, "Prog%05u", program);
+		else
+			snprintf(name, CORPUS_MAX_NAME, "Prog%05uL%u", program, index);
+
+		success = corpus_write_file(folder, name, &file, written);
+	}
+
+	free(body.text);
+	free(file.text);
+
+	return success;
+}
+
+
+/**
+ * Write a header file defining the SWIs called by the corpus, in the form
+ * used by OSLib, for use with -swis.
+ *
+ * \param *folder	The folder to write the file into.
+ * \return		True if successful; else False.
+ */
+
+static bool corpus_write_swis(char *folder)
+{
+	char			filename[CORPUS_MAX_FILENAME];
+	struct corpus_swi	*swi;
+	FILE			*out;
+
+	snprintf(filename, CORPUS_MAX_FILENAME, "%s/%s", folder, CORPUS_SWIS_NAME);
+
+	out = fopen(filename, "w");
+	if (out == NULL) {
+		fprintf(stderr, "Failed to create file '%s'\n", filename);
+		return false;
+	}
+
+	for (swi = corpus_swis; swi->name != NULL; swi++)
+		fprintf(out, "#define %s 0x%X\n", swi->name, swi->number);
+
+	fclose(out);
+
+	return true;
+}
+
+
+/**
+ * Write a buffer out to a file.
+ *
+ * \param *folder	The folder to write the file into.
+ * \param *name		The name of the file.
+ * \param *buffer	The buffer holding the file's text.
+ * \param *written	Pointer to a total to add the number of bytes written to.
+ * \return		True if successful; else False.
+ */
+
+static bool corpus_write_file(char *folder, char *name, struct corpus_buffer *buffer, size_t *written)
+{
+	char	filename[CORPUS_MAX_FILENAME];
+	FILE	*out;
+
+	snprintf(filename, CORPUS_MAX_FILENAME, "%s/%s", folder, name);
+
+	out = fopen(filename, "w");
+	if (out == NULL) {
+		fprintf(stderr, "Failed to create file '%s'\n", filename);
+		return false;
+	}
+
+	if (buffer->length > 0 && fwrite(buffer->text, buffer->length, 1, out) != 1) {
+		fprintf(stderr, "Failed to write file '%s'\n", filename);
+		fclose(out);
+		return false;
+	}
+
+	fclose(out);
+
+	*written += buffer->length;
+
+	return true;
+}
+
+
+/**
+ * Write the header of a file: the comments, the LIBRARY statement for the
+ * next file in the chain and, for the main file, the code which calls the
+ * routines.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param program	The number of the program.
+ * \param file		The number of the file, with 0 being the main file.
+ * \param libraries	The number of library files in the program.
+ * \param first_routine	The index of the file's first routine.
+ */
+
+static void corpus_write_header(struct corpus_buffer *buffer, unsigned program, unsigned file, unsigned libraries, unsigned first_routine)
+{
+	unsigned	routine, calls;
+
+	corpus_indent = 0;
+
+	if (file == 0)
+		corpus_printf(buffer, "REM >Prog%05u\n", program);
+	else
+		corpus_printf(buffer, "REM >Prog%05uL%u\n", program, file);
+
+	corpus_printf(buffer, "REM Synthetic program for benchmarking Tokenize\n");
+	corpus_printf(buffer, "REM ");
+	corpus_write_words(buffer, 4, 10);
+	corpus_printf(buffer, "\n");
+	buffer->lines += 3;
+
+	if (file < libraries) {
+		corpus_printf(buffer, ":\nLIBRARY \"%s:Prog%05uL%u\"\n", CORPUS_PATH_NAME, program, file + 1);
+		buffer->lines += 2;
+	}
+
+	if (file > 0) {
+		corpus_printf(buffer, ":\n");
+		buffer->lines++;
+		return;
+	}
+
+	corpus_printf(buffer, ":\nON ERROR PRINT REPORT$; \" at line \"; ERL : END\n:\nDIM block%% 256, code%% 1024\n");
+	buffer->lines += 4;
+
+	/* Call each of the library entry points, then some of the main file's
+	 * own routines.
+	 */
+
+	for (routine = 0; routine < first_routine; routine++) {
+		if (strncmp(corpus_routines[routine].name, "PROClibrary", 11) == 0) {
+			corpus_start_line(buffer);
+			corpus_write_call(buffer, corpus_routines + routine);
+			corpus_end_line(buffer);
+		}
+	}
+
+	for (calls = 0; calls < 8 && first_routine + calls < corpus_routine_count; calls++) {
+		corpus_start_line(buffer);
+		corpus_write_call(buffer, corpus_routines + first_routine + calls);
+		corpus_end_line(buffer);
+	}
+
+	corpus_printf(buffer, "END\n:\n:\n");
+	buffer->lines += 3;
+}
+
+
+/**
+ * Write the routines making up the body of a file, until it reaches a
+ * given size or number of lines.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param file		The number of the file, with 0 being the main file.
+ * \param size		The size to stop at, in bytes.
+ * \param lines		The number of lines to stop at.
+ */
+
+static void corpus_write_body(struct corpus_buffer *buffer, unsigned file, size_t size, unsigned lines)
+{
+	unsigned	total = 0, kind, pick;
+	char		name[CORPUS_MAX_NAME];
+
+	for (kind = 0; kind < CORPUS_KINDS; kind++)
+		total += corpus_weights[kind];
+
+	lines = (lines > CORPUS_SPARE_LINES * 2) ? lines - CORPUS_SPARE_LINES : lines / 2;
+
+	/* Library files start with an entry point that the main file can
+	 * call, named after the file.
+	 */
+
+	if (file > 0) {
+		snprintf(name, CORPUS_MAX_NAME, "library%u", file);
+		corpus_start_routine(buffer, name, false, 0);
+	} else {
+		snprintf(name, CORPUS_MAX_NAME, "%s%u", corpus_pick(corpus_words), corpus_routine_count);
+		corpus_start_routine(buffer, name, false, corpus_random(CORPUS_MAX_PARAMETERS + 1));
+	}
+
+	while (buffer->length < size && buffer->lines < lines) {
+		pick = corpus_random(total);
+
+		for (kind = 0; kind < CORPUS_KINDS - 1 && pick >= corpus_weights[kind]; kind++)
+			pick -= corpus_weights[kind];
+
+		if (kind != CORPUS_KIND_PROC) {
+			corpus_write_kind(buffer, kind);
+			continue;
+		}
+
+		if (corpus_routine_count >= CORPUS_MAX_ROUTINES)
+			continue;
+
+		corpus_end_routine(buffer);
+		snprintf(name, CORPUS_MAX_NAME, "%s%u", corpus_pick(corpus_words), corpus_routine_count);
+		corpus_start_routine(buffer, name, corpus_chance(30), corpus_random(CORPUS_MAX_PARAMETERS + 1));
+	}
+
+	corpus_end_routine(buffer);
+}
+
+
+/**
+ * Write a line, or block of lines, of a given kind.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param kind		The kind of line to write.
+ */
+
+static void corpus_write_kind(struct corpus_buffer *buffer, enum corpus_kind kind)
+{
+	switch (kind) {
+	case CORPUS_KIND_KEYWORD:
+		corpus_write_keyword_line(buffer);
+		break;
+	case CORPUS_KIND_STRING:
+		corpus_write_string_line(buffer);
+		break;
+	case CORPUS_KIND_REM:
+		corpus_write_rem_line(buffer);
+		break;
+	case CORPUS_KIND_DATA:
+		corpus_write_data_line(buffer);
+		break;
+	case CORPUS_KIND_SYS:
+		corpus_write_sys_line(buffer);
+		break;
+	case CORPUS_KIND_CALL:
+		corpus_write_call_line(buffer);
+		break;
+	case CORPUS_KIND_ASM:
+		corpus_write_asm_block(buffer);
+		break;
+	default:
+		break;
+	}
+}
+
+
+/**
+ * Write a general line of statements, or a block such as a loop or a
+ * CASE statement.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_keyword_line(struct corpus_buffer *buffer)
+{
+	char		*variable;
+	unsigned	cases, i;
+
+	switch (corpus_random(8)) {
+	case 0:
+		variable = corpus_pick(corpus_integers);
+		corpus_start_line(buffer);
+		corpus_keyword(buffer, "FOR");
+		corpus_printf(buffer, " %s = %d ", variable, corpus_random(2));
+		corpus_keyword(buffer, "TO");
+		corpus_printf(buffer, " %s", corpus_pick(corpus_integers));
+		if (corpus_chance(20))
+			corpus_printf(buffer, " STEP %d", 2 + corpus_random(4));
+		corpus_end_line(buffer);
+		corpus_indent++;
+		for (i = 1 + corpus_random(3); i > 0; i--) {
+			corpus_start_line(buffer);
+			corpus_write_simple_statement(buffer);
+			corpus_end_line(buffer);
+		}
+		corpus_indent--;
+		corpus_start_line(buffer);
+		corpus_keyword(buffer, "NEXT");
+		if (corpus_chance(50))
+			corpus_printf(buffer, " %s", variable);
+		corpus_end_line(buffer);
+		break;
+
+	case 1:
+		corpus_start_line(buffer);
+		corpus_keyword(buffer, "WHILE");
+		corpus_printf(buffer, " %s < ", corpus_pick(corpus_integers));
+		corpus_write_expression(buffer, 1);
+		corpus_end_line(buffer);
+		corpus_indent++;
+		for (i = 1 + corpus_random(3); i > 0; i--) {
+			corpus_start_line(buffer);
+			corpus_write_simple_statement(buffer);
+			corpus_end_line(buffer);
+		}
+		corpus_indent--;
+		corpus_start_line(buffer);
+		corpus_keyword(buffer, "ENDWHILE");
+		corpus_end_line(buffer);
+		break;
+
+	case 2:
+		corpus_start_line(buffer);
+		corpus_keyword(buffer, "REPEAT");
+		corpus_end_line(buffer);
+		corpus_indent++;
+		for (i = 1 + corpus_random(3); i > 0; i--) {
+			corpus_start_line(buffer);
+			corpus_write_simple_statement(buffer);
+			corpus_end_line(buffer);
+		}
+		corpus_indent--;
+		corpus_start_line(buffer);
+		corpus_keyword(buffer, "UNTIL");
+		corpus_printf(buffer, " %s >= ", corpus_pick(corpus_integers));
+		corpus_write_expression(buffer, 1);
+		if (corpus_chance(30))
+			corpus_printf(buffer, " OR %s = 0", corpus_pick(corpus_integers));
+		corpus_end_line(buffer);
+		break;
+
+	case 3:
+		corpus_start_line(buffer);
+		corpus_printf(buffer, "CASE %s OF", corpus_pick(corpus_integers));
+		corpus_end_line(buffer);
+		for (cases = 1 + corpus_random(4), i = 0; i < cases; i++) {
+			corpus_start_line(buffer);
+			corpus_printf(buffer, "WHEN %u", i * 2);
+			if (corpus_chance(40))
+				corpus_printf(buffer, ", %u", i * 2 + 1);
+			corpus_end_line(buffer);
+			corpus_indent++;
+			corpus_start_line(buffer);
+			corpus_write_simple_statement(buffer);
+			corpus_end_line(buffer);
+			corpus_indent--;
+		}
+		if (corpus_chance(50)) {
+			corpus_start_line(buffer);
+			corpus_printf(buffer, "OTHERWISE");
+			corpus_end_line(buffer);
+			corpus_indent++;
+			corpus_start_line(buffer);
+			corpus_write_simple_statement(buffer);
+			corpus_end_line(buffer);
+			corpus_indent--;
+		}
+		corpus_start_line(buffer);
+		corpus_printf(buffer, "ENDCASE");
+		corpus_end_line(buffer);
+		break;
+
+	case 4:
+		corpus_start_line(buffer);
+		corpus_printf(buffer, "IF %s AND &%X THEN", corpus_pick(corpus_integers), 1u << corpus_random(16));
+		corpus_end_line(buffer);
+		corpus_indent++;
+		corpus_start_line(buffer);
+		corpus_write_simple_statement(buffer);
+		corpus_end_line(buffer);
+		corpus_indent--;
+		if (corpus_chance(50)) {
+			corpus_start_line(buffer);
+			corpus_printf(buffer, "ELSE");
+			corpus_end_line(buffer);
+			corpus_indent++;
+			corpus_start_line(buffer);
+			corpus_write_simple_statement(buffer);
+			corpus_end_line(buffer);
+			corpus_indent--;
+		}
+		corpus_start_line(buffer);
+		corpus_printf(buffer, "ENDIF");
+		corpus_end_line(buffer);
+		break;
+
+	case 5:
+		corpus_start_line(buffer);
+		corpus_printf(buffer, "IF %s > ", corpus_pick(corpus_integers));
+		corpus_write_expression(buffer, 1);
+		corpus_printf(buffer, " THEN ");
+		corpus_write_simple_statement(buffer);
+		if (corpus_chance(40)) {
+			corpus_printf(buffer, " ELSE ");
+			corpus_write_simple_statement(buffer);
+		}
+		corpus_end_line(buffer);
+		break;
+
+	case 6:
+		corpus_start_line(buffer);
+		corpus_keyword(buffer, "GCOL");
+		corpus_printf(buffer, " 0, %u : MOVE %s, %s : ", corpus_random(16), corpus_pick(corpus_integers), corpus_pick(corpus_integers));
+		corpus_keyword(buffer, "DRAW");
+		corpus_printf(buffer, " %s + %u, %s", corpus_pick(corpus_integers), corpus_random(640), corpus_pick(corpus_integers));
+		if (corpus_chance(30)) {
+			corpus_printf(buffer, " : ");
+			corpus_keyword(buffer, "VDU");
+			corpus_printf(buffer, " %u", 4 + corpus_random(2));
+		}
+		corpus_end_line(buffer);
+		break;
+
+	default:
+		corpus_start_line(buffer);
+		corpus_write_simple_statement(buffer);
+		for (i = corpus_random(3); i > 0; i--) {
+			corpus_printf(buffer, " : ");
+			corpus_write_simple_statement(buffer);
+		}
+		corpus_end_line(buffer);
+		break;
+	}
+}
+
+
+/**
+ * Write a line built around string literals.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_string_line(struct corpus_buffer *buffer)
+{
+	corpus_start_line(buffer);
+
+	switch (corpus_random(5)) {
+	case 0:
+		corpus_keyword(buffer, "PRINT");
+		corpus_printf(buffer, " ");
+		corpus_write_literal(buffer);
+		corpus_printf(buffer, "; %s", corpus_pick(corpus_integers));
+		break;
+	case 1:
+		corpus_printf(buffer, "%s = ", corpus_pick(corpus_strings));
+		corpus_write_string_expression(buffer);
+		break;
+	case 2:
+		corpus_printf(buffer, "%s = INSTR(%s, ", corpus_pick(corpus_integers), corpus_pick(corpus_strings));
+		corpus_write_literal(buffer);
+		corpus_printf(buffer, ")");
+		break;
+	case 3:
+		corpus_printf(buffer, "OSCLI \"Set %s$%s \" + %s", corpus_pick(corpus_words), corpus_pick(corpus_words), corpus_pick(corpus_strings));
+		break;
+	default:
+		corpus_printf(buffer, "%s = ", corpus_pick(corpus_strings));
+		corpus_write_literal(buffer);
+		break;
+	}
+
+	corpus_end_line(buffer);
+}
+
+
+/**
+ * Write a comment, or a blank line.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_rem_line(struct corpus_buffer *buffer)
+{
+	switch (corpus_random(4)) {
+	case 0:
+		corpus_printf(buffer, "\n");
+		buffer->lines++;
+		break;
+	case 1:
+		corpus_start_line(buffer);
+		corpus_write_simple_statement(buffer);
+		corpus_printf(buffer, " : REM ");
+		corpus_write_words(buffer, 2, 6);
+		corpus_end_line(buffer);
+		break;
+	default:
+		corpus_start_line(buffer);
+		corpus_printf(buffer, "REM ");
+		corpus_write_words(buffer, 3, 12);
+		corpus_end_line(buffer);
+		break;
+	}
+}
+
+
+/**
+ * Write a DATA, READ or RESTORE line.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_data_line(struct corpus_buffer *buffer)
+{
+	unsigned	items;
+
+	corpus_start_line(buffer);
+
+	switch (corpus_random(4)) {
+	case 0:
+		corpus_keyword(buffer, "READ");
+		corpus_printf(buffer, " %s, %s", corpus_pick(corpus_integers), corpus_pick(corpus_strings));
+		break;
+	case 1:
+		corpus_keyword(buffer, "RESTORE");
+		if (corpus_chance(50))
+			corpus_printf(buffer, " +%u", 1 + corpus_random(20));
+		break;
+	default:
+		corpus_printf(buffer, "DATA ");
+		for (items = 2 + corpus_random(8); items > 0; items--) {
+			if (corpus_chance(30))
+				corpus_printf(buffer, "%s", corpus_pick(corpus_words));
+			else if (corpus_chance(20))
+				corpus_printf(buffer, "\"%s %s\"", corpus_pick(corpus_words), corpus_pick(corpus_words));
+			else
+				corpus_write_number(buffer);
+
+			if (items > 1)
+				corpus_printf(buffer, ",");
+		}
+		break;
+	}
+
+	corpus_end_line(buffer);
+}
+
+
+/**
+ * Write a SYS call.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_sys_line(struct corpus_buffer *buffer)
+{
+	struct corpus_swi	*swi;
+	unsigned		count = 0;
+	int			reg;
+
+	while (corpus_swis[count].name != NULL)
+		count++;
+
+	swi = corpus_swis + corpus_random(count);
+
+	corpus_start_line(buffer);
+	corpus_printf(buffer, "SYS \"%s%s\"", (corpus_chance(20)) ? "X" : "", swi->name);
+
+	for (reg = 0; reg < swi->inputs; reg++) {
+		if (reg == 1 && corpus_chance(40))
+			corpus_printf(buffer, ", block%%");
+		else if (corpus_chance(50))
+			corpus_printf(buffer, ", %s", corpus_pick(corpus_integers));
+		else
+			corpus_printf(buffer, ", %u", corpus_random(256));
+	}
+
+	if (swi->outputs > 0) {
+		corpus_printf(buffer, " TO ");
+		for (reg = 0; reg < swi->outputs; reg++) {
+			if (reg > 0)
+				corpus_printf(buffer, ",");
+			if (reg == swi->outputs - 1 || corpus_chance(50))
+				corpus_printf(buffer, "%s", corpus_pick(corpus_integers));
+		}
+	}
+
+	corpus_end_line(buffer);
+}
+
+
+/**
+ * Write a call to one of the routines that has already been defined.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_call_line(struct corpus_buffer *buffer)
+{
+	if (corpus_routine_count < 2) {
+		corpus_write_keyword_line(buffer);
+		return;
+	}
+
+	/* Don't call the routine being defined. */
+
+	corpus_start_line(buffer);
+	corpus_write_call(buffer, corpus_routines + corpus_random(corpus_routine_count - 1));
+	corpus_end_line(buffer);
+}
+
+
+/**
+ * Write a block of assembler, in the usual two-pass loop.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_asm_block(struct corpus_buffer *buffer)
+{
+	unsigned	label = corpus_labels++, lines;
+
+	corpus_start_line(buffer);
+	corpus_keyword(buffer, "FOR");
+	corpus_printf(buffer, " pass%% = 0 ");
+	corpus_keyword(buffer, "TO");
+	corpus_printf(buffer, " 2 STEP 2");
+	corpus_end_line(buffer);
+	corpus_indent++;
+	corpus_start_line(buffer);
+	corpus_printf(buffer, "P%% = code%%");
+	corpus_end_line(buffer);
+	corpus_start_line(buffer);
+	corpus_printf(buffer, "[OPT pass%%");
+	corpus_end_line(buffer);
+
+	corpus_start_line(buffer);
+	corpus_printf(buffer, ".loop%u", label);
+	corpus_end_line(buffer);
+
+	for (lines = 2 + corpus_random(10); lines > 0; lines--) {
+		corpus_start_line(buffer);
+
+		switch (corpus_random(6)) {
+		case 0:
+			corpus_printf(buffer, "MOV     R%u, #%u", corpus_random(8), corpus_random(256));
+			break;
+		case 1:
+			corpus_printf(buffer, "ADD     R%u, R%u, R%u, LSL #%u", corpus_random(8), corpus_random(8), corpus_random(8), 1 + corpus_random(4));
+			break;
+		case 2:
+			corpus_printf(buffer, "LDR     R%u, [R%u, #%u]", corpus_random(8), corpus_random(8), corpus_random(64) * 4);
+			break;
+		case 3:
+			corpus_printf(buffer, "STR     R%u, [R%u], #4", corpus_random(8), corpus_random(8));
+			break;
+		case 4:
+			corpus_printf(buffer, "CMP     R%u, #%u", corpus_random(8), corpus_random(256));
+			break;
+		default:
+			corpus_printf(buffer, "SUBS    R%u, R%u, #1", corpus_random(8), corpus_random(8));
+			break;
+		}
+
+		if (corpus_chance(30)) {
+			corpus_printf(buffer, "  ; ");
+			corpus_write_words(buffer, 1, 4);
+		}
+
+		corpus_end_line(buffer);
+	}
+
+	corpus_start_line(buffer);
+	corpus_printf(buffer, "BNE     loop%u", label);
+	corpus_end_line(buffer);
+	corpus_start_line(buffer);
+	corpus_printf(buffer, "MOV     PC, R14");
+	corpus_end_line(buffer);
+	corpus_start_line(buffer);
+	corpus_printf(buffer, "]");
+	corpus_end_line(buffer);
+	corpus_indent--;
+	corpus_start_line(buffer);
+	corpus_keyword(buffer, "NEXT");
+	corpus_printf(buffer, " pass%%");
+	corpus_end_line(buffer);
+}
+
+
+/**
+ * Write a single statement which doesn't need any lines to follow it.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_simple_statement(struct corpus_buffer *buffer)
+{
+	switch (corpus_random(6)) {
+	case 0:
+		corpus_keyword(buffer, "PRINT");
+		corpus_printf(buffer, " %s; \" \"; %s", corpus_pick(corpus_integers), corpus_pick(corpus_reals));
+		break;
+	case 1:
+		corpus_printf(buffer, "%s += ", corpus_pick(corpus_integers));
+		corpus_write_expression(buffer, 1);
+		break;
+	case 2:
+		corpus_printf(buffer, "%s = %s * ", corpus_pick(corpus_reals), corpus_pick(corpus_reals));
+		corpus_write_number(buffer);
+		break;
+	case 3:
+		corpus_printf(buffer, "block%%!%u = %s", corpus_random(64) * 4, corpus_pick(corpus_integers));
+		break;
+	default:
+		corpus_printf(buffer, "%s = ", corpus_pick(corpus_integers));
+		corpus_write_expression(buffer, 0);
+		break;
+	}
+}
+
+
+/**
+ * Start a new DEF PROC or DEF FN, and record it so that it can be called.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param *name		The name of the routine, without the PROC or FN.
+ * \param function	True to define an FN; False to define a PROC.
+ * \param parameters	The number of parameters to give the routine.
+ */
+
+static void corpus_start_routine(struct corpus_buffer *buffer, char *name, bool function, unsigned parameters)
+{
+	struct corpus_routine	*routine = corpus_routines + corpus_routine_count++;
+	unsigned		i;
+	char			*variable = NULL, *suffix = NULL;
+
+	snprintf(routine->name, CORPUS_MAX_NAME, "%s%s", (function) ? "FN" : "PROC", name);
+
+	corpus_indent = 0;
+	corpus_printf(buffer, ":\n:\n");
+	buffer->lines += 2;
+
+	corpus_start_line(buffer);
+	corpus_printf(buffer, "DEF %s", routine->name);
+
+	for (i = 0; i < parameters; i++) {
+		switch (corpus_random(3)) {
+		case 0:
+			routine->parameters[i] = 'i';
+			variable = "value";
+			suffix = "%";
+			break;
+		case 1:
+			routine->parameters[i] = 'r';
+			variable = "amount";
+			suffix = "";
+			break;
+		default:
+			routine->parameters[i] = 's';
+			variable = "label";
+			suffix = "$";
+			break;
+		}
+
+		corpus_printf(buffer, "%s%s%u%s", (i == 0) ? "(" : ", ", variable, i, suffix);
+	}
+
+	routine->parameters[i] = '\0';
+
+	if (parameters > 0)
+		corpus_printf(buffer, ")");
+
+	corpus_end_line(buffer);
+
+	corpus_indent = 1;
+
+	if (corpus_chance(50)) {
+		corpus_start_line(buffer);
+		corpus_keyword(buffer, "LOCAL");
+		corpus_printf(buffer, " %s, %s", corpus_pick(corpus_integers), corpus_pick(corpus_strings));
+		corpus_end_line(buffer);
+	}
+}
+
+
+/**
+ * End the routine currently being defined.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_end_routine(struct corpus_buffer *buffer)
+{
+	struct corpus_routine	*routine = corpus_routines + corpus_routine_count - 1;
+
+	corpus_indent = 0;
+	corpus_start_line(buffer);
+
+	if (strncmp(routine->name, "FN", 2) == 0) {
+		corpus_printf(buffer, "=");
+		corpus_write_expression(buffer, 1);
+	} else {
+		corpus_keyword(buffer, "ENDPROC");
+	}
+
+	corpus_end_line(buffer);
+}
+
+
+/**
+ * Write a call to a routine, with suitable parameters.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param *routine	The routine to call.
+ */
+
+static void corpus_write_call(struct corpus_buffer *buffer, struct corpus_routine *routine)
+{
+	char	*parameter;
+
+	if (strncmp(routine->name, "FN", 2) == 0)
+		corpus_printf(buffer, "%s = ", corpus_pick(corpus_integers));
+
+	corpus_printf(buffer, "%s", routine->name);
+
+	for (parameter = routine->parameters; *parameter != '\0'; parameter++) {
+		corpus_printf(buffer, "%s", (parameter == routine->parameters) ? "(" : ", ");
+
+		switch (*parameter) {
+		case 'i':
+			corpus_write_expression(buffer, 0);
+			break;
+		case 'r':
+			corpus_printf(buffer, "%s", corpus_pick(corpus_reals));
+			break;
+		default:
+			corpus_write_string_expression(buffer);
+			break;
+		}
+	}
+
+	if (*routine->parameters != '\0')
+		corpus_printf(buffer, ")");
+}
+
+
+/**
+ * Write a numeric expression.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param depth		The number of levels of operator still allowed.
+ */
+
+static void corpus_write_expression(struct corpus_buffer *buffer, int depth)
+{
+	static char *operators[] = {"+", "-", "*", "DIV", "MOD", "AND", "OR", "EOR", NULL};
+
+	switch (corpus_random(8)) {
+	case 0:
+		corpus_printf(buffer, "ABS(%s)", corpus_pick(corpus_integers));
+		break;
+	case 1:
+		corpus_printf(buffer, "INT(%s * ", corpus_pick(corpus_reals));
+		corpus_write_number(buffer);
+		corpus_printf(buffer, ")");
+		break;
+	case 2:
+		corpus_printf(buffer, "LEN(%s)", corpus_pick(corpus_strings));
+		break;
+	case 3:
+		corpus_printf(buffer, "block%%!%u", corpus_random(64) * 4);
+		break;
+	case 4:
+		corpus_write_number(buffer);
+		break;
+	default:
+		corpus_printf(buffer, "%s", corpus_pick(corpus_integers));
+		break;
+	}
+
+	if (depth > 0 && corpus_chance(60)) {
+		corpus_printf(buffer, " %s ", corpus_pick(operators));
+
+		if (depth > 1 || corpus_chance(50)) {
+			corpus_printf(buffer, "(");
+			corpus_write_expression(buffer, depth - 1);
+			corpus_printf(buffer, ")");
+		} else {
+			corpus_write_expression(buffer, depth - 1);
+		}
+	}
+}
+
+
+/**
+ * Write a string expression.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_string_expression(struct corpus_buffer *buffer)
+{
+	switch (corpus_random(5)) {
+	case 0:
+		corpus_printf(buffer, "LEFT$(%s, %u) + ", corpus_pick(corpus_strings), 1 + corpus_random(8));
+		corpus_write_literal(buffer);
+		break;
+	case 1:
+		corpus_printf(buffer, "MID$(%s, %u, %u)", corpus_pick(corpus_strings), 1 + corpus_random(8), 1 + corpus_random(8));
+		break;
+	case 2:
+		corpus_printf(buffer, "STR$(%s) + ", corpus_pick(corpus_integers));
+		corpus_write_literal(buffer);
+		break;
+	case 3:
+		corpus_printf(buffer, "%s + CHR$(%u)", corpus_pick(corpus_strings), 32 + corpus_random(95));
+		break;
+	default:
+		corpus_write_literal(buffer);
+		break;
+	}
+}
+
+
+/**
+ * Write a string literal, sometimes containing an embedded quote.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_literal(struct corpus_buffer *buffer)
+{
+	corpus_printf(buffer, "\"");
+
+	if (corpus_chance(10)) {
+		corpus_printf(buffer, "\"\"");
+		corpus_write_words(buffer, 1, 3);
+		corpus_printf(buffer, "\"\"");
+	} else {
+		corpus_write_words(buffer, 1, 5);
+	}
+
+	corpus_printf(buffer, "\"");
+}
+
+
+/**
+ * Write a numeric literal, in decimal, real, &hex or %binary form.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_write_number(struct corpus_buffer *buffer)
+{
+	switch (corpus_random(6)) {
+	case 0:
+		corpus_printf(buffer, "&%X", corpus_random(65536));
+		break;
+	case 1:
+		corpus_printf(buffer, "%%%u%u%u%u", corpus_random(2), corpus_random(2), corpus_random(2), corpus_random(2));
+		break;
+	case 2:
+		corpus_printf(buffer, "%u.%02u", corpus_random(100), corpus_random(100));
+		break;
+	default:
+		corpus_printf(buffer, "%u", corpus_random(1000));
+		break;
+	}
+}
+
+
+/**
+ * Write a number of words, separated by spaces.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param min		The minimum number of words to write.
+ * \param max		The maximum number of words to write.
+ */
+
+static void corpus_write_words(struct corpus_buffer *buffer, unsigned min, unsigned max)
+{
+	unsigned	words = min + corpus_random(max - min + 1);
+
+	while (words-- > 0)
+		corpus_printf(buffer, "%s%s", corpus_pick(corpus_words), (words > 0) ? " " : "");
+}
+
+
+/**
+ * Write a keyword, abbreviating it if required.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param *keyword	The keyword to write.
+ */
+
+static void corpus_keyword(struct corpus_buffer *buffer, char *keyword)
+{
+	struct corpus_abbreviation	*abbreviation;
+
+	if (corpus_chance(corpus_abbreviation_rate)) {
+		for (abbreviation = corpus_abbreviations; abbreviation->name != NULL; abbreviation++) {
+			if (strcmp(abbreviation->name, keyword) == 0) {
+				keyword = abbreviation->abbreviation;
+				break;
+			}
+		}
+	}
+
+	corpus_printf(buffer, "%s", keyword);
+}
+
+
+/**
+ * Start a new line, writing the indent for the current nesting level.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_start_line(struct corpus_buffer *buffer)
+{
+	unsigned	level;
+
+	for (level = 0; level < corpus_indent; level++)
+		corpus_printf(buffer, "%s", (corpus_tabs) ? "\t" : "  ");
+}
+
+
+/**
+ * End the current line.
+ *
+ * \param *buffer	The buffer to write to.
+ */
+
+static void corpus_end_line(struct corpus_buffer *buffer)
+{
+	corpus_printf(buffer, "\n");
+	buffer->lines++;
+}
+
+
+/**
+ * Add formatted text to a buffer, extending it as required. If memory runs
+ * out, the generator gives up.
+ *
+ * \param *buffer	The buffer to write to.
+ * \param *format	The printf() format string.
+ * \param ...		Parameters for the format string.
+ */
+
+static void corpus_printf(struct corpus_buffer *buffer, char *format, ...)
+{
+	va_list	ap;
+	int	length;
+	char	*text;
+
+	va_start(ap, format);
+	length = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+
+	if (length < 0)
+		return;
+
+	if (buffer->length + length + 1 > buffer->size) {
+		buffer->size = (buffer->size == 0) ? 65536 : buffer->size * 2;
+		while (buffer->length + length + 1 > buffer->size)
+			buffer->size *= 2;
+
+		text = realloc(buffer->text, buffer->size);
+		if (text == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+
+		buffer->text = text;
+	}
+
+	va_start(ap, format);
+	vsnprintf(buffer->text + buffer->length, length + 1, format, ap);
+	va_end(ap);
+
+	buffer->length += length;
+}
+
+
+/**
+ * Pick an entry from a NULL terminated list of strings.
+ *
+ * \param *list[]	The list to pick from.
+ * \return		Pointer to the chosen string.
+ */
+
+static char *corpus_pick(char *list[])
+{
+	unsigned	count = 0;
+
+	while (list[count] != NULL)
+		count++;
+
+	return list[corpus_random(count)];
+}
+
+
+/**
+ * Return a pseudo-random number, using an xorshift generator so that the
+ * sequence is the same on every platform.
+ *
+ * \param range		The number of possible values.
+ * \return		A value from 0 to range - 1.
+ */
+
+static unsigned corpus_random(unsigned range)
+{
+	corpus_random_state ^= corpus_random_state >> 12;
+	corpus_random_state ^= corpus_random_state << 25;
+	corpus_random_state ^= corpus_random_state >> 27;
+
+	if (range == 0)
+		return 0;
+
+	return (unsigned) (((corpus_random_state * 0x2545f4914f6cdd1dULL) >> 32) % range);
+}
+
+
+/**
+ * Return true with a given probability.
+ *
+ * \param percent	The chance of returning true, as a percentage.
+ * \return		True or False.
+ */
+
+static bool corpus_chance(unsigned percent)
+{
+	return (corpus_random(100) < percent) ? true : false;
+}
+
+
+/**
+ * Read a size in bytes, with an optional K or M suffix.
+ *
+ * \param *text		The text to read.
+ * \param *size		Pointer to a variable to take the size.
+ * \return		True if the size was valid; else False.
+ */
+
+static bool corpus_read_size(char *text, size_t *size)
+{
+	char			*end;
+	unsigned long long	value;
+
+	if (text == NULL || !isdigit(*text))
+		return false;
+
+	value = strtoull(text, &end, 10);
+
+	if (*end == 'K' || *end == 'k') {
+		value *= 1024;
+		end++;
+	} else if (*end == 'M' || *end == 'm') {
+		value *= 1024 * 1024;
+		end++;
+	}
+
+	if (*end != '\0' || value == 0)
+		return false;
+
+	*size = (size_t) value;
+
+	return true;
+}
+
+
+/**
+ * Read a list of line weights, in the form kind=weight,kind=weight. Any
+ * kinds not listed keep their default weights.
+ *
+ * \param *text		The text to read.
+ * \return		True if the list was valid; else False.
+ */
+
+static bool corpus_read_mix(char *text)
+{
+	char		*end;
+	unsigned	kind, total = 0;
+	size_t		length;
+
+	if (text == NULL)
+		return false;
+
+	while (*text != '\0') {
+		for (kind = 0; kind < CORPUS_KINDS; kind++) {
+			length = strlen(corpus_kind_names[kind]);
+			if (strncmp(text, corpus_kind_names[kind], length) == 0 && text[length] == '=')
+				break;
+		}
+
+		if (kind >= CORPUS_KINDS || !isdigit(text[length + 1]))
+			return false;
+
+		corpus_weights[kind] = strtoul(text + length + 1, &end, 10);
+
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return false;
+
+		text = end;
+	}
+
+	for (kind = 0; kind < CORPUS_KIND_PROC; kind++)
+		total += corpus_weights[kind];
+
+	return (total > 0) ? true : false;
+}
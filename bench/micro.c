@@ -0,0 +1,546 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/* Micro
+ *
+ * Time the tokenizer's lexer primitives in isolation.
+ *
+ * Syntax: Micro [<options>]
+ *
+ * Each primitive is run over a fixed set of inputs many times, and the
+ * average time and, on x86, the average number of time stamp counter
+ * cycles are reported per call. The parser's keyword, string and
+ * number routines are private to parse.c, so it is included here directly
+ * and the rest of the tokenizer is linked in as usual.
+ */
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICRO_CYCLES
+#endif
+
+#include "parse.c"
+
+#include "args.h"
+#include "asm.h"
+#include "proc.h"
+#include "swi.h"
+#include "variable.h"
+
+#define MICRO_DEFAULT_ITERATIONS 2000
+#define MICRO_MAX_INPUTS 2048
+#define MICRO_MAX_TEXT 256
+#define MICRO_LONG_NAME 200
+#define MICRO_SWI_CHUNKS 64
+#define MICRO_SWIS_PER_CHUNK 32
+
+/**
+ * A set of inputs for a primitive.
+ */
+
+struct micro_inputs {
+	char		*text[MICRO_MAX_INPUTS];	/**< The input texts.			*/
+	unsigned	count;				/**< The number of inputs in the set.	*/
+};
+
+/**
+ * A primitive which can be timed: it is called with one input text, and
+ * returns a value to be accumulated so that the call can't be optimised
+ * away.
+ */
+
+typedef unsigned (*micro_primitive)(char *text, bool flag);
+
+static unsigned micro_match_token(char *text, bool flag);
+static unsigned micro_process_string(char *text, bool flag);
+static unsigned micro_process_number(char *text, bool flag);
+static unsigned micro_variable_process(char *text, bool flag);
+static unsigned micro_proc_process(char *text, bool flag);
+static unsigned micro_swi_lookup(char *text, bool flag);
+static unsigned micro_asm_process_variable(char *text, bool flag);
+
+static void micro_run(char *name, char *set, micro_primitive primitive, struct micro_inputs *inputs, bool flag, unsigned iterations);
+static void micro_add(struct micro_inputs *inputs, char *format, ...);
+static bool micro_load_swis(void);
+static double micro_time(void);
+static unsigned long long micro_cycles(void);
+
+static volatile unsigned	micro_sink;
+
+
+int main(int argc, char *argv[])
+{
+	bool			param_error = false;
+	bool			output_help = false;
+	struct args_option	*options;
+	unsigned		iterations = MICRO_DEFAULT_ITERATIONS, length;
+	int			keyword, chunk, swi;
+	char			*name, long_name[MICRO_LONG_NAME + 1];
+	struct micro_inputs	keywords, abbreviations, near_misses, strings, numbers, names, long_names, routines, swis, swi_misses, mnemonics;
+
+	options = args_process_line(argc, argv, "iterations/IK,help/S");
+	if (options == NULL)
+		param_error = true;
+
+	while (options != NULL) {
+		if (strcmp(options->name, "help") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				output_help = true;
+		} else if (strcmp(options->name, "iterations") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.integer < 1)
+					param_error = true;
+				else
+					iterations = options->data->value.integer;
+			}
+		}
+
+		options = options->next;
+	}
+
+	if (param_error || output_help) {
+		printf("Tokenize Lexer Microbenchmarks -- Usage:\n");
+		printf("micro [<options>]\n\n");
+
+		printf(" -help                  Produce this help information.\n");
+		printf(" -iterations <n>        Run each set of inputs <n> times.\n");
+
+		return (output_help) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	proc_initialise();
+	variable_initialise();
+
+	keywords.count = 0;
+	abbreviations.count = 0;
+	near_misses.count = 0;
+	strings.count = 0;
+	numbers.count = 0;
+	names.count = 0;
+	long_names.count = 0;
+	routines.count = 0;
+	swis.count = 0;
+	swi_misses.count = 0;
+	mnemonics.count = 0;
+
+	/* Every keyword in full, every abbreviation that BASIC accepts, and
+	 * near misses which share a prefix with a keyword but aren't one:
+	 * the keyword less its last letter, with its last letter changed,
+	 * and run on into a longer name.
+	 */
+
+	for (keyword = 0; keyword < MAX_KEYWORDS; keyword++) {
+		name = parse_keywords[keyword].name;
+		length = strlen(name);
+
+		micro_add(&keywords, "%s ", name);
+
+		for (; length > 1 && length - 1 >= (unsigned) parse_keywords[keyword].abbrev; length--)
+			micro_add(&abbreviations, "%.*s. ", (int) length - 1, name);
+
+		length = strlen(name);
+
+		if (length > 1)
+			micro_add(&near_misses, "%.*s ", (int) length - 1, name);
+		if (isalpha(name[length - 1]))
+			micro_add(&near_misses, "%.*s%c ", (int) length - 1, name, (name[length - 1] == 'Z') ? 'Y' : name[length - 1] + 1);
+		if (parse_keywords[keyword].var_start)
+			micro_add(&near_misses, "%sX ", name);
+	}
+
+	micro_add(&near_misses, "ZZZZ ");
+	micro_add(&near_misses, "QUITTER ");
+	micro_add(&near_misses, "X ");
+
+	micro_add(&strings, "\"\"");
+	micro_add(&strings, "\"Hello\"");
+	micro_add(&strings, "\"Say \"\"Hello\"\" to the world\"");
+	micro_add(&strings, "\"%0*d\"", MICRO_LONG_NAME, 0);
+
+	micro_add(&numbers, "0 ");
+	micro_add(&numbers, "7 ");
+	micro_add(&numbers, "65535 ");
+	micro_add(&numbers, "2147483647 ");
+	micro_add(&numbers, "3.14159 ");
+	micro_add(&numbers, "0.5 ");
+	micro_add(&numbers, "1E10 ");
+	micro_add(&numbers, "1.5E-7 ");
+	micro_add(&numbers, "&FFFF ");
+	micro_add(&numbers, "&7FFFFFFF ");
+	micro_add(&numbers, "%%10110 ");
+	micro_add(&numbers, "00000100 ");
+
+	/* Variable names, both short and long. Each set is run once before
+	 * it is timed, so the lookups find existing entries.
+	 */
+
+	micro_add(&names, "a");
+	micro_add(&names, "x%%");
+	micro_add(&names, "name$");
+	micro_add(&names, "window_handle%%");
+	micro_add(&names, "scale");
+	micro_add(&names, "block%%");
+	micro_add(&names, "icon_buffer$");
+	micro_add(&names, "`tick");
+
+	for (length = 0; length < MICRO_LONG_NAME; length++)
+		long_name[length] = 'a' + length % 26;
+	long_name[MICRO_LONG_NAME] = '\0';
+
+	micro_add(&long_names, "%s", long_name);
+	micro_add(&long_names, "%s%%", long_name);
+	micro_add(&long_names, "%.*sz$", MICRO_LONG_NAME - 1, long_name);
+	micro_add(&long_names, "%.*s_b", MICRO_LONG_NAME - 2, long_name);
+
+	for (length = 0; length < 64; length++)
+		micro_add(&routines, "routine_%u", length);
+
+	/* SWIs are taken from a header written on the fly, with real names
+	 * and enough synthetic ones to fill the chunk and name lists.
+	 */
+
+	if (!micro_load_swis())
+		return EXIT_FAILURE;
+
+	micro_add(&swis, "OS_Byte");
+	micro_add(&swis, "OS_ReadMonotonicTime");
+	micro_add(&swis, "XOS_ReadVarVal");
+	micro_add(&swis, "Wimp_Poll");
+	micro_add(&swis, "XWimp_SendMessage");
+
+	for (chunk = 0; chunk < MICRO_SWI_CHUNKS; chunk += 7) {
+		for (swi = 0; swi < MICRO_SWIS_PER_CHUNK; swi += 5)
+			micro_add(&swis, "Chunk%d_Swi%d", chunk, swi);
+	}
+
+	micro_add(&swi_misses, "OS_Bite");
+	micro_add(&swi_misses, "Wimp_Pol");
+	micro_add(&swi_misses, "Unknown_Swi");
+	micro_add(&swi_misses, "Chunk1_Swi99");
+	micro_add(&swi_misses, "Chunk99_Swi1");
+	micro_add(&swi_misses, "NoUnderscore");
+
+	micro_add(&mnemonics, "MOV");
+	micro_add(&mnemonics, "MOVEQS");
+	micro_add(&mnemonics, "LDR");
+	micro_add(&mnemonics, "STMFD");
+	micro_add(&mnemonics, "LDMIA");
+	micro_add(&mnemonics, "ADDNE");
+	micro_add(&mnemonics, "BL");
+	micro_add(&mnemonics, "SWI");
+	micro_add(&mnemonics, "label");
+	micro_add(&mnemonics, "R0");
+
+	/* Run the benchmarks. */
+
+	printf("%-32s %-16s %10s %10s\n", "Primitive", "Inputs", "ns/op", "cycles/op");
+
+	micro_run("parse_match_token", "keywords", micro_match_token, &keywords, false, iterations);
+	micro_run("parse_match_token", "abbreviations", micro_match_token, &abbreviations, false, iterations);
+	micro_run("parse_match_token", "near misses", micro_match_token, &near_misses, false, iterations);
+	micro_run("parse_process_string", "strings", micro_process_string, &strings, false, iterations);
+	micro_run("parse_process_string", "strings, dumped", micro_process_string, &strings, true, iterations);
+	micro_run("parse_process_numeric_constant", "numbers", micro_process_number, &numbers, false, iterations);
+	micro_run("parse_process_numeric_constant", "numbers, shorten", micro_process_number, &numbers, true, iterations);
+	micro_run("variable_process", "names", micro_variable_process, &names, false, iterations);
+	micro_run("variable_process", "long names", micro_variable_process, &long_names, false, iterations);
+	micro_run("proc_process", "names", micro_proc_process, &routines, false, iterations);
+	micro_run("swi_get_number_from_name", "hits", micro_swi_lookup, &swis, false, iterations);
+	micro_run("swi_get_number_from_name", "misses", micro_swi_lookup, &swi_misses, false, iterations);
+	micro_run("asm_process_variable", "mnemonics", micro_asm_process_variable, &mnemonics, false, iterations);
+
+	return EXIT_SUCCESS;
+}
+
+
+/**
+ * Match a keyword at the start of a text.
+ *
+ * \param *text		The text to match.
+ * \param flag		Unused.
+ * \return		The keyword matched.
+ */
+
+static unsigned micro_match_token(char *text, bool flag)
+{
+	return parse_match_token(&text);
+}
+
+
+/**
+ * Copy a string literal into the parse buffer.
+ *
+ * \param *text		The text holding the string.
+ * \param flag		True to also dump the contents of the string.
+ * \return		The number of bytes written.
+ */
+
+static unsigned micro_process_string(char *text, bool flag)
+{
+	char	*write = parse_buffer + HEAD_LENGTH, dump[MAX_LINE_LENGTH];
+
+	parse_process_string(&text, &write, (flag) ? dump : NULL);
+
+	return write - parse_buffer;
+}
+
+
+/**
+ * Copy a numeric constant into the parse buffer.
+ *
+ * \param *text		The text holding the constant.
+ * \param flag		True to shorten the constant.
+ * \return		The number of bytes written.
+ */
+
+static unsigned micro_process_number(char *text, bool flag)
+{
+	char	*write = parse_buffer + HEAD_LENGTH;
+
+	*(write - 1) = ' ';
+	parse_process_numeric_constant(&text, &write, flag);
+
+	return write - parse_buffer;
+}
+
+
+/**
+ * Look up a variable name, as a read.
+ *
+ * \param *text		The variable name.
+ * \param flag		True if the variable is an array.
+ * \return		True if the variable was assigned.
+ */
+
+static unsigned micro_variable_process(char *text, bool flag)
+{
+	char	*write = text + strlen(text);
+
+	return variable_process(text, &write, flag, false);
+}
+
+
+/**
+ * Look up a PROC name, as a call.
+ *
+ * \param *text		The name, without the PROC.
+ * \param flag		True for an FN; False for a PROC.
+ * \return		Zero.
+ */
+
+static unsigned micro_proc_process(char *text, bool flag)
+{
+	proc_process(text, flag, false);
+
+	return 0;
+}
+
+
+/**
+ * Look up a SWI name.
+ *
+ * \param *text		The SWI name.
+ * \param flag		Unused.
+ * \return		The SWI number.
+ */
+
+static unsigned micro_swi_lookup(char *text, bool flag)
+{
+	return swi_get_number_from_name(text);
+}
+
+
+/**
+ * Process possible mnemonic text at the start of an assembler statement.
+ *
+ * \param *text		The text, which must follow a space.
+ * \param flag		Unused.
+ * \return		The number of bytes recognised.
+ */
+
+static unsigned micro_asm_process_variable(char *text, bool flag)
+{
+	char	*start = text;
+
+	asm_new_statement();
+	asm_process_variable(&text);
+
+	return text - start;
+}
+
+
+/**
+ * Time a primitive over a set of inputs, and report the result.
+ *
+ * \param *name		The name of the primitive.
+ * \param *set		The name of the set of inputs.
+ * \param primitive	The primitive to time.
+ * \param *inputs	The inputs to use.
+ * \param flag		The flag to pass to the primitive.
+ * \param iterations	The number of times to run through the inputs.
+ */
+
+static void micro_run(char *name, char *set, micro_primitive primitive, struct micro_inputs *inputs, bool flag, unsigned iterations)
+{
+	unsigned		iteration, input, sink = 0;
+	double			start, ns;
+	unsigned long long	cycles;
+
+	/* Run through the inputs once to warm up any caches and create any
+	 * lookup entries.
+	 */
+
+	for (input = 0; input < inputs->count; input++)
+		sink += primitive(inputs->text[input], flag);
+
+	start = micro_time();
+	cycles = micro_cycles();
+
+	for (iteration = 0; iteration < iterations; iteration++) {
+		for (input = 0; input < inputs->count; input++)
+			sink += primitive(inputs->text[input], flag);
+	}
+
+	cycles = micro_cycles() - cycles;
+	ns = (micro_time() - start) * 1e9 / ((double) iterations * inputs->count);
+
+	micro_sink += sink;
+
+	printf("%-32s %-16s %10.1f", name, set, ns);
+
+#ifdef MICRO_CYCLES
+	printf(" %10.1f\n", (double) cycles / ((double) iterations * inputs->count));
+#else
+	printf(" %10s\n", "-");
+#endif
+}
+
+
+/**
+ * Add a formatted input to a set of inputs. Each input is preceded by a
+ * space, so that primitives which look at the previous byte find one.
+ *
+ * \param *inputs	The set to add the input to.
+ * \param *format	The printf() format string.
+ * \param ...		Parameters for the format string.
+ */
+
+static void micro_add(struct micro_inputs *inputs, char *format, ...)
+{
+	va_list	ap;
+	char	*text;
+
+	if (inputs->count >= MICRO_MAX_INPUTS)
+		return;
+
+	text = malloc(MICRO_MAX_TEXT + 1);
+	if (text == NULL)
+		return;
+
+	*text = ' ';
+
+	va_start(ap, format);
+	vsnprintf(text + 1, MICRO_MAX_TEXT, format, ap);
+	va_end(ap);
+
+	inputs->text[inputs->count++] = text + 1;
+}
+
+
+/**
+ * Write a header of SWI definitions to a temporary file, and load it.
+ *
+ * \return		True if successful; else False.
+ */
+
+static bool micro_load_swis(void)
+{
+	char	filename[] = "/tmp/microXXXXXX";
+	int	fd, chunk, swi;
+	FILE	*out;
+	bool	success;
+
+	fd = mkstemp(filename);
+	if (fd < 0 || (out = fdopen(fd, "w")) == NULL) {
+		fprintf(stderr, "Failed to create SWI header\n");
+		return false;
+	}
+
+	fprintf(out, "#define OS_Byte 0x6\n#define OS_ReadVarVal 0x23\n#define OS_ReadMonotonicTime 0x42\n");
+	fprintf(out, "#define Wimp_Poll 0x400C7\n#define Wimp_SendMessage 0x400E7\n");
+
+	for (chunk = 0; chunk < MICRO_SWI_CHUNKS; chunk++) {
+		for (swi = 0; swi < MICRO_SWIS_PER_CHUNK; swi++)
+			fprintf(out, "#define Chunk%d_Swi%d 0x%X\n", chunk, swi, 0x80000 + chunk * 64 + swi);
+	}
+
+	fclose(out);
+
+	success = swi_add_header_file(filename);
+	remove(filename);
+
+	if (!success)
+		fprintf(stderr, "Failed to load SWI header\n");
+
+	return success;
+}
+
+
+/**
+ * Read the monotonic clock.
+ *
+ * \return		The time, in seconds.
+ */
+
+static double micro_time(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+
+/**
+ * Read the processor's cycle counter, if it has one.
+ *
+ * \return		The cycle count, or 0.
+ */
+
+static unsigned long long micro_cycles(void)
+{
+#ifdef MICRO_CYCLES
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,694 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/* Scale
+ *
+ * Measure how the throughput of Tokenize scales as more jobs are run at once.
+ *
+ * Syntax: Scale -tokenize <file> -corpus <dir> [<options>]
+ *
+ * The programs in a corpus written by Corpus are shared out between a pool
+ * of workers, each running one copy of the tokenizer at a time with the
+ * -link and -swi options, in the way that a build farm would run it. The
+ * number of workers is swept from one up to the limit in powers of two, and
+ * the corpus is cut down to give a range of input sizes. The speedup and
+ * efficiency over a single worker are reported for each combination, along
+ * with a breakdown of how much slower each job ran when sharing the machine,
+ * and all of the figures can be written out as CSV.
+ *
+ * Each job has its own SWI table and library queue, so nothing is shared
+ * between them except the machine itself: any slowdown comes from the
+ * cores, caches, memory bandwidth and filing system being contended.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* Local source headers. */
+
+#include "args.h"
+
+/**
+ * The path variable used by the corpus to link the library files.
+ */
+
+#define SCALE_PATH_NAME "Corpus"
+
+#define SCALE_LIST_NAME "Programs"
+#define SCALE_SWIS_NAME "Swis"
+#define SCALE_OUTPUT_NAME "Output"
+
+#define SCALE_DEFAULT_REPEAT 3
+#define SCALE_DEFAULT_SIZES 3
+#define SCALE_MAX_SIZES 8
+#define SCALE_MAX_WORKERS 1024
+#define SCALE_MAX_FILENAME 1024
+#define SCALE_MAX_NAME 64
+#define SCALE_MAX_ARGS 16
+#define SCALE_BUFFER_SIZE 65536
+
+/**
+ * A program from the corpus, with the size of its source.
+ */
+
+struct scale_program {
+	char			*name;		/**< The name of the program's main file.		*/
+	unsigned long long	bytes;		/**< The size of the main file and its libraries.	*/
+
+	struct scale_program	*next;		/**< Pointer to the next program in the list.		*/
+};
+
+/**
+ * The results for one input size and number of workers.
+ */
+
+struct scale_result {
+	unsigned		programs;	/**< The number of programs tokenized.			*/
+	unsigned long long	bytes;		/**< The number of source bytes processed.		*/
+	unsigned		workers;	/**< The number of workers used.			*/
+
+	double			wall;		/**< The wall clock time for the best run, in seconds.	*/
+	double			job_wall;	/**< The total wall clock time of its jobs, in seconds.	*/
+	double			job_cpu;	/**< The total CPU time of its jobs, in seconds.	*/
+};
+
+static struct scale_program	*scale_programs = NULL;
+
+static bool scale_load_corpus(char *corpus, unsigned *count);
+static bool scale_measure_file(char *filename, unsigned long long *bytes);
+static bool scale_run_batch(char *tokenize, char *corpus, struct scale_result *result);
+static pid_t scale_start_tokenize(char *tokenize, char *corpus, char *program, unsigned slot);
+static bool scale_write_csv(char *file, struct scale_result *results, unsigned sizes, unsigned steps);
+static double scale_speedup(struct scale_result *result, struct scale_result *single);
+static double scale_time(void);
+
+
+int main(int argc, char *argv[])
+{
+	bool			param_error = false;
+	bool			output_help = false;
+	struct args_option	*options;
+	char			*tokenize = NULL, *corpus = NULL, *csv_file = NULL;
+	int			repeat = SCALE_DEFAULT_REPEAT, sizes = SCALE_DEFAULT_SIZES, max_workers = 0;
+	unsigned		count, workers, steps, size, step, run;
+	unsigned		worker_counts[SCALE_MAX_WORKERS];
+	struct scale_program	*program;
+	struct scale_result	*results, *result, *single, best;
+
+	/* Decode the command line options. */
+
+	options = args_process_line(argc, argv, "tokenize/AK,corpus/AK,workers/IK,sizes/IK,repeat/IK,csv/K,help/S");
+	if (options == NULL)
+		param_error = true;
+
+	while (options != NULL) {
+		if (strcmp(options->name, "corpus") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL)
+				corpus = options->data->value.string;
+			else
+				param_error = true;
+		} else if (strcmp(options->name, "csv") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.string != NULL)
+					csv_file = options->data->value.string;
+				else
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "help") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				output_help = true;
+		} else if (strcmp(options->name, "repeat") == 0) {
+			if (options->data != NULL) {
+				repeat = options->data->value.integer;
+				if (repeat < 1)
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "sizes") == 0) {
+			if (options->data != NULL) {
+				sizes = options->data->value.integer;
+				if (sizes < 1 || sizes > SCALE_MAX_SIZES)
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "tokenize") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL)
+				tokenize = options->data->value.string;
+			else
+				param_error = true;
+		} else if (strcmp(options->name, "workers") == 0) {
+			if (options->data != NULL) {
+				max_workers = options->data->value.integer;
+				if (max_workers < 1 || max_workers > SCALE_MAX_WORKERS)
+					param_error = true;
+			}
+		}
+
+		options = options->next;
+	}
+
+	if (param_error || output_help) {
+		printf("Tokenize Scaling Benchmark -- Usage:\n");
+		printf("scale -tokenize <file> -corpus <folder> [<options>]\n\n");
+
+		printf(" -corpus <folder>       Tokenize the corpus in <folder>.\n");
+		printf(" -csv <file>            Write the results to <file> as CSV.\n");
+		printf(" -help                  Produce this help information.\n");
+		printf(" -repeat <n>            Keep the best of <n> runs of each combination.\n");
+		printf(" -sizes <n>             Halve the corpus <n> - 1 times to vary the input size.\n");
+		printf(" -tokenize <file>       Run the tokenizer in <file>.\n");
+		printf(" -workers <n>           Sweep up to <n> workers, instead of one per CPU.\n");
+
+		return (output_help) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (!scale_load_corpus(corpus, &count))
+		return EXIT_FAILURE;
+
+	if (max_workers == 0) {
+		max_workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		if (max_workers < 1)
+			max_workers = 1;
+		else if (max_workers > SCALE_MAX_WORKERS)
+			max_workers = SCALE_MAX_WORKERS;
+	}
+
+	/* The worker counts go up in powers of two, finishing at the limit
+	 * whether or not it is a power of two itself.
+	 */
+
+	steps = 0;
+
+	for (workers = 1; workers < (unsigned) max_workers; workers *= 2)
+		worker_counts[steps++] = workers;
+
+	worker_counts[steps++] = max_workers;
+
+	results = malloc(sizeof(struct scale_result) * sizes * steps);
+	if (results == NULL) {
+		fprintf(stderr, "Not enough memory for the results\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Run the benchmarks, from the smallest input size to the largest. */
+
+	printf("Corpus of %u programs, sweeping 1 to %d workers on %ld CPUs\n\n", count, max_workers, sysconf(_SC_NPROCESSORS_ONLN));
+
+	for (size = 0; size < (unsigned) sizes; size++) {
+		for (step = 0; step < steps; step++) {
+			result = results + size * steps + step;
+
+			result->programs = count >> (sizes - size - 1);
+			if (result->programs < 1)
+				result->programs = 1;
+
+			result->bytes = 0;
+			program = scale_programs;
+
+			for (run = 0; run < result->programs && program != NULL; run++) {
+				result->bytes += program->bytes;
+				program = program->next;
+			}
+
+			result->workers = worker_counts[step];
+
+			for (run = 0; run < (unsigned) repeat; run++) {
+				best = *result;
+
+				if (!scale_run_batch(tokenize, corpus, &best)) {
+					free(results);
+					return EXIT_FAILURE;
+				}
+
+				if (run == 0 || best.wall < result->wall)
+					*result = best;
+			}
+
+			printf("%u programs, %llu bytes, %u workers: %.3fs\n", result->programs, result->bytes, result->workers, result->wall);
+			fflush(stdout);
+		}
+	}
+
+	/* Report the throughput, speedup and efficiency for each combination. */
+
+	printf("\n%-24s", "Throughput (MB/s)");
+	for (step = 0; step < steps; step++)
+		printf(" %8u", worker_counts[step]);
+	printf("\n");
+
+	for (size = 0; size < (unsigned) sizes; size++) {
+		printf("%-24llu", results[size * steps].bytes);
+		for (step = 0; step < steps; step++) {
+			result = results + size * steps + step;
+			printf(" %8.2f", (result->wall > 0) ? result->bytes / result->wall / (1024.0 * 1024.0) : 0);
+		}
+		printf("\n");
+	}
+
+	printf("\n%-24s", "Speedup");
+	for (step = 0; step < steps; step++)
+		printf(" %8u", worker_counts[step]);
+	printf("\n");
+
+	for (size = 0; size < (unsigned) sizes; size++) {
+		printf("%-24llu", results[size * steps].bytes);
+		for (step = 0; step < steps; step++)
+			printf(" %8.2f", scale_speedup(results + size * steps + step, results + size * steps));
+		printf("\n");
+	}
+
+	printf("\n%-24s", "Efficiency (%)");
+	for (step = 0; step < steps; step++)
+		printf(" %8u", worker_counts[step]);
+	printf("\n");
+
+	for (size = 0; size < (unsigned) sizes; size++) {
+		printf("%-24llu", results[size * steps].bytes);
+		for (step = 0; step < steps; step++) {
+			result = results + size * steps + step;
+			printf(" %8.1f", scale_speedup(result, results + size * steps) * 100.0 / result->workers);
+		}
+		printf("\n");
+	}
+
+	/* Break down where the time went for the largest input: how much longer
+	 * each job took than it did on its own, and whether that was spent on
+	 * the CPU (contended caches and memory) or off it (waiting for a core
+	 * or for the filing system).
+	 */
+
+	printf("\nContention with %llu bytes\n", results[(sizes - 1) * steps].bytes);
+	printf("%-8s %12s %12s %10s %10s %8s\n", "Workers", "Job wall", "Job CPU", "Slowdown", "CPU growth", "Off-CPU");
+
+	single = results + (sizes - 1) * steps;
+
+	for (step = 0; step < steps; step++) {
+		result = results + (sizes - 1) * steps + step;
+
+		printf("%-8u %10.2fms %10.2fms %9.2fx %9.2fx %7.1f%%\n", result->workers,
+				result->job_wall * 1000.0 / result->programs, result->job_cpu * 1000.0 / result->programs,
+				(single->job_wall > 0) ? result->job_wall / single->job_wall : 0,
+				(single->job_cpu > 0) ? result->job_cpu / single->job_cpu : 0,
+				(result->job_wall > 0) ? (1.0 - result->job_cpu / result->job_wall) * 100.0 : 0);
+	}
+
+	if (csv_file != NULL && !scale_write_csv(csv_file, results, sizes, steps)) {
+		free(results);
+		return EXIT_FAILURE;
+	}
+
+	free(results);
+
+	return EXIT_SUCCESS;
+}
+
+
+/**
+ * Load the list of programs in a corpus, and measure the size of each.
+ *
+ * \param *corpus	The folder holding the corpus.
+ * \param *count	Pointer to a variable to take the number of programs.
+ * \return		True if successful; else False.
+ */
+
+static bool scale_load_corpus(char *corpus, unsigned *count)
+{
+	char			filename[SCALE_MAX_FILENAME], name[SCALE_MAX_NAME], *end;
+	struct scale_program	*program, *tail = NULL;
+	unsigned long long	bytes;
+	unsigned		library;
+	FILE			*list;
+
+	*count = 0;
+
+	snprintf(filename, SCALE_MAX_FILENAME, "%s/%s", corpus, SCALE_LIST_NAME);
+
+	list = fopen(filename, "r");
+	if (list == NULL) {
+		fprintf(stderr, "Failed to open corpus list '%s'\n", filename);
+		return false;
+	}
+
+	while (fgets(name, SCALE_MAX_NAME, list) != NULL) {
+		end = strpbrk(name, "\r\n");
+		if (end != NULL)
+			*end = '\0';
+
+		if (*name == '\0')
+			continue;
+
+		program = malloc(sizeof(struct scale_program));
+		if (program == NULL) {
+			fclose(list);
+			return false;
+		}
+
+		program->name = strdup(name);
+		program->next = NULL;
+
+		snprintf(filename, SCALE_MAX_FILENAME, "%s/%s", corpus, name);
+		if (program->name == NULL || !scale_measure_file(filename, &program->bytes)) {
+			fprintf(stderr, "Failed to read corpus file '%s'\n", filename);
+			fclose(list);
+			return false;
+		}
+
+		/* The libraries are numbered from 1, with the chain ending at
+		 * the first one which doesn't exist.
+		 */
+
+		for (library = 1; ; library++) {
+			snprintf(filename, SCALE_MAX_FILENAME, "%s/%sL%u", corpus, name, library);
+			if (!scale_measure_file(filename, &bytes))
+				break;
+
+			program->bytes += bytes;
+		}
+
+		if (tail == NULL)
+			scale_programs = program;
+		else
+			tail->next = program;
+
+		tail = program;
+		(*count)++;
+	}
+
+	fclose(list);
+
+	if (scale_programs == NULL) {
+		fprintf(stderr, "No programs found in corpus '%s'\n", corpus);
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Find the size of a file.
+ *
+ * \param *filename	The file to measure.
+ * \param *bytes	Pointer to a variable to take the size.
+ * \return		True if successful; False if the file couldn't be read.
+ */
+
+static bool scale_measure_file(char *filename, unsigned long long *bytes)
+{
+	FILE	*file;
+	char	buffer[SCALE_BUFFER_SIZE];
+	size_t	length;
+
+	file = fopen(filename, "r");
+	if (file == NULL)
+		return false;
+
+	*bytes = 0;
+
+	while ((length = fread(buffer, 1, SCALE_BUFFER_SIZE, file)) > 0)
+		*bytes += length;
+
+	fclose(file);
+
+	return true;
+}
+
+
+/**
+ * Tokenize the first programs in the corpus, sharing them out between a
+ * pool of workers. Each worker runs one job at a time, and picks up the
+ * next program as soon as its last one has finished.
+ *
+ * \param *tokenize	The tokenizer to run.
+ * \param *corpus	The folder holding the corpus.
+ * \param *result	The number of programs and workers to use, and to take
+ *			the results.
+ * \return		True if successful; else False.
+ */
+
+static bool scale_run_batch(char *tokenize, char *corpus, struct scale_result *result)
+{
+	struct scale_program	*program = scale_programs;
+	pid_t			*pids, pid;
+	double			*starts, start, now;
+	unsigned		launched = 0, running = 0, slot;
+	int			status;
+	bool			success = true;
+	struct rusage		usage;
+
+	pids = malloc(sizeof(pid_t) * result->workers);
+	starts = malloc(sizeof(double) * result->workers);
+
+	if (pids == NULL || starts == NULL) {
+		fprintf(stderr, "Not enough memory for %u workers\n", result->workers);
+		free(pids);
+		free(starts);
+		return false;
+	}
+
+	for (slot = 0; slot < result->workers; slot++)
+		pids[slot] = 0;
+
+	result->job_wall = 0;
+	result->job_cpu = 0;
+
+	start = scale_time();
+
+	while (launched < result->programs || running > 0) {
+		/* Keep every idle worker busy while there are programs left,
+		 * unless something has already gone wrong.
+		 */
+
+		while (success && running < result->workers && launched < result->programs && program != NULL) {
+			for (slot = 0; slot < result->workers && pids[slot] != 0; slot++);
+
+			starts[slot] = scale_time();
+			pids[slot] = scale_start_tokenize(tokenize, corpus, program->name, slot);
+
+			if (pids[slot] <= 0) {
+				pids[slot] = 0;
+				success = false;
+				break;
+			}
+
+			running++;
+			launched++;
+			program = program->next;
+		}
+
+		if (running == 0)
+			break;
+
+		pid = wait4(-1, &status, 0, &usage);
+
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+
+			fprintf(stderr, "Failed to wait for '%s'\n", tokenize);
+			success = false;
+			break;
+		}
+
+		now = scale_time();
+
+		for (slot = 0; slot < result->workers && pids[slot] != pid; slot++);
+
+		if (slot >= result->workers)
+			continue;
+
+		pids[slot] = 0;
+		running--;
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "Tokenizing with %u workers failed\n", result->workers);
+			success = false;
+		}
+
+		result->job_wall += now - starts[slot];
+		result->job_cpu += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+				usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+	}
+
+	result->wall = scale_time() - start;
+
+	free(pids);
+	free(starts);
+
+	return success;
+}
+
+
+/**
+ * Start the tokenizer on one program, without waiting for it to finish.
+ * Each worker has its own output file, so that jobs running at the same
+ * time don't write over each other.
+ *
+ * \param *tokenize	The tokenizer to run.
+ * \param *corpus	The folder holding the corpus.
+ * \param *program	The name of the program's main file.
+ * \param slot		The number of the worker running the job.
+ * \return		The process ID of the job, or -1 on failure.
+ */
+
+static pid_t scale_start_tokenize(char *tokenize, char *corpus, char *program, unsigned slot)
+{
+	char		source[SCALE_MAX_FILENAME], output[SCALE_MAX_FILENAME], path[SCALE_MAX_FILENAME], swis[SCALE_MAX_FILENAME];
+	char		*args[SCALE_MAX_ARGS];
+	int		arg = 0, null;
+	pid_t		pid;
+
+	snprintf(source, SCALE_MAX_FILENAME, "%s/%s", corpus, program);
+	snprintf(output, SCALE_MAX_FILENAME, "%s/%s%u", corpus, SCALE_OUTPUT_NAME, slot);
+	snprintf(path, SCALE_MAX_FILENAME, "%s:%s/", SCALE_PATH_NAME, corpus);
+	snprintf(swis, SCALE_MAX_FILENAME, "%s/%s", corpus, SCALE_SWIS_NAME);
+
+	args[arg++] = tokenize;
+	args[arg++] = source;
+	args[arg++] = "-out";
+	args[arg++] = output;
+	args[arg++] = "-link";
+	args[arg++] = "-path";
+	args[arg++] = path;
+	args[arg++] = "-swi";
+	args[arg++] = "-swis";
+	args[arg++] = swis;
+	args[arg] = NULL;
+
+	pid = fork();
+
+	if (pid < 0) {
+		fprintf(stderr, "Failed to start '%s'\n", tokenize);
+		return -1;
+	}
+
+	/* The tokenizer's messages are discarded, as warnings from the
+	 * corpus would swamp the results.
+	 */
+
+	if (pid == 0) {
+		null = open("/dev/null", O_WRONLY);
+		if (null >= 0) {
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+		}
+
+		execv(tokenize, args);
+		_exit(127);
+	}
+
+	return pid;
+}
+
+
+/**
+ * Write the results out as CSV, with one row for each input size and
+ * number of workers.
+ *
+ * \param *file		The file to write.
+ * \param *results	The results, grouped by input size.
+ * \param sizes		The number of input sizes.
+ * \param steps		The number of worker counts for each size.
+ * \return		True if successful; else False.
+ */
+
+static bool scale_write_csv(char *file, struct scale_result *results, unsigned sizes, unsigned steps)
+{
+	FILE			*out;
+	unsigned		size, step;
+	struct scale_result	*result, *single;
+	double			speedup;
+
+	out = fopen(file, "w");
+	if (out == NULL) {
+		fprintf(stderr, "Failed to write results to '%s'\n", file);
+		return false;
+	}
+
+	fprintf(out, "programs,bytes,workers,wall_s,mb_per_s,speedup,efficiency,job_wall_ms,job_cpu_ms,slowdown,cpu_growth\n");
+
+	for (size = 0; size < sizes; size++) {
+		single = results + size * steps;
+
+		for (step = 0; step < steps; step++) {
+			result = results + size * steps + step;
+			speedup = scale_speedup(result, single);
+
+			fprintf(out, "%u,%llu,%u,%.4f,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+					result->programs, result->bytes, result->workers, result->wall,
+					(result->wall > 0) ? result->bytes / result->wall / (1024.0 * 1024.0) : 0,
+					speedup, speedup / result->workers,
+					result->job_wall * 1000.0 / result->programs, result->job_cpu * 1000.0 / result->programs,
+					(single->job_wall > 0) ? result->job_wall / single->job_wall : 0,
+					(single->job_cpu > 0) ? result->job_cpu / single->job_cpu : 0);
+		}
+	}
+
+	if (fclose(out) != 0) {
+		fprintf(stderr, "Failed to write results to '%s'\n", file);
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Return the speedup of a set of results over a single worker.
+ *
+ * \param *result	The results to calculate the speedup for.
+ * \param *single	The results for one worker with the same input.
+ * \return		The speedup.
+ */
+
+static double scale_speedup(struct scale_result *result, struct scale_result *single)
+{
+	if (result->wall <= 0)
+		return 0;
+
+	return single->wall / result->wall;
+}
+
+
+/**
+ * Read the monotonic clock.
+ *
+ * \return		The time, in seconds.
+ */
+
+static double scale_time(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
@@ -37,6 +37,7 @@
 
 #include "args.h"
 
+#include "profile.h"
 #include "string.h"
 
 
@@ -68,6 +69,8 @@ struct args_option *args_process_line(int argc, char *argv[], char *definition)
 	if (defs == NULL)
 		return NULL;
 
+	profile_add_memory(PROFILE_MEMORY_ARGS, defs);
+
 	/* Process the parameter options from the configuration string one by
 	 * one, and build the necessary data structures ready to parse the
 	 * command line. */
@@ -88,6 +91,8 @@ struct args_option *args_process_line(int argc, char *argv[], char *definition)
 		if (new == NULL)
 			return NULL;
 
+		profile_add_memory(PROFILE_MEMORY_ARGS, new);
+
 		if (options == NULL)
 			options = new;
 		else if (tail != NULL)
@@ -138,8 +143,10 @@ struct args_option *args_process_line(int argc, char *argv[], char *definition)
 		struct args_option	*search = options;
 		char			*name = NULL;
 
-		if (*argv[i] == '-') {
-			/* The entry's an option name. */
+		if (*argv[i] == '-' && *(argv[i] + 1) != '\0') {
+			/* The entry's an option name. A lone - is a value, as
+			 * it is commonly used to stand for stdin or stdout.
+			 */
 		
 			name = argv[i] + 1;
 
@@ -157,7 +164,7 @@ struct args_option *args_process_line(int argc, char *argv[], char *definition)
 			}
 
 			if (search->type != ARGS_TYPE_BOOL) {
-				if (i + 1 >= argc || *argv[i + 1] == '-') {
+				if (i + 1 >= argc || (*argv[i + 1] == '-' && *(argv[i + 1] + 1) != '\0')) {
 					fprintf(stderr, "Switch -%s requires a value.\n", name);
 					return NULL;
 				}
@@ -190,6 +197,8 @@ struct args_option *args_process_line(int argc, char *argv[], char *definition)
 			if (new == NULL)
 				return NULL;
 
+			profile_add_memory(PROFILE_MEMORY_ARGS, new);
+
 			switch (search->type) {
 			case ARGS_TYPE_BOOL:
 				new->value.boolean = true;
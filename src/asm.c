@@ -28,6 +28,7 @@
  */
 
 #include <ctype.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -111,6 +112,7 @@ enum asm_mnemonic {
 /* &8 */
 
 	MNM_SWI,
+	MNM_SVC,
 
 /* &9 */
 
@@ -436,6 +438,7 @@ static struct asm_mnemonic_definition asm_mnemonics[] = {
 	/* &8 */
 
 	{"SWI",		KWD_NO_MATCH,	asm_conditionals,	NULL,			asm_param_none},
+	{"SVC",		KWD_NO_MATCH,	asm_conditionals,	NULL,			asm_param_none},
 
 	/* &9 */
 
@@ -568,8 +571,50 @@ static enum asm_state		asm_current_state;
 static char			***asm_current_parameter;
 static enum asm_mnemonic	asm_current_mnemonic;
 
+/**
+ * The number of branches from each trie node: A to Z, 0 to 9 and _.
+ */
+
+#define ASM_TRIE_BRANCHES 37
+
+/**
+ * The maximum number of distinct condition, suffix and parameter lists.
+ */
+
+#define ASM_MAX_LISTS 32
+
+/**
+ * A node in one of the tries built from the mnemonic and list definitions.
+ */
+
+struct asm_trie_node {
+	unsigned short	child[ASM_TRIE_BRANCHES];	/**< The node for each following character, or 0 for none.	*/
+	int		value;				/**< The entry ending at this node, or -1 for none.		*/
+};
+
+/**
+ * A condition, suffix or parameter list, and the root of its trie.
+ */
+
+struct asm_trie_list {
+	char		**list;				/**< The list of strings held in the trie.			*/
+	unsigned	root;				/**< The root node of the trie.					*/
+};
+
+static bool			asm_tries_built = false;
+static struct asm_trie_node	*asm_trie = NULL;
+static unsigned			asm_trie_nodes = 0;
+static struct asm_trie_list	asm_trie_lists[ASM_MAX_LISTS];
+static int			asm_trie_list_count = 0;
+static enum asm_mnemonic	asm_keyword_mnemonics[MAX_KEYWORDS];
+
 
 static char*	asm_match_list(char **list, char *text);
+static void	asm_build_tries(void);
+static bool	asm_add_list(char **list);
+static void	asm_add_trie_string(unsigned root, char *text, int value);
+static int	asm_find_trie_string(unsigned root, char *text, bool longest, int *length);
+static int	asm_get_trie_branch(char c);
 
 
 /**
@@ -578,6 +623,9 @@ static char*	asm_match_list(char **list, char *text);
 
 void asm_new_statement(void)
 {
+	if (!asm_tries_built)
+		asm_build_tries();
+
 	asm_current_state = ASM_AT_START;
 	asm_current_mnemonic = MNM_NO_MATCH;
 	asm_current_parameter = NULL;
@@ -593,7 +641,7 @@ void asm_new_statement(void)
 
 void asm_process_keyword(enum parse_keyword keyword)
 {
-	enum asm_mnemonic	entry = 0;
+	enum asm_mnemonic	entry;
 
 	/* Process two special-case tokens which form part of assembler mnemonics
 	 * and will require further special processing when we subsequently get
@@ -608,14 +656,21 @@ void asm_process_keyword(enum parse_keyword keyword)
 		return;
 	}
 
-	/* Otherwise, we're looking for whole tokenised keywords. Scan the list
-	 * of mnemonics and see if we can find a match for this token.
+	/* Otherwise, we're looking for whole tokenised keywords. Look the token
+	 * up in the index of keyword mnemonics, falling back to a scan of the
+	 * list if the index couldn't be built.
 	 */
 
-	while (asm_mnemonics[entry].name != NULL && asm_mnemonics[entry].keyword != keyword)
-		entry++;
+	if (asm_trie != NULL) {
+		entry = (keyword >= 0 && keyword < MAX_KEYWORDS) ? asm_keyword_mnemonics[keyword] : MNM_NO_MATCH;
+	} else {
+		for (entry = 0; asm_mnemonics[entry].name != NULL && asm_mnemonics[entry].keyword != keyword; entry++);
+
+		if (asm_mnemonics[entry].name == NULL)
+			entry = MNM_NO_MATCH;
+	}
 
-	if (asm_mnemonics[entry].name == NULL)
+	if (entry == MNM_NO_MATCH)
 		return;
 
 	/* If the token matched, and we're not at the start of a statement, this
@@ -713,19 +768,23 @@ void asm_process_variable(char **text)
 		 * codes.
 		 */
 
-		while (asm_mnemonics[entry].name != NULL) {
-			for (i = 0; asm_mnemonics[entry].name[i] != '\0' && (*text)[i] != '\0' && asm_mnemonics[entry].name[i] == toupper((*text)[i]); i++);
-
-			if (asm_mnemonics[entry].name[i] == '\0' && i > longest) {
-				found = entry;
-				longest = i;
-			} else {
-				entry++;
+		if (asm_trie != NULL) {
+			found = asm_find_trie_string(0, *text, true, &longest);
+		} else {
+			while (asm_mnemonics[entry].name != NULL) {
+				for (i = 0; asm_mnemonics[entry].name[i] != '\0' && (*text)[i] != '\0' && asm_mnemonics[entry].name[i] == toupper((*text)[i]); i++);
+
+				if (asm_mnemonics[entry].name[i] == '\0' && i > longest) {
+					found = entry;
+					longest = i;
+				} else {
+					entry++;
+				}
 			}
 		}
 
 		if (found != MNM_NO_MATCH) {
-			*text += strlen(asm_mnemonics[found].name);
+			*text += longest;
 			asm_current_state = ASM_TEST_CONDITIONAL;
 			asm_current_mnemonic = found;
 			asm_current_parameter = asm_mnemonics[found].parameters;
@@ -817,9 +876,24 @@ void asm_process_comma(void)
 }
 
 
+/**
+ * Test to see if the current assembler statement is a SWI or SVC instruction
+ * which is waiting for its operand.
+ *
+ * \return		True if a SWI operand is due; else False.
+ */
+
+bool asm_is_swi_operand(void)
+{
+	return (asm_current_state == ASM_TEST_PARAMETERS &&
+			(asm_current_mnemonic == MNM_SWI || asm_current_mnemonic == MNM_SVC)) ? true : false;
+}
+
+
 /**
  * Case insensitively match the first characters in a string with a NULL
- * terminated list of possible matches (in uppercase).
+ * terminated list of possible matches (in uppercase), returning the first
+ * entry in the list to match.
  *
  * \param **list	Array of pointers to strings to test against.
  * \param *text		The text to be matched.
@@ -828,10 +902,20 @@ void asm_process_comma(void)
 
 static char *asm_match_list(char **list, char *text)
 {
-	int	entry = 0, i = 0;
-	bool	found = false;
+	int	entry = 0, i = 0, length;
+
+	/* If the list has a trie, use it to find the match. */
+
+	for (i = 0; asm_trie != NULL && i < asm_trie_list_count; i++) {
+		if (asm_trie_lists[i].list == list) {
+			entry = asm_find_trie_string(asm_trie_lists[i].root, text, false, &length);
+			return (entry == -1) ? NULL : list[entry];
+		}
+	}
+
+	/* Otherwise, test each entry in turn. */
 
-	while (list[entry] != NULL && !found) {
+	while (list[entry] != NULL) {
 		for (i = 0; list[entry][i] != '\0' && text[i] != '\0' && list[entry][i] == toupper(text[i]); i++);
 
 		if (list[entry][i] == '\0')
@@ -843,3 +927,189 @@ static char *asm_match_list(char **list, char *text)
 	return list[entry];
 }
 
+
+/**
+ * Build the tries used to recognise mnemonics, along with their condition
+ * codes, suffixes and parameters, and the index of mnemonics by keyword.
+ * The mnemonic trie is at node 0; if there isn't enough memory, the tries
+ * are left unbuilt and the definition lists are scanned instead.
+ */
+
+static void asm_build_tries(void)
+{
+	enum asm_mnemonic	entry;
+	unsigned		nodes = 1;
+	int			list, i;
+	char			***parameter;
+
+	asm_tries_built = true;
+
+	for (i = 0; i < MAX_KEYWORDS; i++)
+		asm_keyword_mnemonics[i] = MNM_NO_MATCH;
+
+	/* Collect the distinct lists used by the mnemonics, and count the
+	 * nodes required: at most one for each character, plus the roots.
+	 */
+
+	for (entry = 0; asm_mnemonics[entry].name != NULL; entry++) {
+		nodes += strlen(asm_mnemonics[entry].name);
+
+		if (asm_mnemonics[entry].keyword != KWD_NO_MATCH && asm_keyword_mnemonics[asm_mnemonics[entry].keyword] == MNM_NO_MATCH)
+			asm_keyword_mnemonics[asm_mnemonics[entry].keyword] = entry;
+
+		if (asm_mnemonics[entry].conditionals != NULL && !asm_add_list(asm_mnemonics[entry].conditionals))
+			return;
+
+		if (asm_mnemonics[entry].suffixes != NULL && !asm_add_list(asm_mnemonics[entry].suffixes))
+			return;
+
+		for (parameter = asm_mnemonics[entry].parameters; parameter != NULL && *parameter != NULL; parameter++) {
+			if (!asm_add_list(*parameter))
+				return;
+		}
+	}
+
+	for (list = 0; list < asm_trie_list_count; list++) {
+		nodes++;
+
+		for (i = 0; asm_trie_lists[list].list[i] != NULL; i++)
+			nodes += strlen(asm_trie_lists[list].list[i]);
+	}
+
+	if (nodes > USHRT_MAX)
+		return;
+
+	asm_trie = calloc(nodes, sizeof(struct asm_trie_node));
+	if (asm_trie == NULL)
+		return;
+
+	/* Fill in the tries, with the mnemonics at the root node. */
+
+	asm_trie[0].value = -1;
+	asm_trie_nodes = 1;
+
+	for (entry = 0; asm_mnemonics[entry].name != NULL; entry++)
+		asm_add_trie_string(0, asm_mnemonics[entry].name, entry);
+
+	for (list = 0; list < asm_trie_list_count; list++) {
+		asm_trie_lists[list].root = asm_trie_nodes;
+		asm_trie[asm_trie_nodes++].value = -1;
+
+		for (i = 0; asm_trie_lists[list].list[i] != NULL; i++)
+			asm_add_trie_string(asm_trie_lists[list].root, asm_trie_lists[list].list[i], i);
+	}
+}
+
+
+/**
+ * Add a list to the set which are to be given tries, if it isn't already
+ * in there.
+ *
+ * \param **list	The list to add.
+ * \return		True if the list is in the set; False if there
+ *			was no room for it.
+ */
+
+static bool asm_add_list(char **list)
+{
+	int	i;
+
+	for (i = 0; i < asm_trie_list_count; i++) {
+		if (asm_trie_lists[i].list == list)
+			return true;
+	}
+
+	if (asm_trie_list_count >= ASM_MAX_LISTS)
+		return false;
+
+	asm_trie_lists[asm_trie_list_count++].list = list;
+
+	return true;
+}
+
+
+/**
+ * Add a string to a trie. If more than one string has the same text, the
+ * first to be added is retained.
+ *
+ * \param root		The root node of the trie.
+ * \param *text		The uppercase string to add.
+ * \param value		The value to record for the string.
+ */
+
+static void asm_add_trie_string(unsigned root, char *text, int value)
+{
+	unsigned	node = root;
+	int		branch;
+
+	while (*text != '\0') {
+		branch = asm_get_trie_branch(*text++);
+		if (branch == -1)
+			return;
+
+		if (asm_trie[node].child[branch] == 0) {
+			asm_trie[node].child[branch] = asm_trie_nodes;
+			asm_trie[asm_trie_nodes++].value = -1;
+		}
+
+		node = asm_trie[node].child[branch];
+	}
+
+	if (asm_trie[node].value == -1)
+		asm_trie[node].value = value;
+}
+
+
+/**
+ * Case insensitively match the first characters in a string against the
+ * contents of a trie, in a single pass over the text.
+ *
+ * \param root		The root node of the trie.
+ * \param *text		The text to be matched.
+ * \param longest	True to return the longest match; False to return
+ *			the match with the lowest value.
+ * \param *length	Pointer to a variable to take the length of the match.
+ * \return		The value of the matched string, or -1 if none found.
+ */
+
+static int asm_find_trie_string(unsigned root, char *text, bool longest, int *length)
+{
+	unsigned	node = root;
+	int		branch, found = -1, i = 0;
+
+	*length = 0;
+
+	while (text[i] != '\0' && (branch = asm_get_trie_branch(toupper(text[i]))) != -1 &&
+			(node = asm_trie[node].child[branch]) != 0) {
+		i++;
+
+		if (asm_trie[node].value != -1 && (found == -1 || longest || asm_trie[node].value < found)) {
+			found = asm_trie[node].value;
+			*length = i;
+		}
+	}
+
+	return found;
+}
+
+
+/**
+ * Return the trie branch for an uppercase character.
+ *
+ * \param c		The character to look up.
+ * \return		The branch number, or -1 if the character can't
+ *			appear in a trie.
+ */
+
+static int asm_get_trie_branch(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A';
+	else if (c >= '0' && c <= '9')
+		return c - '0' + 26;
+	else if (c == '_')
+		return 36;
+
+	return -1;
+}
+
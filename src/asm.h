@@ -72,5 +72,15 @@ void asm_process_variable(char **text);
 
 void asm_process_comma(void);
 
+
+/**
+ * Test to see if the current assembler statement is a SWI or SVC instruction
+ * which is waiting for its operand.
+ *
+ * \return		True if a SWI operand is due; else False.
+ */
+
+bool asm_is_swi_operand(void);
+
 #endif
 
@@ -0,0 +1,502 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file bundle.c
+ *
+ * Source Bundles, implementation.
+ *
+ * A bundle is a tar archive holding a set of source files, which is mapped
+ * into memory in one go and indexed by name. Files found in the bundle are
+ * then read straight from the mapped archive, instead of being opened from
+ * disc one at a time.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Local source headers. */
+
+#include "bundle.h"
+
+/**
+ * The size of the blocks which make up a tar archive.
+ */
+
+#define BUNDLE_BLOCK_SIZE 512
+
+/**
+ * The number of buckets in the index of file names.
+ */
+
+#define BUNDLE_INDEXES 256
+
+/**
+ * The maximum length of a file name within a bundle.
+ */
+
+#define BUNDLE_MAX_NAME 1024
+
+/**
+ * Offsets and sizes of the fields in a tar header block.
+ */
+
+#define BUNDLE_TAR_NAME 0
+#define BUNDLE_TAR_NAME_SIZE 100
+#define BUNDLE_TAR_SIZE 124
+#define BUNDLE_TAR_SIZE_SIZE 12
+#define BUNDLE_TAR_TYPE 156
+#define BUNDLE_TAR_MAGIC 257
+#define BUNDLE_TAR_PREFIX 345
+#define BUNDLE_TAR_PREFIX_SIZE 155
+
+/**
+ * A file held in the bundle, forming one entry in a linked list.
+ */
+
+struct bundle_file {
+	char			*name;		/**< Pointer to the name of the file.				*/
+	char			*data;		/**< Pointer to the file's contents, within the mapping.	*/
+	size_t			size;		/**< The size of the file's contents.				*/
+
+	struct bundle_file	*next;		/**< Pointer to the next file in the chain, or NULL.		*/
+};
+
+static struct bundle_file	*bundle_files[BUNDLE_INDEXES];
+
+/**
+ * The mapped archive.
+ */
+
+static char			*bundle_data = NULL;
+static size_t			bundle_size = 0;
+
+#ifdef LINUX
+/**
+ * A zero length buffer, for empty files.
+ */
+
+static char			bundle_empty[1];
+
+static bool bundle_read_index(void);
+static bool bundle_add_file(char *name, char *data, size_t size);
+static bool bundle_read_octal(char *field, size_t length, size_t *value);
+static bool bundle_read_pax_path(char *data, size_t size, char *name, size_t length);
+#endif
+static struct bundle_file *bundle_find(char *name);
+static unsigned bundle_find_index(char *name);
+static char *bundle_strip_name(char *name);
+
+
+/**
+ * Open a bundle file, mapping it into memory and indexing the files that
+ * it contains. Any bundle which is already open is closed first.
+ *
+ * \param *file		Pointer to the name of the tar archive to open.
+ * \return		True if successful; False on error.
+ */
+
+bool bundle_open(char *file)
+{
+#ifdef LINUX
+	struct stat	info;
+	int		fd;
+
+	bundle_close();
+
+	if (file == NULL)
+		return false;
+
+	fd = open(file, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	if (fstat(fd, &info) == -1 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	bundle_size = info.st_size;
+	bundle_data = mmap(NULL, bundle_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (bundle_data == MAP_FAILED) {
+		bundle_data = NULL;
+		bundle_size = 0;
+		return false;
+	}
+
+	if (!bundle_read_index()) {
+		bundle_close();
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+/**
+ * Close the current bundle, if there is one, and discard its index.
+ */
+
+void bundle_close(void)
+{
+	struct bundle_file	*entry;
+	int			index;
+
+	for (index = 0; index < BUNDLE_INDEXES; index++) {
+		while (bundle_files[index] != NULL) {
+			entry = bundle_files[index];
+			bundle_files[index] = entry->next;
+			free(entry->name);
+			free(entry);
+		}
+	}
+
+#ifdef LINUX
+	if (bundle_data != NULL)
+		munmap(bundle_data, bundle_size);
+#endif
+
+	bundle_data = NULL;
+	bundle_size = 0;
+}
+
+
+/**
+ * Open a file from the current bundle for reading, if it is present. The
+ * contents are read directly from the mapped archive.
+ *
+ * \param *name		Pointer to the name of the file to open.
+ * \return		The handle of the file, or NULL if not found.
+ */
+
+FILE *bundle_open_file(char *name)
+{
+	struct bundle_file	*entry;
+
+	if (bundle_data == NULL || name == NULL)
+		return NULL;
+
+	entry = bundle_find(bundle_strip_name(name));
+	if (entry == NULL)
+		return NULL;
+
+#ifdef LINUX
+	if (entry->size == 0)
+		return fmemopen(bundle_empty, 0, "r");
+
+	return fmemopen(entry->data, entry->size, "r");
+#else
+	return NULL;
+#endif
+}
+
+
+/**
+ * Test whether a file is present in the current bundle.
+ *
+ * \param *name		Pointer to the name of the file to test.
+ * \return		True if the file is in the bundle; else False.
+ */
+
+bool bundle_has_file(char *name)
+{
+	if (bundle_data == NULL || name == NULL)
+		return false;
+
+	return (bundle_find(bundle_strip_name(name)) != NULL) ? true : false;
+}
+
+
+#ifdef LINUX
+/**
+ * Work through the headers of the mapped tar archive, adding each regular
+ * file to the index. GNU and pax long names are supported; other extensions
+ * are skipped over.
+ *
+ * \return		True if successful; False if the archive was invalid.
+ */
+
+static bool bundle_read_index(void)
+{
+	char	name[BUNDLE_MAX_NAME], *header, *data;
+	size_t	offset = 0, size, blocks, length;
+	bool	long_name = false;
+
+	while (offset + BUNDLE_BLOCK_SIZE <= bundle_size) {
+		header = bundle_data + offset;
+
+		/* An empty block marks the end of the archive. */
+
+		if (*header == '\0')
+			break;
+
+		if (!bundle_read_octal(header + BUNDLE_TAR_SIZE, BUNDLE_TAR_SIZE_SIZE, &size))
+			return false;
+
+		data = header + BUNDLE_BLOCK_SIZE;
+		blocks = (size + BUNDLE_BLOCK_SIZE - 1) / BUNDLE_BLOCK_SIZE;
+
+		if (size > bundle_size - offset - BUNDLE_BLOCK_SIZE)
+			return false;
+
+		switch (header[BUNDLE_TAR_TYPE]) {
+		case 'L':
+			/* A GNU long name, applying to the next entry. */
+
+			length = (size < BUNDLE_MAX_NAME) ? size : BUNDLE_MAX_NAME - 1;
+			memcpy(name, data, length);
+			name[length] = '\0';
+			long_name = true;
+			break;
+
+		case 'x':
+			/* A pax extended header, which might hold a long name
+			 * for the next entry.
+			 */
+
+			if (bundle_read_pax_path(data, size, name, BUNDLE_MAX_NAME))
+				long_name = true;
+			break;
+
+		case '0':
+		case '\0':
+			if (!long_name) {
+				length = 0;
+
+				if (memcmp(header + BUNDLE_TAR_MAGIC, "ustar", 6) == 0 && header[BUNDLE_TAR_PREFIX] != '\0') {
+					length = strnlen(header + BUNDLE_TAR_PREFIX, BUNDLE_TAR_PREFIX_SIZE);
+					memcpy(name, header + BUNDLE_TAR_PREFIX, length);
+					name[length++] = '/';
+				}
+
+				memcpy(name + length, header + BUNDLE_TAR_NAME, BUNDLE_TAR_NAME_SIZE);
+				name[length + strnlen(header + BUNDLE_TAR_NAME, BUNDLE_TAR_NAME_SIZE)] = '\0';
+			}
+
+			if (!bundle_add_file(bundle_strip_name(name), data, size))
+				return false;
+
+			long_name = false;
+			break;
+
+		default:
+			long_name = false;
+			break;
+		}
+
+		offset += BUNDLE_BLOCK_SIZE * (blocks + 1);
+	}
+
+	return true;
+}
+
+
+/**
+ * Add a file to the bundle's index. If a name appears more than once, the
+ * last copy in the archive is used, as tar would do when extracting.
+ *
+ * \param *name		Pointer to the name of the file.
+ * \param *data		Pointer to the file's contents.
+ * \param size		The size of the file's contents.
+ * \return		True if successful; False on failure.
+ */
+
+static bool bundle_add_file(char *name, char *data, size_t size)
+{
+	struct bundle_file	*entry;
+	unsigned		index;
+
+	entry = bundle_find(name);
+	if (entry != NULL) {
+		entry->data = data;
+		entry->size = size;
+		return true;
+	}
+
+	entry = malloc(sizeof(struct bundle_file));
+	if (entry == NULL)
+		return false;
+
+	entry->name = strdup(name);
+	if (entry->name == NULL) {
+		free(entry);
+		return false;
+	}
+
+	entry->data = data;
+	entry->size = size;
+
+	index = bundle_find_index(name);
+	entry->next = bundle_files[index];
+	bundle_files[index] = entry;
+
+	return true;
+}
+
+
+/**
+ * Read an octal number from a tar header field, which may be terminated
+ * by a space or a null.
+ *
+ * \param *field	Pointer to the field to read.
+ * \param length	The length of the field.
+ * \param *value	Pointer to a variable to take the value.
+ * \return		True if successful; False if the field was invalid.
+ */
+
+static bool bundle_read_octal(char *field, size_t length, size_t *value)
+{
+	size_t	result = 0;
+	char	*end = field + length;
+
+	while (field < end && *field == ' ')
+		field++;
+
+	if (field >= end || *field < '0' || *field > '7')
+		return false;
+
+	while (field < end && *field >= '0' && *field <= '7')
+		result = (result * 8) + (*field++ - '0');
+
+	*value = result;
+
+	return true;
+}
+
+
+/**
+ * Search the records in a pax extended header for a path, each record being
+ * in the form "<length> <keyword>=<value>\n".
+ *
+ * \param *data		Pointer to the extended header's data.
+ * \param size		The size of the extended header's data.
+ * \param *name		Pointer to a buffer to take the path.
+ * \param length	The size of the buffer.
+ * \return		True if a path was found; else False.
+ */
+
+static bool bundle_read_pax_path(char *data, size_t size, char *name, size_t length)
+{
+	char	*end = data + size, *record, *value;
+	size_t	record_length;
+
+	while (data < end) {
+		record_length = 0;
+
+		for (record = data; record < end && *record >= '0' && *record <= '9'; record++)
+			record_length = (record_length * 10) + (*record - '0');
+
+		if (record_length == 0 || record_length > (size_t) (end - data) || record >= end || *record != ' ')
+			return false;
+
+		record++;
+
+		if (strncmp(record, "path=", 5) == 0) {
+			value = record + 5;
+			size = data + record_length - 1 - value;
+
+			if (size >= length)
+				return false;
+
+			memcpy(name, value, size);
+			name[size] = '\0';
+			return true;
+		}
+
+		data += record_length;
+	}
+
+	return false;
+}
+#endif
+
+
+/**
+ * Find a file in the bundle's index.
+ *
+ * \param *name		Pointer to the name of the file to find.
+ * \return		Pointer to the file's entry, or NULL if not found.
+ */
+
+static struct bundle_file *bundle_find(char *name)
+{
+	struct bundle_file	*entry;
+
+	for (entry = bundle_files[bundle_find_index(name)]; entry != NULL; entry = entry->next) {
+		if (strcmp(entry->name, name) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Calculate the index bucket for a file name.
+ *
+ * \param *name		Pointer to the name of the file.
+ * \return		The index of the bucket to use.
+ */
+
+static unsigned bundle_find_index(char *name)
+{
+	unsigned	hash = 5381;
+
+	while (*name != '\0')
+		hash = (hash * 33) ^ (unsigned char) *name++;
+
+	return hash % BUNDLE_INDEXES;
+}
+
+
+/**
+ * Remove any leading ./ from a file name, so that names in the archive and
+ * on the command line can be compared directly.
+ *
+ * \param *name		Pointer to the name to strip.
+ * \return		Pointer to the start of the stripped name.
+ */
+
+static char *bundle_strip_name(char *name)
+{
+	while (name[0] == '.' && name[1] == '/')
+		name += 2;
+
+	return name;
+}
+
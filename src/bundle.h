@@ -0,0 +1,77 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file bundle.h
+ *
+ * Source Bundles, interface.
+ */
+
+#ifndef TOKENIZE_BUNDLE_H
+#define TOKENIZE_BUNDLE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+
+/**
+ * Open a bundle file, mapping it into memory and indexing the files that
+ * it contains. Any bundle which is already open is closed first.
+ *
+ * \param *file		Pointer to the name of the tar archive to open.
+ * \return		True if successful; False on error.
+ */
+
+bool bundle_open(char *file);
+
+
+/**
+ * Close the current bundle, if there is one, and discard its index.
+ */
+
+void bundle_close(void);
+
+
+/**
+ * Open a file from the current bundle for reading, if it is present. The
+ * contents are read directly from the mapped archive.
+ *
+ * \param *name		Pointer to the name of the file to open.
+ * \return		The handle of the file, or NULL if not found.
+ */
+
+FILE *bundle_open_file(char *name);
+
+
+/**
+ * Test whether a file is present in the current bundle.
+ *
+ * \param *name		Pointer to the name of the file to test.
+ * \return		True if the file is in the bundle; else False.
+ */
+
+bool bundle_has_file(char *name);
+
+#endif
+
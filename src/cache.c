@@ -0,0 +1,729 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file cache.c
+ *
+ * Incremental Tokenisation Cache, implementation.
+ *
+ * The cache holds a snapshot for each source file processed, in order: a
+ * hash of the file's contents, the tokenised lines that it produced, the
+ * libraries that it queued and messages that it reported, and the parser
+ * state after it was processed. Since the state is cumulative,
+ * an unchanged run of leading files can be skipped by writing out their
+ * lines and restoring the state from the last of them.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local source headers. */
+
+#include "cache.h"
+
+#include "library.h"
+#include "msg.h"
+#include "parse.h"
+#include "proc.h"
+#include "program.h"
+#include "variable.h"
+
+#define CACHE_MAX_LINE 1024
+#define CACHE_BLOCK_SIZE 4096
+
+/**
+ * A snapshot from the old cache file, forming one entry in a linked list.
+ */
+
+struct cache_snapshot {
+	char			*name;		/**< Pointer to the name of the source file.			*/
+	unsigned long long	hash;		/**< The hash of the source file's contents.			*/
+	int			line_number;	/**< The line number after the file was processed.		*/
+	bool			crunch_rems;	/**< The REM crunching state after the file was processed.	*/
+
+	long			start;		/**< The offset of the snapshot in the cache file.		*/
+	long			output;		/**< The offset of the tokenised output.			*/
+	unsigned		output_length;	/**< The length of the tokenised output.			*/
+	long			events;		/**< The offset of the queued libraries and messages.		*/
+	long			counts;		/**< The offset of the routine and variable counts.		*/
+	long			end;		/**< The offset of the end of the snapshot.			*/
+
+	struct cache_snapshot	*next;		/**< Pointer to the next snapshot in the chain, or NULL.	*/
+};
+
+static char			*cache_filename = NULL;
+static char			*cache_new_filename = NULL;
+
+static FILE			*cache_old = NULL;
+static struct cache_snapshot	*cache_snapshots = NULL;
+static struct cache_snapshot	*cache_next_snapshot = NULL;
+
+static FILE			*cache_new = NULL;
+
+/**
+ * Details of the source file being parsed.
+ */
+
+static unsigned long long	cache_file_hash = 0;
+static char			*cache_output = NULL;
+static unsigned			cache_output_length = 0;
+static unsigned			cache_output_size = 0;
+static char			*cache_events = NULL;
+static unsigned			cache_events_length = 0;
+static unsigned			cache_events_size = 0;
+static unsigned			cache_events_count = 0;
+static bool			cache_file_valid = false;
+
+static bool cache_read_index(unsigned long long signature);
+static bool cache_skip_counts(char *heading);
+static bool cache_replay_output(struct cache_snapshot *snapshot, FILE *out, struct parse_options *options);
+static bool cache_replay_events(struct cache_snapshot *snapshot, char *name, struct parse_options *options);
+static void cache_add_message(enum msg_type type, char *message, unsigned line, unsigned column);
+static void cache_add_event(char *format, ...);
+static bool cache_copy_snapshot(struct cache_snapshot *snapshot);
+static unsigned long long cache_hash_file(FILE *in);
+
+
+/**
+ * Open a cache file, reading in the details of the snapshots that it holds
+ * if its signature matches the one given, and start a new cache to replace
+ * it when the job is complete.
+ *
+ * \param *file		Pointer to the name of the cache file.
+ * \param signature	A hash of the options which affect the output.
+ * \return		True if successful; False on error.
+ */
+
+bool cache_open(char *file, unsigned long long signature)
+{
+	if (file == NULL)
+		return false;
+
+	cache_filename = strdup(file);
+	cache_new_filename = malloc(strlen(file) + 5);
+	if (cache_filename == NULL || cache_new_filename == NULL)
+		return false;
+
+	strcpy(cache_new_filename, file);
+	strcat(cache_new_filename, "_new");
+
+	cache_new = fopen(cache_new_filename, "wb");
+	if (cache_new == NULL)
+		return false;
+
+	fprintf(cache_new, "Tokenize cache %016llx\n", signature);
+
+	/* If there's an old cache, index its snapshots. A cache which can't
+	 * be read, or was made with different options, is simply ignored.
+	 */
+
+	cache_old = fopen(file, "rb");
+	if (cache_old != NULL && !cache_read_index(signature)) {
+		fclose(cache_old);
+		cache_old = NULL;
+	}
+
+	cache_next_snapshot = cache_snapshots;
+
+	return true;
+}
+
+
+/**
+ * Test a source file against the next snapshot in the cache. If the file is
+ * unchanged, and all of the files before it were too, then the tokenised
+ * output held in the snapshot is written out and the parser state restored
+ * without the file needing to be parsed again.
+ *
+ * \param *in		The handle of the source file.
+ * \param *out		The handle of the file to write the output to.
+ * \param *line_number	Pointer to a variable holding the current line number.
+ * \param *options	Pointer to the tokenisation options.
+ * \param *replayed	Pointer to a variable to be set to True if the file
+ *			was replayed, or False if it must be parsed.
+ * \return		True if successful; False on error.
+ */
+
+bool cache_replay_file(FILE *in, FILE *out, int *line_number, struct parse_options *options, bool *replayed)
+{
+	struct cache_snapshot	*snapshot = cache_next_snapshot;
+	char			*name = library_get_filename();
+
+	/* Once one file has been parsed, there's no going back. */
+
+	cache_next_snapshot = NULL;
+	*replayed = false;
+
+	/* A file which can't be read twice, such as a pipe, can't be checked
+	 * against the cache, nor cached itself.
+	 */
+
+	if (fseek(in, 0, SEEK_CUR) != 0) {
+		cache_file_valid = false;
+
+		if (cache_new != NULL) {
+			fclose(cache_new);
+			cache_new = NULL;
+		}
+
+		return true;
+	}
+
+	cache_file_hash = cache_hash_file(in);
+	cache_output_length = 0;
+	cache_events_length = 0;
+	cache_events_count = 0;
+	cache_file_valid = (cache_new != NULL) ? true : false;
+
+	if (snapshot == NULL || name == NULL || snapshot->hash != cache_file_hash || strcmp(snapshot->name, name) != 0) {
+		if (cache_file_valid)
+			msg_set_recorder(cache_add_message);
+
+		return true;
+	}
+
+	if (options->verbose_output)
+		printf("Using cached copy of source file '%s'\n", name);
+
+	/* From here on, the output and state have been changed, so a failure
+	 * can't be recovered by parsing the file instead.
+	 */
+
+	*replayed = true;
+
+	if (!cache_replay_output(snapshot, out, options) || !cache_replay_events(snapshot, name, options) ||
+			fseek(cache_old, snapshot->counts, SEEK_SET) != 0 || !proc_load_counts(cache_old) || !variable_load_counts(cache_old)) {
+		msg_report(MSG_CACHE_READ_FAIL, cache_filename);
+		return false;
+	}
+
+	*line_number = snapshot->line_number;
+	options->crunch_rems = snapshot->crunch_rems;
+
+	if (cache_file_valid && !cache_copy_snapshot(snapshot))
+		cache_file_valid = false;
+
+	if (!cache_file_valid && cache_new != NULL) {
+		fclose(cache_new);
+		cache_new = NULL;
+	}
+
+	cache_next_snapshot = snapshot->next;
+
+	return true;
+}
+
+
+/**
+ * Record a line of tokenised output from the source file being parsed. If
+ * there's no cache open, the line is ignored.
+ *
+ * \param *line		Pointer to the tokenised line.
+ * \param assembler	True if the line is part of an assembler block.
+ */
+
+void cache_add_line(char *line, bool assembler)
+{
+	unsigned	length = *((unsigned char *) line + 3);
+	char		*extended;
+
+	if (!cache_file_valid)
+		return;
+
+	if (cache_output_length + length + 1 > cache_output_size) {
+		extended = realloc(cache_output, cache_output_size + length + 1 + CACHE_BLOCK_SIZE);
+		if (extended == NULL) {
+			cache_file_valid = false;
+			return;
+		}
+
+		cache_output = extended;
+		cache_output_size += length + 1 + CACHE_BLOCK_SIZE;
+	}
+
+	cache_output[cache_output_length++] = (assembler) ? 1 : 0;
+	memcpy(cache_output + cache_output_length, line, length);
+	cache_output_length += length;
+}
+
+
+/**
+ * Record a file queued for linking by the source file being parsed, so that
+ * it can be queued again when the file is replayed. If there's no cache open,
+ * the file is ignored.
+ *
+ * \param *file		Pointer to the name of the file, as given to
+ *			library_add_file().
+ */
+
+void cache_add_library(char *file)
+{
+	if (cache_file_valid)
+		cache_add_event("Library %u %s\n", msg_get_line(), file);
+}
+
+
+/**
+ * Complete the parsing of a source file, writing a snapshot of its output,
+ * the libraries that it queued, the messages that it reported and the parser
+ * state to the new cache.
+ *
+ * \param line_number	The current line number.
+ * \param *options	Pointer to the tokenisation options.
+ */
+
+void cache_end_file(int line_number, struct parse_options *options)
+{
+	char	*name = library_get_filename();
+
+	msg_set_recorder(NULL);
+
+	if (cache_file_valid && name == NULL)
+		cache_file_valid = false;
+
+	if (cache_file_valid && (fprintf(cache_new, "File %016llx %s\nState %d %d %u\n", cache_file_hash, name,
+			line_number, (options->crunch_rems) ? 1 : 0, cache_output_length) < 0 ||
+			fwrite(cache_output, sizeof(char), cache_output_length, cache_new) != cache_output_length ||
+			fprintf(cache_new, "\nEvents %u\n", cache_events_count) < 0 ||
+			fwrite(cache_events, sizeof(char), cache_events_length, cache_new) != cache_events_length ||
+			!proc_save_counts(cache_new) || !variable_save_counts(cache_new) ||
+			fprintf(cache_new, "End\n") < 0))
+		cache_file_valid = false;
+
+	if (!cache_file_valid && cache_new != NULL) {
+		fclose(cache_new);
+		cache_new = NULL;
+	}
+}
+
+
+/**
+ * Close the cache, replacing the old cache file with the new one if the job
+ * was successful.
+ *
+ * \param success	True if the job was successful; else False.
+ */
+
+void cache_close(bool success)
+{
+	struct cache_snapshot	*snapshot;
+
+	msg_set_recorder(NULL);
+
+	if (cache_old != NULL) {
+		fclose(cache_old);
+		cache_old = NULL;
+	}
+
+	while (cache_snapshots != NULL) {
+		snapshot = cache_snapshots;
+		cache_snapshots = snapshot->next;
+		free(snapshot->name);
+		free(snapshot);
+	}
+
+	/* The new cache is closed early if a file couldn't be recorded, so
+	 * whatever it contains by now is valid.
+	 */
+
+	if (cache_new != NULL)
+		fclose(cache_new);
+
+	if (cache_filename != NULL && cache_new_filename != NULL) {
+		if (success) {
+			remove(cache_filename);
+			rename(cache_new_filename, cache_filename);
+		} else {
+			remove(cache_new_filename);
+		}
+	}
+
+	free(cache_output);
+	free(cache_events);
+	free(cache_filename);
+	free(cache_new_filename);
+
+	cache_new = NULL;
+	cache_output = NULL;
+	cache_output_size = 0;
+	cache_events = NULL;
+	cache_events_size = 0;
+	cache_file_valid = false;
+	cache_filename = NULL;
+	cache_new_filename = NULL;
+}
+
+
+/**
+ * Add a block of data to a 64-bit FNV-1a hash.
+ *
+ * \param hash		The hash so far, or CACHE_HASH_START.
+ * \param *data		Pointer to the data to add.
+ * \param length	The length of the data.
+ * \return		The updated hash.
+ */
+
+unsigned long long cache_hash(unsigned long long hash, char *data, size_t length)
+{
+	while (length-- > 0)
+		hash = (hash ^ (unsigned char) *data++) * 1099511628211ULL;
+
+	return hash;
+}
+
+
+/**
+ * Add the contents of a file to a 64-bit FNV-1a hash. If the file can't be
+ * read, its name is added in its place.
+ *
+ * \param hash		The hash so far, or CACHE_HASH_START.
+ * \param *file		Pointer to the name of the file to add.
+ * \return		The updated hash.
+ */
+
+unsigned long long cache_hash_contents(unsigned long long hash, char *file)
+{
+	char	block[CACHE_BLOCK_SIZE];
+	size_t	length;
+	FILE	*in;
+
+	in = fopen(file, "rb");
+	if (in == NULL)
+		return cache_hash(hash, file, strlen(file) + 1);
+
+	while ((length = fread(block, sizeof(char), CACHE_BLOCK_SIZE, in)) > 0)
+		hash = cache_hash(hash, block, length);
+
+	fclose(in);
+
+	return hash;
+}
+
+
+/**
+ * Read the index of snapshots from the old cache file. If the file is
+ * damaged part way through, the snapshots before the damage are kept.
+ *
+ * \param signature	The signature expected in the file.
+ * \return		True if the file could be used; else False.
+ */
+
+static bool cache_read_index(unsigned long long signature)
+{
+	char			line[CACHE_MAX_LINE], *name;
+	unsigned long long	value;
+	int			length, crunch_rems;
+	struct cache_snapshot	*snapshot, **link = &cache_snapshots;
+
+	if (fgets(line, CACHE_MAX_LINE, cache_old) == NULL || sscanf(line, "Tokenize cache %llx", &value) != 1 || value != signature)
+		return false;
+
+	while (true) {
+		snapshot = malloc(sizeof(struct cache_snapshot));
+		if (snapshot == NULL)
+			break;
+
+		snapshot->start = ftell(cache_old);
+		snapshot->name = NULL;
+		snapshot->next = NULL;
+
+		if (fgets(line, CACHE_MAX_LINE, cache_old) == NULL || sscanf(line, "File %llx %n", &snapshot->hash, &length) != 1 ||
+				(name = strtok(line + length, "\r\n")) == NULL || (snapshot->name = strdup(name)) == NULL)
+			break;
+
+		if (fgets(line, CACHE_MAX_LINE, cache_old) == NULL ||
+				sscanf(line, "State %d %d %u", &snapshot->line_number, &crunch_rems, &snapshot->output_length) != 3)
+			break;
+
+		snapshot->crunch_rems = (crunch_rems != 0) ? true : false;
+		snapshot->output = ftell(cache_old);
+
+		if (fseek(cache_old, snapshot->output_length, SEEK_CUR) != 0 || fgetc(cache_old) != '\n')
+			break;
+
+		snapshot->events = ftell(cache_old);
+
+		if (!cache_skip_counts("Events"))
+			break;
+
+		snapshot->counts = ftell(cache_old);
+
+		if (!cache_skip_counts("Routines") || !cache_skip_counts("Variables") ||
+				fgets(line, CACHE_MAX_LINE, cache_old) == NULL || strcmp(line, "End\n") != 0)
+			break;
+
+		snapshot->end = ftell(cache_old);
+
+		*link = snapshot;
+		link = &(snapshot->next);
+	}
+
+	if (snapshot != NULL) {
+		free(snapshot->name);
+		free(snapshot);
+	}
+
+	return true;
+}
+
+
+/**
+ * Skip over a block of counts in the old cache file.
+ *
+ * \param *heading	The heading expected at the start of the block.
+ * \return		True if successful; False if the block was damaged.
+ */
+
+static bool cache_skip_counts(char *heading)
+{
+	char		line[CACHE_MAX_LINE];
+	unsigned	count;
+	size_t		length = strlen(heading);
+
+	if (fgets(line, CACHE_MAX_LINE, cache_old) == NULL || strncmp(line, heading, length) != 0 ||
+			sscanf(line + length, "%u", &count) != 1)
+		return false;
+
+	while (count-- > 0) {
+		if (fgets(line, CACHE_MAX_LINE, cache_old) == NULL || strchr(line, '\n') == NULL)
+			return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Write out the tokenised lines held in a snapshot, or add them to the
+ * program store if that is in use.
+ *
+ * \param *snapshot	Pointer to the snapshot to replay.
+ * \param *out		The handle of the file to write the output to.
+ * \param *options	Pointer to the tokenisation options.
+ * \return		True if successful; False on error.
+ */
+
+static bool cache_replay_output(struct cache_snapshot *snapshot, FILE *out, struct parse_options *options)
+{
+	char		*output, *line;
+	unsigned	length;
+	bool		success = true;
+
+	output = malloc(snapshot->output_length + 1);
+	if (output == NULL)
+		return false;
+
+	if (fseek(cache_old, snapshot->output, SEEK_SET) != 0 ||
+			fread(output, sizeof(char), snapshot->output_length, cache_old) != snapshot->output_length) {
+		free(output);
+		return false;
+	}
+
+	/* Check that the lines fit together before any are used. */
+
+	for (line = output; line + 5 <= output + snapshot->output_length; line += length + 1)
+		length = *((unsigned char *) line + 4);
+
+	if (line != output + snapshot->output_length) {
+		free(output);
+		return false;
+	}
+
+	for (line = output; success && line < output + snapshot->output_length; line += length + 1) {
+		length = *((unsigned char *) line + 4);
+
+		if (options->crunch_dead_code || options->order_definitions || options->crunch_merge_lines)
+			success = program_add_line(line + 1, (*line != 0) ? true : false);
+		else
+			success = (fwrite(line + 1, sizeof(char), length, out) == length) ? true : false;
+	}
+
+	free(output);
+
+	return success;
+}
+
+
+/**
+ * Queue the libraries and report the messages held in a snapshot, as they
+ * were when the file was parsed.
+ *
+ * \param *snapshot	Pointer to the snapshot to replay.
+ * \param *name		Pointer to the name of the source file.
+ * \param *options	Pointer to the tokenisation options.
+ * \return		True if successful; False on error.
+ */
+
+static bool cache_replay_events(struct cache_snapshot *snapshot, char *name, struct parse_options *options)
+{
+	char		line[CACHE_MAX_LINE], *end;
+	unsigned	count, line_number, column;
+	int		type, length;
+
+	if (fseek(cache_old, snapshot->events, SEEK_SET) != 0 ||
+			fgets(line, CACHE_MAX_LINE, cache_old) == NULL || sscanf(line, "Events %u", &count) != 1)
+		return false;
+
+	while (count-- > 0) {
+		if (fgets(line, CACHE_MAX_LINE, cache_old) == NULL || (end = strchr(line, '\n')) == NULL)
+			return false;
+
+		*end = '\0';
+
+		if (sscanf(line, "Library %u%n", &line_number, &length) == 1 && line[length] == ' ') {
+			library_add_file(line + length + 1);
+
+			if (options->verbose_output) {
+				msg_set_location(line_number, name);
+				msg_report(MSG_QUEUE_LIB, line + length + 1);
+			}
+		} else if (sscanf(line, "Message %d %u %u%n", &type, &line_number, &column, &length) == 3 && line[length] == ' ') {
+			msg_set_location(line_number, name);
+			msg_set_column(column);
+			msg_replay((enum msg_type) type, line + length + 1);
+		} else {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Record a message reported by the source file being parsed.
+ *
+ * \param type		The type of the message.
+ * \param *message	Pointer to the text of the message.
+ * \param line		The line at which the message was reported.
+ * \param column	The column at which the message was reported, or 0.
+ */
+
+static void cache_add_message(enum msg_type type, char *message, unsigned line, unsigned column)
+{
+	/* Queued libraries are only reported in verbose mode, which can
+	 * change between runs, so they are reported from the Library event
+	 * on replay instead.
+	 */
+
+	if (cache_file_valid && type != MSG_QUEUE_LIB)
+		cache_add_event("Message %d %u %u %s\n", type, line, column, message);
+}
+
+
+/**
+ * Record a library or message event from the source file being parsed, as a
+ * single line of text. An event which won't fit on one line can't be read
+ * back, so the file can't be cached.
+ *
+ * \param *format	Pointer to a printf format for the event.
+ * \param ...		Additional printf parameters as required.
+ */
+
+static void cache_add_event(char *format, ...)
+{
+	char		event[CACHE_MAX_LINE], *extended;
+	int		length;
+	va_list		ap;
+
+	va_start(ap, format);
+	length = vsnprintf(event, CACHE_MAX_LINE, format, ap);
+	va_end(ap);
+
+	if (length <= 0 || length >= CACHE_MAX_LINE || strchr(event, '\n') != event + length - 1) {
+		cache_file_valid = false;
+		return;
+	}
+
+	if (cache_events_length + length > cache_events_size) {
+		extended = realloc(cache_events, cache_events_size + length + CACHE_BLOCK_SIZE);
+		if (extended == NULL) {
+			cache_file_valid = false;
+			return;
+		}
+
+		cache_events = extended;
+		cache_events_size += length + CACHE_BLOCK_SIZE;
+	}
+
+	memcpy(cache_events + cache_events_length, event, length);
+	cache_events_length += length;
+	cache_events_count++;
+}
+
+
+/**
+ * Copy a snapshot from the old cache file to the new one.
+ *
+ * \param *snapshot	Pointer to the snapshot to copy.
+ * \return		True if successful; False on error.
+ */
+
+static bool cache_copy_snapshot(struct cache_snapshot *snapshot)
+{
+	char	block[CACHE_BLOCK_SIZE];
+	long	remaining = snapshot->end - snapshot->start;
+	size_t	length;
+
+	if (fseek(cache_old, snapshot->start, SEEK_SET) != 0)
+		return false;
+
+	while (remaining > 0) {
+		length = (remaining > CACHE_BLOCK_SIZE) ? CACHE_BLOCK_SIZE : remaining;
+
+		if (fread(block, sizeof(char), length, cache_old) != length || fwrite(block, sizeof(char), length, cache_new) != length)
+			return false;
+
+		remaining -= length;
+	}
+
+	return true;
+}
+
+
+/**
+ * Calculate the hash of the contents of a file, leaving the file pointer
+ * back at the start.
+ *
+ * \param *in		The handle of the file to hash.
+ * \return		The hash of the file.
+ */
+
+static unsigned long long cache_hash_file(FILE *in)
+{
+	char			block[CACHE_BLOCK_SIZE];
+	size_t			length;
+	unsigned long long	hash = CACHE_HASH_START;
+
+	while ((length = fread(block, sizeof(char), CACHE_BLOCK_SIZE, in)) > 0)
+		hash = cache_hash(hash, block, length);
+
+	rewind(in);
+
+	return hash;
+}
+
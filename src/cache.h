@@ -0,0 +1,146 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file cache.h
+ *
+ * Incremental Tokenisation Cache, interface.
+ */
+
+#ifndef TOKENIZE_CACHE_H
+#define TOKENIZE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "parse.h"
+
+/**
+ * The starting value for a hash calculated with cache_hash().
+ */
+
+#define CACHE_HASH_START 14695981039346656037ULL
+
+
+/**
+ * Open a cache file, reading in the details of the snapshots that it holds
+ * if its signature matches the one given, and start a new cache to replace
+ * it when the job is complete.
+ *
+ * \param *file		Pointer to the name of the cache file.
+ * \param signature	A hash of the options which affect the output.
+ * \return		True if successful; False on error.
+ */
+
+bool cache_open(char *file, unsigned long long signature);
+
+
+/**
+ * Test a source file against the next snapshot in the cache. If the file is
+ * unchanged, and all of the files before it were too, then the tokenised
+ * output held in the snapshot is written out and the parser state restored
+ * without the file needing to be parsed again.
+ *
+ * \param *in		The handle of the source file.
+ * \param *out		The handle of the file to write the output to.
+ * \param *line_number	Pointer to a variable holding the current line number.
+ * \param *options	Pointer to the tokenisation options.
+ * \param *replayed	Pointer to a variable to be set to True if the file
+ *			was replayed, or False if it must be parsed.
+ * \return		True if successful; False on error.
+ */
+
+bool cache_replay_file(FILE *in, FILE *out, int *line_number, struct parse_options *options, bool *replayed);
+
+
+/**
+ * Record a line of tokenised output from the source file being parsed. If
+ * there's no cache open, the line is ignored.
+ *
+ * \param *line		Pointer to the tokenised line.
+ * \param assembler	True if the line is part of an assembler block.
+ */
+
+void cache_add_line(char *line, bool assembler);
+
+
+/**
+ * Record a file queued for linking by the source file being parsed, so that
+ * it can be queued again when the file is replayed. If there's no cache open,
+ * the file is ignored.
+ *
+ * \param *file		Pointer to the name of the file, as given to
+ *			library_add_file().
+ */
+
+void cache_add_library(char *file);
+
+
+/**
+ * Complete the parsing of a source file, writing a snapshot of its output and
+ * the parser state to the new cache.
+ *
+ * \param line_number	The current line number.
+ * \param *options	Pointer to the tokenisation options.
+ */
+
+void cache_end_file(int line_number, struct parse_options *options);
+
+
+/**
+ * Close the cache, replacing the old cache file with the new one if the job
+ * was successful.
+ *
+ * \param success	True if the job was successful; else False.
+ */
+
+void cache_close(bool success);
+
+
+/**
+ * Add a block of data to a 64-bit FNV-1a hash.
+ *
+ * \param hash		The hash so far, or CACHE_HASH_START.
+ * \param *data		Pointer to the data to add.
+ * \param length	The length of the data.
+ * \return		The updated hash.
+ */
+
+unsigned long long cache_hash(unsigned long long hash, char *data, size_t length);
+
+
+/**
+ * Add the contents of a file to a 64-bit FNV-1a hash. If the file can't be
+ * read, its name is added in its place.
+ *
+ * \param hash		The hash so far, or CACHE_HASH_START.
+ * \param *file		Pointer to the name of the file to add.
+ * \return		The updated hash.
+ */
+
+unsigned long long cache_hash_contents(unsigned long long hash, char *file);
+
+#endif
+
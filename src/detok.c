@@ -0,0 +1,477 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file detok.c
+ *
+ * Line Detokenisation, implementation.
+ *
+ * Tokens are expanded using tables built from the parser's own keyword
+ * list, indexed directly by token value, so that each byte of a line can
+ * be dealt with in constant time.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local source headers. */
+
+#include "detok.h"
+
+#include "parse.h"
+
+/**
+ * The number of token tables: one for single byte tokens, and one each for
+ * the 0xc6, 0xc7 and 0xc8 two byte tokens.
+ */
+
+#define DETOK_TABLES 4
+
+/**
+ * The first byte of the two byte tokens.
+ */
+
+#define DETOK_TWO_BYTE_BASE 0xc6
+
+/**
+ * The details of a token.
+ */
+
+struct detok_token {
+	char			*name;		/**< The name of the keyword, as listed by BASIC, or NULL.	*/
+	int			abbrev;		/**< The minimum length of an abbreviation of the name.		*/
+	char			*alternative;	/**< Another name which gives the same token, or NULL.		*/
+	int			alternative_abbrev; /**< The minimum length of an abbreviation of the alternative. */
+	bool			to_line_end;	/**< True if the rest of the line isn't tokenised.		*/
+	bool			statement_start; /**< True if the next item starts a new statement.		*/
+};
+
+/**
+ * The types of item found in a tokenised line.
+ */
+
+enum detok_item_type {
+	DETOK_END,				/**< The end of the line has been reached.			*/
+	DETOK_CHARACTER,			/**< A plain character.						*/
+	DETOK_KEYWORD,				/**< A keyword token.						*/
+	DETOK_LINE_NUMBER			/**< A line number constant.					*/
+};
+
+/**
+ * An item found in a tokenised line.
+ */
+
+struct detok_item {
+	enum detok_item_type	type;		/**< The type of the item.					*/
+	unsigned char		*raw;		/**< Pointer to the item's bytes in the tokenised line.		*/
+	unsigned		length;		/**< The number of bytes in the item.				*/
+	struct detok_token	*token;		/**< The keyword's token, for DETOK_KEYWORD.			*/
+	unsigned		number;		/**< The line number, for DETOK_LINE_NUMBER.			*/
+};
+
+/**
+ * The state of a scan through a tokenised line.
+ */
+
+struct detok_scan {
+	unsigned char		*position;	/**< The next byte to be scanned.				*/
+	unsigned char		*end;		/**< The first byte beyond the end of the line.			*/
+	bool			in_string;	/**< True if the scan is inside a string.			*/
+	bool			to_line_end;	/**< True if the rest of the line isn't tokenised.		*/
+	bool			statement_start; /**< True if the next item starts a statement.			*/
+};
+
+static struct detok_token	detok_tokens[DETOK_TABLES][256];
+static bool			detok_initialised = false;
+
+static void detok_initialise(void);
+static void detok_start_scan(struct detok_scan *scan, char *line);
+static void detok_next_item(struct detok_scan *scan, struct detok_item *item);
+static bool detok_match_keyword(struct detok_token *token, char **source, char *end);
+static bool detok_match_name(char *name, int abbrev, char **source, char *end);
+
+
+/**
+ * Expand a tokenised line back into text, as BASIC would list it but
+ * without the line number.
+ *
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ * \param *text		Pointer to a buffer to take the terminated text.
+ * \param length	The size of the buffer.
+ * \return		True if successful; False if the buffer was too small.
+ */
+
+bool detok_line(char *line, char *text, size_t length)
+{
+	struct detok_scan	scan;
+	struct detok_item	item;
+	char			*end = text + length;
+	size_t			size;
+	int			written;
+
+	if (line == NULL || text == NULL || length == 0)
+		return false;
+
+	detok_start_scan(&scan, line);
+
+	for (detok_next_item(&scan, &item); item.type != DETOK_END; detok_next_item(&scan, &item)) {
+		switch (item.type) {
+		case DETOK_KEYWORD:
+			size = strlen(item.token->name);
+			if (size >= end - text)
+				return false;
+			memcpy(text, item.token->name, size);
+			text += size;
+			break;
+
+		case DETOK_LINE_NUMBER:
+			written = snprintf(text, end - text, "%u", item.number);
+			if (written < 0 || written >= end - text)
+				return false;
+			text += written;
+			break;
+
+		default:
+			if (end - text <= 1)
+				return false;
+			*text++ = *item.raw;
+			break;
+		}
+	}
+
+	*text = '\0';
+
+	return true;
+}
+
+
+/**
+ * Check that a tokenised line is a faithful copy of the source text that
+ * it came from. Keywords may have been abbreviated in the source, and tabs
+ * may have been expanded into spaces.
+ *
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ * \param *source	Pointer to the source text, without any line number.
+ * \param length	The length of the source text.
+ * \param tab_indent	The number of spaces that a tab could expand to.
+ * \param *column	Pointer to a variable to take the column of the
+ *			source at which any difference was found.
+ * \return		True if the line matched; False if not.
+ */
+
+bool detok_verify_line(char *line, char *source, size_t length, unsigned tab_indent, unsigned *column)
+{
+	struct detok_scan	scan;
+	struct detok_item	item;
+	char			*read = source, *end = source + length;
+	unsigned		spaces, tabs, output, number, digits;
+	bool			matched = true;
+
+	if (line == NULL || source == NULL)
+		return false;
+
+	detok_start_scan(&scan, line);
+	detok_next_item(&scan, &item);
+
+	while (matched && item.type != DETOK_END) {
+		switch (item.type) {
+		case DETOK_KEYWORD:
+			matched = detok_match_keyword(item.token, &read, end);
+
+			/* If the source contained a top-bit character which
+			 * looks like a token, it will have been copied as-is.
+			 */
+
+			if (!matched && (size_t) (end - read) >= item.length && memcmp(read, item.raw, item.length) == 0) {
+				read += item.length;
+				matched = true;
+			}
+			break;
+
+		case DETOK_LINE_NUMBER:
+			for (number = 0, digits = 0; read < end && *read >= '0' && *read <= '9'; digits++)
+				number = number * 10 + (*read++ - '0');
+
+			matched = (digits > 0 && number == item.number) ? true : false;
+			break;
+
+		default:
+			if (*item.raw != ' ' && *item.raw != '\t') {
+				matched = (read < end && *read == *item.raw) ? true : false;
+				if (matched)
+					read++;
+				break;
+			}
+
+			/* Compare runs of whitespace as a whole, allowing for
+			 * each tab in the source to have become anything from
+			 * one space up to a full tab stop.
+			 */
+
+			for (output = 0; item.type == DETOK_CHARACTER && (*item.raw == ' ' || *item.raw == '\t'); output++)
+				detok_next_item(&scan, &item);
+
+			for (spaces = 0, tabs = 0; read < end && (*read == ' ' || *read == '\t'); read++) {
+				if (*read == '\t')
+					tabs++;
+				else
+					spaces++;
+			}
+
+			if (tab_indent == 0)
+				tab_indent = 1;
+
+			matched = (output >= spaces + tabs && output <= spaces + (tabs * tab_indent)) ? true : false;
+			continue;
+		}
+
+		detok_next_item(&scan, &item);
+	}
+
+	if (matched && read != end)
+		matched = false;
+
+	if (column != NULL)
+		*column = (read - source) + 1;
+
+	return matched;
+}
+
+
+/**
+ * Build the token tables from the parser's list of keywords.
+ */
+
+static void detok_initialise(void)
+{
+	enum parse_keyword	keyword;
+	struct detok_token	*token;
+	unsigned		values[2], value;
+	int			i;
+	char			*name;
+
+	for (keyword = 0; keyword < MAX_KEYWORDS; keyword++) {
+		values[0] = parse_get_left_token(keyword);
+		values[1] = parse_get_token(keyword);
+		name = parse_get_keyword_name(keyword);
+
+		for (i = 0; i < 2; i++) {
+			value = values[i];
+
+			if (value >= 0x100)
+				token = &detok_tokens[(value & 0xff) - DETOK_TWO_BYTE_BASE + 1][value >> 8];
+			else
+				token = &detok_tokens[0][value];
+
+			/* Where two keywords share a token, such as COLOR and
+			 * COLOUR, BASIC lists the longer one.
+			 */
+
+			if (token->name != NULL && strcmp(token->name, name) != 0) {
+				if (strlen(name) > strlen(token->name)) {
+					token->alternative = token->name;
+					token->alternative_abbrev = token->abbrev;
+				} else {
+					token->alternative = name;
+					token->alternative_abbrev = parse_get_keyword_abbreviation(keyword);
+					continue;
+				}
+			}
+
+			token->name = name;
+			token->abbrev = parse_get_keyword_abbreviation(keyword);
+			token->to_line_end = (keyword == KWD_REM || keyword == KWD_DATA) ? true : false;
+			token->statement_start = (keyword == KWD_THEN || keyword == KWD_ELSE) ? true : false;
+		}
+	}
+
+	detok_initialised = true;
+}
+
+
+/**
+ * Prepare to scan the body of a tokenised line.
+ *
+ * \param *scan		Pointer to the scan block to initialise.
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ */
+
+static void detok_start_scan(struct detok_scan *scan, char *line)
+{
+	if (!detok_initialised)
+		detok_initialise();
+
+	scan->position = (unsigned char *) line + 4;
+	scan->end = (unsigned char *) line + *((unsigned char *) line + 3);
+	scan->in_string = false;
+	scan->to_line_end = false;
+	scan->statement_start = true;
+}
+
+
+/**
+ * Return the next item from a tokenised line. Tokens are not expanded within
+ * strings, or in the text following REM, DATA and star commands.
+ *
+ * \param *scan		Pointer to the scan block to use.
+ * \param *item		Pointer to a block to take the item.
+ */
+
+static void detok_next_item(struct detok_scan *scan, struct detok_item *item)
+{
+	struct detok_token	*token;
+	unsigned char		byte;
+
+	item->raw = scan->position;
+	item->length = 1;
+
+	if (scan->position >= scan->end) {
+		item->type = DETOK_END;
+		item->length = 0;
+		return;
+	}
+
+	byte = *scan->position++;
+	item->type = DETOK_CHARACTER;
+
+	if (scan->to_line_end)
+		return;
+
+	if (scan->in_string) {
+		if (byte == '"')
+			scan->in_string = false;
+		return;
+	}
+
+	switch (byte) {
+	case ' ':
+	case '\t':
+		return;
+	case '"':
+		scan->in_string = true;
+		break;
+	case '*':
+		if (scan->statement_start)
+			scan->to_line_end = true;
+		break;
+	case ':':
+		scan->statement_start = true;
+		return;
+	case PARSE_TOKEN_CONST:
+		if (scan->end - scan->position >= 3) {
+			item->type = DETOK_LINE_NUMBER;
+			item->number = parse_read_line_constant((char *) scan->position);
+			item->length = 4;
+			scan->position += 3;
+		}
+		break;
+	default:
+		if (byte < 0x7f)
+			break;
+
+		if (byte >= DETOK_TWO_BYTE_BASE && byte < DETOK_TWO_BYTE_BASE + DETOK_TABLES - 1 && scan->position < scan->end) {
+			token = &detok_tokens[byte - DETOK_TWO_BYTE_BASE + 1][*scan->position];
+			if (token->name != NULL) {
+				scan->position++;
+				item->length = 2;
+			}
+		} else {
+			token = &detok_tokens[0][byte];
+		}
+
+		if (token->name == NULL)
+			break;
+
+		item->type = DETOK_KEYWORD;
+		item->token = token;
+
+		if (token->to_line_end)
+			scan->to_line_end = true;
+
+		if (token->statement_start) {
+			scan->statement_start = true;
+			return;
+		}
+		break;
+	}
+
+	scan->statement_start = false;
+}
+
+
+/**
+ * Match a keyword against the source text, by any of its names and in full
+ * or abbreviated form.
+ *
+ * \param *token	Pointer to the keyword's token.
+ * \param **source	Pointer to the source pointer, updated on a match.
+ * \param *end		Pointer to the end of the source text.
+ * \return		True if the keyword matched; else False.
+ */
+
+static bool detok_match_keyword(struct detok_token *token, char **source, char *end)
+{
+	if (detok_match_name(token->name, token->abbrev, source, end))
+		return true;
+
+	if (token->alternative != NULL && detok_match_name(token->alternative, token->alternative_abbrev, source, end))
+		return true;
+
+	return false;
+}
+
+
+/**
+ * Match a keyword name against the source text, either in full or as an
+ * abbreviation ending with a full stop.
+ *
+ * \param *name		Pointer to the name to match.
+ * \param abbrev	The minimum length of an abbreviation.
+ * \param **source	Pointer to the source pointer, updated on a match.
+ * \param *end		Pointer to the end of the source text.
+ * \return		True if the name matched; else False.
+ */
+
+static bool detok_match_name(char *name, int abbrev, char **source, char *end)
+{
+	size_t	length = strlen(name), available = end - *source;
+	int	prefix;
+
+	if (available >= length && memcmp(*source, name, length) == 0) {
+		*source += length;
+		return true;
+	}
+
+	for (prefix = 1; prefix < length && prefix < available && (*source)[prefix - 1] == name[prefix - 1]; prefix++) {
+		if (prefix >= abbrev && (*source)[prefix] == '.') {
+			*source += prefix + 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
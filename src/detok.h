@@ -0,0 +1,68 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file detok.h
+ *
+ * Line Detokenisation, interface.
+ */
+
+#ifndef TOKENIZE_DETOK_H
+#define TOKENIZE_DETOK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/**
+ * Expand a tokenised line back into text, as BASIC would list it but
+ * without the line number.
+ *
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ * \param *text		Pointer to a buffer to take the terminated text.
+ * \param length	The size of the buffer.
+ * \return		True if successful; False if the buffer was too small.
+ */
+
+bool detok_line(char *line, char *text, size_t length);
+
+
+/**
+ * Check that a tokenised line is a faithful copy of the source text that
+ * it came from. Keywords may have been abbreviated in the source, and tabs
+ * may have been expanded into spaces.
+ *
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ * \param *source	Pointer to the source text, without any line number.
+ * \param length	The length of the source text.
+ * \param tab_indent	The number of spaces that a tab could expand to.
+ * \param *column	Pointer to a variable to take the column of the
+ *			source at which any difference was found.
+ * \return		True if the line matched; False if not.
+ */
+
+bool detok_verify_line(char *line, char *source, size_t length, unsigned tab_indent, unsigned *column);
+
+#endif
+
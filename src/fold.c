@@ -0,0 +1,858 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file fold.c
+ *
+ * Constant Expression Folding, implementation.
+ *
+ * Subexpressions built only from numeric and string literals -- including
+ * the values substituted for constant variables -- are evaluated, and the
+ * result written back in place of the expression. Only +, -, *, /, DIV and
+ * MOD are handled. BASIC holds reals to 32 bits of mantissa, so real values
+ * are only folded when every input and the result can be held exactly.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Local source headers. */
+
+#include "fold.h"
+
+#include "number.h"
+#include "parse.h"
+
+#define FOLD_MAX_STRING 255
+#define FOLD_MAX_TEXT 520
+
+/**
+ * Item codes returned by fold_next(), in addition to those returned by
+ * parse_scan_next().
+ */
+
+#define FOLD_ITEM_NUMBER (-2)
+#define FOLD_ITEM_STRING (-3)
+#define FOLD_ITEM_OTHER (-4)
+
+/**
+ * The binding of the operators at the top level of a subexpression, in
+ * increasing order of precedence.
+ */
+
+enum fold_level {
+	FOLD_LEVEL_ADD = 1,			/**< The subexpression contains a + or -.			*/
+	FOLD_LEVEL_MULTIPLY,			/**< The subexpression contains a *, /, DIV or MOD.		*/
+	FOLD_LEVEL_UNARY,			/**< The subexpression is a unary + or -.			*/
+	FOLD_LEVEL_ATOM				/**< The subexpression is a literal or bracketed.		*/
+};
+
+enum fold_type {
+	FOLD_INTEGER,				/**< The value is an integer.					*/
+	FOLD_REAL,				/**< The value is a real.					*/
+	FOLD_STRING				/**< The value is a string.					*/
+};
+
+/**
+ * A constant value.
+ */
+
+struct fold_value {
+	enum fold_type	type;			/**< The type of the value.					*/
+	int		integer;		/**< The value, if an integer.					*/
+	double		real;			/**< The value, if a real.					*/
+	char		string[FOLD_MAX_STRING];/**< The value, if a string (not terminated).			*/
+	int		length;			/**< The length of the string value.				*/
+};
+
+static bool fold_run(char *line, struct parse_scan *scan);
+static bool fold_expression(struct parse_scan *scan, struct fold_value *value, enum fold_level *level, int *changes);
+static bool fold_term(struct parse_scan *scan, struct fold_value *value, enum fold_level *level, int *changes);
+static bool fold_unary(struct parse_scan *scan, struct fold_value *value, enum fold_level *level, int *changes);
+static bool fold_apply(struct fold_value *left, int operator, struct fold_value *right);
+static bool fold_logical(struct parse_scan *scan, struct fold_value *value);
+static bool fold_conjunction(struct parse_scan *scan, struct fold_value *value);
+static bool fold_comparison(struct parse_scan *scan, struct fold_value *value);
+static bool fold_negation(struct parse_scan *scan, struct fold_value *value);
+static int fold_compare(struct fold_value *left, struct fold_value *right, bool *valid);
+static int fold_next(struct parse_scan *scan, struct fold_value *value);
+static bool fold_read_string(char *start, char *end, struct fold_value *value);
+static int fold_write_value(struct fold_value *value, char *text, size_t length);
+static bool fold_is_left_delimiter(int item);
+static bool fold_is_right_delimiter(int item);
+static bool fold_is_name_body(char c);
+
+
+/**
+ * Fold any constant subexpressions in a tokenised line, replacing them
+ * with a single literal value. The line is updated in place, and can only
+ * get shorter.
+ *
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ * \return		The new length of the line.
+ */
+
+unsigned fold_process_line(char *line)
+{
+	struct parse_scan	scan;
+	struct fold_value	value;
+	int			item;
+
+	parse_scan_start(&scan, line);
+
+	while ((item = fold_next(&scan, &value)) != PARSE_SCAN_END) {
+		if (fold_is_left_delimiter(item))
+			fold_run(line, &scan);
+	}
+
+	return *((unsigned char *) line + 3);
+}
+
+
+/**
+ * Evaluate a condition, such as that following an IF, if it is built only
+ * from constant values. On success, the scan is left after the condition.
+ *
+ * \param *scan		Pointer to the scan, positioned before the condition.
+ * \param *result	Pointer to a variable to take the outcome.
+ * \return		True if the condition was constant; else False.
+ */
+
+bool fold_evaluate_condition(struct parse_scan *scan, bool *result)
+{
+	struct parse_scan	run = *scan;
+	struct fold_value	value;
+
+	if (!fold_logical(&run, &value) || value.type == FOLD_STRING)
+		return false;
+
+	*result = ((value.type == FOLD_INTEGER) ? value.integer != 0 : value.real != 0) ? true : false;
+	*scan = run;
+
+	return true;
+}
+
+
+/**
+ * Attempt to fold the subexpression following a delimiter, updating the
+ * line and the scan position if successful.
+ *
+ * \param *line		Pointer to the tokenised line.
+ * \param *scan		Pointer to the scan, positioned after the delimiter.
+ * \return		True if the line was changed; else False.
+ */
+
+static bool fold_run(char *line, struct parse_scan *scan)
+{
+	struct parse_scan	run, follow;
+	struct fold_value	value;
+	enum fold_level		level;
+	char			text[FOLD_MAX_TEXT], *start, *end;
+	int			changes = 0, item, length;
+
+	follow = *scan;
+	if (fold_next(&follow, &value) == PARSE_SCAN_END)
+		return false;
+
+	start = follow.item;
+	run = *scan;
+
+	if (!fold_expression(&run, &value, &level, &changes) || changes == 0)
+		return false;
+
+	/* The expression can only be replaced if whatever follows it binds
+	 * less tightly than the operators within it.
+	 */
+
+	follow = run;
+	item = fold_next(&follow, NULL);
+
+	if (!fold_is_right_delimiter(item) && item != '+' && item != '-' &&
+			!(level >= FOLD_LEVEL_MULTIPLY && (item == '*' || item == '/' ||
+			item == parse_get_token(KWD_DIV) || item == parse_get_token(KWD_MOD))) &&
+			!(level == FOLD_LEVEL_ATOM && item == '^'))
+		return false;
+
+	end = run.position;
+
+	length = fold_write_value(&value, text, FOLD_MAX_TEXT);
+	if (length <= 0 || length > end - start)
+		return false;
+
+	memcpy(start, text, length);
+	memmove(start + length, end, scan->end - end);
+
+	scan->end -= (end - start) - length;
+	scan->position = start + length;
+	scan->next_start = false;
+
+	*((unsigned char *) line + 3) = scan->end - line;
+
+	return true;
+}
+
+
+/**
+ * Evaluate an additive expression.
+ *
+ * \param *scan		Pointer to the scan, updated on exit.
+ * \param *value	Pointer to a block to take the result.
+ * \param *level	Pointer to a variable to take the binding level.
+ * \param *changes	Pointer to a count of operations folded.
+ * \return		True if successful; False if not constant.
+ */
+
+static bool fold_expression(struct parse_scan *scan, struct fold_value *value, enum fold_level *level, int *changes)
+{
+	struct parse_scan	save;
+	struct fold_value	right;
+	enum fold_level		right_level;
+	int			item, saved_changes;
+
+	if (!fold_term(scan, value, level, changes))
+		return false;
+
+	while (true) {
+		save = *scan;
+		saved_changes = *changes;
+
+		item = fold_next(scan, NULL);
+		if ((item != '+' && item != '-') || !fold_term(scan, &right, &right_level, changes) ||
+				!fold_apply(value, item, &right)) {
+			*scan = save;
+			*changes = saved_changes;
+			return true;
+		}
+
+		*level = FOLD_LEVEL_ADD;
+		(*changes)++;
+	}
+}
+
+
+/**
+ * Evaluate a multiplicative expression.
+ *
+ * \param *scan		Pointer to the scan, updated on exit.
+ * \param *value	Pointer to a block to take the result.
+ * \param *level	Pointer to a variable to take the binding level.
+ * \param *changes	Pointer to a count of operations folded.
+ * \return		True if successful; False if not constant.
+ */
+
+static bool fold_term(struct parse_scan *scan, struct fold_value *value, enum fold_level *level, int *changes)
+{
+	struct parse_scan	save;
+	struct fold_value	right;
+	enum fold_level		right_level;
+	int			item, saved_changes;
+
+	if (!fold_unary(scan, value, level, changes))
+		return false;
+
+	while (true) {
+		save = *scan;
+		saved_changes = *changes;
+
+		item = fold_next(scan, NULL);
+		if ((item != '*' && item != '/' && item != parse_get_token(KWD_DIV) && item != parse_get_token(KWD_MOD)) ||
+				!fold_unary(scan, &right, &right_level, changes) || !fold_apply(value, item, &right)) {
+			*scan = save;
+			*changes = saved_changes;
+			return true;
+		}
+
+		*level = FOLD_LEVEL_MULTIPLY;
+		(*changes)++;
+	}
+}
+
+
+/**
+ * Evaluate a literal, a bracketed expression or a unary + or -.
+ *
+ * \param *scan		Pointer to the scan, updated on exit.
+ * \param *value	Pointer to a block to take the result.
+ * \param *level	Pointer to a variable to take the binding level.
+ * \param *changes	Pointer to a count of operations folded.
+ * \return		True if successful; False if not constant.
+ */
+
+static bool fold_unary(struct parse_scan *scan, struct fold_value *value, enum fold_level *level, int *changes)
+{
+	enum fold_level		sub_level;
+	int			item, initial_changes = *changes;
+
+	item = fold_next(scan, value);
+
+	switch (item) {
+	case FOLD_ITEM_NUMBER:
+	case FOLD_ITEM_STRING:
+		*level = FOLD_LEVEL_ATOM;
+		return true;
+
+	case '(':
+		if (!fold_expression(scan, value, &sub_level, changes) || fold_next(scan, NULL) != ')')
+			return false;
+
+		*level = FOLD_LEVEL_ATOM;
+		(*changes)++;
+		return true;
+
+	case '+':
+	case '-':
+		if (!fold_unary(scan, value, &sub_level, changes) || value->type == FOLD_STRING)
+			return false;
+
+		if (item == '-' && value->type == FOLD_INTEGER) {
+			if (value->integer == INT_MIN)
+				return false;
+			value->integer = -value->integer;
+		} else if (item == '-') {
+			value->real = -value->real;
+		}
+
+		/* A minus in front of a number is just part of the literal. */
+
+		if (item == '+' || sub_level != FOLD_LEVEL_ATOM || *changes != initial_changes)
+			(*changes)++;
+
+		*level = FOLD_LEVEL_UNARY;
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Apply a binary operator to two constant values.
+ *
+ * \param *left		Pointer to the left-hand value, which takes the result.
+ * \param operator	The operator to apply.
+ * \param *right	Pointer to the right-hand value.
+ * \return		True if successful; False if the result can't be folded.
+ */
+
+static bool fold_apply(struct fold_value *left, int operator, struct fold_value *right)
+{
+	long long	integer;
+	double		a, b, real;
+
+	/* Strings can only be concatenated. */
+
+	if (left->type == FOLD_STRING || right->type == FOLD_STRING) {
+		if (left->type != FOLD_STRING || right->type != FOLD_STRING || operator != '+' ||
+				left->length + right->length > FOLD_MAX_STRING)
+			return false;
+
+		memcpy(left->string + left->length, right->string, right->length);
+		left->length += right->length;
+		return true;
+	}
+
+	/* Integer arithmetic, refusing anything which overflows. */
+
+	if (left->type == FOLD_INTEGER && right->type == FOLD_INTEGER && operator != '/') {
+		if (operator == '+') {
+			integer = (long long) left->integer + right->integer;
+		} else if (operator == '-') {
+			integer = (long long) left->integer - right->integer;
+		} else if (operator == '*') {
+			integer = (long long) left->integer * right->integer;
+		} else if (right->integer == 0 || (left->integer == INT_MIN && right->integer == -1)) {
+			return false;
+		} else if (operator == parse_get_token(KWD_DIV)) {
+			integer = left->integer / right->integer;
+		} else {
+			integer = left->integer % right->integer;
+		}
+
+		if (integer < INT_MIN || integer > INT_MAX)
+			return false;
+
+		left->integer = integer;
+		return true;
+	}
+
+	/* Real arithmetic, refusing anything which isn't exact. */
+
+	if (operator == parse_get_token(KWD_DIV) || operator == parse_get_token(KWD_MOD))
+		return false;
+
+	a = (left->type == FOLD_INTEGER) ? left->integer : left->real;
+	b = (right->type == FOLD_INTEGER) ? right->integer : right->real;
+
+	if (operator == '+')
+		real = a + b;
+	else if (operator == '-')
+		real = a - b;
+	else if (operator == '*')
+		real = a * b;
+	else if (b != 0)
+		real = a / b;
+	else
+		return false;
+
+	if (!number_is_exact(real))
+		return false;
+
+	left->type = FOLD_REAL;
+	left->real = real;
+
+	return true;
+}
+
+
+/**
+ * Evaluate a condition joined by OR and EOR.
+ *
+ * \param *scan		Pointer to the scan, updated on exit.
+ * \param *value	Pointer to a block to take the result.
+ * \return		True if successful; False if not constant.
+ */
+
+static bool fold_logical(struct parse_scan *scan, struct fold_value *value)
+{
+	struct parse_scan	save;
+	struct fold_value	right;
+	int			item;
+
+	if (!fold_conjunction(scan, value))
+		return false;
+
+	while (true) {
+		save = *scan;
+
+		item = fold_next(scan, NULL);
+		if (item != parse_get_token(KWD_OR) && item != parse_get_token(KWD_EOR)) {
+			*scan = save;
+			return true;
+		}
+
+		if (!fold_conjunction(scan, &right) || value->type != FOLD_INTEGER || right.type != FOLD_INTEGER)
+			return false;
+
+		if (item == parse_get_token(KWD_OR))
+			value->integer |= right.integer;
+		else
+			value->integer ^= right.integer;
+	}
+}
+
+
+/**
+ * Evaluate a condition joined by AND.
+ *
+ * \param *scan		Pointer to the scan, updated on exit.
+ * \param *value	Pointer to a block to take the result.
+ * \return		True if successful; False if not constant.
+ */
+
+static bool fold_conjunction(struct parse_scan *scan, struct fold_value *value)
+{
+	struct parse_scan	save;
+	struct fold_value	right;
+
+	if (!fold_comparison(scan, value))
+		return false;
+
+	while (true) {
+		save = *scan;
+
+		if (fold_next(scan, NULL) != parse_get_token(KWD_AND)) {
+			*scan = save;
+			return true;
+		}
+
+		if (!fold_comparison(scan, &right) || value->type != FOLD_INTEGER || right.type != FOLD_INTEGER)
+			return false;
+
+		value->integer &= right.integer;
+	}
+}
+
+
+/**
+ * Evaluate a comparison between two values, or a single value.
+ *
+ * \param *scan		Pointer to the scan, updated on exit.
+ * \param *value	Pointer to a block to take the result.
+ * \return		True if successful; False if not constant.
+ */
+
+static bool fold_comparison(struct parse_scan *scan, struct fold_value *value)
+{
+	struct parse_scan	save;
+	struct fold_value	right;
+	int			item, second, order;
+	bool			valid, outcome;
+
+	if (!fold_negation(scan, value))
+		return false;
+
+	save = *scan;
+
+	item = fold_next(scan, NULL);
+	if (item != '=' && item != '<' && item != '>') {
+		*scan = save;
+		return true;
+	}
+
+	/* Pick up the second character of <>, <= and >=. */
+
+	save = *scan;
+	second = fold_next(scan, NULL);
+
+	if (!((item == '<' && (second == '>' || second == '=')) || (item == '>' && second == '='))) {
+		*scan = save;
+		second = 0;
+	}
+
+	if (!fold_negation(scan, &right))
+		return false;
+
+	order = fold_compare(value, &right, &valid);
+	if (!valid)
+		return false;
+
+	if (item == '=')
+		outcome = (order == 0);
+	else if (item == '<' && second == '>')
+		outcome = (order != 0);
+	else if (item == '<' && second == '=')
+		outcome = (order <= 0);
+	else if (item == '<')
+		outcome = (order < 0);
+	else if (second == '=')
+		outcome = (order >= 0);
+	else
+		outcome = (order > 0);
+
+	value->type = FOLD_INTEGER;
+	value->integer = (outcome) ? -1 : 0;
+
+	return true;
+}
+
+
+/**
+ * Evaluate TRUE, FALSE, a NOT, or an arithmetic expression. NOT binds as
+ * tightly as unary minus, so it only applies to the single value after it.
+ *
+ * \param *scan		Pointer to the scan, updated on exit.
+ * \param *value	Pointer to a block to take the result.
+ * \return		True if successful; False if not constant.
+ */
+
+static bool fold_negation(struct parse_scan *scan, struct fold_value *value)
+{
+	struct parse_scan	save = *scan;
+	enum fold_level		level;
+	int			item, changes = 0;
+
+	item = fold_next(scan, NULL);
+
+	if (item == parse_get_token(KWD_TRUE) || item == parse_get_token(KWD_FALSE)) {
+		value->type = FOLD_INTEGER;
+		value->integer = (item == parse_get_token(KWD_TRUE)) ? -1 : 0;
+		return true;
+	}
+
+	if (item == parse_get_token(KWD_NOT)) {
+		save = *scan;
+		item = fold_next(scan, NULL);
+		*scan = save;
+
+		if (item == parse_get_token(KWD_NOT) || item == parse_get_token(KWD_TRUE) || item == parse_get_token(KWD_FALSE)) {
+			if (!fold_negation(scan, value))
+				return false;
+		} else if (!fold_unary(scan, value, &level, &changes)) {
+			return false;
+		}
+
+		if (value->type != FOLD_INTEGER)
+			return false;
+
+		value->integer = ~value->integer;
+		return true;
+	}
+
+	*scan = save;
+
+	return fold_expression(scan, value, &level, &changes);
+}
+
+
+/**
+ * Compare two constant values.
+ *
+ * \param *left		Pointer to the left-hand value.
+ * \param *right	Pointer to the right-hand value.
+ * \param *valid	Pointer to a variable set to False if the values
+ *			can't be compared.
+ * \return		Less than, equal to or greater than zero, as the
+ *			left-hand value is less than, equal to or greater
+ *			than the right.
+ */
+
+static int fold_compare(struct fold_value *left, struct fold_value *right, bool *valid)
+{
+	double	a, b;
+	int	result;
+
+	*valid = true;
+
+	if (left->type == FOLD_STRING && right->type == FOLD_STRING) {
+		result = memcmp(left->string, right->string, (left->length < right->length) ? left->length : right->length);
+		return (result != 0) ? result : left->length - right->length;
+	}
+
+	if (left->type == FOLD_STRING || right->type == FOLD_STRING) {
+		*valid = false;
+		return 0;
+	}
+
+	a = (left->type == FOLD_INTEGER) ? left->integer : left->real;
+	b = (right->type == FOLD_INTEGER) ? right->integer : right->real;
+
+	return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+
+/**
+ * Return the next item from a line, as parse_scan_next() but with numbers,
+ * strings and names returned as single items.
+ *
+ * \param *scan		Pointer to the scan to use.
+ * \param *value	Pointer to a block to take the value of a literal,
+ *			or NULL if not required.
+ * \return		The next item.
+ */
+
+static int fold_next(struct parse_scan *scan, struct fold_value *value)
+{
+	struct fold_value	discard;
+	struct number_value	number;
+	char			*end;
+	int			item;
+
+	if (value == NULL)
+		value = &discard;
+
+	item = parse_scan_next(scan);
+
+	if (item == '"')
+		return (fold_read_string(scan->item, scan->position, value)) ? FOLD_ITEM_STRING : FOLD_ITEM_OTHER;
+
+	if ((item >= '0' && item <= '9') || item == '.' || item == '&' || item == '%') {
+		end = number_read(scan->item, scan->end, &number);
+
+		if (end == NULL) {
+			while (scan->position < scan->end && (fold_is_name_body(*scan->position) || *scan->position == '.'))
+				scan->position++;
+			return FOLD_ITEM_OTHER;
+		}
+
+		scan->position = end;
+
+		if (!number.exact)
+			return FOLD_ITEM_OTHER;
+
+
+		value->type = (number.type == NUMBER_INTEGER) ? FOLD_INTEGER : FOLD_REAL;
+		value->integer = number.integer;
+		value->real = number.real;
+
+		return FOLD_ITEM_NUMBER;
+	}
+
+	if (item >= 0 && item < 0x7f && fold_is_name_body(item)) {
+		while (scan->position < scan->end && fold_is_name_body(*scan->position))
+			scan->position++;
+
+		if (scan->position < scan->end && (*scan->position == '%' || *scan->position == '$'))
+			scan->position++;
+
+		return FOLD_ITEM_OTHER;
+	}
+
+	return item;
+}
+
+
+/**
+ * Read a string literal, including its quotes.
+ *
+ * \param *start	Pointer to the opening quote.
+ * \param *end		Pointer to the byte after the closing quote.
+ * \param *value	Pointer to a block to take the value.
+ * \return		True if successful; False if the string isn't terminated.
+ */
+
+static bool fold_read_string(char *start, char *end, struct fold_value *value)
+{
+	value->type = FOLD_STRING;
+	value->length = 0;
+
+	start++;
+
+	while (start < end) {
+		if (*start == '"' && (start + 1 >= end || *(start + 1) != '"'))
+			return (start + 1 == end) ? true : false;
+
+		if (*start == '"')
+			start++;
+
+		if (value->length >= FOLD_MAX_STRING)
+			return false;
+
+		value->string[value->length++] = *start++;
+	}
+
+	return false;
+}
+
+
+/**
+ * Write a constant value out as a BASIC literal.
+ *
+ * \param *value	Pointer to the value to write.
+ * \param *text		Pointer to a buffer to take the literal.
+ * \param length	The size of the buffer.
+ * \return		The length of the literal, or 0 on failure.
+ */
+
+static int fold_write_value(struct fold_value *value, char *text, size_t length)
+{
+	struct number_value	number;
+	char			*write;
+	int			i;
+
+	switch (value->type) {
+	case FOLD_INTEGER:
+	case FOLD_REAL:
+		number.type = (value->type == FOLD_INTEGER) ? NUMBER_INTEGER : NUMBER_REAL;
+		number.integer = value->integer;
+		number.real = value->real;
+		number.exact = true;
+
+		return number_write(&number, text, length, false, true);
+
+	case FOLD_STRING:
+		if (length < 2 * value->length + 3)
+			return 0;
+
+		write = text;
+		*write++ = '"';
+		for (i = 0; i < value->length; i++) {
+			if (value->string[i] == '"')
+				*write++ = '"';
+			*write++ = value->string[i];
+		}
+		*write++ = '"';
+		*write = '\0';
+
+		return write - text;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Test an item to see if it can come before a foldable subexpression,
+ * binding less tightly than any of the operators that might be folded.
+ *
+ * \param item		The item to test.
+ * \return		True if the item is a delimiter; else False.
+ */
+
+static bool fold_is_left_delimiter(int item)
+{
+	switch (item) {
+	case '=':
+	case '(':
+	case ',':
+	case '<':
+	case '>':
+		return true;
+	}
+
+	return (item == parse_get_token(KWD_TO) || item == parse_get_token(KWD_STEP) ||
+			item == parse_get_token(KWD_IF) || item == parse_get_token(KWD_UNTIL) ||
+			item == parse_get_token(KWD_WHILE) || item == parse_get_left_token(KWD_WHILE) ||
+			item == parse_get_token(KWD_CASE) || item == parse_get_left_token(KWD_CASE) ||
+			item == parse_get_token(KWD_WHEN) || item == parse_get_left_token(KWD_WHEN) ||
+			item == parse_get_token(KWD_AND) || item == parse_get_token(KWD_OR) ||
+			item == parse_get_token(KWD_EOR)) ? true : false;
+}
+
+
+/**
+ * Test an item to see if it can follow a foldable subexpression, binding
+ * less tightly than any of the operators that might be folded.
+ *
+ * \param item		The item to test.
+ * \return		True if the item is a delimiter; else False.
+ */
+
+static bool fold_is_right_delimiter(int item)
+{
+	switch (item) {
+	case PARSE_SCAN_END:
+	case ':':
+	case ',':
+	case ')':
+	case ';':
+	case '\'':
+	case '=':
+	case '<':
+	case '>':
+		return true;
+	}
+
+	return (item == parse_get_token(KWD_THEN) || item == parse_get_token(KWD_ELSE) ||
+			item == parse_get_left_token(KWD_ELSE) || item == parse_get_token(KWD_TO) ||
+			item == parse_get_token(KWD_STEP) || item == parse_get_token(KWD_AND) ||
+			item == parse_get_token(KWD_OR) || item == parse_get_token(KWD_EOR) ||
+			item == parse_get_token(KWD_OF)) ? true : false;
+}
+
+
+/**
+ * Test a character to see if it is a valid name body character (alphanumeric,
+ * _ and `), returning true or false.
+ *
+ * \param c		The character to test.
+ * \return		true if the character is valid; else false.
+ */
+
+static bool fold_is_name_body(char c)
+{
+	return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '`') ? true : false;
+}
+
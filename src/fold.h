@@ -0,0 +1,62 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file fold.h
+ *
+ * Constant Expression Folding, interface.
+ */
+
+#ifndef TOKENIZE_FOLD_H
+#define TOKENIZE_FOLD_H
+
+#include <stdbool.h>
+
+#include "parse.h"
+
+
+/**
+ * Fold any constant subexpressions in a tokenised line, replacing them
+ * with a single literal value. The line is updated in place, and can only
+ * get shorter.
+ *
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ * \return		The new length of the line.
+ */
+
+unsigned fold_process_line(char *line);
+
+
+/**
+ * Evaluate a condition, such as that following an IF, if it is built only
+ * from constant values. On success, the scan is left after the condition.
+ *
+ * \param *scan		Pointer to the scan, positioned before the condition.
+ * \param *result	Pointer to a variable to take the outcome.
+ * \return		True if the condition was constant; else False.
+ */
+
+bool fold_evaluate_condition(struct parse_scan *scan, bool *result);
+
+#endif
+
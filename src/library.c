@@ -37,8 +37,12 @@
 
 #include "library.h"
 
+#include "bundle.h"
 #include "msg.h"
+#include "preload.h"
+#include "profile.h"
 #include "string.h"
+#include "trace.h"
 
 #define LIBRARY_MAX_FILENAME 256
 
@@ -60,9 +64,15 @@ static struct library_file	*library_file_head = NULL;
 
 static struct library_path	*library_path_head = NULL;
 
+static unsigned			library_files_added = 0;				/**< The number of files added so far.	*/
+
 static char			library_filename_buffer[LIBRARY_MAX_FILENAME];	/**< Buffer holding the last filename.	*/
 static char			*library_filename = NULL;			/**< Pointer to the last filename.	*/
 
+static bool			library_preloading = false;			/**< True if files are being preloaded.	*/
+
+static void library_queue_preload(char *file);
+
 
 /**
  * Add a combined path definition to the list of library file paths. The
@@ -79,8 +89,11 @@ void library_add_path_combined(char *combined)
 	if (name == NULL)
 		return;
 
+	profile_add_memory(PROFILE_MEMORY_LIBRARY, name);
+
 	path = strchr(name, ':');
 	if (path == NULL) {
+		profile_remove_memory(PROFILE_MEMORY_LIBRARY, name);
 		free(name);
 		return;
 	}
@@ -88,6 +101,7 @@ void library_add_path_combined(char *combined)
 	*path++ = '\0';
 
 	library_add_path(name, path);
+	profile_remove_memory(PROFILE_MEMORY_LIBRARY, name);
 	free(name);
 }
 
@@ -113,6 +127,10 @@ void library_add_path(char *name, char *path)
 	new->name = strdup(name);
 	new->path = strdup(path);
 
+	profile_add_memory(PROFILE_MEMORY_LIBRARY, new);
+	profile_add_memory(PROFILE_MEMORY_LIBRARY, new->name);
+	profile_add_memory(PROFILE_MEMORY_LIBRARY, new->path);
+
 	new->next = library_path_head;
 	library_path_head = new;
 }
@@ -173,6 +191,11 @@ void library_add_file(char *file)
 		return;
 	}
 
+	profile_add_memory(PROFILE_MEMORY_LIBRARY, new);
+	profile_add_memory(PROFILE_MEMORY_LIBRARY, new->file);
+
+	library_files_added++;
+
 	if (library_file_tail == NULL) {
 		library_file_head = new;
 		library_file_tail = new;
@@ -180,12 +203,18 @@ void library_add_file(char *file)
 		library_file_tail->next = new;
 		library_file_tail = new;
 	}
+
+	trace_instant(TRACE_TRACK_MAIN, "library", new->file);
+
+	library_queue_preload(new->file);
 }
 
 
 /**
  * Get the next file to be processed from the library list, as a complete
- * filename ready to be used by the file load routine.
+ * filename ready to be used by the file load routine. A file named - is
+ * taken to be stdin; otherwise, any bundle and preloaded files are checked
+ * before the disc.
  *
  * \return		True if a filename was returned; else false.
  */
@@ -196,22 +225,33 @@ FILE *library_get_file(void)
 	FILE			*file = NULL;
 
 	while (library_file_head != NULL && file == NULL) {
-		file = fopen(library_file_head->file, "r");
+		strncpy(library_filename_buffer, library_file_head->file, LIBRARY_MAX_FILENAME);
+		library_filename = library_filename_buffer;
+
+		if (strcmp(library_file_head->file, LIBRARY_STDIN) == 0) {
+			file = stdin;
+		} else {
+			file = bundle_open_file(library_file_head->file);
+			if (file == NULL)
+				file = preload_open_file(library_file_head->file);
+			if (file == NULL)
+				file = fopen(library_file_head->file, "r");
+		}
 
 		if (file == NULL) {
 			msg_report(MSG_OPEN_FAIL, library_file_head->file);
 			return NULL;
 		}
 
-		strncpy(library_filename_buffer, library_file_head->file, LIBRARY_MAX_FILENAME);
-		library_filename = library_filename_buffer;
-
 		old = library_file_head;
 		library_file_head = library_file_head->next;
 		if (library_file_tail == old)
 			library_file_tail = NULL;
-		if (old->file != NULL)
+		if (old->file != NULL) {
+			profile_remove_memory(PROFILE_MEMORY_LIBRARY, old->file);
 			free(old->file);
+		}
+		profile_remove_memory(PROFILE_MEMORY_LIBRARY, old);
 		free(old);
 	}
 
@@ -220,7 +260,8 @@ FILE *library_get_file(void)
 
 
 /**
- * Get the name of the last file to be opened by the library.
+ * Get the name of the last file that the library tried to open, whether
+ * or not it could be opened.
  *
  * \return		Pointer to the filename, or NULL if none.
  */
@@ -229,3 +270,97 @@ char *library_get_filename(void)
 {
 	return library_filename;
 }
+
+
+/**
+ * Get the number of files which have been added to the library list since
+ * the program started, whether or not they have been processed yet.
+ *
+ * \return		The number of files added.
+ */
+
+unsigned library_get_count(void)
+{
+	return library_files_added;
+}
+
+
+/**
+ * Discard any files which are still waiting to be processed, so that a new
+ * set can be added.
+ */
+
+void library_clear_files(void)
+{
+	struct library_file	*old;
+
+	while (library_file_head != NULL) {
+		old = library_file_head;
+		library_file_head = old->next;
+		profile_remove_memory(PROFILE_MEMORY_LIBRARY, old->file);
+		free(old->file);
+		profile_remove_memory(PROFILE_MEMORY_LIBRARY, old);
+		free(old);
+	}
+
+	library_file_tail = NULL;
+
+	if (library_preloading)
+		preload_clear();
+}
+
+
+/**
+ * Start loading files in the background as soon as they are added to the
+ * list, so that they are ready in memory by the time they are needed.
+ * Any files already on the list are queued straight away.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool library_start_preload(void)
+{
+	struct library_file	*file;
+
+	if (!preload_start())
+		return false;
+
+	library_preloading = true;
+
+	for (file = library_file_head; file != NULL; file = file->next)
+		library_queue_preload(file->file);
+
+	return true;
+}
+
+
+/**
+ * Stop loading files in the background, and free any which were loaded
+ * but not used.
+ */
+
+void library_stop_preload(void)
+{
+	if (!library_preloading)
+		return;
+
+	preload_stop();
+	library_preloading = false;
+}
+
+
+/**
+ * Queue a file to be preloaded, if preloading is in use and the file is to
+ * be read from disc.
+ *
+ * \param *file		Pointer to the name of the file.
+ */
+
+static void library_queue_preload(char *file)
+{
+	if (!library_preloading || strcmp(file, LIBRARY_STDIN) == 0 || bundle_has_file(file))
+		return;
+
+	preload_add_file(file);
+}
+
@@ -32,6 +32,12 @@
 
 #include <stdio.h>
 
+/**
+ * The filename used to represent stdin.
+ */
+
+#define LIBRARY_STDIN "-"
+
 
 /**
  * Add a combined path definition to the list of library file paths. The
@@ -65,7 +71,9 @@ void library_add_file(char *file);
 
 /**
  * Get the next file to be processed from the library list, as a complete
- * filename ready to be used by the file load routine.
+ * filename ready to be used by the file load routine. A file named - is
+ * taken to be stdin; otherwise, any bundle and preloaded files are checked
+ * before the disc.
  *
  * \return		True if a filename was returned; else false.
  */
@@ -74,12 +82,50 @@ FILE *library_get_file(void);
 
 
 /**
- * Get the name of the last file to be opened by the library.
+ * Get the name of the last file that the library tried to open, whether
+ * or not it could be opened.
  *
  * \return		Pointer to the filename, or NULL if none.
  */
 
 char *library_get_filename(void);
 
+
+/**
+ * Get the number of files which have been added to the library list since
+ * the program started, whether or not they have been processed yet.
+ *
+ * \return		The number of files added.
+ */
+
+unsigned library_get_count(void);
+
+
+/**
+ * Discard any files which are still waiting to be processed, so that a new
+ * set can be added.
+ */
+
+void library_clear_files(void);
+
+
+/**
+ * Start loading files in the background as soon as they are added to the
+ * list, so that they are ready in memory by the time they are needed.
+ * Any files already on the list are queued straight away.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool library_start_preload(void);
+
+
+/**
+ * Stop loading files in the background, and free any which were loaded
+ * but not used.
+ */
+
+void library_stop_preload(void);
+
 #endif
 
@@ -0,0 +1,547 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file memo.c
+ *
+ * Source Line Memo, implementation.
+ *
+ * Lines which are byte-for-byte identical, and which start in the same
+ * parser state, tokenise to the same body. The memo holds the body of each
+ * line seen more than once, along with the calls made to the procedure and
+ * variable modules while it was parsed, so that these can be replayed on a
+ * repeat.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local source headers. */
+
+#include "memo.h"
+
+#include "proc.h"
+#include "profile.h"
+#include "variable.h"
+
+#define MEMO_INITIAL_INDEXES 1024
+#define MEMO_MAX_INDEXES 1048576
+#define MEMO_SEEN_BITS 1048576
+#define MEMO_MAX_NAME 1024
+
+/**
+ * The profile counters which only change while a line is parsed, and so
+ * must be added to again when it is replayed.
+ */
+
+static enum profile_counter memo_counters[] = {
+	PROFILE_STATEMENTS,
+	PROFILE_KEYWORDS_FULL,
+	PROFILE_KEYWORDS_ABBREVIATED
+};
+
+#define MEMO_COUNTERS (sizeof(memo_counters) / sizeof(enum profile_counter))
+
+enum memo_call_type {
+	MEMO_CALL_PROC,				/**< A call to proc_process().					*/
+	MEMO_CALL_VARIABLE			/**< A call to variable_process().				*/
+};
+
+/**
+ * A line held in the memo, forming one entry in a linked list. The block
+ * holding the structure continues with the source text, then the tokenised
+ * body, then the calls made while the line was parsed. Each call is stored
+ * as its type, its two flags and its name, one byte each for the first three
+ * and the name terminated by a zero.
+ */
+
+struct memo_line {
+	unsigned		hash;		/**< The hash of the source text and state.			*/
+	unsigned		length;		/**< The length of the source text.				*/
+	unsigned		state;		/**< The parser state at the start of the line.			*/
+
+	unsigned		body_length;	/**< The length of the tokenised body.				*/
+	unsigned		result;		/**< The parser state at the end of the line.			*/
+
+	unsigned		calls_length;	/**< The length of the recorded calls.				*/
+	unsigned		counts[MEMO_COUNTERS]; /**< The amounts added to the profile counters.		*/
+	unsigned		run;		/**< The run in which the line was last used.			*/
+
+	struct memo_line	*next;		/**< Pointer to the next line in the chain, or NULL.		*/
+};
+
+/**
+ * The hash table of lines, which grows as lines are added.
+ */
+
+static struct memo_line	**memo_list = NULL;
+static unsigned		memo_indexes = 0;
+static unsigned		memo_entries = 0;
+
+/**
+ * The number of the current run, for when the memo is kept between runs.
+ */
+
+static unsigned		memo_run = 0;
+
+/**
+ * A bit for each hash value seen; a line is only added to the memo once its
+ * hash has been seen before, so that the memo isn't filled with lines which
+ * never repeat.
+ */
+
+static unsigned char	*memo_seen = NULL;
+
+/**
+ * Set to true if every line should be added to the memo on first sight.
+ */
+
+static bool		memo_keep_all = false;
+
+/**
+ * The hash of the line which was last looked up and not found, and whether
+ * it should be added to the memo once parsed.
+ */
+
+static unsigned		memo_pending_hash = 0;
+static bool		memo_pending_admit = false;
+
+/**
+ * The calls recorded for the line being parsed, in the form in which they
+ * are stored with the line.
+ */
+
+static char		*memo_calls = NULL;
+static unsigned		memo_calls_length = 0;
+static unsigned		memo_calls_size = 0;
+
+/**
+ * The profile counters at the start of the line being parsed.
+ */
+
+static unsigned long	memo_counts[MEMO_COUNTERS];
+
+/**
+ * Set to true if the line being parsed can't be added to the memo.
+ */
+
+static bool		memo_abandoned = false;
+
+static void memo_record_call(enum memo_call_type type, char *name, bool first, bool second);
+static void memo_grow(void);
+static void memo_free_lines(bool all);
+static unsigned memo_find_hash(char *text, unsigned length, unsigned state);
+
+
+/**
+ * Set whether every line should be added to the memo on first sight, rather
+ * than only those which have been seen before.
+ *
+ * \param keep_all	True to add every line; False to add repeats only.
+ */
+
+void memo_set_keep_all(bool keep_all)
+{
+	memo_keep_all = keep_all;
+}
+
+
+/**
+ * Remove all of the lines from the memo, so that nothing is reused from
+ * runs made before the call.
+ */
+
+void memo_clear(void)
+{
+	memo_free_lines(true);
+
+	if (memo_seen != NULL)
+		memset(memo_seen, 0, MEMO_SEEN_BITS / 8);
+}
+
+
+/**
+ * End a run, removing any lines from the memo which weren't used during it
+ * so that lines which have been edited away don't build up.
+ */
+
+void memo_end_run(void)
+{
+	memo_free_lines(false);
+	memo_run++;
+}
+
+
+/**
+ * Start recording the calls made while a new line is parsed, so that they
+ * can be stored with the line if it is added to the memo.
+ */
+
+void memo_start_line(void)
+{
+	unsigned	i;
+
+	memo_calls_length = 0;
+	memo_abandoned = !memo_pending_admit;
+
+	for (i = 0; i < MEMO_COUNTERS; i++)
+		memo_counts[i] = profile_get_count(memo_counters[i]);
+}
+
+
+/**
+ * Record a call to proc_process() made while parsing the current line.
+ *
+ * \param *name		Pointer to the name of the routine.
+ * \param is_function	True if the routine is an FN; False if it is a PROC.
+ * \param is_definition	True if this is a DEF; False for a call.
+ */
+
+void memo_record_proc(char *name, bool is_function, bool is_definition)
+{
+	memo_record_call(MEMO_CALL_PROC, name, is_function, is_definition);
+}
+
+
+/**
+ * Record a call to variable_process() made while parsing the current line.
+ *
+ * \param *name		Pointer to the name of the variable.
+ * \param is_array	True if the variable is an array; else False.
+ * \param statement_left	True if this is an assignment; False for a read.
+ */
+
+void memo_record_variable(char *name, bool is_array, bool statement_left)
+{
+	memo_record_call(MEMO_CALL_VARIABLE, name, is_array, statement_left);
+}
+
+
+/**
+ * Mark the current line as having side effects which can't be recorded, so
+ * that it will not be added to the memo.
+ */
+
+void memo_abandon_line(void)
+{
+	memo_abandoned = true;
+}
+
+
+/**
+ * Add the current line to the memo, along with any calls recorded since
+ * memo_start_line() was called. This must follow an unsuccessful call to
+ * memo_replay_line() for the same line. If the line hasn't been seen before,
+ * or there isn't enough memory, the line is quietly left out: it will just
+ * be parsed again if it repeats.
+ *
+ * \param *text		Pointer to the source text of the line.
+ * \param length	The length of the source text.
+ * \param state		The parser state at the start of the line.
+ * \param *body		Pointer to the tokenised body of the line.
+ * \param body_length	The length of the tokenised body.
+ * \param result	The parser state at the end of the line.
+ */
+
+void memo_store_line(char *text, unsigned length, unsigned state, char *body, unsigned body_length, unsigned result)
+{
+	struct memo_line	*line;
+	char			*data;
+	unsigned		index, i;
+
+	if (memo_abandoned)
+		return;
+
+	if (memo_entries >= memo_indexes)
+		memo_grow();
+
+	if (memo_list == NULL)
+		return;
+
+	line = malloc(sizeof(struct memo_line) + length + body_length + memo_calls_length);
+	if (line == NULL)
+		return;
+
+	profile_add_memory(PROFILE_MEMORY_MEMO, line);
+
+	line->hash = memo_pending_hash;
+	line->length = length;
+	line->state = state;
+	line->body_length = body_length;
+	line->result = result;
+	line->calls_length = memo_calls_length;
+	line->run = memo_run;
+
+	for (i = 0; i < MEMO_COUNTERS; i++)
+		line->counts[i] = profile_get_count(memo_counters[i]) - memo_counts[i];
+
+	data = (char *) (line + 1);
+	memcpy(data, text, length);
+	memcpy(data + length, body, body_length);
+	memcpy(data + length + body_length, memo_calls, memo_calls_length);
+
+	index = line->hash & (memo_indexes - 1);
+	line->next = memo_list[index];
+	memo_list[index] = line;
+	memo_entries++;
+}
+
+
+/**
+ * Look a line up in the memo. If it is found, copy its tokenised body into
+ * the buffer supplied and replay the calls made when it was first parsed.
+ *
+ * \param *text		Pointer to the source text of the line.
+ * \param length	The length of the source text.
+ * \param state		The parser state at the start of the line.
+ * \param *body		Pointer to a buffer to take the tokenised body.
+ * \param *body_length	Pointer to a variable to take the body length.
+ * \param *result	Pointer to a variable to take the parser state at
+ *			the end of the line.
+ * \return		True if the line was found; else False.
+ */
+
+bool memo_replay_line(char *text, unsigned length, unsigned state, char *body, unsigned *body_length, unsigned *result)
+{
+	struct memo_line	*line = NULL;
+	char			name[MEMO_MAX_NAME], *data, *end, *write;
+	unsigned		hash, bit, i;
+
+	hash = memo_find_hash(text, length, state);
+
+	if (memo_list != NULL) {
+		line = memo_list[hash & (memo_indexes - 1)];
+
+		while (line != NULL && (line->hash != hash || line->length != length || line->state != state ||
+				memcmp(line + 1, text, length) != 0))
+			line = line->next;
+	}
+
+	/* If the line isn't there, note whether it has been seen before so
+	 * that memo_store_line() knows whether to keep it.
+	 */
+
+	if (line == NULL) {
+		if (memo_seen == NULL) {
+			memo_seen = calloc(MEMO_SEEN_BITS / 8, 1);
+			profile_add_memory(PROFILE_MEMORY_MEMO, memo_seen);
+		}
+
+		bit = hash & (MEMO_SEEN_BITS - 1);
+
+		memo_pending_hash = hash;
+		memo_pending_admit = memo_keep_all;
+
+		if (memo_seen != NULL) {
+			if (memo_seen[bit / 8] & (1 << (bit % 8)))
+				memo_pending_admit = true;
+			memo_seen[bit / 8] |= 1 << (bit % 8);
+		}
+
+		return false;
+	}
+
+	line->run = memo_run;
+
+	data = (char *) (line + 1) + length;
+
+	memcpy(body, data, line->body_length);
+	*body_length = line->body_length;
+	*result = line->result;
+
+	/* Replay the calls and profile counts, so that the routine and
+	 * variable counts come out as if the line had been parsed again. Any
+	 * constant substitution made by variable_process() is already in the
+	 * body, so it goes into a scratch buffer here.
+	 */
+
+	for (i = 0; i < MEMO_COUNTERS; i++) {
+		if (line->counts[i] > 0)
+			profile_count(memo_counters[i], line->counts[i]);
+	}
+
+	data += line->body_length;
+	end = data + line->calls_length;
+
+	while (data < end) {
+		switch (data[0]) {
+		case MEMO_CALL_PROC:
+			proc_process(data + 3, data[1], data[2]);
+			break;
+		case MEMO_CALL_VARIABLE:
+			snprintf(name, MEMO_MAX_NAME, "%s", data + 3);
+			write = name + strlen(name);
+			variable_process(name, &write, data[1], data[2]);
+			break;
+		}
+
+		data += strlen(data + 3) + 4;
+	}
+
+	return true;
+}
+
+
+/**
+ * Record a call made while parsing the current line. If there isn't enough
+ * memory, the line is abandoned instead.
+ *
+ * \param type		The function which was called.
+ * \param *name		Pointer to the name passed to the function.
+ * \param first		The first flag passed to the function.
+ * \param second	The second flag passed to the function.
+ */
+
+static void memo_record_call(enum memo_call_type type, char *name, bool first, bool second)
+{
+	unsigned	length, size;
+	char		*calls;
+
+	if (memo_abandoned)
+		return;
+
+	length = strlen(name);
+	if (length >= MEMO_MAX_NAME) {
+		memo_abandoned = true;
+		return;
+	}
+
+	/* Extend the buffer if the call won't fit. */
+
+	if (memo_calls_length + length + 4 > memo_calls_size) {
+		size = (memo_calls_size == 0) ? 256 : memo_calls_size;
+		while (memo_calls_length + length + 4 > size)
+			size *= 2;
+
+		profile_remove_memory(PROFILE_MEMORY_MEMO, memo_calls);
+		calls = realloc(memo_calls, size);
+		if (calls == NULL) {
+			profile_add_memory(PROFILE_MEMORY_MEMO, memo_calls);
+			memo_abandoned = true;
+			return;
+		}
+
+		profile_add_memory(PROFILE_MEMORY_MEMO, calls);
+		memo_calls = calls;
+		memo_calls_size = size;
+	}
+
+	calls = memo_calls + memo_calls_length;
+	calls[0] = type;
+	calls[1] = first;
+	calls[2] = second;
+	memcpy(calls + 3, name, length + 1);
+
+	memo_calls_length += length + 4;
+}
+
+
+/**
+ * Double the size of the hash table, or create it if it doesn't exist. If
+ * there isn't enough memory, the table is left as it is.
+ */
+
+static void memo_grow(void)
+{
+	struct memo_line	**list, *line, *next;
+	unsigned		indexes, index, i;
+
+	indexes = (memo_indexes == 0) ? MEMO_INITIAL_INDEXES : memo_indexes * 2;
+	if (indexes > MEMO_MAX_INDEXES)
+		return;
+
+	list = calloc(indexes, sizeof(struct memo_line *));
+	if (list == NULL)
+		return;
+
+	profile_add_memory(PROFILE_MEMORY_MEMO, list);
+
+	for (i = 0; i < memo_indexes; i++) {
+		for (line = memo_list[i]; line != NULL; line = next) {
+			next = line->next;
+			index = line->hash & (indexes - 1);
+			line->next = list[index];
+			list[index] = line;
+		}
+	}
+
+	profile_remove_memory(PROFILE_MEMORY_MEMO, memo_list);
+	free(memo_list);
+
+	memo_list = list;
+	memo_indexes = indexes;
+}
+
+
+/**
+ * Free lines held in the memo.
+ *
+ * \param all		True to free every line; False to free only those
+ *			which weren't used during the current run.
+ */
+
+static void memo_free_lines(bool all)
+{
+	struct memo_line	**link, *line;
+	unsigned		i;
+
+	for (i = 0; i < memo_indexes; i++) {
+		link = &(memo_list[i]);
+
+		while (*link != NULL) {
+			line = *link;
+
+			if (all || line->run != memo_run) {
+				*link = line->next;
+				profile_remove_memory(PROFILE_MEMORY_MEMO, line);
+				free(line);
+				memo_entries--;
+			} else {
+				link = &(line->next);
+			}
+		}
+	}
+}
+
+
+/**
+ * Return an FNV-1a hash of a line of source text and its state.
+ *
+ * \param *text		Pointer to the source text of the line.
+ * \param length	The length of the source text.
+ * \param state		The parser state at the start of the line.
+ * \return		The hash for the line.
+ */
+
+static unsigned memo_find_hash(char *text, unsigned length, unsigned state)
+{
+	unsigned	hash = 2166136261u ^ state;
+
+	while (length-- > 0)
+		hash = (hash ^ (unsigned char) *text++) * 16777619u;
+
+	return hash;
+}
@@ -0,0 +1,134 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file memo.h
+ *
+ * Source Line Memo, interface.
+ */
+
+#ifndef TOKENIZE_MEMO_H
+#define TOKENIZE_MEMO_H
+
+#include <stdbool.h>
+
+
+/**
+ * Set whether every line should be added to the memo on first sight, rather
+ * than only those which have been seen before.
+ *
+ * \param keep_all	True to add every line; False to add repeats only.
+ */
+
+void memo_set_keep_all(bool keep_all);
+
+
+/**
+ * Remove all of the lines from the memo, so that nothing is reused from
+ * runs made before the call.
+ */
+
+void memo_clear(void);
+
+
+/**
+ * End a run, removing any lines from the memo which weren't used during it
+ * so that lines which have been edited away don't build up.
+ */
+
+void memo_end_run(void);
+
+
+/**
+ * Start recording the calls made while a new line is parsed, so that they
+ * can be stored with the line if it is added to the memo.
+ */
+
+void memo_start_line(void);
+
+
+/**
+ * Record a call to proc_process() made while parsing the current line.
+ *
+ * \param *name		Pointer to the name of the routine.
+ * \param is_function	True if the routine is an FN; False if it is a PROC.
+ * \param is_definition	True if this is a DEF; False for a call.
+ */
+
+void memo_record_proc(char *name, bool is_function, bool is_definition);
+
+
+/**
+ * Record a call to variable_process() made while parsing the current line.
+ *
+ * \param *name		Pointer to the name of the variable.
+ * \param is_array	True if the variable is an array; else False.
+ * \param statement_left	True if this is an assignment; False for a read.
+ */
+
+void memo_record_variable(char *name, bool is_array, bool statement_left);
+
+
+/**
+ * Mark the current line as having side effects which can't be recorded, so
+ * that it will not be added to the memo.
+ */
+
+void memo_abandon_line(void);
+
+
+/**
+ * Add the current line to the memo, along with any calls recorded since
+ * memo_start_line() was called. This must follow an unsuccessful call to
+ * memo_replay_line() for the same line.
+ *
+ * \param *text		Pointer to the source text of the line.
+ * \param length	The length of the source text.
+ * \param state		The parser state at the start of the line.
+ * \param *body		Pointer to the tokenised body of the line.
+ * \param body_length	The length of the tokenised body.
+ * \param result	The parser state at the end of the line.
+ */
+
+void memo_store_line(char *text, unsigned length, unsigned state, char *body, unsigned body_length, unsigned result);
+
+
+/**
+ * Look a line up in the memo. If it is found, copy its tokenised body into
+ * the buffer supplied and replay the calls made when it was first parsed.
+ *
+ * \param *text		Pointer to the source text of the line.
+ * \param length	The length of the source text.
+ * \param state		The parser state at the start of the line.
+ * \param *body		Pointer to a buffer to take the tokenised body.
+ * \param *body_length	Pointer to a variable to take the body length.
+ * \param *result	Pointer to a variable to take the parser state at
+ *			the end of the line.
+ * \return		True if the line was found; else False.
+ */
+
+bool memo_replay_line(char *text, unsigned length, unsigned state, char *body, unsigned *body_length, unsigned *result);
+
+#endif
+
@@ -34,12 +34,21 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
 /* Local source headers. */
 
 #include "msg.h"
+#include "profile.h"
 
-#define MSG_MAX_LOCATION_TEXT 256
 #define MSG_MAX_MESSAGE 256
+#define MSG_MAX_COLUMN 32
+#define MSG_MAX_TEXT 1024
+#define MSG_BUFFER_BLOCK 4096
+#define MSG_MAX_NUMBER 32
+#define MSG_BUCKETS 256
 
 enum msg_level {
 	MSG_INFO,
@@ -49,6 +58,7 @@ enum msg_level {
 
 struct msg_data {
 	enum msg_level	level;
+	char		*code;
 	char		*text;
 	bool		show_location;
 };
@@ -62,53 +72,190 @@ struct msg_data {
  */
 
 static struct msg_data msg_messages[] = {
-	{MSG_ERROR,	"Unknown error",				true	},
-	{MSG_ERROR,	"Failed to open source file '%s'",		false	},
-	{MSG_ERROR,	"Constant variable %s already defined",		false	},
-	{MSG_WARNING,	"Constant variable assignment to %s removed",	true	},
-	{MSG_ERROR,	"No room to define variable %s",		false	},
-	{MSG_WARNING,	"Variable %s referenced but not assigned",	false	},
-	{MSG_WARNING,	"Array %s() used but not defined",		false	},
-	{MSG_WARNING,	"Variable %s assigned but not referenced",	false	},
-	{MSG_WARNING,	"Array %s() defined but not used",		false	},
-	{MSG_ERROR,	"No room to define function or procedure %s%s",	false	},
-	{MSG_WARNING,	"No definition found for %s%s",			false	},
-	{MSG_WARNING,	"%s%s defined more than once",			false	},
-	{MSG_WARNING,	"%s%s is defined but not used",			false	},
-	{MSG_ERROR,	"Line number %u out of range",			true	},
-	{MSG_ERROR,	"AUTO line number too large",			true	},
-	{MSG_WARNING,	"Line number %u out of sequence",		true	},
-	{MSG_ERROR,	"Line too long",				true	},
-	{MSG_ERROR,	"Invalid line number constant",			true	},
-	{MSG_WARNING,	"Unterminated string",				true	},
-	{MSG_ERROR,	"Misformed deleted statement",			true	},
-	{MSG_INFO,	"Queue 'LIBRARY \"%s\"' for linking",		true	},
-	{MSG_WARNING,	"Unisolated LIBRARY not linked",		true	},
-	{MSG_WARNING,	"Variable LIBRARY not linked",			true	},
-	{MSG_WARNING,	"SYS \"%s\" not found on lookup",		true	},
-	{MSG_ERROR,	"Failed to load SWI file '%s'",			false	}
+	{MSG_ERROR,	"UNKNOWN_ERROR",	"Unknown error",				true	},
+	{MSG_ERROR,	"OPEN_FAIL",		"Failed to open source file '%s'",		false	},
+	{MSG_ERROR,	"CONST_REDEF",		"Constant variable %s already defined",		false	},
+	{MSG_WARNING,	"CONST_REMOVE",		"Constant variable assignment to %s removed",	true	},
+	{MSG_ERROR,	"VAR_NOMEM",		"No room to define variable %s",		false	},
+	{MSG_WARNING,	"VAR_MISSING_DEF",	"Variable %s referenced but not assigned",	false	},
+	{MSG_WARNING,	"VAR_MISSING_DIM",	"Array %s() used but not defined",		false	},
+	{MSG_WARNING,	"VAR_UNUSED_DEF",	"Variable %s assigned but not referenced",	false	},
+	{MSG_WARNING,	"VAR_UNUSED_DIM",	"Array %s() defined but not used",		false	},
+	{MSG_ERROR,	"PROC_NOMEM",		"No room to define function or procedure %s%s",	false	},
+	{MSG_WARNING,	"PROC_MISSING_DEF",	"No definition found for %s%s",			false	},
+	{MSG_WARNING,	"PROC_MULTIPLE_DEF",	"%s%s defined more than once",			false	},
+	{MSG_WARNING,	"PROC_UNUSED",		"%s%s is defined but not used",			false	},
+	{MSG_ERROR,	"LINE_OUT_OF_RANGE",	"Line number %u out of range",			true	},
+	{MSG_ERROR,	"AUTO_OUT_OF_RANGE",	"AUTO line number too large",			true	},
+	{MSG_WARNING,	"LINE_OUT_OF_SEQUENCE",	"Line number %u out of sequence",		true	},
+	{MSG_ERROR,	"LINE_TOO_LONG",	"Line too long",				true	},
+	{MSG_ERROR,	"BAD_LINE_CONST",	"Invalid line number constant",			true	},
+	{MSG_WARNING,	"BAD_STRING",		"Unterminated string",				true	},
+	{MSG_ERROR,	"BAD_DELETE",		"Misformed deleted statement",			true	},
+	{MSG_INFO,	"QUEUE_LIB",		"Queue 'LIBRARY \"%s\"' for linking",		true	},
+	{MSG_WARNING,	"SKIPPED_LIB",		"Unisolated LIBRARY not linked",		true	},
+	{MSG_WARNING,	"VAR_LIB",		"Variable LIBRARY not linked",			true	},
+	{MSG_WARNING,	"SWI_LOOKUP_FAIL",	"SYS \"%s\" not found on lookup",		true	},
+	{MSG_WARNING,	"ASM_SWI_LOOKUP_FAIL",	"SWI \"%s\" not found on lookup",		true	},
+	{MSG_ERROR,	"SWI_LOAD_FAIL",	"Failed to load SWI file '%s'",			false	},
+	{MSG_ERROR,	"PROGRAM_NOMEM",	"No room to store tokenised program",		false	},
+	{MSG_ERROR,	"CALLS_LOAD_FAIL",	"Failed to load call profile '%s'",		false	},
+	{MSG_WARNING,	"ORDER_SEQUENCE",	"Line %u out of sequence; routines not reordered",	false	},
+	{MSG_WARNING,	"ORDER_COMPUTED",	"Computed line reference at line %u; routines not reordered",	false	},
+	{MSG_WARNING,	"MERGE_COMPUTED",	"Computed line reference at line %u; lines not merged",	false	},
+	{MSG_ERROR,	"CACHE_WRITE_FAIL",	"Failed to create cache file '%s'",		false	},
+	{MSG_ERROR,	"CACHE_READ_FAIL",	"Failed to read cache file '%s'",		false	},
+	{MSG_ERROR,	"BUNDLE_LOAD_FAIL",	"Failed to load bundle file '%s'",		false	},
+	{MSG_ERROR,	"VERIFY_FAIL",		"Tokenised line differs from source, listing as '%s'", true	},
+	{MSG_ERROR,	"TRACE_WRITE_FAIL",	"Failed to write trace file '%s'",		false	}
+};
+
+/**
+ * The location of the line being processed. The file name is not copied, so
+ * the caller must keep it valid for as long as the location is in use.
+ */
+
+struct msg_location {
+	char		*file;		/**< Pointer to the name of the file, or NULL.		*/
+	unsigned	line;		/**< The number of the line in the file.		*/
+	unsigned	column;		/**< The column in the line, from 1, or 0 if unknown.	*/
+};
+
+/**
+ * The message state is kept for each thread, so that jobs running on
+ * different threads don't see each other's locations, errors or messages.
+ */
+
+#ifdef LINUX
+#define MSG_PER_THREAD __thread
+#else
+#define MSG_PER_THREAD
+#endif
+
+static MSG_PER_THREAD struct msg_location	msg_location = {NULL, 0, 0};
+
+/**
+ * A message held for machine-readable output, forming one entry in a linked
+ * list in the order that they were first reported, and in a hash chain.
+ * Repeats of the same message are counted instead of being stored again.
+ */
+
+struct msg_diagnostic {
+	enum msg_type		type;		/**< The type of the message.				*/
+	char			*text;		/**< Pointer to a copy of the message text.		*/
+	char			*file;		/**< Pointer to a copy of the file name, or NULL.	*/
+	unsigned		line;		/**< The line of its first occurrence.			*/
+	unsigned		column;		/**< The column of its first occurrence, or 0.		*/
+	unsigned		count;		/**< The number of times that it was reported.		*/
+
+	struct msg_diagnostic	*next;		/**< Pointer to the next message in the list, or NULL.	*/
+	struct msg_diagnostic	*chain;		/**< Pointer to the next message in the hash chain.	*/
 };
 
-static char	msg_location[MSG_MAX_LOCATION_TEXT];
+/**
+ * The format in which messages are written out.
+ */
+
+static enum msg_format				msg_format = MSG_FORMAT_TEXT;
+
+/**
+ * The messages held for machine-readable output.
+ */
+
+static MSG_PER_THREAD struct msg_diagnostic	*msg_diagnostics_head = NULL;
+static MSG_PER_THREAD struct msg_diagnostic	*msg_diagnostics_tail = NULL;
+static MSG_PER_THREAD struct msg_diagnostic	*msg_diagnostics_hash[MSG_BUCKETS];
 
 /**
  * Set to true if an error is reported.
  */
 
-static bool	msg_error_reported = false;
+static MSG_PER_THREAD bool		msg_error_reported = false;
+
+/**
+ * The number of messages reported so far.
+ */
+
+static MSG_PER_THREAD unsigned		msg_reported = 0;
+
+/**
+ * The function to be passed each message as it is reported, or NULL.
+ */
+
+static MSG_PER_THREAD void		(*msg_record_function)(enum msg_type type, char *message, unsigned line, unsigned column) = NULL;
+
+/**
+ * The buffer holding messages waiting to be written out, and its size and
+ * the amount of it in use. Messages are only buffered if msg_buffering is
+ * true.
+ */
+
+static MSG_PER_THREAD bool		msg_buffering = false;
+static MSG_PER_THREAD char		*msg_buffer = NULL;
+static MSG_PER_THREAD size_t		msg_buffer_size = 0;
+static MSG_PER_THREAD size_t		msg_buffer_used = 0;
+
+/**
+ * The lock held while writing to stderr, so that the messages from one job
+ * aren't broken up by those from another.
+ */
+
+#ifdef LINUX
+static pthread_mutex_t			msg_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void msg_output(enum msg_type type, char *message);
+static void msg_record(enum msg_type type, char *text);
+static void msg_store_diagnostics(void);
+static void msg_free_diagnostics(void);
+static void msg_store_json(char *text);
+static void msg_store_string(char *text);
+static void msg_store_number(unsigned number);
+static void msg_store(char *text, size_t length);
+static void msg_write(char *text, size_t length);
+
+
+/**
+ * Set the format in which messages are written out. This should be done
+ * before any messages are reported.
+ *
+ * \param format	The format to use.
+ */
+
+void msg_set_format(enum msg_format format)
+{
+	msg_format = format;
+}
+
 
 /**
  * Set the location for future messages, in the form of a file and line number
- * relating to the source files.
+ * relating to the source files. This is called for every line, so nothing is
+ * formatted until a message is reported.
  *
  * \param line		The number of the current line.
- * \param *file		Pointer to the name of the current file.
+ * \param *file		Pointer to the name of the current file, which must
+ *			remain valid until the location is changed.
  */
 
 void msg_set_location(unsigned line, char *file)
 {
-	snprintf(msg_location, MSG_MAX_LOCATION_TEXT, "at line %u of '%s'", line, (file != NULL) ? file : "");
-	msg_location[MSG_MAX_LOCATION_TEXT - 1] = '\0';
+	msg_location.file = file;
+	msg_location.line = line;
+	msg_location.column = 0;
+}
+
+
+/**
+ * Set the column within the current line for future messages, until the
+ * location is next set.
+ *
+ * \param column	The column, counting from 1, or 0 if unknown.
+ */
+
+void msg_set_column(unsigned column)
+{
+	msg_location.column = column;
 }
 
 
@@ -121,7 +268,7 @@ void msg_set_location(unsigned line, char *file)
 
 void msg_report(enum msg_type type, ...)
 {
-	char		message[MSG_MAX_MESSAGE], *level;
+	char		message[MSG_MAX_MESSAGE];
 	va_list		ap;
 
 	if (type < 0 || type >= MSG_MAX_MESSAGES)
@@ -133,6 +280,70 @@ void msg_report(enum msg_type type, ...)
 
 	message[MSG_MAX_MESSAGE - 1] = '\0';
 
+	if (msg_record_function != NULL)
+		msg_record_function(type, message, msg_location.line, msg_location.column);
+
+	msg_output(type, message);
+}
+
+
+/**
+ * Report a message again, using the text that it was given when it was first
+ * reported and the current location.
+ *
+ * \param type		The type of the message.
+ * \param *message	Pointer to the text of the message.
+ */
+
+void msg_replay(enum msg_type type, char *message)
+{
+	if (type < 0 || type >= MSG_MAX_MESSAGES)
+		return;
+
+	msg_output(type, message);
+}
+
+
+/**
+ * Set a function to be passed each message as it is reported, along with
+ * the line and column at which it occurred.
+ *
+ * \param recorder	The function to pass messages to, or NULL for none.
+ */
+
+void msg_set_recorder(void (*recorder)(enum msg_type type, char *message, unsigned line, unsigned column))
+{
+	msg_record_function = recorder;
+}
+
+
+/**
+ * Return the number of the line at the current location.
+ *
+ * 
+eturn		The line number.
+ */
+
+unsigned msg_get_line(void)
+{
+	return msg_location.line;
+}
+
+
+/**
+ * Write out a message, or add it to the buffer, at the current location.
+ *
+ * \param type		The type of the message.
+ * \param *message	Pointer to the text of the message.
+ */
+
+static void msg_output(enum msg_type type, char *message)
+{
+	char		text[MSG_MAX_TEXT], column[MSG_MAX_COLUMN], *level;
+	int		length;
+
+	msg_reported++;
+
 	switch (msg_messages[type].level) {
 	case MSG_INFO:
 		level = "Info";
@@ -149,10 +360,373 @@ void msg_report(enum msg_type type, ...)
 		break;
 	}
 
-	if (msg_messages[type].show_location)
-		fprintf(stderr, "%s: %s %s\n", level, message, msg_location);
+	/* Machine-readable messages are written out when the buffer is
+	 * flushed, or straight away if it isn't in use.
+	 */
+
+	if (msg_format != MSG_FORMAT_TEXT) {
+		msg_record(type, message);
+		if (!msg_buffering)
+			msg_flush();
+		return;
+	}
+
+	if (msg_messages[type].show_location && msg_location.file != NULL) {
+		if (msg_location.column > 0)
+			snprintf(column, MSG_MAX_COLUMN, ", column %u", msg_location.column);
+		else
+			*column = '\0';
+
+		length = snprintf(text, MSG_MAX_TEXT, "%s: %s at line %u%s of '%s'\n", level, message,
+				msg_location.line, column, msg_location.file);
+	} else {
+		length = snprintf(text, MSG_MAX_TEXT, "%s: %s\n", level, message);
+	}
+
+	/* If the text was truncated, it still needs to end in a newline. */
+
+	if (length < 0)
+		return;
+
+	if (length >= MSG_MAX_TEXT) {
+		length = MSG_MAX_TEXT - 1;
+		text[length - 1] = '\n';
+	}
+
+	if (msg_buffering)
+		msg_store(text, length);
 	else
-		fprintf(stderr, "%s: %s\n", level, message);
+		msg_write(text, length);
+}
+
+
+/**
+ * Start collecting messages in a buffer, instead of writing them out as they
+ * are reported. Each job should do this when it starts, and write them out
+ * with msg_flush() when it has finished.
+ */
+
+void msg_start_buffer(void)
+{
+	msg_buffering = true;
+}
+
+
+/**
+ * Write out any messages held in the buffer in one go, then go back to
+ * writing messages out as they are reported. For machine-readable output,
+ * a complete document is written each time, even if there are no messages.
+ */
+
+void msg_flush(void)
+{
+	msg_buffering = false;
+
+	if (msg_format != MSG_FORMAT_TEXT) {
+		msg_store_diagnostics();
+		msg_free_diagnostics();
+	}
+
+	if (msg_buffer == NULL)
+		return;
+
+	msg_write(msg_buffer, msg_buffer_used);
+
+	profile_remove_memory(PROFILE_MEMORY_MSG, msg_buffer);
+	free(msg_buffer);
+
+	msg_buffer = NULL;
+	msg_buffer_size = 0;
+	msg_buffer_used = 0;
+}
+
+
+/**
+ * Hold a message for machine-readable output, or count it again if the same
+ * message has already been reported. If there isn't enough memory to hold
+ * it, the message is lost.
+ *
+ * \param type		The type of the message.
+ * \param *text		Pointer to the text of the message.
+ */
+
+static void msg_record(enum msg_type type, char *text)
+{
+	struct msg_diagnostic	*diagnostic;
+	unsigned		hash = type;
+	char			*c;
+
+	for (c = text; *c != '\0'; c++)
+		hash = (hash * 33) + (unsigned char) *c;
+
+	hash %= MSG_BUCKETS;
+
+	for (diagnostic = msg_diagnostics_hash[hash]; diagnostic != NULL; diagnostic = diagnostic->chain) {
+		if (diagnostic->type == type && strcmp(diagnostic->text, text) == 0) {
+			diagnostic->count++;
+			return;
+		}
+	}
+
+	diagnostic = malloc(sizeof(struct msg_diagnostic));
+	if (diagnostic == NULL)
+		return;
+
+	diagnostic->type = type;
+	diagnostic->text = strdup(text);
+	diagnostic->file = NULL;
+	diagnostic->line = 0;
+	diagnostic->column = 0;
+	diagnostic->count = 1;
+	diagnostic->next = NULL;
+
+	if (msg_messages[type].show_location && msg_location.file != NULL) {
+		diagnostic->file = strdup(msg_location.file);
+		diagnostic->line = msg_location.line;
+		diagnostic->column = msg_location.column;
+	}
+
+	if (diagnostic->text == NULL || (msg_messages[type].show_location && msg_location.file != NULL && diagnostic->file == NULL)) {
+		free(diagnostic->text);
+		free(diagnostic->file);
+		free(diagnostic);
+		return;
+	}
+
+	profile_add_memory(PROFILE_MEMORY_MSG, diagnostic);
+	profile_add_memory(PROFILE_MEMORY_MSG, diagnostic->text);
+	profile_add_memory(PROFILE_MEMORY_MSG, diagnostic->file);
+
+	diagnostic->chain = msg_diagnostics_hash[hash];
+	msg_diagnostics_hash[hash] = diagnostic;
+
+	if (msg_diagnostics_tail == NULL)
+		msg_diagnostics_head = diagnostic;
+	else
+		msg_diagnostics_tail->next = diagnostic;
+
+	msg_diagnostics_tail = diagnostic;
+}
+
+
+/**
+ * Add the messages held for machine-readable output to the buffer, as a
+ * complete JSON or SARIF document.
+ */
+
+static void msg_store_diagnostics(void)
+{
+	struct msg_diagnostic	*diagnostic;
+	struct msg_data		*data;
+
+	if (msg_format == MSG_FORMAT_SARIF) {
+		msg_store_string("{\"version\":\"2.1.0\",\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",");
+		msg_store_string("\"runs\":[{\"tool\":{\"driver\":{\"name\":\"Tokenize\",\"version\":\"" BUILD_VERSION "\"}},\"results\":[\n");
+	} else {
+		msg_store_string("{\"tool\":\"Tokenize\",\"version\":\"" BUILD_VERSION "\",\"diagnostics\":[\n");
+	}
+
+	for (diagnostic = msg_diagnostics_head; diagnostic != NULL; diagnostic = diagnostic->next) {
+		data = msg_messages + diagnostic->type;
+
+		if (msg_format == MSG_FORMAT_SARIF) {
+			msg_store_string("{\"ruleId\":\"");
+			msg_store_string(data->code);
+			msg_store_string((data->level == MSG_ERROR) ? "\",\"level\":\"error\"" :
+					(data->level == MSG_WARNING) ? "\",\"level\":\"warning\"" : "\",\"level\":\"note\"");
+			msg_store_string(",\"message\":{\"text\":");
+			msg_store_json(diagnostic->text);
+			msg_store_string("}");
+
+			if (diagnostic->file != NULL) {
+				msg_store_string(",\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":");
+				msg_store_json(diagnostic->file);
+				msg_store_string("},\"region\":{\"startLine\":");
+				msg_store_number(diagnostic->line);
+				if (diagnostic->column > 0) {
+					msg_store_string(",\"startColumn\":");
+					msg_store_number(diagnostic->column);
+				}
+				msg_store_string("}}}]");
+			}
+
+			msg_store_string(",\"occurrenceCount\":");
+			msg_store_number(diagnostic->count);
+		} else {
+			msg_store_string("{\"code\":\"");
+			msg_store_string(data->code);
+			msg_store_string((data->level == MSG_ERROR) ? "\",\"severity\":\"error\"" :
+					(data->level == MSG_WARNING) ? "\",\"severity\":\"warning\"" : "\",\"severity\":\"info\"");
+			msg_store_string(",\"message\":");
+			msg_store_json(diagnostic->text);
+
+			if (diagnostic->file != NULL) {
+				msg_store_string(",\"file\":");
+				msg_store_json(diagnostic->file);
+				msg_store_string(",\"line\":");
+				msg_store_number(diagnostic->line);
+				if (diagnostic->column > 0) {
+					msg_store_string(",\"column\":");
+					msg_store_number(diagnostic->column);
+				}
+			}
+
+			msg_store_string(",\"count\":");
+			msg_store_number(diagnostic->count);
+		}
+
+		msg_store_string((diagnostic->next != NULL) ? "},\n" : "}\n");
+	}
+
+	msg_store_string((msg_format == MSG_FORMAT_SARIF) ? "]}]}\n" : "]}\n");
+}
+
+
+/**
+ * Free the messages held for machine-readable output.
+ */
+
+static void msg_free_diagnostics(void)
+{
+	struct msg_diagnostic	*diagnostic;
+	unsigned		hash;
+
+	while (msg_diagnostics_head != NULL) {
+		diagnostic = msg_diagnostics_head;
+		msg_diagnostics_head = diagnostic->next;
+
+		profile_remove_memory(PROFILE_MEMORY_MSG, diagnostic->text);
+		free(diagnostic->text);
+		profile_remove_memory(PROFILE_MEMORY_MSG, diagnostic->file);
+		free(diagnostic->file);
+		profile_remove_memory(PROFILE_MEMORY_MSG, diagnostic);
+		free(diagnostic);
+	}
+
+	msg_diagnostics_tail = NULL;
+
+	for (hash = 0; hash < MSG_BUCKETS; hash++)
+		msg_diagnostics_hash[hash] = NULL;
+}
+
+
+/**
+ * Add a string to the buffer as a quoted JSON string.
+ *
+ * \param *text		Pointer to the string to add.
+ */
+
+static void msg_store_json(char *text)
+{
+	char	escape[MSG_MAX_NUMBER];
+
+	msg_store("\"", 1);
+
+	for (; *text != '\0'; text++) {
+		if (*text == '"' || *text == '\\') {
+			snprintf(escape, MSG_MAX_NUMBER, "\\%c", *text);
+			msg_store(escape, 2);
+		} else if ((unsigned char) *text < 0x20) {
+			snprintf(escape, MSG_MAX_NUMBER, "\\u%04x", (unsigned char) *text);
+			msg_store(escape, 6);
+		} else {
+			msg_store(text, 1);
+		}
+	}
+
+	msg_store("\"", 1);
+}
+
+
+/**
+ * Add a string to the buffer as it stands.
+ *
+ * \param *text		Pointer to the string to add.
+ */
+
+static void msg_store_string(char *text)
+{
+	msg_store(text, strlen(text));
+}
+
+
+/**
+ * Add a number to the buffer.
+ *
+ * \param number	The number to add.
+ */
+
+static void msg_store_number(unsigned number)
+{
+	char	text[MSG_MAX_NUMBER];
+
+	snprintf(text, MSG_MAX_NUMBER, "%u", number);
+	msg_store_string(text);
+}
+
+
+/**
+ * Add a message to the buffer, extending it if required. If there isn't
+ * enough memory, the buffer is written out to make room.
+ *
+ * \param *text		Pointer to the text of the message.
+ * \param length	The length of the text.
+ */
+
+static void msg_store(char *text, size_t length)
+{
+	char	*buffer;
+	size_t	size;
+
+	if (msg_buffer_used + length > msg_buffer_size) {
+		size = (msg_buffer_size > 0) ? msg_buffer_size : MSG_BUFFER_BLOCK;
+		while (size < msg_buffer_used + length)
+			size *= 2;
+
+		profile_remove_memory(PROFILE_MEMORY_MSG, msg_buffer);
+		buffer = realloc(msg_buffer, size);
+
+		if (buffer == NULL) {
+			profile_add_memory(PROFILE_MEMORY_MSG, msg_buffer);
+
+			if (msg_buffer != NULL)
+				msg_write(msg_buffer, msg_buffer_used);
+
+			msg_buffer_used = 0;
+			msg_write(text, length);
+			return;
+		}
+
+		profile_add_memory(PROFILE_MEMORY_MSG, buffer);
+
+		msg_buffer = buffer;
+		msg_buffer_size = size;
+	}
+
+	memcpy(msg_buffer + msg_buffer_used, text, length);
+	msg_buffer_used += length;
+}
+
+
+/**
+ * Write some message text to stderr.
+ *
+ * \param *text		Pointer to the text to write.
+ * \param length	The length of the text.
+ */
+
+static void msg_write(char *text, size_t length)
+{
+#ifdef LINUX
+	pthread_mutex_lock(&msg_lock);
+#endif
+
+	fwrite(text, sizeof(char), length, stderr);
+	fflush(stderr);
+
+#ifdef LINUX
+	pthread_mutex_unlock(&msg_lock);
+#endif
 }
 
 
@@ -167,3 +741,26 @@ bool msg_errors(void)
 	return msg_error_reported;
 }
 
+
+/**
+ * Forget about any errors which have been reported, so that msg_errors()
+ * only reflects those reported after this call.
+ */
+
+void msg_clear_errors(void)
+{
+	msg_error_reported = false;
+}
+
+
+/**
+ * Return the number of messages which have been reported so far.
+ *
+ * \return		The number of messages reported.
+ */
+
+unsigned msg_count(void)
+{
+	return msg_reported;
+}
+
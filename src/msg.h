@@ -65,22 +65,66 @@ enum msg_type {
 	MSG_SKIPPED_LIB,
 	MSG_VAR_LIB,
 	MSG_SWI_LOOKUP_FAIL,
+	MSG_ASM_SWI_LOOKUP_FAIL,
 	MSG_SWI_LOAD_FAIL,
+	MSG_PROGRAM_NOMEM,
+	MSG_CALLS_LOAD_FAIL,
+	MSG_ORDER_SEQUENCE,
+	MSG_ORDER_COMPUTED,
+	MSG_MERGE_COMPUTED,
+	MSG_CACHE_WRITE_FAIL,
+	MSG_CACHE_READ_FAIL,
+	MSG_BUNDLE_LOAD_FAIL,
+	MSG_VERIFY_FAIL,
+	MSG_TRACE_WRITE_FAIL,
 	MSG_MAX_MESSAGES
 };
 
 
+/**
+ * The formats in which messages can be written out.
+ */
+
+enum msg_format {
+	MSG_FORMAT_TEXT = 0,		/**< One line of text per message.			*/
+	MSG_FORMAT_JSON,		/**< A JSON document of messages for each job.		*/
+	MSG_FORMAT_SARIF		/**< A SARIF 2.1.0 log of messages for each job.		*/
+};
+
+
+/**
+ * Set the format in which messages are written out. This should be done
+ * before any messages are reported.
+ *
+ * \param format	The format to use.
+ */
+
+void msg_set_format(enum msg_format format);
+
+
 /**
  * Set the location for future messages, in the form of a file and line number
- * relating to the source files.
+ * relating to the source files. This is called for every line, so nothing is
+ * formatted until a message is reported.
  *
  * \param line		The number of the current line.
- * \param *file		Pointer to the name of the current file.
+ * \param *file		Pointer to the name of the current file, which must
+ *			remain valid until the location is changed.
  */
 
 void msg_set_location(unsigned line, char *file);
 
 
+/**
+ * Set the column within the current line for future messages, until the
+ * location is next set.
+ *
+ * \param column	The column, counting from 1, or 0 if unknown.
+ */
+
+void msg_set_column(unsigned column);
+
+
 /**
  * Generate a message to the user, based on a range of standard message tokens
  *
@@ -91,6 +135,53 @@ void msg_set_location(unsigned line, char *file);
 void msg_report(enum msg_type type, ...);
 
 
+/**
+ * Report a message again, using the text that it was given when it was first
+ * reported and the current location.
+ *
+ * \param type		The type of the message.
+ * \param *message	Pointer to the text of the message.
+ */
+
+void msg_replay(enum msg_type type, char *message);
+
+
+/**
+ * Set a function to be passed each message as it is reported, along with
+ * the line and column at which it occurred.
+ *
+ * \param recorder	The function to pass messages to, or NULL for none.
+ */
+
+void msg_set_recorder(void (*recorder)(enum msg_type type, char *message, unsigned line, unsigned column));
+
+
+/**
+ * Return the number of the line at the current location.
+ *
+ * \return		The line number.
+ */
+
+unsigned msg_get_line(void);
+
+
+/**
+ * Start collecting messages in a buffer, instead of writing them out as they
+ * are reported. Each job should do this when it starts, and write them out
+ * with msg_flush() when it has finished.
+ */
+
+void msg_start_buffer(void);
+
+
+/**
+ * Write out any messages held in the buffer in one go, then go back to
+ * writing messages out as they are reported.
+ */
+
+void msg_flush(void);
+
+
 /**
  * Indicate whether an error has been reported at any point.
  *
@@ -99,5 +190,22 @@ void msg_report(enum msg_type type, ...);
 
 bool msg_errors(void);
 
+
+/**
+ * Forget about any errors which have been reported, so that msg_errors()
+ * only reflects those reported after this call.
+ */
+
+void msg_clear_errors(void);
+
+
+/**
+ * Return the number of messages which have been reported so far.
+ *
+ * \return		The number of messages reported.
+ */
+
+unsigned msg_count(void);
+
 #endif
 
@@ -0,0 +1,420 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file number.c
+ *
+ * Numeric Literal Handling, implementation.
+ *
+ * BASIC holds reals as a 32-bit mantissa with an 8-bit exponent, so two
+ * literals are treated as equal if they round to the same value at that
+ * precision. Where a literal is held exactly, any replacement must also be
+ * held exactly, so that nothing depends on how BASIC rounds its input.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Local source headers. */
+
+#include "number.h"
+
+#define NUMBER_MANTISSA_BITS 32
+#define NUMBER_MAX_TEXT 64
+#define NUMBER_MAX_PRECISION 17
+
+static bool number_read_exact(unsigned long long mantissa, int exponent);
+static int number_format_real(char *text, size_t length, double real, int precision, bool exponent_form);
+static double number_round(double real);
+static bool number_is_name_body(char c);
+
+
+/**
+ * Read a numeric literal, in decimal, &hex or %binary form, as BASIC would.
+ *
+ * \param *text		Pointer to the first character of the literal.
+ * \param *end		Pointer to the end of the available text.
+ * \param *value	Pointer to a block to take the value.
+ * \return		Pointer to the character after the literal, or NULL
+ *			if the literal couldn't be read.
+ */
+
+char *number_read(char *text, char *end, struct number_value *value)
+{
+	unsigned long long	mantissa = 0;
+	unsigned		bits = 0, limit;
+	int			digits = 0, fraction = 0, exponent = 0, sign = 1, base, digit;
+	bool			real = false, overflow = false;
+	char			buffer[NUMBER_MAX_TEXT], *read = text;
+
+	if (read < end && (*read == '&' || *read == '%')) {
+		base = (*read++ == '&') ? 16 : 2;
+		limit = UINT_MAX / base;
+
+		while (read < end) {
+			if (*read >= '0' && *read <= ((base == 16) ? '9' : '1'))
+				digit = *read - '0';
+			else if (base == 16 && *read >= 'A' && *read <= 'F')
+				digit = *read - 'A' + 10;
+			else if (base == 16 && *read >= 'a' && *read <= 'f')
+				digit = *read - 'a' + 10;
+			else
+				break;
+
+			if (bits > limit)
+				return NULL;
+
+			bits = bits * base + digit;
+			digits++;
+			read++;
+		}
+
+		if (digits == 0 || (read < end && number_is_name_body(*read)))
+			return NULL;
+
+		value->type = NUMBER_INTEGER;
+		value->integer = (int) bits;
+		value->exact = true;
+		return read;
+	}
+
+	while (read < end && ((*read >= '0' && *read <= '9') || (*read == '.' && !real))) {
+		if (*read == '.') {
+			real = true;
+		} else {
+			if (mantissa > (ULLONG_MAX - 9) / 10)
+				overflow = true;
+			else
+				mantissa = mantissa * 10 + (*read - '0');
+
+			if (overflow && !real)
+				exponent++;
+			else if (!overflow && real)
+				fraction++;
+
+			digits++;
+		}
+
+		read++;
+	}
+
+	if (digits == 0)
+		return NULL;
+
+	if (read < end && (*read == 'E' || *read == 'e')) {
+		char *exp = read + 1;
+		int scale = 0;
+
+		if (exp < end && (*exp == '+' || *exp == '-'))
+			sign = (*exp++ == '-') ? -1 : 1;
+
+		if (exp < end && *exp >= '0' && *exp <= '9') {
+			while (exp < end && *exp >= '0' && *exp <= '9') {
+				scale = scale * 10 + (*exp++ - '0');
+				if (scale > 99)
+					return NULL;
+			}
+
+			exponent += sign * scale;
+			real = true;
+			read = exp;
+		}
+	}
+
+	if (read < end && (number_is_name_body(*read) || *read == '.'))
+		return NULL;
+
+	if (!real && !overflow && mantissa <= INT_MAX) {
+		value->type = NUMBER_INTEGER;
+		value->integer = (int) mantissa;
+		value->exact = true;
+		return read;
+	}
+
+	if (read - text >= NUMBER_MAX_TEXT)
+		return NULL;
+
+	memcpy(buffer, text, read - text);
+	buffer[read - text] = '\0';
+
+	value->type = NUMBER_REAL;
+	value->real = number_round(strtod(buffer, NULL));
+
+	if (isinf(value->real) || !number_is_exact(value->real))
+		return NULL;
+
+	value->exact = (!overflow && number_read_exact(mantissa, exponent - fraction)) ? true : false;
+
+	return read;
+}
+
+
+/**
+ * Write a numeric value out as the shortest BASIC literal which reads back
+ * to the same value. Integers use decimal or &hex, whichever is shorter.
+ *
+ * \param *value	Pointer to the value to write.
+ * \param *text		Pointer to a buffer to take the terminated literal.
+ * \param length	The size of the buffer.
+ * \param keep_type	True if the literal must read back as the same type;
+ *			False to allow a whole real to be written as an integer.
+ * \param allow_sign	True to allow a leading minus sign; False to force
+ *			negative integers into &hex, and fail for negative reals.
+ * \return		The length of the literal, or 0 on failure.
+ */
+
+int number_write(struct number_value *value, char *text, size_t length, bool keep_type, bool allow_sign)
+{
+	struct number_value	check;
+	char			candidate[NUMBER_MAX_TEXT], *digits, *end;
+	int			written, best = 0, precision, form;
+	double			target, result;
+
+	if (value->type == NUMBER_INTEGER) {
+		written = snprintf(candidate, NUMBER_MAX_TEXT, "&%X", (unsigned) value->integer);
+		best = snprintf(text, length, "%d", value->integer);
+
+		if ((value->integer < 0 && !allow_sign) || best <= 0 || (size_t) best >= length || written < best) {
+			if ((size_t) written >= length)
+				return 0;
+			strcpy(text, candidate);
+			best = written;
+		}
+
+		return best;
+	}
+
+	if (value->real < 0 && !allow_sign)
+		return 0;
+
+	/* Try each precision in both plain and exponent form, keeping the
+	 * shortest which reads back to the same value.
+	 */
+
+	target = number_round(value->real);
+
+	for (precision = 1; precision <= NUMBER_MAX_PRECISION; precision++) {
+		for (form = 0; form < 2; form++) {
+			written = number_format_real(candidate, NUMBER_MAX_TEXT, value->real, precision, (form == 1) ? true : false);
+			if (written <= 0 || (best > 0 && written >= best) || (size_t) written >= length)
+				continue;
+
+			digits = (*candidate == '-') ? candidate + 1 : candidate;
+
+			end = number_read(digits, candidate + written, &check);
+			if (end != candidate + written || (keep_type && check.type != NUMBER_REAL) ||
+					(value->exact && !check.exact))
+				continue;
+
+			result = (check.type == NUMBER_INTEGER) ? check.integer : check.real;
+			if (number_round((digits != candidate) ? -result : result) != target)
+				continue;
+
+			strcpy(text, candidate);
+			best = written;
+		}
+	}
+
+	return best;
+}
+
+
+/**
+ * Test whether a real value can be held exactly by BASIC, which uses a
+ * 32-bit mantissa and an 8-bit exponent.
+ *
+ * \param real		The value to test.
+ * \return		True if the value is exact; else False.
+ */
+
+bool number_is_exact(double real)
+{
+	double	mantissa;
+	int	exponent;
+
+	if (real == 0)
+		return true;
+
+	if (isnan(real) || isinf(real))
+		return false;
+
+	mantissa = frexp(real, &exponent);
+	if (exponent < -126 || exponent > 127)
+		return false;
+
+	mantissa = ldexp(mantissa, NUMBER_MANTISSA_BITS);
+
+	return (mantissa == (double) (long long) mantissa) ? true : false;
+}
+
+
+/**
+ * Test whether a decimal value, mantissa * 10^exponent, can be held exactly
+ * by BASIC. For a negative exponent, this is only possible if the matching
+ * power of 5 divides into the mantissa, leaving a power of 2 to be applied.
+ *
+ * \param mantissa	The decimal mantissa.
+ * \param exponent	The decimal exponent.
+ * \return		True if the value is exact; else False.
+ */
+
+static bool number_read_exact(unsigned long long mantissa, int exponent)
+{
+	unsigned long long	power;
+	int			twos = 0;
+
+	if (mantissa == 0)
+		return true;
+
+	if (exponent < 0) {
+		for (power = 1; exponent < 0; exponent++) {
+			if (power > mantissa / 5)
+				return false;
+			power *= 5;
+			twos++;
+		}
+
+		if (mantissa % power != 0)
+			return false;
+
+		mantissa /= power;
+	} else {
+		for (; exponent > 0; exponent--) {
+			if (mantissa > ULLONG_MAX / 10)
+				return false;
+			mantissa *= 10;
+		}
+	}
+
+	if (mantissa >= (1ULL << 53))
+		return false;
+
+	return number_is_exact(ldexp((double) mantissa, -twos));
+}
+
+
+/**
+ * Format a real value at a given number of significant figures, tidied
+ * into the shortest form that BASIC will accept: no leading zero before
+ * the point, no trailing zeros after it, and an exponent with no sign or
+ * leading zeros unless needed.
+ *
+ * \param *text		Pointer to a buffer to take the literal.
+ * \param length	The size of the buffer.
+ * \param real		The value to format.
+ * \param precision	The number of significant figures to use.
+ * \param exponent_form	True to always use an exponent; False to use one
+ *			only where printf's %G would.
+ * \return		The length of the literal, or 0 on failure.
+ */
+
+static int number_format_real(char *text, size_t length, double real, int precision, bool exponent_form)
+{
+	char	*exponent, *digits, *point, *end;
+	int	written;
+
+	if (exponent_form)
+		written = snprintf(text, length, "%.*E", precision - 1, real);
+	else
+		written = snprintf(text, length, "%.*G", precision, real);
+
+	if (written <= 0 || (size_t) written >= length)
+		return 0;
+
+	/* Tidy the exponent, if there is one. */
+
+	exponent = strchr(text, 'E');
+	if (exponent != NULL) {
+		digits = exponent + 1;
+		end = digits;
+		if (*end == '+')
+			end++;
+		else if (*end == '-')
+			*digits++ = *end++;
+		while (*end == '0' && *(end + 1) != '\0')
+			end++;
+		memmove(digits, end, strlen(end) + 1);
+	}
+
+	/* Remove trailing zeros from the fractional part. */
+
+	point = strchr(text, '.');
+	if (point != NULL) {
+		end = (exponent != NULL) ? exponent : text + strlen(text);
+		digits = end;
+		while (digits > point + 1 && *(digits - 1) == '0')
+			digits--;
+		if (digits == point + 1)
+			digits = point;
+		memmove(digits, end, strlen(end) + 1);
+	}
+
+	/* Remove a leading zero before the point. */
+
+	digits = (*text == '-') ? text + 1 : text;
+	if (*digits == '0' && *(digits + 1) == '.')
+		memmove(digits, digits + 1, strlen(digits + 1) + 1);
+
+	return strlen(text);
+}
+
+
+/**
+ * Round a real value to the precision that BASIC holds it to.
+ *
+ * \param real		The value to round.
+ * \return		The rounded value.
+ */
+
+static double number_round(double real)
+{
+	double	mantissa;
+	int	exponent;
+
+	if (real == 0 || isnan(real) || isinf(real))
+		return real;
+
+	mantissa = ldexp(frexp(real, &exponent), NUMBER_MANTISSA_BITS);
+	mantissa = (double) (long long) (mantissa + ((mantissa < 0) ? -0.5 : 0.5));
+
+	return ldexp(mantissa, exponent - NUMBER_MANTISSA_BITS);
+}
+
+
+/**
+ * Test a character to see if it is a valid name body character (alphanumeric,
+ * _ and `), returning true or false.
+ *
+ * \param c		The character to test.
+ * \return		true if the character is valid; else false.
+ */
+
+static bool number_is_name_body(char c)
+{
+	return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '`') ? true : false;
+}
+
@@ -0,0 +1,97 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file number.h
+ *
+ * Numeric Literal Handling, interface.
+ */
+
+#ifndef TOKENIZE_NUMBER_H
+#define TOKENIZE_NUMBER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * The types of numeric value known to BASIC.
+ */
+
+enum number_type {
+	NUMBER_INTEGER,				/**< The value is an integer.					*/
+	NUMBER_REAL				/**< The value is a real.					*/
+};
+
+/**
+ * A numeric value, as read from a literal.
+ */
+
+struct number_value {
+	enum number_type	type;		/**< The type of the value.					*/
+	int			integer;	/**< The value, if an integer.					*/
+	double			real;		/**< The value, if a real, rounded as BASIC would hold it.	*/
+	bool			exact;		/**< True if BASIC holds the value exactly as written.		*/
+};
+
+
+/**
+ * Read a numeric literal, in decimal, &hex or %binary form, as BASIC would.
+ *
+ * \param *text		Pointer to the first character of the literal.
+ * \param *end		Pointer to the end of the available text.
+ * \param *value	Pointer to a block to take the value.
+ * \return		Pointer to the character after the literal, or NULL
+ *			if the literal couldn't be read.
+ */
+
+char *number_read(char *text, char *end, struct number_value *value);
+
+
+/**
+ * Write a numeric value out as the shortest BASIC literal which reads back
+ * to the same value. Integers use decimal or &hex, whichever is shorter.
+ *
+ * \param *value	Pointer to the value to write.
+ * \param *text		Pointer to a buffer to take the terminated literal.
+ * \param length	The size of the buffer.
+ * \param keep_type	True if the literal must read back as the same type;
+ *			False to allow a whole real to be written as an integer.
+ * \param allow_sign	True to allow a leading minus sign; False to force
+ *			negative integers into &hex, and fail for negative reals.
+ * \return		The length of the literal, or 0 on failure.
+ */
+
+int number_write(struct number_value *value, char *text, size_t length, bool keep_type, bool allow_sign);
+
+
+/**
+ * Test whether a real value can be held exactly by BASIC.
+ *
+ * \param real		The value to test.
+ * \return		True if the value is exact; else False.
+ */
+
+bool number_is_exact(double real);
+
+#endif
+
@@ -43,9 +43,15 @@
 #include "parse.h"
 
 #include "asm.h"
+#include "cache.h"
+#include "fold.h"
 #include "library.h"
+#include "memo.h"
 #include "msg.h"
+#include "number.h"
 #include "proc.h"
+#include "profile.h"
+#include "stats.h"
 #include "swi.h"
 #include "variable.h"
 
@@ -56,8 +62,15 @@
 #define PARSE_BUFFER_LEN 1024
 #define MAX_LINE_LENGTH 256
 #define HEAD_LENGTH 4
+#define PARSE_MAX_NUMBER 64
 
-#define TOKEN_CONST 0x8d
+/**
+ * Flags making up the parser state held in the line memo.
+ */
+
+#define PARSE_MEMO_ASSEMBLER 0x01
+#define PARSE_MEMO_CRUNCH_REMS 0x02
+#define PARSE_MEMO_DELETED 0x04
 
 #define parse_output_length(p) ((p) - parse_buffer)
 
@@ -328,14 +341,17 @@ static char parse_buffer[PARSE_BUFFER_LEN];
 static char library_path[PARSE_BUFFER_LEN];
 
 
+static bool parse_process_statements(char *start, char *read, char **output, struct parse_options *options, bool *assembler, bool line_empty, bool *deleted);
 static enum parse_status parse_process_statement(char **read, char **write, int *real_pos, struct parse_options *options, bool *assembler, bool line_start);
 static enum parse_keyword parse_match_token(char **buffer);
 static bool parse_process_string(char **read, char **write, char *dump);
-static bool parse_process_numeric_constant(char **read, char **write);
+static bool parse_process_numeric_constant(char **read, char **write, bool shorten);
 static bool parse_process_binary_constant(char **read, char **write, int *extra_spaces);
 static void parse_process_fnproc(char **read, char **write);
 static void parse_process_variable(char **read, char **write);
 static void parse_process_whitespace(char **read, char **write, int extra_spaces, struct parse_options *options);
+static void parse_process_assembler_whitespace(char **read, char **write, char *start);
+static void parse_skip_assembler_comment(char **read);
 static void parse_process_to_line_end(char **read, char **write, int extra_spaces, struct parse_options *options, bool expand_tabs);
 static void parse_expand_tab(char **read, char **write, int extra_spaces, struct parse_options *options);
 static bool parse_is_name_body(char c);
@@ -361,13 +377,11 @@ char *parse_process_line(char *line, struct parse_options *options, bool *assemb
 	char			*read = line, *write = parse_buffer, *start;
 	int			read_number = -1;
 	int			leading_spaces = 0;
-	enum parse_status	status = PARSE_COMPLETE;
+	unsigned		memo_length, memo_state, memo_result, body_length, messages;
 
-	bool	line_start = true;		/**< True while we're at the start of a line.				*/
-	int	real_pos = 0;			/**< The real position in the line, including expanded keywords.	*/
 	bool	all_deleted = true;		/**< True while all the statements on the line have been deleted.	*/
-	int	statements = 0;			/**< The number of statements found on the line.			*/
 	bool	line_empty = false;		/**< Set to true if the line has nothing after the line number.		*/
+	bool	line_assembler = *assembler;	/**< True if the line started in an assembler block.			*/
 
 	/* Skip any leading whitespace on the line. */
 
@@ -411,14 +425,115 @@ char *parse_process_line(char *line, struct parse_options *options, bool *assemb
 	*write++ = 0;		/* Line number low byte placeholder.	*/
 	*write++ = 0;		/* Line length placeholder.		*/
 
-	/* Unless we're stripping all whitespace, output the line indent. */
-
 	if (leading_spaces > (MAX_LINE_LENGTH - HEAD_LENGTH)) {
 		msg_report(MSG_LINE_TOO_LONG);
 		return NULL;
 	}
 
-	if (!options->crunch_indent) {
+	/* If the memo is in use, look for an identical line which started in
+	 * the same state: if there is one, its body can be reused. Otherwise,
+	 * process the statements and add the result to the memo, so long as
+	 * no messages were reported along the way.
+	 */
+
+	if (options->memo_lines) {
+		for (memo_length = 0; start[memo_length] != '\n'; memo_length++);
+
+		memo_state = ((*assembler) ? PARSE_MEMO_ASSEMBLER : 0) | ((options->crunch_rems) ? PARSE_MEMO_CRUNCH_REMS : 0);
+
+		if (memo_replay_line(start, memo_length, memo_state, write, &body_length, &memo_result)) {
+			write += body_length;
+			*assembler = (memo_result & PARSE_MEMO_ASSEMBLER) ? true : false;
+			all_deleted = (memo_result & PARSE_MEMO_DELETED) ? true : false;
+			if (memo_result & PARSE_MEMO_CRUNCH_REMS)
+				options->crunch_rems = true;
+		} else {
+			memo_start_line();
+			messages = msg_count();
+
+			if (!parse_process_statements(start, read, &write, options, assembler, line_empty, &all_deleted))
+				return NULL;
+
+			memo_result = ((*assembler) ? PARSE_MEMO_ASSEMBLER : 0) | ((options->crunch_rems) ? PARSE_MEMO_CRUNCH_REMS : 0) |
+					((all_deleted) ? PARSE_MEMO_DELETED : 0);
+
+			if (msg_count() == messages)
+				memo_store_line(start, memo_length, memo_state, parse_buffer + HEAD_LENGTH, write - parse_buffer - HEAD_LENGTH, memo_result);
+		}
+	} else if (!parse_process_statements(start, read, &write, options, assembler, line_empty, &all_deleted)) {
+		return NULL;
+	}
+
+	/* If all the statements in the line were deleted, then it doesn't want
+	 * to be written. We report this back by setting the first byte of the
+	 * buffer to zero: since this is defined to always be \r, it clearly
+	 * marks the line as valid but empty.
+	 *
+	 * Otherwise, write the line length and terminate the output buffer. */
+
+	if (all_deleted == true) {
+		*parse_buffer = '\0';
+	} else {
+		if (read_number != -1) {
+			*line_number = read_number;
+		} else if (*line_number == -1) {
+			*line_number = options->line_start;
+		} else {
+			*line_number += options->line_increment;
+			if (*line_number > PARSE_MAX_LINE_NUMBER) {
+				msg_report(MSG_AUTO_OUT_OF_RANGE);
+				return NULL;
+			}
+		}
+
+		*(parse_buffer + 1) = (*line_number & 0xff00) >> 8;
+		*(parse_buffer + 2) = (*line_number & 0x00ff);
+		*(parse_buffer + 3) = (write - parse_buffer) & 0xff;
+
+		/* Fold constant expressions, which can only shorten the line. */
+
+		if (options->crunch_fold && !line_assembler && !*assembler)
+			write = parse_buffer + fold_process_line(parse_buffer);
+
+		*write = '\0';
+	}
+
+	return parse_buffer;
+}
+
+
+/**
+ * Process the statements on a line, following any line number, writing the
+ * tokenised form to the output buffer.
+ *
+ * \param *start	Pointer to the start of the line's indent.
+ * \param *read		Pointer to the first character after the indent.
+ * \param **output	Pointer to the output buffer write pointer, which will
+ *			be updated on exit.
+ * \param *options	Parse options block to set the configuration.
+ * \param *assembler	Pointer to a boolean which is TRUE if we are in an
+ *			assember section and FALSE otherwise; updated on exit.
+ * \param line_empty	True if the line has nothing after the line number.
+ * \param *deleted	Pointer to a variable to be set to True if all of
+ *			the statements on the line were deleted.
+ * \return		True if successful; False on error.
+ */
+
+static bool parse_process_statements(char *start, char *read, char **output, struct parse_options *options, bool *assembler, bool line_empty, bool *deleted)
+{
+	char			*write = *output;
+	enum parse_status	status = PARSE_COMPLETE;
+
+	bool	line_start = true;		/**< True while we're at the start of a line.				*/
+	int	real_pos = 0;			/**< The real position in the line, including expanded keywords.	*/
+	bool	all_deleted = true;		/**< True while all the statements on the line have been deleted.	*/
+	int	statements = 0;			/**< The number of statements found on the line.			*/
+
+	/* Unless we're stripping all whitespace, output the line indent. Lines
+	 * inside an assembler block lose it when assembler is being crunched.
+	 */
+
+	if (!options->crunch_indent && !(options->crunch_assembler && *assembler)) {
 		while (start < read) {
 			if (*start == '\t')
 				parse_expand_tab(&start, &write, 0, options);
@@ -444,6 +559,7 @@ char *parse_process_line(char *line, struct parse_options *options, bool *assemb
 	while (*read != '\n') {
 		status = parse_process_statement(&read, &write, &real_pos, options, assembler, line_start);
 		statements++;
+		profile_count(PROFILE_STATEMENTS, 1);
 
 		if (status == PARSE_DELETED) {
 			/* If the statement was deleted, remove any following separator. */
@@ -481,7 +597,7 @@ char *parse_process_line(char *line, struct parse_options *options, bool *assemb
 				real_pos++;
 			} else if (parse_output_length(write) >= MAX_LINE_LENGTH) {
 				msg_report(MSG_LINE_TOO_LONG);
-				return NULL;
+				return false;
 			}
 
 			/* If this isn't a comment, and we're due to remove all of the
@@ -511,7 +627,7 @@ char *parse_process_line(char *line, struct parse_options *options, bool *assemb
 				break;
 			}
 
-			return NULL;
+			return false;
 		}
 
 		line_start = false;
@@ -543,35 +659,10 @@ char *parse_process_line(char *line, struct parse_options *options, bool *assemb
 			write--;
 	}
 
-	/* If all the statements in the line were deleted, then it doesn't want
-	 * to be written. We report this back by setting the first byte of the
-	 * buffer to zero: since this is defined to always be \r, it clearly
-	 * marks the line as valid but empty.
-	 *
-	 * Otherwise, write the line length and terminate the output buffer. */
+	*output = write;
+	*deleted = all_deleted;
 
-	if (all_deleted == true) {
-		*parse_buffer = '\0';
-	} else {
-		if (read_number != -1) {
-			*line_number = read_number;
-		} else if (*line_number == -1) {
-			*line_number = options->line_start;
-		} else {
-			*line_number += options->line_increment;
-			if (*line_number > PARSE_MAX_LINE_NUMBER) {
-				msg_report(MSG_AUTO_OUT_OF_RANGE);
-				return NULL;
-			}
-		}
-
-		*(parse_buffer + 1) = (*line_number & 0xff00) >> 8;
-		*(parse_buffer + 2) = (*line_number & 0x00ff);
-		*(parse_buffer + 3) = (write - parse_buffer) & 0xff;
-		*write = '\0';
-	}
-
-	return parse_buffer;
+	return true;
 }
 
 
@@ -627,6 +718,7 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 
 		if (*assembler == true && !assembler_comment && **read == '[') {
 			/* Open a matched [...] in assembler. */
+			stats_count_branch(STATS_ASSEMBLER_BRACKET);
 			bracket_count++;
 			*(*write)++ = *(*read)++;
 
@@ -640,6 +732,7 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			clean_to_end = false;
 		} else if (*assembler == true && !assembler_comment && **read == ']' && bracket_count > 0) {
 			/* Close a matched [...] in assembler. */
+			stats_count_branch(STATS_ASSEMBLER_BRACKET);
 			bracket_count--;
 			*(*write)++ = *(*read)++;
 
@@ -653,6 +746,7 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			clean_to_end = false;
 		} else if (*assembler == true && !assembler_comment && **read == ']') {
 			/* An unmatched ] in a statememt terminates the assember. */
+			stats_count_branch(STATS_ASSEMBLER_BRACKET);
 			*assembler = false;
 			*(*write)++ = *(*read)++;
 
@@ -664,8 +758,23 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			sys_state = SYS_NONE;
 			definition_state = DEF_NONE;
 			clean_to_end = false;
+		} else if (*assembler == true && !assembler_comment && (**read == ';' || **read == '\\') && options->crunch_assembler) {
+			/* An assembler comment which is to be removed, along with
+			 * any whitespace before it.
+			 */
+			stats_count_branch(STATS_ASSEMBLER_COMMENT);
+			parse_skip_assembler_comment(read);
+
+			while (*write > start_pos && *(*write - 1) == ' ')
+				(*write)--;
+
+			if (*write == start_pos) {
+				status = PARSE_DELETED;
+				clean_to_end = true;
+			}
 		} else if (*assembler == true && !assembler_comment && (**read == ';' || **read == '\\')) {
 			/* An assembler comment, so parsing needs to relax. */
+			stats_count_branch(STATS_ASSEMBLER_COMMENT);
 			assembler_comment = true;
 			*(*write)++ = *(*read)++;
 
@@ -680,6 +789,8 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 		} else if (**read == '[' && *assembler == false) {
 			/* This is the start of an assembler block. */
 
+			stats_count_branch(STATS_ASSEMBLER_BRACKET);
+
 			*assembler = true;
 			*(*write)++ = *(*read)++;
 
@@ -695,25 +806,56 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			clean_to_end = false;
 		} else if (**read == '\"') {
 			/* Copy strings as a lump, but not from assembler comments. */
-			char *string_start = *write;
+			char *string_start = *write, *next;
 			long swi_number;
-			
-			if (!parse_process_string(read, write, (library_path_due == true || sys_state == SYS_NAME) ? library_path : NULL) && !assembler_comment)
+			bool swi_name = false;
+
+			stats_count_branch(STATS_STRING);
+
+			/* In assembler, a string which is the whole operand of a
+			 * SWI or SVC instruction is a SWI name.
+			 */
+
+			if (*assembler == true && !assembler_comment && options->convert_swis && asm_is_swi_operand()) {
+				next = string_start;
+				while (next > start_pos && *(next - 1) == ' ')
+					next--;
+
+				swi_name = (next > start_pos && parse_is_name_body(*(next - 1))) ? true : false;
+			}
+
+			if (!parse_process_string(read, write, (library_path_due == true || sys_state == SYS_NAME || swi_name) ? library_path : NULL) && !assembler_comment)
 				msg_report(MSG_BAD_STRING);
 
 			clean_to_end = false;
 
+			if (swi_name) {
+				next = *read;
+				while (*next == ' ' || *next == '\t')
+					next++;
+
+				if (*next != ':' && *next != '\n' && *next != ';' && *next != '\\')
+					swi_name = false;
+			}
+
 			if (library_path_due && *library_path != '\0' && options->link_libraries) {
 				library_add_file(library_path);
+				cache_add_library(library_path);
+				profile_count(PROFILE_LIBRARIES, 1);
+				memo_abandon_line();
 				clean_to_end = true;
 				status = PARSE_DELETED;
 				if (options->verbose_output)
 					msg_report(MSG_QUEUE_LIB, library_path);
-			} else if (sys_state == SYS_NAME && *library_path != '\0' && options->convert_swis) {
+			} else if ((sys_state == SYS_NAME || swi_name) && *library_path != '\0' && options->convert_swis) {
+				profile_start(PROFILE_SWI_LOOKUP);
 				swi_number = swi_get_number_from_name(library_path);
+				profile_stop(PROFILE_SWI_LOOKUP);
 
 				if (swi_number != -1)
 					*write = string_start + snprintf(string_start, 9, "&%lX", swi_number);
+				else if (swi_name)
+					msg_report(MSG_ASM_SWI_LOOKUP_FAIL, library_path);
 				else
 					msg_report(MSG_SWI_LOOKUP_FAIL, library_path);
 			}
@@ -730,6 +872,11 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			unsigned	bytes;
 			char		*fnproc_name;
 
+			/* A keyword can only end in a . if it was abbreviated. */
+
+			stats_count_branch(STATS_KEYWORD);
+			stats_count_keyword(token, (*(*read - 1) == '.') ? true : false);
+
 			/* ELSE needs to be tokenised differently if it is at the
 			 * start of a line. Oterwise what matters is if we're on
 			 * the left- or right-hand side of a statement or not, to
@@ -797,7 +944,11 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 				fnproc_name = *write;
 				parse_process_fnproc(read, write);
 				**write = '\0';
+				profile_start(PROFILE_LOOKUP);
 				proc_process(fnproc_name, token == KWD_FN, definition_state == DEF_SEEN);
+				profile_stop(PROFILE_LOOKUP);
+				if (options->memo_lines)
+					memo_record_proc(fnproc_name, token == KWD_FN, definition_state == DEF_SEEN);
 				if (definition_state == DEF_SEEN)
 					definition_state = DEF_NAME;
 				break;
@@ -856,8 +1007,11 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 				break;
 			}
 
-			if (*assembler == true)
+			if (*assembler == true) {
+				profile_start(PROFILE_ASSEMBLER);
 				asm_process_keyword(token);
+				profile_stop(PROFILE_ASSEMBLER);
+			}
 
 			if (token != KWD_DEF && token != KWD_FN && token != KWD_PROC &&
 					(token != KWD_RETURN || (definition_state != DEF_ASSIGN && definition_state != DEF_READ)))
@@ -868,8 +1022,9 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 		} else if ((**read >= '0' && **read <= '9') && constant_due) {
 			/* Handle binary line number constants, falling back
 			 * to textual ones if the value is out of range. */
+			stats_count_branch(STATS_LINE_NUMBER);
 			if (!parse_process_binary_constant(read, write, &extra_spaces))
-				parse_process_numeric_constant(read, write);
+				parse_process_numeric_constant(read, write, false);
 
 			statement_start = false;
 			line_start = false;
@@ -883,6 +1038,15 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			bool indirection = false;
 			bool array = false;
 			bool assignment = false;
+			bool deleted;
+
+			/* Names starting with an upper case letter have already
+			 * failed to match a keyword.
+			 */
+
+			stats_count_branch(STATS_VARIABLE);
+			if (**read >= 'A' && **read <= 'Z')
+				stats_count_keyword_miss();
 
 			parse_process_variable(read, write);
 
@@ -896,8 +1060,11 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			 * the variable module for processing.
 			 */
 
-			if (*assembler == true)
+			if (*assembler == true) {
+				profile_start(PROFILE_ASSEMBLER);
 				asm_process_variable(&variable_name);
+				profile_stop(PROFILE_ASSEMBLER);
+			}
 
 			/* A variable is considered to be getting assigned to if:
 			 * - it's on statement left and is either string or not followed by ! or ?,
@@ -936,7 +1103,14 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			 * are!
 			 */
 
-			if (!assembler_comment && variable_process(variable_name, write, array, assignment)) {
+			if (!assembler_comment && options->memo_lines)
+				memo_record_variable(variable_name, array, assignment);
+
+			profile_start(PROFILE_LOOKUP);
+			deleted = !assembler_comment && variable_process(variable_name, write, array, assignment);
+			profile_stop(PROFILE_LOOKUP);
+
+			if (deleted) {
 				msg_report(MSG_CONST_REMOVE, variable_name);
 				status = PARSE_DELETED;
 				no_clean_check = true;
@@ -956,7 +1130,8 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			clean_to_end = false;
 		} else if ((**read >= '0' && **read <= '9') || **read == '&' || **read == '%' || **read == '.') {
 			/* Handle numeric constants. */
-			if (parse_process_numeric_constant(read, write)) {
+			stats_count_branch(STATS_NUMERIC);
+			if (parse_process_numeric_constant(read, write, options->crunch_numbers && !*assembler && !constant_due)) {
 				constant_due = false;
 				statement_left = false;
 			}
@@ -970,15 +1145,27 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 		} else if (**read == '*' && statement_left) {
 			/* It's a star command, so run out to the end of the line. */
 
+			stats_count_branch(STATS_STAR_COMMAND);
+
 			parse_process_to_line_end(read, write, *real_pos + extra_spaces, options, false);
 			clean_to_end = false;
+		} else if (isspace(**read) && *assembler == true && !assembler_comment && options->crunch_assembler) {
+			/* Handle whitespace in assembler. */
+
+			stats_count_branch(STATS_WHITESPACE);
+
+			parse_process_assembler_whitespace(read, write, start_pos);
 		} else if (isspace(**read)) {
 			/* Handle whitespace. */
 
+			stats_count_branch(STATS_WHITESPACE);
+
 			parse_process_whitespace(read, write, *real_pos + extra_spaces, options);
 		} else {
 			/* Handle eveything else. */
 
+			stats_count_branch(STATS_OTHER);
+
 			statement_start = false;
 			line_start = false;
 			library_path_due = false;
@@ -999,8 +1186,11 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 			 * part of FN or PROC parameters.
 			 */
 
-			if (*assembler == true && definition_state != DEF_ASSIGN && definition_state != DEF_READ && **read == ',')
+			if (*assembler == true && definition_state != DEF_ASSIGN && definition_state != DEF_READ && **read == ',') {
+				profile_start(PROFILE_ASSEMBLER);
 				asm_process_comma();
+				profile_stop(PROFILE_ASSEMBLER);
+			}
 
 			/* "Assignment Lists" follow INPUT, INPUT#, INPUT LINE, LINE INPUT,
 			 * MOUSE and READ. The variables that they contain are considered
@@ -1067,11 +1257,11 @@ static enum parse_status parse_process_statement(char **read, char **write, int
 		return PARSE_ERROR_TOO_LONG;
 	}
 
-	/* If the statement is only whitespace, and we're removing empty statements,
-	 * flag the statement to be deleted.
+	/* If the statement is only whitespace, and we're removing empty statements
+	 * or it's in assembler which is being crunched, flag it to be deleted.
 	 */
 
-	if (status == PARSE_WHITESPACE && options->crunch_empty) {
+	if (status == PARSE_WHITESPACE && (options->crunch_empty || (options->crunch_assembler && *assembler))) {
 		clean_to_end = true;
 		status = PARSE_DELETED;
 	}
@@ -1126,6 +1316,8 @@ static enum parse_keyword parse_match_token(char **buffer)
 	if (keyword == KWD_NO_MATCH)
 		return KWD_NO_MATCH;
 
+	profile_start(PROFILE_KEYWORDS);
+
 	/* Scan through the keyword table from the start point identified above
 	 * until we find that we've alphabetically passed the text to be matched.
 	 * For each keyword, run a scan to try and match it with the text either
@@ -1205,13 +1397,17 @@ static enum parse_keyword parse_match_token(char **buffer)
 	 * be longer than the partial one, and so correct.
 	 */
 
+	profile_stop(PROFILE_KEYWORDS);
+
 	if (full != KWD_NO_MATCH) {
 		*buffer = full_end;
+		profile_count(PROFILE_KEYWORDS_FULL, 1);
 		return full;
 	}
 
 	if (partial != KWD_NO_MATCH) {
 		*buffer = partial_end;
+		profile_count(PROFILE_KEYWORDS_ABBREVIATED, 1);
 		return partial;
 	}
 
@@ -1268,12 +1464,16 @@ static bool parse_process_string(char **read, char **write, char *dump)
  *
  * \param **read	Pointer to the current read pointer.
  * \param **write	Pointer to the current write pointer.
+ * \param shorten	True to replace the constant with its shortest form.
  * \return		True if the value wasn't hex; false if it was.
  */
 
-static bool parse_process_numeric_constant(char **read, char **write)
+static bool parse_process_numeric_constant(char **read, char **write, bool shorten)
 {
-	bool non_hex = true;
+	struct number_value	value;
+	char			text[PARSE_MAX_NUMBER], *start = *write;
+	int			length;
+	bool			non_hex = true;
 
 	switch (**read) {
 	case '&':
@@ -1311,6 +1511,24 @@ static bool parse_process_numeric_constant(char **read, char **write)
 		break;
 	}
 
+	/* Only a constant which stands alone, and which reads back to the
+	 * same value, can be replaced. The type must also be kept, and a
+	 * real which BASIC can't hold exactly is left as it was written.
+	 */
+
+	if (!shorten || (start > parse_buffer + HEAD_LENGTH && (parse_is_name_body(*(start - 1)) || *(start - 1) == '.')) ||
+			parse_is_name_body(**read) || **read == '.')
+		return non_hex;
+
+	if (number_read(start, *write, &value) != *write || !value.exact)
+		return non_hex;
+
+	length = number_write(&value, text, PARSE_MAX_NUMBER, true, false);
+	if (length > 0 && length < *write - start) {
+		memcpy(start, text, length);
+		*write = start + length;
+	}
+
 	return non_hex;
 }
 
@@ -1346,10 +1564,9 @@ static bool parse_process_binary_constant(char **read, char **write, int *extra_
 		return false;
 	}
 
-	*(*write)++ = TOKEN_CONST;
-	*(*write)++ = (((line & 0xc0) >> 2) | ((line & 0xc000) >> 12)) ^ 0x54;
-	*(*write)++ = (line & 0x3f) | 0x40;
-	*(*write)++ = ((line & 0x3f00) >> 8) | 0x40;
+	*(*write)++ = PARSE_TOKEN_CONST;
+	parse_write_line_constant(*write, line);
+	*write += 3;
 
 	*extra_spaces += strlen(number) - 4;
 
@@ -1391,6 +1608,51 @@ static void parse_process_variable(char **read, char **write)
 }
 
 
+/**
+ * Process white space in an assembler statement which is being crunched.
+ * Whitespace at the start of the statement, after an opening [, around
+ * commas or before the end of the statement is removed; anywhere else, it
+ * becomes a single space.
+ *
+ * \param **read	Pointer to the current read pointer.
+ * \param **write	Pointer to the current write pointer.
+ * \param *start	Pointer to the start of the statement in the output.
+ */
+
+static void parse_process_assembler_whitespace(char **read, char **write, char *start)
+{
+	while (isspace(**read) && **read != '\n')
+		(*read)++;
+
+	if (*write == start || *(*write - 1) == ',' || *(*write - 1) == '[' || **read == ',' || **read == ':' ||
+			**read == '\n' || **read == ';' || **read == '\\')
+		return;
+
+	if (parse_output_length(*write) < MAX_LINE_LENGTH)
+		*(*write)++ = ' ';
+}
+
+
+/**
+ * Skip over an assembler comment, which runs to the end of the statement.
+ * As when the comment is being kept, strings within it are skipped intact.
+ *
+ * \param **read	Pointer to the current read pointer.
+ */
+
+static void parse_skip_assembler_comment(char **read)
+{
+	bool	string = false;
+
+	while (**read != '\n' && (string || **read != ':')) {
+		if (**read == '"')
+			string = !string;
+
+		(*read)++;
+	}
+}
+
+
 /**
  * Process white space in a line, either expanding tabs, reducing it to a single
  * space or removing it completely depending on the configured options.
@@ -1540,3 +1802,183 @@ unsigned parse_get_token(enum parse_keyword keyword)
 	return parse_keywords[(keyword)].elsewhere;
 }
 
+
+/**
+ * Return the "left" token for a keyword, as used at the start of a statement.
+ *
+ * \param keyword	The keyword to return a token for.
+ * \return		The "left" token for the keyword.
+ */
+
+unsigned parse_get_left_token(enum parse_keyword keyword)
+{
+	if (keyword == KWD_NO_MATCH)
+		return 0;
+
+	return parse_keywords[(keyword)].start;
+}
+
+
+/**
+ * Return the name of a keyword, as it would be listed by BASIC.
+ *
+ * \param keyword	The keyword to return the name of.
+ * \return		Pointer to the name, or NULL if there isn't one.
+ */
+
+char *parse_get_keyword_name(enum parse_keyword keyword)
+{
+	if (keyword < 0 || keyword >= MAX_KEYWORDS)
+		return NULL;
+
+	return parse_keywords[(keyword)].name;
+}
+
+
+/**
+ * Return the minimum number of characters which can be given before a full
+ * stop to abbreviate a keyword.
+ *
+ * \param keyword	The keyword to return the abbreviation length for.
+ * \return		The minimum number of characters, or 0 if there isn't one.
+ */
+
+int parse_get_keyword_abbreviation(enum parse_keyword keyword)
+{
+	if (keyword < 0 || keyword >= MAX_KEYWORDS)
+		return 0;
+
+	return parse_keywords[(keyword)].abbrev;
+}
+
+
+/**
+ * Decode the three bytes following a line number constant token.
+ *
+ * \param *bytes	Pointer to the first of the three encoded bytes.
+ * \return		The line number held in the constant.
+ */
+
+unsigned parse_read_line_constant(char *bytes)
+{
+	unsigned char	*data = (unsigned char *) bytes;
+	unsigned	flags;
+
+	flags = data[0] ^ 0x54;
+
+	return (data[1] & 0x3f) | ((flags & 0x30) << 2) | ((data[2] & 0x3f) << 8) | ((flags & 0x0c) << 12);
+}
+
+
+/**
+ * Encode a line number into the three bytes which follow a line number
+ * constant token.
+ *
+ * \param *bytes	Pointer to the buffer to take the three bytes.
+ * \param line		The line number to encode.
+ */
+
+void parse_write_line_constant(char *bytes, unsigned line)
+{
+	bytes[0] = (((line & 0xc0) >> 2) | ((line & 0xc000) >> 12)) ^ 0x54;
+	bytes[1] = (line & 0x3f) | 0x40;
+	bytes[2] = ((line & 0x3f00) >> 8) | 0x40;
+}
+
+
+/**
+ * Prepare to scan the contents of a tokenised line, as returned by
+ * parse_process_line().
+ *
+ * \param *scan		Pointer to the scan block to initialise.
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ */
+
+void parse_scan_start(struct parse_scan *scan, char *line)
+{
+	if (scan == NULL || line == NULL)
+		return;
+
+	scan->position = line + HEAD_LENGTH;
+	scan->end = line + *((unsigned char *) line + 3);
+	scan->item = scan->position;
+	scan->statement_start = false;
+	scan->next_start = true;
+}
+
+
+/**
+ * Return the next item from a tokenised line. Whitespace is skipped, strings
+ * are returned as a single '"' item, and the text following REM, DATA and
+ * star commands is not returned at all. Two-byte tokens are returned in the
+ * same form as parse_get_token().
+ *
+ * On return, scan->item points to the first byte of the item, so that the
+ * operand of a line number constant can be found; scan->statement_start
+ * is true if the item was the first in its statement.
+ *
+ * \param *scan		Pointer to the scan block to use.
+ * \return		The next item, or PARSE_SCAN_END at the end of the line.
+ */
+
+int parse_scan_next(struct parse_scan *scan)
+{
+	int	item;
+
+	if (scan == NULL)
+		return PARSE_SCAN_END;
+
+	while (scan->position < scan->end && (*scan->position == ' ' || *scan->position == '\t'))
+		scan->position++;
+
+	if (scan->position >= scan->end)
+		return PARSE_SCAN_END;
+
+	scan->item = scan->position;
+	scan->statement_start = scan->next_start;
+	scan->next_start = false;
+
+	item = *((unsigned char *) scan->position++);
+
+	switch (item) {
+	case '"':
+		while (scan->position < scan->end) {
+			if (*scan->position++ != '"')
+				continue;
+
+			if (scan->position < scan->end && *scan->position == '"')
+				scan->position++;
+			else
+				break;
+		}
+		break;
+	case '*':
+		if (scan->statement_start)
+			scan->position = scan->end;
+		break;
+	case ':':
+		scan->next_start = true;
+		break;
+	case PARSE_TOKEN_CONST:
+		scan->position += 3;
+		if (scan->position > scan->end)
+			scan->position = scan->end;
+		break;
+	case 0xc6:
+	case 0xc7:
+	case 0xc8:
+		if (scan->position < scan->end)
+			item |= *((unsigned char *) scan->position++) << 8;
+		break;
+	default:
+		if (item == parse_keywords[KWD_REM].elsewhere || item == parse_keywords[KWD_DATA].elsewhere)
+			scan->position = scan->end;
+		else if (item == parse_keywords[KWD_THEN].elsewhere || item == parse_keywords[KWD_ELSE].elsewhere ||
+				item == parse_keywords[KWD_ELSE].start)
+			scan->next_start = true;
+		break;
+	}
+
+	return item;
+}
+
@@ -34,6 +34,18 @@
 
 #define PARSE_MAX_LINE_NUMBER 65279
 
+/**
+ * The token used to introduce an inline line number constant.
+ */
+
+#define PARSE_TOKEN_CONST 0x8d
+
+/**
+ * The value returned by parse_scan_next() at the end of a line.
+ */
+
+#define PARSE_SCAN_END (-1)
+
 /**
  * List of keyword array indexes. This must match the entries in the
  * parse_keywords[] array defined in parse.c.
@@ -221,6 +233,12 @@ struct parse_options {
 
 	bool		verbose_output;		/**< True to produce verbose output; false to be silent.	*/
 
+	bool		order_definitions;	/**< True to move the most called routines to the front.	*/
+
+	bool		memo_lines;		/**< True to reuse the output of identical source lines.	*/
+
+	bool		verify_lines;		/**< True to check each tokenised line against its source.	*/
+
 	bool		crunch_body_rems;	/**< True to remove all body REM statements.			*/
 	bool		crunch_rems;		/**< True to remove all REM statements.				*/
 	bool		crunch_empty;		/**< True to remove all empty statements.			*/
@@ -229,6 +247,23 @@ struct parse_options {
 	bool		crunch_trailing;	/**< True to remove all trailing whitespace, TEXTLOAD-style.	*/
 	bool		crunch_whitespace;	/**< True to reduce contiguous whitespace to a single space.	*/
 	bool		crunch_all_whitespace;	/**< True to remove all whitespace.				*/
+	bool		crunch_merge_lines;	/**< True to merge consecutive lines where possible.		*/
+	bool		crunch_fold;		/**< True to fold constant expressions into single values.	*/
+	bool		crunch_numbers;		/**< True to write numeric literals in their shortest form.	*/
+	bool		crunch_dead_code;	/**< True to remove code disabled by constant conditions.	*/
+	bool		crunch_assembler;	/**< True to remove comments and spacing from assembler.	*/
+};
+
+/**
+ * State for scanning through the items in a tokenised line.
+ */
+
+struct parse_scan {
+	char		*position;		/**< The next byte to be scanned.				*/
+	char		*end;			/**< The first byte beyond the end of the line.			*/
+	char		*item;			/**< The first byte of the last item returned.			*/
+	bool		statement_start;	/**< True if the last item returned started a statement.	*/
+	bool		next_start;		/**< True if the next item will start a statement.		*/
 };
 
 /**
@@ -271,5 +306,85 @@ char *parse_process_line(char *line, struct parse_options *options, bool *assemb
 
 unsigned parse_get_token(enum parse_keyword keyword);
 
+
+/**
+ * Return the "left" token for a keyword, as used at the start of a statement.
+ *
+ * \param keyword	The keyword to return a token for.
+ * \return		The "left" token for the keyword.
+ */
+
+unsigned parse_get_left_token(enum parse_keyword keyword);
+
+
+/**
+ * Return the name of a keyword, as it would be listed by BASIC.
+ *
+ * \param keyword	The keyword to return the name of.
+ * \return		Pointer to the name, or NULL if there isn't one.
+ */
+
+char *parse_get_keyword_name(enum parse_keyword keyword);
+
+
+/**
+ * Return the minimum number of characters which can be given before a full
+ * stop to abbreviate a keyword.
+ *
+ * \param keyword	The keyword to return the abbreviation length for.
+ * \return		The minimum number of characters, or 0 if there isn't one.
+ */
+
+int parse_get_keyword_abbreviation(enum parse_keyword keyword);
+
+
+/**
+ * Decode the three bytes following a line number constant token.
+ *
+ * \param *bytes	Pointer to the first of the three encoded bytes.
+ * \return		The line number held in the constant.
+ */
+
+unsigned parse_read_line_constant(char *bytes);
+
+
+/**
+ * Encode a line number into the three bytes which follow a line number
+ * constant token.
+ *
+ * \param *bytes	Pointer to the buffer to take the three bytes.
+ * \param line		The line number to encode.
+ */
+
+void parse_write_line_constant(char *bytes, unsigned line);
+
+
+/**
+ * Prepare to scan the contents of a tokenised line, as returned by
+ * parse_process_line().
+ *
+ * \param *scan		Pointer to the scan block to initialise.
+ * \param *line		Pointer to the tokenised line, starting at the \r.
+ */
+
+void parse_scan_start(struct parse_scan *scan, char *line);
+
+
+/**
+ * Return the next item from a tokenised line. Whitespace is skipped, strings
+ * are returned as a single '"' item, and the text following REM, DATA and
+ * star commands is not returned at all. Two-byte tokens are returned in the
+ * same form as parse_get_token().
+ *
+ * On return, scan->item points to the first byte of the item, so that the
+ * operand of a line number constant can be found; scan->statement_start
+ * is true if the item was the first in its statement.
+ *
+ * \param *scan		Pointer to the scan block to use.
+ * \return		The next item, or PARSE_SCAN_END at the end of the line.
+ */
+
+int parse_scan_next(struct parse_scan *scan);
+
 #endif
 
@@ -0,0 +1,449 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file preload.c
+ *
+ * Source File Preloading, implementation.
+ *
+ * Files are queued for loading as soon as their names are known, and are
+ * read into memory by a small pool of threads while the parser is busy
+ * with the files before them. This hides the latency of opening and
+ * reading lots of small files one after another.
+ *
+ * Only the threads touch the contents of an entry until it is marked as
+ * loaded; after that, it belongs to the main thread.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LINUX
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Local source headers. */
+
+#include "preload.h"
+#include "profile.h"
+#include "trace.h"
+
+#ifdef LINUX
+
+/**
+ * The number of threads used to load files.
+ */
+
+#define PRELOAD_THREADS 8
+
+/**
+ * A file being preloaded, forming one entry in a linked list.
+ */
+
+struct preload_file {
+	char			*name;		/**< Pointer to the name of the file.				*/
+	char			*data;		/**< Pointer to the file's contents, or NULL.			*/
+	size_t			size;		/**< The size of the file's contents.				*/
+	bool			claimed;	/**< True once a thread has started loading the file.		*/
+	bool			loaded;		/**< True once the thread has finished with the file.		*/
+
+	struct preload_file	*next;		/**< Pointer to the next file in the list, or NULL.		*/
+};
+
+static struct preload_file	*preload_head = NULL;
+static struct preload_file	*preload_tail = NULL;
+static struct preload_file	*preload_next = NULL;
+
+/**
+ * The contents of the last file handed out, which are freed when the next
+ * one is requested.
+ */
+
+static char			*preload_current = NULL;
+
+/**
+ * The thread pool, and the locks and conditions used to coordinate it.
+ */
+
+static pthread_t		preload_threads[PRELOAD_THREADS];
+static int			preload_thread_count = 0;
+static bool			preload_stopping = false;
+
+static pthread_mutex_t		preload_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t		preload_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t		preload_loaded = PTHREAD_COND_INITIALIZER;
+
+static void *preload_thread(void *parameter);
+static void preload_read_file(struct preload_file *file, unsigned track);
+static void preload_free_files(void);
+
+#endif
+
+
+/**
+ * Start the pool of threads used to preload files.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool preload_start(void)
+{
+#ifdef LINUX
+	if (preload_thread_count > 0)
+		return true;
+
+	preload_stopping = false;
+
+	while (preload_thread_count < PRELOAD_THREADS) {
+		if (pthread_create(&preload_threads[preload_thread_count], NULL, preload_thread, (void *) (intptr_t) preload_thread_count) != 0)
+			break;
+
+		preload_thread_count++;
+	}
+
+	return (preload_thread_count > 0) ? true : false;
+#else
+	return false;
+#endif
+}
+
+
+/**
+ * Stop the pool of threads, and discard any files which have been preloaded.
+ * Files still waiting to be loaded are abandoned, while those already being
+ * loaded are finished first.
+ */
+
+void preload_stop(void)
+{
+#ifdef LINUX
+	int	thread;
+
+	pthread_mutex_lock(&preload_lock);
+	preload_stopping = true;
+	preload_next = NULL;
+	pthread_cond_broadcast(&preload_work);
+	pthread_mutex_unlock(&preload_lock);
+
+	for (thread = 0; thread < preload_thread_count; thread++)
+		pthread_join(preload_threads[thread], NULL);
+
+	preload_thread_count = 0;
+
+	preload_free_files();
+#endif
+}
+
+
+/**
+ * Discard all of the files which have been queued or preloaded, waiting
+ * for any which are being loaded to finish first.
+ */
+
+void preload_clear(void)
+{
+#ifdef LINUX
+	struct preload_file	*file;
+
+	pthread_mutex_lock(&preload_lock);
+
+	preload_next = NULL;
+
+	for (file = preload_head; file != NULL; file = file->next) {
+		while (file->claimed && !file->loaded)
+			pthread_cond_wait(&preload_loaded, &preload_lock);
+	}
+
+	pthread_mutex_unlock(&preload_lock);
+
+	preload_free_files();
+#endif
+}
+
+
+/**
+ * Queue a file to be loaded by the thread pool. Nothing happens if the
+ * pool hasn't been started.
+ *
+ * \param *name		Pointer to the name of the file to load.
+ */
+
+void preload_add_file(char *name)
+{
+#ifdef LINUX
+	struct preload_file	*file;
+
+	if (preload_thread_count == 0 || name == NULL)
+		return;
+
+	file = malloc(sizeof(struct preload_file));
+	if (file == NULL)
+		return;
+
+	file->name = strdup(name);
+	if (file->name == NULL) {
+		free(file);
+		return;
+	}
+
+	profile_add_memory(PROFILE_MEMORY_PRELOAD, file);
+	profile_add_memory(PROFILE_MEMORY_PRELOAD, file->name);
+
+	file->data = NULL;
+	file->size = 0;
+	file->claimed = false;
+	file->loaded = false;
+	file->next = NULL;
+
+	pthread_mutex_lock(&preload_lock);
+
+	if (preload_tail == NULL)
+		preload_head = file;
+	else
+		preload_tail->next = file;
+
+	preload_tail = file;
+
+	if (preload_next == NULL)
+		preload_next = file;
+
+	pthread_cond_signal(&preload_work);
+	pthread_mutex_unlock(&preload_lock);
+#endif
+}
+
+
+/**
+ * Open a preloaded file for reading, waiting for it to finish loading if
+ * necessary. The previous file returned must have been closed before this
+ * is called, as its contents are freed.
+ *
+ * \param *name		Pointer to the name of the file to open.
+ * \return		The handle of the file, or NULL if it wasn't queued
+ *			or couldn't be loaded.
+ */
+
+FILE *preload_open_file(char *name)
+{
+#ifdef LINUX
+	struct preload_file	*file, *previous = NULL;
+	FILE			*handle = NULL;
+
+	profile_remove_memory(PROFILE_MEMORY_PRELOAD, preload_current);
+	free(preload_current);
+	preload_current = NULL;
+
+	if (preload_thread_count == 0 || name == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&preload_lock);
+
+	for (file = preload_head; file != NULL && strcmp(file->name, name) != 0; file = file->next)
+		previous = file;
+
+	if (file == NULL) {
+		pthread_mutex_unlock(&preload_lock);
+		return NULL;
+	}
+
+	/* If no thread has got to the file yet, load it here instead of
+	 * waiting; otherwise, wait for the thread to finish with it.
+	 */
+
+	if (!file->claimed) {
+		file->claimed = true;
+		if (preload_next == file)
+			preload_next = file->next;
+
+		pthread_mutex_unlock(&preload_lock);
+		preload_read_file(file, TRACE_TRACK_MAIN);
+		pthread_mutex_lock(&preload_lock);
+	} else {
+		while (!file->loaded)
+			pthread_cond_wait(&preload_loaded, &preload_lock);
+	}
+
+	/* Remove the file from the list, taking care not to lose the place
+	 * in the queue.
+	 */
+
+	if (previous == NULL)
+		preload_head = file->next;
+	else
+		previous->next = file->next;
+
+	if (preload_tail == file)
+		preload_tail = previous;
+
+	pthread_mutex_unlock(&preload_lock);
+
+	if (file->data != NULL) {
+		preload_current = file->data;
+		handle = fmemopen(file->data, file->size, "r");
+	}
+
+	profile_remove_memory(PROFILE_MEMORY_PRELOAD, file->name);
+	free(file->name);
+	profile_remove_memory(PROFILE_MEMORY_PRELOAD, file);
+	free(file);
+
+	return handle;
+#else
+	return NULL;
+#endif
+}
+
+
+#ifdef LINUX
+/**
+ * The body of each thread in the pool, which loads queued files until the
+ * pool is stopped.
+ *
+ * \param *parameter	The number of the thread in the pool.
+ * \return		Unused.
+ */
+
+static void *preload_thread(void *parameter)
+{
+	struct preload_file	*file;
+	unsigned		track = TRACE_TRACK_PRELOAD + (intptr_t) parameter;
+	char			name[32];
+
+	snprintf(name, sizeof(name), "Preload %u", track - TRACE_TRACK_PRELOAD + 1);
+	trace_name_track(track, name);
+
+	pthread_mutex_lock(&preload_lock);
+
+	while (true) {
+		while (preload_next == NULL && !preload_stopping)
+			pthread_cond_wait(&preload_work, &preload_lock);
+
+		if (preload_next == NULL)
+			break;
+
+		file = preload_next;
+		file->claimed = true;
+		preload_next = file->next;
+
+		pthread_mutex_unlock(&preload_lock);
+		preload_read_file(file, track);
+		pthread_mutex_lock(&preload_lock);
+
+		pthread_cond_broadcast(&preload_loaded);
+	}
+
+	pthread_mutex_unlock(&preload_lock);
+
+	return NULL;
+}
+
+
+/**
+ * Read the contents of a file into memory. If anything goes wrong, the
+ * data is left as NULL so that the file will be opened normally and the
+ * error reported in the usual way.
+ *
+ * \param *file		Pointer to the file to read.
+ * \param track		The trace track of the thread doing the reading.
+ */
+
+static void preload_read_file(struct preload_file *file, unsigned track)
+{
+	struct stat	info;
+	char		*data = NULL;
+	ssize_t		length;
+	size_t		size = 0;
+	int		fd;
+
+	trace_begin(track, "preload", file->name);
+
+	fd = open(file->name, O_RDONLY);
+
+	if (fd != -1 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+		data = malloc(info.st_size + 1);
+		profile_add_memory(PROFILE_MEMORY_PRELOAD, data);
+
+		while (data != NULL && size < (size_t) info.st_size) {
+			length = pread(fd, data + size, info.st_size - size, size);
+			if (length <= 0) {
+				profile_remove_memory(PROFILE_MEMORY_PRELOAD, data);
+				free(data);
+				data = NULL;
+			} else {
+				size += length;
+			}
+		}
+	}
+
+	if (fd != -1)
+		close(fd);
+
+	trace_end(track);
+
+	pthread_mutex_lock(&preload_lock);
+	file->data = data;
+	file->size = size;
+	file->loaded = true;
+	pthread_mutex_unlock(&preload_lock);
+}
+
+
+/**
+ * Free all of the entries in the list of files.
+ */
+
+static void preload_free_files(void)
+{
+	struct preload_file	*file;
+
+	pthread_mutex_lock(&preload_lock);
+
+	while (preload_head != NULL) {
+		file = preload_head;
+		preload_head = file->next;
+		profile_remove_memory(PROFILE_MEMORY_PRELOAD, file->data);
+		free(file->data);
+		profile_remove_memory(PROFILE_MEMORY_PRELOAD, file->name);
+		free(file->name);
+		profile_remove_memory(PROFILE_MEMORY_PRELOAD, file);
+		free(file);
+	}
+
+	preload_tail = NULL;
+	preload_next = NULL;
+
+	pthread_mutex_unlock(&preload_lock);
+
+	profile_remove_memory(PROFILE_MEMORY_PRELOAD, preload_current);
+	free(preload_current);
+	preload_current = NULL;
+}
+#endif
+
@@ -0,0 +1,87 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file preload.h
+ *
+ * Source File Preloading, interface.
+ */
+
+#ifndef TOKENIZE_PRELOAD_H
+#define TOKENIZE_PRELOAD_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+
+/**
+ * Start the pool of threads used to preload files.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool preload_start(void);
+
+
+/**
+ * Stop the pool of threads, and discard any files which have been preloaded.
+ * Files still waiting to be loaded are abandoned, while those already being
+ * loaded are finished first.
+ */
+
+void preload_stop(void);
+
+
+/**
+ * Discard all of the files which have been queued or preloaded, waiting
+ * for any which are being loaded to finish first.
+ */
+
+void preload_clear(void);
+
+
+/**
+ * Queue a file to be loaded by the thread pool. Nothing happens if the
+ * pool hasn't been started.
+ *
+ * \param *name		Pointer to the name of the file to load.
+ */
+
+void preload_add_file(char *name);
+
+
+/**
+ * Open a preloaded file for reading, waiting for it to finish loading if
+ * necessary. The previous file returned must have been closed before this
+ * is called, as its contents are freed.
+ *
+ * \param *name		Pointer to the name of the file to open.
+ * \return		The handle of the file, or NULL if it wasn't queued
+ *			or couldn't be loaded.
+ */
+
+FILE *preload_open_file(char *name);
+
+#endif
+
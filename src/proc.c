@@ -29,6 +29,7 @@
 
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -37,6 +38,7 @@
 #include "proc.h"
 
 #include "msg.h"
+#include "profile.h"
 
 enum proc_type {
 	PROC_UNKNOWN = 0,			/**< The routine's type isn't known.				*/
@@ -54,6 +56,7 @@ struct proc_entry {
 
 	unsigned		definitions;	/**< The number of times the routine has been defined.		*/
 	unsigned		calls;		/**< The number of times the routine has been called.		*/
+	unsigned long		profile;	/**< The number of calls recorded in a runtime profile.		*/
 
 	struct proc_entry	*next;		/**< Pointer to the next routine in the chain, or NULL.		*/
 };
@@ -61,6 +64,18 @@ struct proc_entry {
 #define PROC_INDEXES 128
 static struct proc_entry	*proc_list[PROC_INDEXES];
 
+/**
+ * The maximum length of a line in a call profile file.
+ */
+
+#define PROC_MAX_PROFILE_LINE 1024
+
+/**
+ * True if a runtime call profile has been loaded.
+ */
+
+static bool			proc_profile_loaded = false;
+
 static struct proc_entry *proc_create(enum proc_type type, char *name);
 static struct proc_entry *proc_find(enum proc_type type, char *name);
 static int proc_find_index(char *name);
@@ -80,6 +95,25 @@ void proc_initialise(void)
 }
 
 
+/**
+ * Clear the definition and call counts for all of the known routines, ready
+ * for the source to be processed again. Any runtime profile is kept.
+ */
+
+void proc_reset_counts(void)
+{
+	int			index;
+	struct proc_entry	*list;
+
+	for (index = 0; index < PROC_INDEXES; index++) {
+		for (list = proc_list[index]; list != NULL; list = list->next) {
+			list->definitions = 0;
+			list->calls = 0;
+		}
+	}
+}
+
+
 /**
  * Generate a report on the list of functions and procedures, detaining
  * missing definitions, multiple definitions and optionally unused definitions.
@@ -150,6 +184,215 @@ void proc_process(char *name, bool is_function, bool is_definition)
 }
 
 
+/**
+ * Load a runtime call profile, replacing the static call counts used when
+ * ranking routines. Each line of the file contains a routine name, complete
+ * with its PROC or FN prefix, followed by a call count; blank lines and lines
+ * starting with # are ignored.
+ *
+ * \param *file		Pointer to the name of the profile file to load.
+ * \return		True if successful; False on error.
+ */
+
+bool proc_load_profile(char *file)
+{
+	FILE			*profile;
+	char			line[PROC_MAX_PROFILE_LINE], *name, *count, *end;
+	enum proc_type		type;
+	struct proc_entry	*routine;
+	unsigned long		calls;
+
+	if (file == NULL)
+		return false;
+
+	profile = fopen(file, "r");
+	if (profile == NULL)
+		return false;
+
+	while (fgets(line, PROC_MAX_PROFILE_LINE, profile) != NULL) {
+		name = strtok(line, " \t\r\n");
+		if (name == NULL || *name == '#')
+			continue;
+
+		count = strtok(NULL, " \t\r\n");
+		if (count == NULL) {
+			fclose(profile);
+			return false;
+		}
+
+		if (strncmp(name, "PROC", 4) == 0) {
+			type = PROC_PROCEDURE;
+			name += 4;
+		} else if (strncmp(name, "FN", 2) == 0) {
+			type = PROC_FUNCTION;
+			name += 2;
+		} else {
+			fclose(profile);
+			return false;
+		}
+
+		calls = strtoul(count, &end, 10);
+		if (*name == '\0' || *end != '\0') {
+			fclose(profile);
+			return false;
+		}
+
+		routine = proc_find(type, name);
+		if (routine == NULL)
+			routine = proc_create(type, name);
+
+		if (routine == NULL) {
+			fclose(profile);
+			return false;
+		}
+
+		routine->profile += calls;
+	}
+
+	fclose(profile);
+
+	proc_profile_loaded = true;
+
+	return true;
+}
+
+
+/**
+ * Write the definition and call counts for all of the known routines to a
+ * file, in a form which can be read back by proc_load_counts().
+ *
+ * \param *out		The handle of the file to write to.
+ * \return		True if successful; False on error.
+ */
+
+bool proc_save_counts(FILE *out)
+{
+	int			index, entries, entry;
+	unsigned		count = 0;
+	struct proc_entry	*list, **chain;
+
+	for (index = 0; index < PROC_INDEXES; index++) {
+		for (list = proc_list[index]; list != NULL; list = list->next) {
+			if (list->name != NULL)
+				count++;
+		}
+	}
+
+	if (fprintf(out, "Routines %u\n", count) < 0)
+		return false;
+
+	/* New routines are added to the head of each chain, so write each
+	 * chain out from its tail in order that proc_load_counts() will
+	 * rebuild it in the same order.
+	 */
+
+	for (index = 0; index < PROC_INDEXES; index++) {
+		for (entries = 0, list = proc_list[index]; list != NULL; list = list->next)
+			entries++;
+
+		if (entries == 0)
+			continue;
+
+		chain = malloc(sizeof(struct proc_entry *) * entries);
+		if (chain == NULL)
+			return false;
+
+		profile_add_memory(PROFILE_MEMORY_PROC, chain);
+
+		for (entry = 0, list = proc_list[index]; list != NULL; list = list->next)
+			chain[entry++] = list;
+
+		for (entry = entries - 1; entry >= 0; entry--) {
+			if (chain[entry]->name != NULL && fprintf(out, "%u %u %s%s\n", chain[entry]->definitions, chain[entry]->calls,
+					proc_prefix_name(chain[entry]->type), chain[entry]->name) < 0) {
+				profile_remove_memory(PROFILE_MEMORY_PROC, chain);
+				free(chain);
+				return false;
+			}
+		}
+
+		profile_remove_memory(PROFILE_MEMORY_PROC, chain);
+		free(chain);
+	}
+
+	return true;
+}
+
+
+/**
+ * Read the definition and call counts for a set of routines from a file
+ * written by proc_save_counts(), replacing the counts held for them.
+ *
+ * \param *in		The handle of the file to read from.
+ * \return		True if successful; False on error.
+ */
+
+bool proc_load_counts(FILE *in)
+{
+	char			line[PROC_MAX_PROFILE_LINE], *name;
+	unsigned		count, definitions, calls;
+	int			length;
+	enum proc_type		type;
+	struct proc_entry	*routine;
+
+	if (fgets(line, PROC_MAX_PROFILE_LINE, in) == NULL || sscanf(line, "Routines %u", &count) != 1)
+		return false;
+
+	while (count-- > 0) {
+		if (fgets(line, PROC_MAX_PROFILE_LINE, in) == NULL || sscanf(line, "%u %u %n", &definitions, &calls, &length) != 2)
+			return false;
+
+		name = line + length;
+		name[strcspn(name, "\r\n")] = '\0';
+
+		if (strncmp(name, "PROC", 4) == 0) {
+			type = PROC_PROCEDURE;
+			name += 4;
+		} else if (strncmp(name, "FN", 2) == 0) {
+			type = PROC_FUNCTION;
+			name += 2;
+		} else {
+			return false;
+		}
+
+		routine = proc_find(type, name);
+		if (routine == NULL)
+			routine = proc_create(type, name);
+
+		if (routine == NULL)
+			return false;
+
+		routine->definitions = definitions;
+		routine->calls = calls;
+	}
+
+	return true;
+}
+
+
+/**
+ * Return the number of calls made to a function or procedure, for use when
+ * ranking routines by how often they are used. If a runtime profile has been
+ * loaded, the counts from that are used; otherwise the number of calls seen
+ * in the source is returned.
+ *
+ * \param *name		Pointer to the name of the routine, without prefix.
+ * \param is_function	True if the routine is an FN; False if it is a PROC.
+ * \return		The number of calls to the routine.
+ */
+
+unsigned long proc_get_calls(char *name, bool is_function)
+{
+	struct proc_entry	*routine;
+
+	routine = proc_find((is_function) ? PROC_FUNCTION : PROC_PROCEDURE, name);
+	if (routine == NULL)
+		return 0;
+
+	return (proc_profile_loaded) ? routine->profile : routine->calls;
+}
+
+
 /**
  * Create a new routine, returning a pointer to its data block.
  *
@@ -175,8 +418,12 @@ static struct proc_entry *proc_create(enum proc_type type, char *name)
 	routine->name = strdup(name);
 	routine->type = type;
 
+	profile_add_memory(PROFILE_MEMORY_PROC, routine);
+	profile_add_memory(PROFILE_MEMORY_PROC, routine->name);
+
 	routine->definitions = 0;
 	routine->calls = 0;
+	routine->profile = 0;
 
 	index = proc_find_index(name);
 	routine->next = proc_list[index];
@@ -31,6 +31,7 @@
 #define TOKENIZE_PROC_H
 
 #include <stdbool.h>
+#include <stdio.h>
 
 
 /**
@@ -40,6 +41,14 @@
 void proc_initialise(void);
 
 
+/**
+ * Clear the definition and call counts for all of the known routines, ready
+ * for the source to be processed again. Any runtime profile is kept.
+ */
+
+void proc_reset_counts(void);
+
+
 /**
  * Generate a report on the list of functions and procedures, detaining
  * missing definitions, multiple definitions and optionally unused definitions.
@@ -62,5 +71,54 @@ void proc_report(bool unused);
 
 void proc_process(char *name, bool is_function, bool is_definition);
 
+
+/**
+ * Load a runtime call profile, replacing the static call counts used when
+ * ranking routines. Each line of the file contains a routine name, complete
+ * with its PROC or FN prefix, followed by a call count; blank lines and lines
+ * starting with # are ignored.
+ *
+ * \param *file		Pointer to the name of the profile file to load.
+ * \return		True if successful; False on error.
+ */
+
+bool proc_load_profile(char *file);
+
+
+/**
+ * Write the definition and call counts for all of the known routines to a
+ * file, in a form which can be read back by proc_load_counts().
+ *
+ * \param *out		The handle of the file to write to.
+ * \return		True if successful; False on error.
+ */
+
+bool proc_save_counts(FILE *out);
+
+
+/**
+ * Read the definition and call counts for a set of routines from a file
+ * written by proc_save_counts(), replacing the counts held for them.
+ *
+ * \param *in		The handle of the file to read from.
+ * \return		True if successful; False on error.
+ */
+
+bool proc_load_counts(FILE *in);
+
+
+/**
+ * Return the number of calls made to a function or procedure, for use when
+ * ranking routines by how often they are used. If a runtime profile has been
+ * loaded, the counts from that are used; otherwise the number of calls seen
+ * in the source is returned.
+ *
+ * \param *name		Pointer to the name of the routine, without prefix.
+ * \param is_function	True if the routine is an FN; False if it is a PROC.
+ * \return		The number of calls to the routine.
+ */
+
+unsigned long proc_get_calls(char *name, bool is_function);
+
 #endif
 
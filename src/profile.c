@@ -0,0 +1,499 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file profile.c
+ *
+ * Phase Timing and Counters, implementation.
+ *
+ * Time is only ever charged to the innermost phase running, so that the
+ * phases don't overlap; line parsing has the phases within it added back
+ * in when it is reported.
+ *
+ * Wall time comes from the monotonic clock, which can be read without
+ * leaving user space. Reading the CPU clock needs a call into the kernel,
+ * which would cost more than a line takes to process, so it is only used
+ * for the phases which aren't entered for every line, and for the total.
+ *
+ * Heap memory is measured by asking the C library for the usable size of
+ * each block as it is allocated and freed, so that the sizes don't have to
+ * be stored anywhere; this includes any slack that the allocator adds, and
+ * so reflects the real footprint. Blocks are accounted from the start, as
+ * the command line must be read before we know if profiling is wanted, but
+ * this stops once it has been read if not. The preload threads allocate
+ * memory too, so the figures are updated atomically.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef LINUX
+#include <malloc.h>
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+/* Local source headers. */
+
+#include "profile.h"
+
+/**
+ * A phase being timed.
+ */
+
+struct profile_timer {
+	double			wall;		/**< The wall time spent in the phase, less any within it.	*/
+	double			cpu;		/**< The CPU time spent in the phase, if it is recorded.	*/
+	double			wall_start;	/**< The wall time at which the phase was last started.		*/
+	double			cpu_start;	/**< The CPU time at which the phase was last started.		*/
+	enum profile_phase	outer;		/**< The phase which was running when this one started.		*/
+};
+
+/**
+ * The heap memory used by an area.
+ */
+
+struct profile_memory_use {
+	unsigned long		blocks;		/**< The number of blocks allocated.				*/
+	size_t			current;	/**< The number of bytes currently allocated.			*/
+	size_t			peak;		/**< The largest number of bytes allocated at once.		*/
+};
+
+/**
+ * The names of the phases. This must match the order of enum profile_phase.
+ */
+
+static char *profile_phase_names[] = {
+	"Argument parsing",
+	"SWI header loading",
+	"File I/O",
+	"Line parsing",
+	"Output writing",
+	"Keyword matching",
+	"Variable and FN/PROC lookup",
+	"SWI lookup",
+	"Assembler recognition"
+};
+
+/**
+ * The names of the counters. This must match the order of enum profile_counter.
+ */
+
+static char *profile_counter_names[] = {
+	"Lines",
+	"Statements",
+	"Keywords matched in full",
+	"Keywords matched from abbreviations",
+	"Variable lookups",
+	"Variable entries examined",
+	"Constants substituted",
+	"Libraries linked"
+};
+
+/**
+ * The names of the memory areas. This must match the order of
+ * enum profile_memory.
+ */
+
+static char *profile_memory_names[] = {
+	"Command line",
+	"Library files",
+	"Line memo",
+	"Messages",
+	"Preloaded files",
+	"FN/PROC table",
+	"Program store",
+	"SWI tables",
+	"Variable table"
+};
+
+static bool			profile_enabled = false;
+static struct profile_timer	profile_timers[PROFILE_PHASES];
+static unsigned long		profile_counters[PROFILE_COUNTERS];
+
+/**
+ * The innermost phase currently running, or PROFILE_PHASES if there isn't one.
+ */
+
+static enum profile_phase	profile_current = PROFILE_PHASES;
+
+/**
+ * The wall and CPU times at which the current report period started.
+ */
+
+static double			profile_wall_start = 0.0;
+static double			profile_cpu_start = 0.0;
+
+/**
+ * The heap memory used by each area, plus one more for the total.
+ */
+
+static struct profile_memory_use	profile_memory[PROFILE_MEMORY_AREAS + 1];
+
+/**
+ * True while blocks of memory are being accounted for.
+ */
+
+static bool			profile_accounting = true;
+
+static void profile_clear(void);
+static void profile_report_phase(enum profile_phase phase, bool nested);
+#ifdef LINUX
+static void profile_add_memory_use(struct profile_memory_use *use, size_t size);
+#endif
+static void profile_report_memory(char *name, struct profile_memory_use *use);
+static double profile_read_clock(bool cpu);
+
+
+/**
+ * Initialise the profile module, and start timing PROFILE_ARGS. This should
+ * be called as early as possible, since the command line hasn't been read
+ * yet and we don't know if profiling is wanted.
+ */
+
+void profile_initialise(void)
+{
+	profile_clear();
+
+	profile_timers[PROFILE_ARGS].wall_start = profile_wall_start;
+	profile_timers[PROFILE_ARGS].cpu_start = profile_cpu_start;
+	profile_timers[PROFILE_ARGS].outer = PROFILE_PHASES;
+	profile_current = PROFILE_ARGS;
+}
+
+
+/**
+ * Turn profiling on. Until this is called, the other calls do nothing.
+ */
+
+void profile_enable(void)
+{
+	profile_enabled = true;
+}
+
+
+/**
+ * Note that the command line has been read. Unless profiling has been
+ * turned on by now, memory is no longer accounted for.
+ */
+
+void profile_end_command_line(void)
+{
+	profile_accounting = profile_enabled;
+}
+
+
+/**
+ * Start timing a phase.
+ *
+ * \param phase		The phase to start timing.
+ */
+
+void profile_start(enum profile_phase phase)
+{
+	if (!profile_enabled || phase >= PROFILE_PHASES)
+		return;
+
+	profile_timers[phase].outer = profile_current;
+	profile_current = phase;
+
+	profile_timers[phase].wall_start = profile_read_clock(false);
+	if (phase < PROFILE_FILE_IO)
+		profile_timers[phase].cpu_start = profile_read_clock(true);
+}
+
+
+/**
+ * Stop timing a phase, adding the time since profile_start() was called
+ * to its total.
+ *
+ * \param phase		The phase to stop timing.
+ */
+
+void profile_stop(enum profile_phase phase)
+{
+	double			wall, cpu = 0.0;
+	enum profile_phase	outer;
+
+	if (!profile_enabled || phase >= PROFILE_PHASES)
+		return;
+
+	wall = profile_read_clock(false) - profile_timers[phase].wall_start;
+	if (phase < PROFILE_FILE_IO)
+		cpu = profile_read_clock(true) - profile_timers[phase].cpu_start;
+
+	profile_timers[phase].wall += wall;
+	profile_timers[phase].cpu += cpu;
+
+	outer = profile_timers[phase].outer;
+
+	if (outer != PROFILE_PHASES) {
+		profile_timers[outer].wall -= wall;
+		profile_timers[outer].cpu -= cpu;
+	}
+
+	profile_current = outer;
+}
+
+
+/**
+ * Add to one of the counters.
+ *
+ * \param counter	The counter to add to.
+ * \param count		The amount to add.
+ */
+
+void profile_count(enum profile_counter counter, unsigned count)
+{
+	if (!profile_enabled || counter >= PROFILE_COUNTERS)
+		return;
+
+	profile_counters[counter] += count;
+}
+
+
+/**
+ * Read one of the counters.
+ *
+ * \param counter	The counter to read.
+ * \return		The value of the counter, or 0 if profiling is not
+ *			enabled.
+ */
+
+unsigned long profile_get_count(enum profile_counter counter)
+{
+	if (!profile_enabled || counter >= PROFILE_COUNTERS)
+		return 0;
+
+	return profile_counters[counter];
+}
+
+
+/**
+ * Account for a block of memory which has just been allocated. This is done
+ * until the command line has been read whether or not profiling is enabled,
+ * since blocks are allocated before it is known if it is wanted.
+ *
+ * \param area		The area which owns the block.
+ * \param *block	Pointer to the block, or NULL.
+ */
+
+void profile_add_memory(enum profile_memory area, void *block)
+{
+#ifdef LINUX
+	size_t	size;
+
+	if (!profile_accounting || block == NULL || area >= PROFILE_MEMORY_AREAS)
+		return;
+
+	size = malloc_usable_size(block);
+
+	profile_add_memory_use(&profile_memory[area], size);
+	profile_add_memory_use(&profile_memory[PROFILE_MEMORY_AREAS], size);
+#endif
+}
+
+
+/**
+ * Account for a block of memory which is about to be freed.
+ *
+ * \param area		The area which owns the block.
+ * \param *block	Pointer to the block, or NULL.
+ */
+
+void profile_remove_memory(enum profile_memory area, void *block)
+{
+#ifdef LINUX
+	size_t	size;
+
+	if (!profile_accounting || block == NULL || area >= PROFILE_MEMORY_AREAS)
+		return;
+
+	size = malloc_usable_size(block);
+
+	__atomic_sub_fetch(&profile_memory[area].current, size, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&profile_memory[PROFILE_MEMORY_AREAS].current, size, __ATOMIC_RELAXED);
+#endif
+}
+
+
+/**
+ * Write the times and counts collected so far to stdout, if profiling
+ * is enabled, then clear them ready for the next run. The memory figures
+ * cover the whole life of the process.
+ */
+
+void profile_report(void)
+{
+	enum profile_phase	phase;
+	enum profile_counter	counter;
+	enum profile_memory	area;
+	unsigned long		lookups;
+#ifdef LINUX
+	struct rusage		usage;
+#endif
+
+	if (!profile_enabled)
+		return;
+
+	printf("%-35s%11s%11s\n", "Phase", "Wall (ms)", "CPU (ms)");
+
+	for (phase = PROFILE_ARGS; phase < PROFILE_KEYWORDS; phase++) {
+		profile_report_phase(phase, false);
+
+		if (phase == PROFILE_PARSE) {
+			profile_report_phase(PROFILE_KEYWORDS, true);
+			profile_report_phase(PROFILE_LOOKUP, true);
+			profile_report_phase(PROFILE_SWI_LOOKUP, true);
+			profile_report_phase(PROFILE_ASSEMBLER, true);
+		}
+	}
+
+	printf("%-35s%11.3f%11.3f\n", "Total", (profile_read_clock(false) - profile_wall_start) * 1000.0,
+			(profile_read_clock(true) - profile_cpu_start) * 1000.0);
+
+	printf("\n");
+
+	for (counter = PROFILE_LINES; counter < PROFILE_COUNTERS; counter++)
+		printf("%-35s%11lu\n", profile_counter_names[counter], profile_counters[counter]);
+
+	lookups = profile_counters[PROFILE_VARIABLE_LOOKUPS];
+	printf("%-35s%11.2f\n", "Average variable chain length",
+			(lookups > 0) ? (double) profile_counters[PROFILE_VARIABLE_STEPS] / lookups : 0.0);
+
+	printf("\n%-35s%11s%11s%11s\n", "Memory", "Blocks", "Live (KB)", "Peak (KB)");
+
+	for (area = PROFILE_MEMORY_ARGS; area < PROFILE_MEMORY_AREAS; area++)
+		profile_report_memory(profile_memory_names[area], &profile_memory[area]);
+
+	profile_report_memory("Total", &profile_memory[PROFILE_MEMORY_AREAS]);
+
+#ifdef LINUX
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		printf("%-35s%33ld\n", "Peak resident set size (KB)", usage.ru_maxrss);
+#endif
+
+	profile_clear();
+}
+
+
+/**
+ * Clear all of the timers and counters, and start a new report period.
+ */
+
+static void profile_clear(void)
+{
+	memset(profile_timers, 0, sizeof(profile_timers));
+	memset(profile_counters, 0, sizeof(profile_counters));
+
+	profile_wall_start = profile_read_clock(false);
+	profile_cpu_start = profile_read_clock(true);
+}
+
+
+/**
+ * Write a line of the report for a phase to stdout. CPU time is only shown
+ * for the phases which record it.
+ *
+ * \param phase		The phase to report.
+ * \param nested	True if the phase is nested within line parsing.
+ */
+
+static void profile_report_phase(enum profile_phase phase, bool nested)
+{
+	double	wall = profile_timers[phase].wall;
+	int	inner;
+
+	if (phase == PROFILE_PARSE) {
+		for (inner = PROFILE_KEYWORDS; inner < PROFILE_PHASES; inner++)
+			wall += profile_timers[inner].wall;
+	}
+
+	if (nested)
+		printf("  %-33s%11.3f%11s\n", profile_phase_names[phase], wall * 1000.0, "-");
+	else if (phase >= PROFILE_FILE_IO)
+		printf("%-35s%11.3f%11s\n", profile_phase_names[phase], wall * 1000.0, "-");
+	else
+		printf("%-35s%11.3f%11.3f\n", profile_phase_names[phase], wall * 1000.0, profile_timers[phase].cpu * 1000.0);
+}
+
+
+#ifdef LINUX
+/**
+ * Add a newly allocated block to the memory used by an area. The figures
+ * are updated atomically, without taking a lock; the peak is only written
+ * if it hasn't been raised past the new total by another thread.
+ *
+ * \param *use		Pointer to the memory used by the area.
+ * \param size		The size of the block.
+ */
+
+static void profile_add_memory_use(struct profile_memory_use *use, size_t size)
+{
+	size_t	current, peak;
+
+	__atomic_add_fetch(&use->blocks, 1, __ATOMIC_RELAXED);
+	current = __atomic_add_fetch(&use->current, size, __ATOMIC_RELAXED);
+
+	peak = __atomic_load_n(&use->peak, __ATOMIC_RELAXED);
+	while (current > peak && !__atomic_compare_exchange_n(&use->peak, &peak, current, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+#endif
+
+
+/**
+ * Write a line of the memory report to stdout.
+ *
+ * \param *name		Pointer to the name of the area.
+ * \param *use		Pointer to the memory used by the area.
+ */
+
+static void profile_report_memory(char *name, struct profile_memory_use *use)
+{
+	printf("%-35s%11lu%11.1f%11.1f\n", name, use->blocks, use->current / 1024.0, use->peak / 1024.0);
+}
+
+
+/**
+ * Read one of the clocks.
+ *
+ * \param cpu		True to read the CPU time used by the process; False
+ *			to read the wall time.
+ * \return		The time from the clock, in seconds.
+ */
+
+static double profile_read_clock(bool cpu)
+{
+#ifdef LINUX
+	struct timespec	now;
+
+	if (clock_gettime((cpu) ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_MONOTONIC, &now) != 0)
+		return 0.0;
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1000000000.0;
+#else
+	return 0.0;
+#endif
+}
+
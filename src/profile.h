@@ -0,0 +1,187 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file profile.h
+ *
+ * Phase Timing and Counters, interface.
+ */
+
+#ifndef TOKENIZE_PROFILE_H
+#define TOKENIZE_PROFILE_H
+
+#include <stdbool.h>
+
+/**
+ * The phases which can be timed. This must match the entries in the
+ * profile_phase_names[] array defined in profile.c.
+ *
+ * The phases from PROFILE_FILE_IO onwards are entered for every line, and
+ * only record wall time. Those from PROFILE_KEYWORDS onwards are only ever
+ * entered from within PROFILE_PARSE, and their times are included in it.
+ */
+
+enum profile_phase {
+	PROFILE_ARGS = 0,		/**< Decoding the command line.				*/
+	PROFILE_SWI_LOAD,		/**< Loading SWI header files.				*/
+	PROFILE_FILE_IO,		/**< Opening and reading source files.			*/
+	PROFILE_PARSE,			/**< Parsing source lines.				*/
+	PROFILE_OUTPUT,			/**< Writing the tokenised output.			*/
+	PROFILE_KEYWORDS,		/**< Matching keywords.					*/
+	PROFILE_LOOKUP,			/**< Looking up variables and FN/PROC names.		*/
+	PROFILE_SWI_LOOKUP,		/**< Converting SWI names into numbers.			*/
+	PROFILE_ASSEMBLER,		/**< Recognising assembler mnemonics.			*/
+	PROFILE_PHASES			/**< The number of phases.				*/
+};
+
+/**
+ * The events which can be counted. This must match the entries in the
+ * profile_counter_names[] array defined in profile.c.
+ */
+
+enum profile_counter {
+	PROFILE_LINES = 0,		/**< Source lines parsed.				*/
+	PROFILE_STATEMENTS,		/**< Statements parsed.					*/
+	PROFILE_KEYWORDS_FULL,		/**< Keywords matched in full.				*/
+	PROFILE_KEYWORDS_ABBREVIATED,	/**< Keywords matched from abbreviations.		*/
+	PROFILE_VARIABLE_LOOKUPS,	/**< Searches of the variable table.			*/
+	PROFILE_VARIABLE_STEPS,		/**< Entries examined during variable searches.		*/
+	PROFILE_CONSTANTS,		/**< Constants substituted into the output.		*/
+	PROFILE_LIBRARIES,		/**< Libraries queued for linking.			*/
+	PROFILE_COUNTERS		/**< The number of counters.				*/
+};
+
+/**
+ * The areas for which heap memory is accounted. This must match the entries
+ * in the profile_memory_names[] array defined in profile.c.
+ */
+
+enum profile_memory {
+	PROFILE_MEMORY_ARGS = 0,	/**< The decoded command line.				*/
+	PROFILE_MEMORY_LIBRARY,		/**< The library paths and queue of files.		*/
+	PROFILE_MEMORY_MEMO,		/**< The memo of repeated lines.			*/
+	PROFILE_MEMORY_MSG,		/**< Messages waiting to be reported.			*/
+	PROFILE_MEMORY_PRELOAD,		/**< Files being preloaded.				*/
+	PROFILE_MEMORY_PROC,		/**< The FN/PROC table.					*/
+	PROFILE_MEMORY_PROGRAM,		/**< The program store.					*/
+	PROFILE_MEMORY_SWI,		/**< The SWI name tables.				*/
+	PROFILE_MEMORY_VARIABLE,	/**< The variable table.				*/
+	PROFILE_MEMORY_AREAS		/**< The number of areas.				*/
+};
+
+
+/**
+ * Initialise the profile module, and start timing PROFILE_ARGS. This should
+ * be called as early as possible, since the command line hasn't been read
+ * yet and we don't know if profiling is wanted.
+ */
+
+void profile_initialise(void);
+
+
+/**
+ * Turn profiling on. Until this is called, the other calls do nothing.
+ */
+
+void profile_enable(void);
+
+
+/**
+ * Note that the command line has been read. Unless profiling has been
+ * turned on by now, memory is no longer accounted for.
+ */
+
+void profile_end_command_line(void);
+
+
+/**
+ * Start timing a phase.
+ *
+ * \param phase		The phase to start timing.
+ */
+
+void profile_start(enum profile_phase phase);
+
+
+/**
+ * Stop timing a phase, adding the time since profile_start() was called
+ * to its total.
+ *
+ * \param phase		The phase to stop timing.
+ */
+
+void profile_stop(enum profile_phase phase);
+
+
+/**
+ * Add to one of the counters.
+ *
+ * \param counter	The counter to add to.
+ * \param count		The amount to add.
+ */
+
+void profile_count(enum profile_counter counter, unsigned count);
+
+
+/**
+ * Read one of the counters.
+ *
+ * \param counter	The counter to read.
+ * \return		The value of the counter, or 0 if profiling is not
+ *			enabled.
+ */
+
+unsigned long profile_get_count(enum profile_counter counter);
+
+
+/**
+ * Account for a block of memory which has just been allocated. This is done
+ * until the command line has been read whether or not profiling is enabled,
+ * since blocks are allocated before it is known if it is wanted.
+ *
+ * \param area		The area which owns the block.
+ * \param *block	Pointer to the block, or NULL.
+ */
+
+void profile_add_memory(enum profile_memory area, void *block);
+
+
+/**
+ * Account for a block of memory which is about to be freed.
+ *
+ * \param area		The area which owns the block.
+ * \param *block	Pointer to the block, or NULL.
+ */
+
+void profile_remove_memory(enum profile_memory area, void *block);
+
+
+/**
+ * Write the times and counts collected so far to stdout, if profiling
+ * is enabled, then clear them ready for the next run.
+ */
+
+void profile_report(void);
+
+#endif
+
@@ -0,0 +1,1255 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file program.c
+ *
+ * Tokenised Program Store, implementation.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Local source headers. */
+
+#include "program.h"
+
+#include "fold.h"
+#include "msg.h"
+#include "parse.h"
+#include "proc.h"
+#include "profile.h"
+
+#define PROGRAM_MAX_NAME 256
+#define PROGRAM_MAX_LINE_LENGTH 255
+#define PROGRAM_HEAD_LENGTH 4
+
+/**
+ * A tokenised line, forming one entry in a linked list.
+ */
+
+struct program_line {
+	unsigned		number;		/**< The line's number.					*/
+	char			*data;		/**< The tokenised line, starting at the \r.		*/
+	bool			assembler;	/**< True if the line is all or part of an assembler block.	*/
+
+	struct program_line	*next;		/**< Pointer to the next line, or NULL.			*/
+};
+
+/**
+ * A block of lines which starts with a DEF, and which is moved as a unit
+ * when the program is reordered.
+ */
+
+struct program_block {
+	struct program_line	*first;		/**< The first line in the block.			*/
+	struct program_line	*last;		/**< The last line in the block.			*/
+	unsigned long		calls;		/**< The number of calls to the routines defined.	*/
+	bool			data;		/**< True if the block contains DATA statements.	*/
+	int			index;		/**< The block's original position in the program.	*/
+};
+
+static struct program_line	*program_head = NULL;
+static struct program_line	*program_tail = NULL;
+
+static bool program_remove_dead_block(struct program_line *previous, struct program_line *line, unsigned char *targets);
+static bool program_remove_dead_statement(struct program_line *previous, struct program_line *line, unsigned char *targets, bool keep_lines);
+static bool program_find_block_end(struct program_line *line, struct program_line **otherwise, struct program_line **end);
+static void program_strip_keyword(struct program_line *previous, struct program_line *line, unsigned char *targets);
+static void program_remove_lines(struct program_line *previous, struct program_line *line, struct program_line *end, unsigned char *targets);
+static void program_replace_body(struct program_line *line, char *start, char *from, char *to);
+static bool program_check_region(struct program_line *line, struct program_line *end, unsigned char *targets);
+static struct program_line *program_find_previous(struct program_line *line);
+static bool program_is_empty(struct program_line *line);
+static int program_first_item(struct program_line *line);
+static bool program_ends_with_then(struct program_line *line);
+static unsigned char *program_find_targets(void);
+static bool program_is_target(struct program_line *line, unsigned char *targets);
+static bool program_check_references(struct program_line *line, unsigned *numbers, int count);
+static bool program_check_constant(char *constant, unsigned *numbers, int count);
+static bool program_is_definition(struct program_line *line);
+static bool program_contains_data(struct program_line *line);
+static bool program_can_merge(struct program_line *line, struct program_line *next, unsigned char *targets);
+static bool program_merge(struct program_line *line, struct program_line *next);
+static unsigned long program_get_calls(struct program_line *line);
+static void program_renumber_constants(struct program_line *line, unsigned *numbers, unsigned *renumbered, int count);
+static int program_find_number(unsigned number, unsigned *numbers, int count);
+static int program_compare_blocks(const void *a, const void *b);
+static void program_free(void *block);
+
+
+/**
+ * Add a tokenised line to the end of the stored program.
+ *
+ * \param *line		Pointer to the tokenised line to be copied.
+ * \param assembler	True if the line is all or part of an assembler block.
+ * \return		True if successful; False on failure.
+ */
+
+bool program_add_line(char *line, bool assembler)
+{
+	struct program_line	*entry;
+	unsigned		length;
+
+	if (line == NULL)
+		return false;
+
+	length = *((unsigned char *) line + 3);
+
+	entry = malloc(sizeof(struct program_line));
+	if (entry == NULL) {
+		msg_report(MSG_PROGRAM_NOMEM);
+		return false;
+	}
+
+	profile_add_memory(PROFILE_MEMORY_PROGRAM, entry);
+
+	entry->data = malloc(length);
+	if (entry->data == NULL) {
+		program_free(entry);
+		msg_report(MSG_PROGRAM_NOMEM);
+		return false;
+	}
+
+	profile_add_memory(PROFILE_MEMORY_PROGRAM, entry->data);
+
+	memcpy(entry->data, line, length);
+	entry->number = (*((unsigned char *) line + 1) << 8) | *((unsigned char *) line + 2);
+	entry->assembler = assembler;
+	entry->next = NULL;
+
+	if (program_tail == NULL)
+		program_head = entry;
+	else
+		program_tail->next = entry;
+
+	program_tail = entry;
+
+	return true;
+}
+
+
+/**
+ * Remove any code which can never run because it is controlled by an IF
+ * whose condition is constant, such as one using a constant variable given
+ * with -define. Both single-line and multi-line IF statements are handled.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool program_remove_dead_code(void)
+{
+	struct program_line	*previous, *line;
+	unsigned char		*targets;
+	bool			computed = false;
+
+	/* If any line references can't be followed, lines can't safely be
+	 * removed from the program; code can still be removed from within
+	 * single lines, but lines which end up empty must be kept.
+	 */
+
+	for (line = program_head; line != NULL; line = line->next) {
+		if (!program_check_references(line, NULL, 0))
+			computed = true;
+	}
+
+	targets = program_find_targets();
+	if (targets == NULL)
+		return false;
+
+	previous = NULL;
+	line = program_head;
+
+	while (line != NULL) {
+		if (!line->assembler && ((!computed && program_remove_dead_block(previous, line, targets)) ||
+				program_remove_dead_statement(previous, line, targets, computed))) {
+			line = (previous == NULL) ? program_head : previous->next;
+			continue;
+		}
+
+		previous = line;
+		line = line->next;
+	}
+
+	program_free(targets);
+
+	return true;
+}
+
+
+/**
+ * Reorder the DEF blocks at the end of the program, so that the most called
+ * routines are found first by the interpreter. The line numbers used by the
+ * blocks are reallocated in their new order, and any line number constants
+ * which refer to them are updated to match.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool program_order_definitions(void)
+{
+	struct program_line	*start, *previous, *line;
+	struct program_block	*blocks;
+	unsigned		*numbers, *renumbered;
+	int			count = 0, block_count = 0, i;
+
+	/* Find the first line starting with a DEF, which marks the end of the
+	 * main program. Everything from here on is a candidate for moving.
+	 */
+
+	previous = NULL;
+	start = program_head;
+
+	while (start != NULL && !program_is_definition(start)) {
+		previous = start;
+		start = start->next;
+	}
+
+	if (start == NULL)
+		return true;
+
+	for (line = start; line != NULL; line = line->next)
+		count++;
+
+	numbers = malloc(sizeof(unsigned) * count);
+	renumbered = malloc(sizeof(unsigned) * count);
+	blocks = malloc(sizeof(struct program_block) * count);
+
+	profile_add_memory(PROFILE_MEMORY_PROGRAM, numbers);
+	profile_add_memory(PROFILE_MEMORY_PROGRAM, renumbered);
+	profile_add_memory(PROFILE_MEMORY_PROGRAM, blocks);
+
+	if (numbers == NULL || renumbered == NULL || blocks == NULL) {
+		program_free(numbers);
+		program_free(renumbered);
+		program_free(blocks);
+		msg_report(MSG_PROGRAM_NOMEM);
+		return false;
+	}
+
+	/* Record the line numbers in use, which must be in sequence if we're
+	 * to be able to shuffle them around.
+	 */
+
+	for (line = start, i = 0; line != NULL; line = line->next, i++) {
+		numbers[i] = line->number;
+
+		if (i > 0 && numbers[i] <= numbers[i - 1]) {
+			msg_report(MSG_ORDER_SEQUENCE, line->number);
+			program_free(numbers);
+			program_free(renumbered);
+			program_free(blocks);
+			return true;
+		}
+	}
+
+	/* Check that every reference to a line can be followed. */
+
+	for (line = program_head; line != NULL; line = line->next) {
+		if (!program_check_references(line, numbers, count)) {
+			msg_report(MSG_ORDER_COMPUTED, line->number);
+			program_free(numbers);
+			program_free(renumbered);
+			program_free(blocks);
+			return true;
+		}
+	}
+
+	/* Split the lines into blocks at each DEF. Consecutive DEF lines are
+	 * kept together, to allow for routines which share a body.
+	 */
+
+	for (line = start; line != NULL; line = line->next) {
+		if (program_is_definition(line) && (block_count == 0 || !program_is_definition(blocks[block_count - 1].last))) {
+			blocks[block_count].first = line;
+			blocks[block_count].calls = 0;
+			blocks[block_count].data = false;
+			blocks[block_count].index = block_count;
+			block_count++;
+		}
+
+		blocks[block_count - 1].last = line;
+
+		if (program_is_definition(line)) {
+			unsigned long calls = program_get_calls(line);
+
+			if (calls > blocks[block_count - 1].calls)
+				blocks[block_count - 1].calls = calls;
+		}
+
+		if (program_contains_data(line))
+			blocks[block_count - 1].data = true;
+	}
+
+	qsort(blocks, block_count, sizeof(struct program_block), program_compare_blocks);
+
+	/* Relink the blocks in their new order. */
+
+	for (i = 0; i < block_count; i++) {
+		if (i == 0 && previous == NULL)
+			program_head = blocks[i].first;
+		else if (i == 0)
+			previous->next = blocks[i].first;
+		else
+			blocks[i - 1].last->next = blocks[i].first;
+	}
+
+	blocks[block_count - 1].last->next = NULL;
+	program_tail = blocks[block_count - 1].last;
+
+	/* Hand the line numbers back out in sequence, then update any
+	 * references to them before changing the lines themselves.
+	 */
+
+	line = (previous == NULL) ? program_head : previous->next;
+
+	for (i = 0; line != NULL; line = line->next, i++)
+		renumbered[program_find_number(line->number, numbers, count)] = numbers[i];
+
+	for (line = program_head; line != NULL; line = line->next)
+		program_renumber_constants(line, numbers, renumbered, count);
+
+	line = (previous == NULL) ? program_head : previous->next;
+
+	for (i = 0; line != NULL; line = line->next, i++) {
+		line->number = numbers[i];
+		line->data[1] = (line->number & 0xff00) >> 8;
+		line->data[2] = line->number & 0xff;
+	}
+
+	program_free(numbers);
+	program_free(renumbered);
+	program_free(blocks);
+
+	return true;
+}
+
+
+/**
+ * Merge consecutive lines together, up to the maximum line length, where
+ * this can be done without changing the way that the program runs. Lines
+ * which are the target of a line number constant are left alone.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool program_merge_lines(void)
+{
+	struct program_line	*line, *next;
+	unsigned char		*targets;
+
+	for (line = program_head; line != NULL; line = line->next) {
+		if (!program_check_references(line, NULL, 0)) {
+			msg_report(MSG_MERGE_COMPUTED, line->number);
+			return true;
+		}
+	}
+
+	targets = program_find_targets();
+	if (targets == NULL)
+		return false;
+
+	/* Pull lines up onto the one before for as long as we can. */
+
+	line = program_head;
+
+	while (line != NULL && line->next != NULL) {
+		next = line->next;
+
+		if (!program_can_merge(line, next, targets)) {
+			line = next;
+			continue;
+		}
+
+		if (!program_merge(line, next)) {
+			program_free(targets);
+			return false;
+		}
+	}
+
+	program_free(targets);
+
+	return true;
+}
+
+
+/**
+ * Write the stored program to a file, without the end of program marker.
+ *
+ * \param *out		The handle of the file to write to.
+ * \return		True if successful; False on failure.
+ */
+
+bool program_write(FILE *out)
+{
+	struct program_line	*line;
+	unsigned		length;
+
+	if (out == NULL)
+		return false;
+
+	for (line = program_head; line != NULL; line = line->next) {
+		length = *((unsigned char *) line->data + 3);
+
+		if (fwrite(line->data, sizeof(char), length, out) != length)
+			return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Discard the stored program, freeing the memory that it used.
+ */
+
+void program_clear(void)
+{
+	struct program_line	*line;
+
+	while (program_head != NULL) {
+		line = program_head;
+		program_head = line->next;
+		program_free(line->data);
+		program_free(line);
+	}
+
+	program_tail = NULL;
+}
+
+
+/**
+ * Remove the dead part of a multi-line IF ... ELSE ... ENDIF block whose
+ * condition is constant, along with the IF, ELSE and ENDIF themselves.
+ *
+ * \param *previous	Pointer to the line before the IF, or NULL.
+ * \param *line		Pointer to the line to test for an IF.
+ * \param *targets	Pointer to the bitmap of referenced line numbers.
+ * \return		True if the program was changed; else False.
+ */
+
+static bool program_remove_dead_block(struct program_line *previous, struct program_line *line, unsigned char *targets)
+{
+	struct program_line	*otherwise, *end, *stop;
+	struct parse_scan	scan;
+	bool			result;
+
+	parse_scan_start(&scan, line->data);
+
+	if (parse_scan_next(&scan) != parse_get_token(KWD_IF) || !fold_evaluate_condition(&scan, &result) ||
+			parse_scan_next(&scan) != parse_get_token(KWD_THEN) || parse_scan_next(&scan) != PARSE_SCAN_END)
+		return false;
+
+	if (!program_find_block_end(line, &otherwise, &end))
+		return false;
+
+	if (result) {
+		if (otherwise != NULL && !program_check_region(otherwise, end, targets))
+			return false;
+
+		if (otherwise != NULL)
+			program_remove_lines(program_find_previous(otherwise), otherwise, end, targets);
+	} else {
+		stop = (otherwise != NULL) ? otherwise : end;
+
+		if (!program_check_region(line->next, stop, targets))
+			return false;
+
+		program_remove_lines(line, line->next, stop, targets);
+
+		if (otherwise != NULL)
+			program_strip_keyword(line, otherwise, targets);
+	}
+
+	program_strip_keyword(program_find_previous(end), end, targets);
+	program_remove_lines(previous, line, line->next, targets);
+
+	return true;
+}
+
+
+/**
+ * Remove the dead part of a single-line IF whose condition is constant,
+ * along with the IF itself. Processing stops at the first IF which can't
+ * be removed, as the rest of the line belongs to it.
+ *
+ * \param *previous	Pointer to the line before the one to process, or NULL.
+ * \param *line		Pointer to the line to process.
+ * \param *targets	Pointer to the bitmap of referenced line numbers.
+ * \param keep_lines	True if the line must be kept, even if empty.
+ * \return		True if the program was changed; else False.
+ */
+
+static bool program_remove_dead_statement(struct program_line *previous, struct program_line *line, unsigned char *targets, bool keep_lines)
+{
+	struct parse_scan	scan;
+	char			*start, *body, *otherwise = NULL, *rest = NULL, *end;
+	bool			result, nested = false;
+	int			item;
+
+	parse_scan_start(&scan, line->data);
+
+	do {
+		item = parse_scan_next(&scan);
+		if (item == PARSE_SCAN_END)
+			return false;
+	} while (!scan.statement_start || item != parse_get_token(KWD_IF));
+
+	start = scan.item;
+
+	if (!fold_evaluate_condition(&scan, &result) || parse_scan_next(&scan) != parse_get_token(KWD_THEN))
+		return false;
+
+	body = scan.position;
+	end = scan.end;
+
+	/* An IF with nothing after the THEN is a multi-line IF. */
+
+	item = parse_scan_next(&scan);
+	if (item == PARSE_SCAN_END)
+		return false;
+
+	/* Find the first ELSE, which is where a failed IF will continue. READ
+	 * only finds DATA at the start of a line, so moving it is not safe.
+	 */
+
+	for (; item != PARSE_SCAN_END; item = parse_scan_next(&scan)) {
+		if (item == parse_get_token(KWD_ELSE) && otherwise == NULL) {
+			otherwise = scan.item;
+			rest = scan.position;
+		} else if (item == parse_get_token(KWD_IF) && otherwise == NULL) {
+			nested = true;
+		} else if (item == parse_get_token(KWD_DATA)) {
+			return false;
+		}
+	}
+
+	/* A successful IF runs until any ELSE, but if there's another IF
+	 * before it, the ELSE belongs to that instead.
+	 */
+
+	if (result && otherwise != NULL && nested)
+		return false;
+
+	if (result)
+		program_replace_body(line, start, body, (otherwise != NULL) ? otherwise : end);
+	else if (otherwise != NULL)
+		program_replace_body(line, start, rest, end);
+	else
+		program_replace_body(line, start, end, end);
+
+	if (!keep_lines && program_is_empty(line))
+		program_remove_lines(previous, line, line->next, targets);
+
+	return true;
+}
+
+
+/**
+ * Find the ELSE and ENDIF belonging to a multi-line IF.
+ *
+ * \param *line		Pointer to the line containing the IF.
+ * \param **otherwise	Pointer to a variable to take the ELSE line, or NULL.
+ * \param **end		Pointer to a variable to take the ENDIF line.
+ * \return		True if the block could be followed; else False.
+ */
+
+static bool program_find_block_end(struct program_line *line, struct program_line **otherwise, struct program_line **end)
+{
+	int	depth = 0, item;
+
+	*otherwise = NULL;
+
+	for (line = line->next; line != NULL; line = line->next) {
+		if (line->assembler)
+			return false;
+
+		item = program_first_item(line);
+
+		if (item == parse_get_left_token(KWD_DEF))
+			return false;
+
+		if (depth == 0 && item == parse_get_left_token(KWD_ELSE)) {
+			if (*otherwise != NULL)
+				return false;
+			*otherwise = line;
+		}
+
+		if (item == parse_get_left_token(KWD_ENDIF) && depth-- == 0) {
+			*end = line;
+			return true;
+		}
+
+		if (program_ends_with_then(line))
+			depth++;
+	}
+
+	return false;
+}
+
+
+/**
+ * Check that a run of lines can be removed from the program: none of them
+ * can be the target of a line reference, or contain DATA for READ to find.
+ *
+ * \param *line		Pointer to the first line in the run.
+ * \param *end		Pointer to the line after the run.
+ * \param *targets	Pointer to the bitmap of referenced line numbers.
+ * \return		True if the lines can be removed; else False.
+ */
+
+static bool program_check_region(struct program_line *line, struct program_line *end, unsigned char *targets)
+{
+	for (; line != NULL && line != end; line = line->next) {
+		if (program_is_target(line, targets) || program_contains_data(line))
+			return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Remove the keyword from the start of a line, along with any colon which
+ * follows it. If nothing else remains, the line is removed.
+ *
+ * \param *previous	Pointer to the line before the one to process, or NULL.
+ * \param *line		Pointer to the line to process.
+ * \param *targets	Pointer to the bitmap of referenced line numbers.
+ */
+
+static void program_strip_keyword(struct program_line *previous, struct program_line *line, unsigned char *targets)
+{
+	struct parse_scan	scan;
+	char			*start, *rest;
+
+	parse_scan_start(&scan, line->data);
+
+	if (parse_scan_next(&scan) == PARSE_SCAN_END)
+		return;
+
+	start = scan.item;
+	rest = scan.position;
+
+	while (rest < scan.end && *rest == ' ')
+		rest++;
+
+	if (rest < scan.end && *rest == ':')
+		rest++;
+
+	while (rest < scan.end && *rest == ' ')
+		rest++;
+
+	memmove(start, rest, scan.end - rest);
+	line->data[3] = (scan.end - rest) + (start - line->data);
+
+	if (program_is_empty(line))
+		program_remove_lines(previous, line, line->next, targets);
+}
+
+
+/**
+ * Remove a run of lines from the program. Any which are the target of
+ * a line reference are emptied instead, so that the reference still works.
+ *
+ * \param *previous	Pointer to the line before the run, or NULL.
+ * \param *line		Pointer to the first line in the run.
+ * \param *end		Pointer to the line after the run.
+ * \param *targets	Pointer to the bitmap of referenced line numbers.
+ */
+
+static void program_remove_lines(struct program_line *previous, struct program_line *line, struct program_line *end, unsigned char *targets)
+{
+	struct program_line	*next;
+
+	while (line != NULL && line != end) {
+		next = line->next;
+
+		if (program_is_target(line, targets)) {
+			line->data[3] = PROGRAM_HEAD_LENGTH;
+			previous = line;
+		} else {
+			if (previous == NULL)
+				program_head = next;
+			else
+				previous->next = next;
+
+			if (program_tail == line)
+				program_tail = previous;
+
+			program_free(line->data);
+			program_free(line);
+		}
+
+		line = next;
+	}
+}
+
+
+/**
+ * Replace the statements in a line from a given point onwards with another
+ * part of the same line. Spaces around the new part are removed, and a line
+ * number following THEN or ELSE is turned into a GOTO.
+ *
+ * \param *line		Pointer to the line to update.
+ * \param *start	Pointer to the point in the line to replace from.
+ * \param *from		Pointer to the start of the replacement text.
+ * \param *to		Pointer to the end of the replacement text.
+ */
+
+static void program_replace_body(struct program_line *line, char *start, char *from, char *to)
+{
+	char		buffer[PROGRAM_MAX_LINE_LENGTH];
+	unsigned	length = 0;
+
+	while (from < to && *from == ' ')
+		from++;
+
+	while (to > from && *(to - 1) == ' ')
+		to--;
+
+	/* With nothing to add, remove any separator left at the end. */
+
+	if (from == to) {
+		while (start > line->data + PROGRAM_HEAD_LENGTH && (*(start - 1) == ' ' || *(start - 1) == ':'))
+			start--;
+	}
+
+	if (from < to && (unsigned char) *from == PARSE_TOKEN_CONST)
+		buffer[length++] = parse_get_token(KWD_GOTO);
+
+	memcpy(buffer + length, from, to - from);
+	length += to - from;
+
+	memcpy(start, buffer, length);
+	line->data[3] = (start - line->data) + length;
+}
+
+
+/**
+ * Test a line to see if it contains nothing but whitespace.
+ *
+ * \param *line		Pointer to the line to test.
+ * \return		True if the line is empty; else False.
+ */
+
+static bool program_is_empty(struct program_line *line)
+{
+	return (program_first_item(line) == PARSE_SCAN_END) ? true : false;
+}
+
+
+/**
+ * Return the first item in a line.
+ *
+ * \param *line		Pointer to the line to test.
+ * \return		The first item, as returned by parse_scan_next().
+ */
+
+static int program_first_item(struct program_line *line)
+{
+	struct parse_scan	scan;
+
+	parse_scan_start(&scan, line->data);
+
+	return parse_scan_next(&scan);
+}
+
+
+/**
+ * Test a line to see if it ends with a THEN, and so opens a multi-line IF.
+ *
+ * \param *line		Pointer to the line to test.
+ * \return		True if the line ends with THEN; else False.
+ */
+
+static bool program_ends_with_then(struct program_line *line)
+{
+	struct parse_scan	scan;
+	int			item, last = PARSE_SCAN_END;
+
+	parse_scan_start(&scan, line->data);
+
+	while ((item = parse_scan_next(&scan)) != PARSE_SCAN_END)
+		last = item;
+
+	return (last == parse_get_token(KWD_THEN)) ? true : false;
+}
+
+
+/**
+ * Find the line before a line in the program.
+ *
+ * \param *line		Pointer to the line to find.
+ * \return		Pointer to the line before, or NULL if none.
+ */
+
+static struct program_line *program_find_previous(struct program_line *line)
+{
+	struct program_line	*previous;
+
+	if (line == program_head)
+		return NULL;
+
+	for (previous = program_head; previous != NULL && previous->next != line; previous = previous->next);
+
+	return previous;
+}
+
+
+/**
+ * Build a bitmap of all of the line numbers referred to by line number
+ * constants in the program.
+ *
+ * \return		Pointer to the bitmap, or NULL on failure.
+ */
+
+static unsigned char *program_find_targets(void)
+{
+	struct program_line	*line;
+	struct parse_scan	scan;
+	unsigned char		*targets;
+	unsigned		number;
+	int			item;
+
+	targets = calloc((PARSE_MAX_LINE_NUMBER >> 3) + 1, sizeof(unsigned char));
+	if (targets == NULL) {
+		msg_report(MSG_PROGRAM_NOMEM);
+		return NULL;
+	}
+
+	profile_add_memory(PROFILE_MEMORY_PROGRAM, targets);
+
+	for (line = program_head; line != NULL; line = line->next) {
+		parse_scan_start(&scan, line->data);
+
+		while ((item = parse_scan_next(&scan)) != PARSE_SCAN_END) {
+			if (item != PARSE_TOKEN_CONST)
+				continue;
+
+			number = parse_read_line_constant(scan.item + 1);
+			if (number <= PARSE_MAX_LINE_NUMBER)
+				targets[number >> 3] |= 1 << (number & 0x07);
+		}
+	}
+
+	return targets;
+}
+
+
+/**
+ * Test a line to see if it is the target of a line number constant.
+ *
+ * \param *line		Pointer to the line to test.
+ * \param *targets	Pointer to the bitmap of referenced line numbers.
+ * \return		True if the line is a target; else False.
+ */
+
+static bool program_is_target(struct program_line *line, unsigned char *targets)
+{
+	return (line->number <= PARSE_MAX_LINE_NUMBER && (targets[line->number >> 3] & (1 << (line->number & 0x07)))) ? true : false;
+}
+
+
+/**
+ * Check a line for references to other lines which can't be updated if the
+ * lines are renumbered: computed GOTO, GOSUB and RESTORE, comparisons with
+ * ERL, and constants which fall between lines in the range being moved.
+ * If no line numbers are supplied, constants are not checked.
+ *
+ * \param *line		Pointer to the line to check.
+ * \param *numbers	Pointer to the sorted line numbers which may move.
+ * \param count		The number of line numbers in the array.
+ * \return		True if the line is safe; False if not.
+ */
+
+static bool program_check_references(struct program_line *line, unsigned *numbers, int count)
+{
+	struct parse_scan	scan;
+	int			item, previous = PARSE_SCAN_END;
+
+	parse_scan_start(&scan, line->data);
+
+	while ((item = parse_scan_next(&scan)) != PARSE_SCAN_END) {
+		if (item == PARSE_TOKEN_CONST) {
+			if (!program_check_constant(scan.item + 1, numbers, count))
+				return false;
+		} else if (item == parse_get_token(KWD_GOTO) || item == parse_get_token(KWD_GOSUB)) {
+			item = parse_scan_next(&scan);
+
+			while (item == PARSE_TOKEN_CONST) {
+				if (!program_check_constant(scan.item + 1, numbers, count))
+					return false;
+
+				item = parse_scan_next(&scan);
+				if (item != ',')
+					break;
+
+				item = parse_scan_next(&scan);
+			}
+
+			if (item != PARSE_SCAN_END && item != ':' && item != parse_get_token(KWD_ELSE))
+				return false;
+		} else if (item == parse_get_token(KWD_RESTORE)) {
+			item = parse_scan_next(&scan);
+
+			if (item == PARSE_TOKEN_CONST) {
+				if (!program_check_constant(scan.item + 1, numbers, count))
+					return false;
+
+				item = parse_scan_next(&scan);
+			} else if (item == parse_get_token(KWD_DATA) || item == parse_get_token(KWD_ERROR) ||
+					item == parse_get_token(KWD_LOCAL)) {
+				item = parse_scan_next(&scan);
+			}
+
+			if (item != PARSE_SCAN_END && item != ':' && item != parse_get_token(KWD_ELSE))
+				return false;
+		} else if (item == parse_get_token(KWD_ERL)) {
+			/* ERL is safe to print, but not to use in any other way. */
+
+			if (previous != ';' && previous != ',' && previous != '\'' && previous != '~' &&
+					previous != parse_get_token(KWD_PRINT))
+				return false;
+
+			item = parse_scan_next(&scan);
+
+			if (item != PARSE_SCAN_END && item != ':' && item != ';' && item != ',' && item != '\'' &&
+					item != parse_get_token(KWD_ELSE))
+				return false;
+		}
+
+		previous = item;
+	}
+
+	return true;
+}
+
+
+/**
+ * Check a line number constant, to ensure that if it falls within the range
+ * of lines which may be renumbered, it refers to one of them exactly.
+ *
+ * \param *constant	Pointer to the three bytes of the encoded constant.
+ * \param *numbers	Pointer to the sorted line numbers which may move.
+ * \param count		The number of line numbers in the array.
+ * \return		True if the constant is safe; False if not.
+ */
+
+static bool program_check_constant(char *constant, unsigned *numbers, int count)
+{
+	unsigned	number;
+
+	if (numbers == NULL || count == 0)
+		return true;
+
+	number = parse_read_line_constant(constant);
+
+	if (number < numbers[0] || number > numbers[count - 1])
+		return true;
+
+	return (program_find_number(number, numbers, count) != -1) ? true : false;
+}
+
+
+/**
+ * Test a line to see if it starts with a DEF.
+ *
+ * \param *line		Pointer to the line to test.
+ * \return		True if the line starts with DEF; else False.
+ */
+
+static bool program_is_definition(struct program_line *line)
+{
+	struct parse_scan	scan;
+
+	parse_scan_start(&scan, line->data);
+
+	return (parse_scan_next(&scan) == parse_get_left_token(KWD_DEF)) ? true : false;
+}
+
+
+/**
+ * Test a line to see if it contains any DATA statements.
+ *
+ * \param *line		Pointer to the line to test.
+ * \return		True if the line contains DATA; else False.
+ */
+
+static bool program_contains_data(struct program_line *line)
+{
+	struct parse_scan	scan;
+	int			item;
+
+	parse_scan_start(&scan, line->data);
+
+	while ((item = parse_scan_next(&scan)) != PARSE_SCAN_END) {
+		if (item == parse_get_token(KWD_DATA))
+			return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Test whether a line can be appended to the one before it.
+ *
+ * \param *line		Pointer to the line to be appended to.
+ * \param *next		Pointer to the line to be appended.
+ * \param *targets	Pointer to the bitmap of referenced line numbers.
+ * \return		True if the lines can be merged; else False.
+ */
+
+static bool program_can_merge(struct program_line *line, struct program_line *next, unsigned char *targets)
+{
+	struct parse_scan	scan;
+	int			item, length;
+
+	if (line->assembler || next->assembler)
+		return false;
+
+	if (program_is_target(next, targets))
+		return false;
+
+	length = *((unsigned char *) line->data + 3) + *((unsigned char *) next->data + 3) - PROGRAM_HEAD_LENGTH + 1;
+	if (length > PROGRAM_MAX_LINE_LENGTH)
+		return false;
+
+	/* Anything following an IF, CASE, ON, REM, DATA or star command would
+	 * be swallowed up by it if moved on to the same line.
+	 */
+
+	parse_scan_start(&scan, line->data);
+
+	while ((item = parse_scan_next(&scan)) != PARSE_SCAN_END) {
+		if (item == parse_get_token(KWD_IF) || item == parse_get_token(KWD_CASE) ||
+				item == parse_get_token(KWD_ON) || item == parse_get_token(KWD_REM) ||
+				item == parse_get_token(KWD_DATA) || item == parse_get_token(KWD_ELSE) ||
+				item == parse_get_left_token(KWD_ELSE) || (item == '*' && scan.statement_start))
+			return false;
+	}
+
+	/* Some statements must be found at the start of a line. */
+
+	parse_scan_start(&scan, next->data);
+
+	item = parse_scan_next(&scan);
+
+	if (item == parse_get_left_token(KWD_DEF) || item == parse_get_left_token(KWD_ELSE) ||
+			item == parse_get_left_token(KWD_WHEN) || item == parse_get_left_token(KWD_OTHERWISE) ||
+			item == parse_get_left_token(KWD_ENDCASE) || item == parse_get_left_token(KWD_ENDIF) ||
+			item == parse_get_left_token(KWD_ENDWHILE))
+		return false;
+
+	return (program_contains_data(next)) ? false : true;
+}
+
+
+/**
+ * Append a line to the one before it, separated by a colon, and remove it
+ * from the program.
+ *
+ * \param *line		Pointer to the line to be appended to.
+ * \param *next		Pointer to the line to be appended.
+ * \return		True if successful; False on failure.
+ */
+
+static bool program_merge(struct program_line *line, struct program_line *next)
+{
+	char		*data, *start, *end, *append, *append_end;
+	unsigned	length;
+
+	start = line->data + PROGRAM_HEAD_LENGTH;
+	end = line->data + *((unsigned char *) line->data + 3);
+
+	while (end > start && *(end - 1) == ' ')
+		end--;
+
+	append = next->data + PROGRAM_HEAD_LENGTH;
+	append_end = next->data + *((unsigned char *) next->data + 3);
+
+	while (append < append_end && *append == ' ')
+		append++;
+
+	if (append < append_end) {
+		data = malloc(PROGRAM_MAX_LINE_LENGTH);
+		if (data == NULL) {
+			msg_report(MSG_PROGRAM_NOMEM);
+			return false;
+		}
+
+		profile_add_memory(PROFILE_MEMORY_PROGRAM, data);
+
+		length = end - line->data;
+		memcpy(data, line->data, length);
+
+		if (end > start && *(end - 1) != ':')
+			data[length++] = ':';
+
+		memcpy(data + length, append, append_end - append);
+		length += append_end - append;
+		data[3] = length;
+
+		program_free(line->data);
+		line->data = data;
+	}
+
+	line->next = next->next;
+	if (program_tail == next)
+		program_tail = line;
+
+	program_free(next->data);
+	program_free(next);
+
+	return true;
+}
+
+
+/**
+ * Return the number of calls made to the routine defined on a DEF line.
+ *
+ * \param *line		Pointer to the line to test.
+ * \return		The number of calls to the routine.
+ */
+
+static unsigned long program_get_calls(struct program_line *line)
+{
+	struct parse_scan	scan;
+	char			name[PROGRAM_MAX_NAME];
+	int			item, length = 0;
+
+	parse_scan_start(&scan, line->data);
+
+	if (parse_scan_next(&scan) != parse_get_left_token(KWD_DEF))
+		return 0;
+
+	item = parse_scan_next(&scan);
+	if (item != parse_get_token(KWD_PROC) && item != parse_get_token(KWD_FN))
+		return 0;
+
+	while (scan.position < scan.end && length < PROGRAM_MAX_NAME - 1 &&
+			((*scan.position >= 'a' && *scan.position <= 'z') || (*scan.position >= 'A' && *scan.position <= 'Z') ||
+			(*scan.position >= '0' && *scan.position <= '9') || *scan.position == '_' || *scan.position == '`'))
+		name[length++] = *scan.position++;
+
+	name[length] = '\0';
+
+	return proc_get_calls(name, item == parse_get_token(KWD_FN));
+}
+
+
+/**
+ * Update any line number constants in a line which refer to lines which
+ * have been renumbered.
+ *
+ * \param *line		Pointer to the line to update.
+ * \param *numbers	Pointer to the sorted original line numbers.
+ * \param *renumbered	Pointer to the new numbers for each original line.
+ * \param count		The number of line numbers in the arrays.
+ */
+
+static void program_renumber_constants(struct program_line *line, unsigned *numbers, unsigned *renumbered, int count)
+{
+	struct parse_scan	scan;
+	int			item, index;
+
+	parse_scan_start(&scan, line->data);
+
+	while ((item = parse_scan_next(&scan)) != PARSE_SCAN_END) {
+		if (item != PARSE_TOKEN_CONST)
+			continue;
+
+		index = program_find_number(parse_read_line_constant(scan.item + 1), numbers, count);
+		if (index != -1)
+			parse_write_line_constant(scan.item + 1, renumbered[index]);
+	}
+}
+
+
+/**
+ * Find a line number in a sorted array of line numbers.
+ *
+ * \param number	The line number to find.
+ * \param *numbers	Pointer to the sorted line numbers.
+ * \param count		The number of line numbers in the array.
+ * \return		The index of the number, or -1 if not found.
+ */
+
+static int program_find_number(unsigned number, unsigned *numbers, int count)
+{
+	int	low = 0, high = count - 1, middle;
+
+	while (low <= high) {
+		middle = (low + high) / 2;
+
+		if (numbers[middle] == number)
+			return middle;
+		else if (numbers[middle] < number)
+			low = middle + 1;
+		else
+			high = middle - 1;
+	}
+
+	return -1;
+}
+
+
+/**
+ * Compare two blocks for qsort(), putting the most called routines first.
+ * Blocks containing DATA go to the end in their original order, so that
+ * READ sees the same sequence of values.
+ *
+ * \param *a		Pointer to the first block.
+ * \param *b		Pointer to the second block.
+ * \return		The result of the comparison.
+ */
+
+static int program_compare_blocks(const void *a, const void *b)
+{
+	const struct program_block	*first = a, *second = b;
+
+	if (first->data != second->data)
+		return (first->data) ? 1 : -1;
+
+	if (!first->data && first->calls != second->calls)
+		return (first->calls > second->calls) ? -1 : 1;
+
+	return first->index - second->index;
+}
+
+
+/**
+ * Free a block of memory belonging to the program store.
+ *
+ * \param *block	Pointer to the block to free, or NULL.
+ */
+
+static void program_free(void *block)
+{
+	profile_remove_memory(PROFILE_MEMORY_PROGRAM, block);
+	free(block);
+}
+
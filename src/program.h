@@ -0,0 +1,99 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file program.h
+ *
+ * Tokenised Program Store, interface.
+ */
+
+#ifndef TOKENIZE_PROGRAM_H
+#define TOKENIZE_PROGRAM_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+
+/**
+ * Add a tokenised line to the end of the stored program.
+ *
+ * \param *line		Pointer to the tokenised line to be copied.
+ * \param assembler	True if the line is all or part of an assembler block.
+ * \return		True if successful; False on failure.
+ */
+
+bool program_add_line(char *line, bool assembler);
+
+
+/**
+ * Remove any code which can never run because it is controlled by an IF
+ * whose condition is constant, such as one using a constant variable given
+ * with -define. Both single-line and multi-line IF statements are handled.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool program_remove_dead_code(void);
+
+
+/**
+ * Reorder the DEF blocks at the end of the program, so that the most called
+ * routines are found first by the interpreter. The line numbers used by the
+ * blocks are reallocated in their new order, and any line number constants
+ * which refer to them are updated to match.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool program_order_definitions(void);
+
+
+/**
+ * Merge consecutive lines together, up to the maximum line length, where
+ * this can be done without changing the way that the program runs. Lines
+ * which are the target of a line number constant are left alone.
+ *
+ * \return		True if successful; False on failure.
+ */
+
+bool program_merge_lines(void);
+
+
+/**
+ * Write the stored program to a file, without the end of program marker.
+ *
+ * \param *out		The handle of the file to write to.
+ * \return		True if successful; False on failure.
+ */
+
+bool program_write(FILE *out);
+
+
+/**
+ * Discard the stored program, freeing the memory that it used.
+ */
+
+void program_clear(void);
+
+#endif
+
@@ -0,0 +1,214 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file stats.c
+ *
+ * Parser Statistics, implementation.
+ *
+ * The statement parser counts each pass through its branches, and each
+ * keyword that it matches, so that the mix of code seen in real programs
+ * can be used to decide which paths are worth making faster.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local source headers. */
+
+#include "stats.h"
+
+/**
+ * The names of the branches. This must match the order of enum stats_branch.
+ */
+
+static char *stats_branch_names[] = {
+	"Keyword",
+	"Variable or name",
+	"Numeric constant",
+	"Line number constant",
+	"String",
+	"Star command",
+	"Assembler bracket",
+	"Assembler comment",
+	"Whitespace",
+	"Other character"
+};
+
+static bool		stats_enabled = false;
+static unsigned long	stats_branches[STATS_BRANCHES];
+static unsigned long	stats_keywords_full[MAX_KEYWORDS];
+static unsigned long	stats_keywords_abbreviated[MAX_KEYWORDS];
+static unsigned long	stats_keyword_misses = 0;
+
+static int stats_compare_keywords(const void *first, const void *second);
+static double stats_percent(unsigned long count, unsigned long total);
+
+
+/**
+ * Turn the statistics on. Until this is called, the other calls do nothing.
+ */
+
+void stats_enable(void)
+{
+	stats_enabled = true;
+}
+
+
+/**
+ * Count a pass through one of the statement parser's branches.
+ *
+ * \param branch	The branch taken.
+ */
+
+void stats_count_branch(enum stats_branch branch)
+{
+	if (stats_enabled && branch >= 0 && branch < STATS_BRANCHES)
+		stats_branches[branch]++;
+}
+
+
+/**
+ * Count a keyword which has been matched.
+ *
+ * \param keyword	The keyword matched.
+ * \param abbreviated	True if it was matched from an abbreviation.
+ */
+
+void stats_count_keyword(enum parse_keyword keyword, bool abbreviated)
+{
+	if (!stats_enabled || keyword < 0 || keyword >= MAX_KEYWORDS)
+		return;
+
+	if (abbreviated)
+		stats_keywords_abbreviated[keyword]++;
+	else
+		stats_keywords_full[keyword]++;
+}
+
+
+/**
+ * Count a name starting with an upper case letter which failed to match
+ * a keyword.
+ */
+
+void stats_count_keyword_miss(void)
+{
+	if (stats_enabled)
+		stats_keyword_misses++;
+}
+
+
+/**
+ * Write the statistics collected so far to stdout, if they are enabled,
+ * then clear them ready for the next run. The keywords are listed from the
+ * most frequent down, leaving out any which weren't seen.
+ */
+
+void stats_report(void)
+{
+	enum stats_branch	branch;
+	enum parse_keyword	keyword, order[MAX_KEYWORDS];
+	unsigned long		total = 0, full = 0, abbreviated = 0, count;
+
+	if (!stats_enabled)
+		return;
+
+	for (branch = STATS_KEYWORD; branch < STATS_BRANCHES; branch++)
+		total += stats_branches[branch];
+
+	printf("%-35s%11s%11s\n", "Parser branch", "Count", "%");
+
+	for (branch = STATS_KEYWORD; branch < STATS_BRANCHES; branch++)
+		printf("%-35s%11lu%11.2f\n", stats_branch_names[branch], stats_branches[branch], stats_percent(stats_branches[branch], total));
+
+	printf("%-35s%11lu\n", "Total", total);
+
+	for (keyword = 0; keyword < MAX_KEYWORDS; keyword++) {
+		order[keyword] = keyword;
+		full += stats_keywords_full[keyword];
+		abbreviated += stats_keywords_abbreviated[keyword];
+	}
+
+	qsort(order, MAX_KEYWORDS, sizeof(enum parse_keyword), stats_compare_keywords);
+
+	printf("\n%-24s%11s%11s%11s%11s\n", "Keyword", "Full", "Abbrev", "Total", "% Abbrev");
+
+	for (keyword = 0; keyword < MAX_KEYWORDS; keyword++) {
+		count = stats_keywords_full[order[keyword]] + stats_keywords_abbreviated[order[keyword]];
+		if (count == 0)
+			break;
+
+		printf("%-24s%11lu%11lu%11lu%11.2f\n", parse_get_keyword_name(order[keyword]),
+				stats_keywords_full[order[keyword]], stats_keywords_abbreviated[order[keyword]],
+				count, stats_percent(stats_keywords_abbreviated[order[keyword]], count));
+	}
+
+	printf("%-24s%11lu%11lu%11lu%11.2f\n", "Total", full, abbreviated, full + abbreviated, stats_percent(abbreviated, full + abbreviated));
+	printf("%-24s%11lu\n", "Names not keywords", stats_keyword_misses);
+
+	memset(stats_branches, 0, sizeof(stats_branches));
+	memset(stats_keywords_full, 0, sizeof(stats_keywords_full));
+	memset(stats_keywords_abbreviated, 0, sizeof(stats_keywords_abbreviated));
+	stats_keyword_misses = 0;
+}
+
+
+/**
+ * Compare two keywords for qsort(), so that the most frequent come first
+ * and those which were seen equally often stay in alphabetical order.
+ *
+ * \param *first	Pointer to the first keyword.
+ * \param *second	Pointer to the second keyword.
+ * \return		The result of the comparison.
+ */
+
+static int stats_compare_keywords(const void *first, const void *second)
+{
+	enum parse_keyword	a = *((const enum parse_keyword *) first), b = *((const enum parse_keyword *) second);
+	unsigned long		count_a, count_b;
+
+	count_a = stats_keywords_full[a] + stats_keywords_abbreviated[a];
+	count_b = stats_keywords_full[b] + stats_keywords_abbreviated[b];
+
+	if (count_a != count_b)
+		return (count_a > count_b) ? -1 : 1;
+
+	return (a > b) - (a < b);
+}
+
+
+/**
+ * Return one count as a percentage of another.
+ *
+ * \param count		The count.
+ * \param total		The total that it is part of.
+ * \return		The percentage, or 0 if the total is 0.
+ */
+
+static double stats_percent(unsigned long count, unsigned long total)
+{
+	return (total > 0) ? (double) count * 100.0 / total : 0.0;
+}
@@ -0,0 +1,99 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file stats.h
+ *
+ * Parser Statistics, interface.
+ */
+
+#ifndef TOKENIZE_STATS_H
+#define TOKENIZE_STATS_H
+
+#include <stdbool.h>
+
+#include "parse.h"
+
+/**
+ * The branches of the statement parser which can be counted. This must match
+ * the entries in the stats_branch_names[] array defined in stats.c.
+ */
+
+enum stats_branch {
+	STATS_KEYWORD = 0,		/**< A keyword.						*/
+	STATS_VARIABLE,			/**< A variable, or FN/PROC name.			*/
+	STATS_NUMERIC,			/**< A numeric constant.				*/
+	STATS_LINE_NUMBER,		/**< A line number constant after GOTO and the like.	*/
+	STATS_STRING,			/**< A string.						*/
+	STATS_STAR_COMMAND,		/**< A star command.					*/
+	STATS_ASSEMBLER_BRACKET,	/**< An assembler [ or ].				*/
+	STATS_ASSEMBLER_COMMENT,	/**< An assembler comment.				*/
+	STATS_WHITESPACE,		/**< A run of whitespace.				*/
+	STATS_OTHER,			/**< Any other character.				*/
+	STATS_BRANCHES			/**< The number of branches.				*/
+};
+
+
+/**
+ * Turn the statistics on. Until this is called, the other calls do nothing.
+ */
+
+void stats_enable(void);
+
+
+/**
+ * Count a pass through one of the statement parser's branches.
+ *
+ * \param branch	The branch taken.
+ */
+
+void stats_count_branch(enum stats_branch branch);
+
+
+/**
+ * Count a keyword which has been matched.
+ *
+ * \param keyword	The keyword matched.
+ * \param abbreviated	True if it was matched from an abbreviation.
+ */
+
+void stats_count_keyword(enum parse_keyword keyword, bool abbreviated);
+
+
+/**
+ * Count a name starting with an upper case letter which failed to match
+ * a keyword.
+ */
+
+void stats_count_keyword_miss(void);
+
+
+/**
+ * Write the statistics collected so far to stdout, if they are enabled,
+ * then clear them ready for the next run.
+ */
+
+void stats_report(void);
+
+#endif
+
@@ -37,6 +37,8 @@
 
 #include "swi.h"
 
+#include "profile.h"
+
 /* OSLib source headers. */
 
 #ifdef RISCOS
@@ -131,6 +133,8 @@ long swi_get_number_from_name(char *name)
 	if (copy == NULL)
 		return -1;
 
+	profile_add_memory(PROFILE_MEMORY_SWI, copy);
+
 	chunk_name = strtok(copy, "_");
 	swi_name = strtok(NULL, "_");
 
@@ -146,6 +150,7 @@ long swi_get_number_from_name(char *name)
 	chunk = swi_find_chunk(chunk_name);
 	swi = swi_find_swi(chunk, swi_name);
 
+	profile_remove_memory(PROFILE_MEMORY_SWI, copy);
 	free(copy);
 
 	if (swi == NULL)
@@ -259,6 +264,37 @@ bool swi_add_header_file(char *file)
 }
 
 
+/**
+ * Discard all of the SWI names and numbers loaded from header files, so
+ * that a fresh set can be added.
+ */
+
+void swi_clear(void)
+{
+	struct swi_chunk	*chunk;
+	struct swi		*swi;
+
+	while (swi_chunk_list != NULL) {
+		chunk = swi_chunk_list;
+		swi_chunk_list = chunk->next;
+
+		while (chunk->swis != NULL) {
+			swi = chunk->swis;
+			chunk->swis = swi->next;
+			profile_remove_memory(PROFILE_MEMORY_SWI, swi->name);
+			free(swi->name);
+			profile_remove_memory(PROFILE_MEMORY_SWI, swi);
+			free(swi);
+		}
+
+		profile_remove_memory(PROFILE_MEMORY_SWI, chunk->name);
+		free(chunk->name);
+		profile_remove_memory(PROFILE_MEMORY_SWI, chunk);
+		free(chunk);
+	}
+}
+
+
 /**
  * Add a SWI definition to the list of known SWIs, creating the necessary
  * data blocks. X versions of SWIs are converted into their non-X variants.
@@ -303,6 +339,9 @@ static bool swi_add_definition(char *chunk_name, char *swi_name, long number)
 		chunk->base = 0;
 		chunk->swis = NULL;
 
+		profile_add_memory(PROFILE_MEMORY_SWI, chunk);
+		profile_add_memory(PROFILE_MEMORY_SWI, chunk->name);
+
 		chunk->next = swi_chunk_list;
 		swi_chunk_list = chunk;
 	}
@@ -322,6 +361,9 @@ static bool swi_add_definition(char *chunk_name, char *swi_name, long number)
 		swi->name = strdup(swi_name);
 		swi->number = number;
 
+		profile_add_memory(PROFILE_MEMORY_SWI, swi);
+		profile_add_memory(PROFILE_MEMORY_SWI, swi->name);
+
 		swi->next = chunk->swis;
 		chunk->swis = swi;
 	}
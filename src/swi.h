@@ -52,5 +52,13 @@ long swi_get_number_from_name(char *name);
 
 bool swi_add_header_file(char *file);
 
+
+/**
+ * Discard all of the SWI names and numbers loaded from header files, so
+ * that a fresh set can be added.
+ */
+
+void swi_clear(void);
+
 #endif
 
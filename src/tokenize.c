@@ -30,6 +30,7 @@
  * Options -v  - Produce verbose output
  */
 
+#include <ctype.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,12 +39,21 @@
 /* Local source headers. */
 
 #include "args.h"
+#include "bundle.h"
+#include "cache.h"
+#include "detok.h"
 #include "library.h"
+#include "memo.h"
 #include "msg.h"
 #include "parse.h"
 #include "proc.h"
+#include "profile.h"
+#include "program.h"
+#include "stats.h"
 #include "swi.h"
+#include "trace.h"
 #include "variable.h"
+#include "watch.h"
 
 /* OSLib source headers. */
 
@@ -54,9 +64,32 @@
 #define MAX_INPUT_LINE_LENGTH 1024
 #define MAX_LOCATION_TEXT 256
 
-static bool tokenize_run_job(char *output_file, struct parse_options *options);
+/**
+ * The size of the buffer used for the output file, so that output sent down
+ * a pipe is written in large blocks.
+ */
+
+#define OUTPUT_BUFFER_SIZE 65536
+
+/**
+ * The filename used to represent stdout.
+ */
+
+#define OUTPUT_STDOUT "-"
+
+/**
+ * The size of the buffer used to list a line which fails verification. No
+ * keyword is more than nine characters long, so this will hold any line.
+ */
+
+#define VERIFY_LISTING_LENGTH 4096
+
+static bool tokenize_run_job(char *output_file, char *cache_file, unsigned long long signature, bool watch, struct parse_options *options);
+static bool tokenize_wait_for_changes(struct args_data *source_files, struct args_data *swi_files, char *bundle_file);
 static bool tokenize_parse_file(FILE *in, FILE *out, int *line_number, struct parse_options *options);
+static void tokenize_verify_line(char *line, char *tokenised, struct parse_options *options);
 static char *tokenize_fgets(char *line, size_t len, FILE *file);
+static unsigned long long tokenize_hash_option(unsigned long long hash, struct args_option *option);
 
 int main(int argc, char *argv[])
 {
@@ -67,10 +100,16 @@ int main(int argc, char *argv[])
 	bool			report_procs = false;
 	bool			report_unused_procs = false;
 	bool			delete_failures = true;
-	struct args_option	*options;
-	struct args_data	*option_data;
-	char			*output_file = NULL;
-	struct parse_options	parse_options;
+	bool			watch = false, preload = false, constants = false, profile = false, stats = false, success;
+	struct args_option	*options, *option;
+	struct args_data	*option_data, *source_files = NULL, *swi_files = NULL;
+	char			*output_file = NULL, *cache_file = NULL, *bundle_file = NULL, *trace_file = NULL;
+	unsigned long long	signature = CACHE_HASH_START, job_signature;
+	struct parse_options	parse_options, initial_options;
+
+	/* Start timing the command line, in case -profile is given. */
+
+	profile_initialise();
 
 	/* Default processing options. */
 
@@ -80,6 +119,9 @@ int main(int argc, char *argv[])
 	parse_options.link_libraries = false;
 	parse_options.convert_swis = false;
 	parse_options.verbose_output = false;
+	parse_options.order_definitions = false;
+	parse_options.memo_lines = false;
+	parse_options.verify_lines = false;
 	parse_options.crunch_body_rems = false;
 	parse_options.crunch_rems = false;
 	parse_options.crunch_empty = false;
@@ -88,6 +130,11 @@ int main(int argc, char *argv[])
 	parse_options.crunch_trailing = false;
 	parse_options.crunch_whitespace = false;
 	parse_options.crunch_all_whitespace = false;
+	parse_options.crunch_merge_lines = false;
+	parse_options.crunch_fold = false;
+	parse_options.crunch_numbers = false;
+	parse_options.crunch_dead_code = false;
+	parse_options.crunch_assembler = false;
 
 	/* Initialise the variable and procedure handlers. */
 
@@ -97,21 +144,109 @@ int main(int argc, char *argv[])
 	/* Decode the command line options. */
 
 	options = args_process_line(argc, argv,
-			"path/KM,source/AM,out/AK,start/IK,increment/IK,define/KM,link/KS,swi/S,swis/KM,tab/IK,crunch/K,warn/K,verbose/S,leave/S,help/S");
+			"path/KM,source/AM,out/AK,bundle/K,start/IK,increment/IK,define/KM,link/KS,swi/S,swis/KM,tab/IK,crunch/K,warn/K,order/S,calls/K,memo/S,cache/K,watch/S,preload/S,verify/S,profile/S,stats/S,trace/K,diag-format/K,verbose/S,leave/S,help/S");
 	if (options == NULL)
 		param_error = true;
 
+	/* The message format has to be set before the options are processed,
+	 * so that any failure to load the files that they name is reported in
+	 * it. Profiling and tracing have to be turned on then too, so that the
+	 * time spent loading any -swis files or bundle can be separated out.
+	 */
+
+	for (option = options; option != NULL; option = option->next) {
+		signature = tokenize_hash_option(signature, option);
+
+		if (strcmp(option->name, "diag-format") == 0) {
+			if (option->data != NULL) {
+				if (option->data->value.string == NULL)
+					param_error = true;
+				else if (strcmp(option->data->value.string, "json") == 0)
+					msg_set_format(MSG_FORMAT_JSON);
+				else if (strcmp(option->data->value.string, "sarif") == 0)
+					msg_set_format(MSG_FORMAT_SARIF);
+				else if (strcmp(option->data->value.string, "text") != 0)
+					param_error = true;
+			}
+#ifdef LINUX
+		} else if (strcmp(option->name, "profile") == 0 && option->data != NULL && option->data->value.boolean == true) {
+			profile_enable();
+		} else if (strcmp(option->name, "trace") == 0 && option->data != NULL && option->data->value.string != NULL) {
+			trace_enable();
+#endif
+		}
+	}
+
+	profile_end_command_line();
+
+	trace_name_track(TRACE_TRACK_MAIN, "Tokenize");
+	trace_begin(TRACE_TRACK_MAIN, "phase", "Command line");
+
 	while (options != NULL) {
-		if (strcmp(options->name, "crunch") == 0) {
+		if (strcmp(options->name, "bundle") == 0) {
+			if (options->data != NULL) {
+#ifdef LINUX
+				/* Bundles are mapped into memory, which is only
+				 * supported on Linux.
+				 */
+
+				bundle_file = options->data->value.string;
+
+				if (bundle_file == NULL) {
+					param_error = true;
+				} else {
+					trace_begin(TRACE_TRACK_MAIN, "phase", "Load bundle");
+					success = bundle_open(bundle_file);
+					trace_end(TRACE_TRACK_MAIN);
+
+					if (!success) {
+						msg_report(MSG_BUNDLE_LOAD_FAIL, bundle_file);
+						return EXIT_FAILURE;
+					}
+				}
+#endif
+#ifdef RISCOS
+				param_error = true;
+#endif
+			}
+		} else if (strcmp(options->name, "cache") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.string != NULL)
+					cache_file = options->data->value.string;
+				else
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "calls") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.string == NULL) {
+					param_error = true;
+				} else if (!proc_load_profile(options->data->value.string)) {
+					msg_report(MSG_CALLS_LOAD_FAIL, options->data->value.string);
+					return EXIT_FAILURE;
+				}
+			}
+		} else if (strcmp(options->name, "crunch") == 0) {
 			if (options->data != NULL) {
 				char *mode = options->data->value.string;
 
 				while (mode != NULL && *mode != '\0') {
 					switch (*mode++) {
+					case 'A':
+					case 'a':
+						parse_options.crunch_assembler = true;
+						break;
+					case 'D':
+					case 'd':
+						parse_options.crunch_dead_code = true;
+						break;
 					case 'E':
 					case 'e':
 						parse_options.crunch_empty = true;
 						break;
+					case 'F':
+					case 'f':
+						parse_options.crunch_fold = true;
+						break;
 					case 'I':
 					case 'i':
 						parse_options.crunch_indent = true;
@@ -120,6 +255,14 @@ int main(int argc, char *argv[])
 					case 'l':
 						parse_options.crunch_empty_lines = true;
 						break;
+					case 'M':
+					case 'm':
+						parse_options.crunch_merge_lines = true;
+						break;
+					case 'N':
+					case 'n':
+						parse_options.crunch_numbers = true;
+						break;
 					case 'R':
 						parse_options.crunch_rems = true;
 					case 'r':
@@ -142,10 +285,12 @@ int main(int argc, char *argv[])
 				option_data = options->data;
 
 				while (option_data != NULL) {
-					if (option_data->value.string != NULL)
+					if (option_data->value.string != NULL) {
 						variable_add_constant_combined(option_data->value.string);
-					else
+						constants = true;
+					} else {
 						param_error = true;
+					}
 					option_data = option_data->next;
 				}
 			}
@@ -161,11 +306,66 @@ int main(int argc, char *argv[])
 		} else if (strcmp(options->name, "link") == 0) {
 			if (options->data != NULL && options->data->value.boolean == true)
 				parse_options.link_libraries = true;
+		} else if (strcmp(options->name, "memo") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				parse_options.memo_lines = true;
+		} else if (strcmp(options->name, "order") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				parse_options.order_definitions = true;
+		} else if (strcmp(options->name, "preload") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true) {
+#ifdef LINUX
+				/* Preloading uses a pool of POSIX threads. */
+
+				preload = true;
+#endif
+#ifdef RISCOS
+				param_error = true;
+#endif
+			}
+		} else if (strcmp(options->name, "verify") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				parse_options.verify_lines = true;
+		} else if (strcmp(options->name, "profile") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true) {
+#ifdef LINUX
+				/* The profile is timed using the POSIX clocks. It has
+				 * already been turned on, before any -swis files were
+				 * loaded.
+				 */
+
+				profile = true;
+#endif
+#ifdef RISCOS
+				param_error = true;
+#endif
+			}
+		} else if (strcmp(options->name, "stats") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true) {
+				stats_enable();
+				stats = true;
+			}
+		} else if (strcmp(options->name, "trace") == 0) {
+			if (options->data != NULL) {
+#ifdef LINUX
+				/* Tracing has already been turned on, before any
+				 * -swis files were loaded.
+				 */
+
+				trace_file = options->data->value.string;
+				if (trace_file == NULL)
+					param_error = true;
+#endif
+#ifdef RISCOS
+				param_error = true;
+#endif
+			}
 		} else if (strcmp(options->name, "verbose") == 0) {
 			if (options->data != NULL && options->data->value.boolean == true)
 				parse_options.verbose_output = true;
 		} else if (strcmp(options->name, "source") == 0) {
 			if (options->data != NULL) {
+				source_files = options->data;
 				option_data = options->data;
 
 				while (option_data != NULL) {
@@ -193,8 +393,12 @@ int main(int argc, char *argv[])
 				 * to us.
 				 */
 
+				swi_files = options->data;
 				option_data = options->data;
 
+				profile_start(PROFILE_SWI_LOAD);
+				trace_begin(TRACE_TRACK_MAIN, "phase", "Load SWI headers");
+
 				while (option_data != NULL) {
 					if (option_data->value.string != NULL) {
 						if (!swi_add_header_file(option_data->value.string)) {
@@ -206,6 +410,9 @@ int main(int argc, char *argv[])
 					}
 					option_data = option_data->next;
 				}
+
+				trace_end(TRACE_TRACK_MAIN);
+				profile_stop(PROFILE_SWI_LOAD);
 #endif
 #ifdef RISCOS
 				/* On RISC OS, there's no point using SWI lists as
@@ -249,6 +456,19 @@ int main(int argc, char *argv[])
 		} else if (strcmp(options->name, "tab") == 0) {
 			if (options->data != NULL)
 				parse_options.tab_indent = options->data->value.integer;
+		} else if (strcmp(options->name, "watch") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true) {
+#ifdef LINUX
+				/* Watching for changes relies on inotify, which is
+				 * only available on Linux.
+				 */
+
+				watch = true;
+#endif
+#ifdef RISCOS
+				param_error = true;
+#endif
+			}
 		} else if (strcmp(options->name, "warn") == 0) {
 			if (options->data != NULL) {
 				char *mode = options->data->value.string;
@@ -276,6 +496,48 @@ int main(int argc, char *argv[])
 		options = options->next;
 	}
 
+	/* Verbose, profile or stats output would be mixed in with the tokenised file
+	 * if it is sent to stdout, and there's nothing to watch for a pipe.
+	 */
+
+	if (output_file != NULL && strcmp(output_file, OUTPUT_STDOUT) == 0 && (parse_options.verbose_output || profile || stats || watch))
+		param_error = true;
+
+	/* Files replayed from the cache aren't parsed, so the profile counts
+	 * and parser statistics would only cover part of the source. Lines
+	 * replayed from the memo restore their profile counts, but not their
+	 * statistics.
+	 */
+
+	if (cache_file != NULL && (profile || stats))
+		param_error = true;
+
+	if ((parse_options.memo_lines || watch) && stats)
+		param_error = true;
+
+	for (option_data = source_files; option_data != NULL && watch; option_data = option_data->next) {
+		if (option_data->value.string != NULL && strcmp(option_data->value.string, LIBRARY_STDIN) == 0)
+			param_error = true;
+	}
+
+	/* Verification compares the output with the source, so nothing can be
+	 * allowed to change the code on the way through.
+	 */
+
+	if (parse_options.verify_lines && (constants || parse_options.convert_swis || parse_options.crunch_body_rems ||
+			parse_options.crunch_empty || parse_options.crunch_empty_lines || parse_options.crunch_indent ||
+			parse_options.crunch_trailing || parse_options.crunch_whitespace || parse_options.crunch_merge_lines ||
+			parse_options.crunch_fold || parse_options.crunch_numbers || parse_options.crunch_dead_code ||
+			parse_options.crunch_assembler))
+		param_error = true;
+
+	/* That's the end of the command line, although any -swis files were
+	 * loaded along the way and have been timed separately.
+	 */
+
+	profile_stop(PROFILE_ARGS);
+	trace_end(TRACE_TRACK_MAIN);
+
 	/* Generate any necessary verbose or help output. If param_error is true,
 	 * then we need to give some usage guidance and exit with an error.
 	 */
@@ -287,72 +549,196 @@ int main(int argc, char *argv[])
 
 	if (param_error || output_help) {
 		printf("ARM BASIC V Tokenizer -- Usage:\n");
-		printf("tokenize <infile> [<infile> ...] -out <outfile> [<options>]\n\n");
+		printf("tokenize <infile> [<infile> ...] -out <outfile> [<options>]\n");
+		printf("Use - for <infile> or <outfile> to read stdin or write stdout.\n\n");
 
-		printf(" -crunch [EILRTW]       Control application of output CRUNCHing.\n");
+#ifdef LINUX
+		printf(" -bundle <file>         Read source files from tar archive <file>.\n");
+#endif
+		printf(" -cache <file>          Reuse output of unchanged files cached in <file>.\n");
+		printf(" -calls <file>          Rank FN/PROC for -order using counts from <file>.\n");
+		printf(" -crunch [ADEFILMNRTW]  Control application of output CRUNCHing.\n");
+		printf("                    A|a - Remove assembler comments and spacing.\n");
+		printf("                    D|d - Remove code disabled by constant IFs.\n");
 		printf("                    E|e - Remove empty statements.\n");
+		printf("                    F|f - Fold constant expressions.\n");
 		printf("                    I|i - Remove opening indents.\n");
 		printf("                    L|l - Remove empty lines (implied by E).\n");
+		printf("                    M|m - Merge lines together where possible.\n");
+		printf("                    N|n - Shorten numeric constants.\n");
 		printf("                    R|r - Remove all|non-opening comments.\n");
 		printf("                    T|t - Remove trailing whitespace (implied by W).\n");
 		printf("                    W|w - Remove|reduce in-line whitespace.\n");
 		printf(" -define <name>=<value> Define constant variables.\n");
+		printf(" -diag-format <format>  Report messages as text, json or sarif.\n");
 		printf(" -help                  Produce this help information.\n");
 		printf(" -increment <n>         Set the AUTO line number increment to <n>.\n");
 		printf(" -link                  Link files from LIBRARY statements.\n");
+		printf(" -memo                  Reuse the output of repeated source lines.\n");
+		printf(" -order                 Move the most called FN/PROC to the front.\n");
 		printf(" -out <file>            Write tokenized basic to file <out>.\n");
 #ifdef LINUX
 		printf(" -path <name>:<path>    Set path variable <name> to <path>.\n");
+		printf(" -preload               Load source files in the background.\n");
+		printf(" -profile               Report time spent in each phase of processing.\n");
 #endif
+		printf(" -stats                 Report how often each parser path is taken.\n");
 		printf(" -start <n>             Set the AUTO line number start to <n>.\n");
 		printf(" -swi                   Convert SWI names into numbers.\n");
 #ifdef LINUX
 		printf(" -swis <file>           Use SWI names from file <file>.\n");
 #endif
 		printf(" -tab <n>               Set the tab column width to <n> spaces.\n");
+#ifdef LINUX
+		printf(" -trace <file>          Write trace events for each phase to <file>.\n");
+#endif
 		printf(" -verbose               Generate verbose process information.\n");
+		printf(" -verify                Check each tokenized line against its source.\n");
 		printf(" -warn [PV]             Control generation of information warnings.\n");
 		printf("                    P|p - Warn of unused|missing, multiple FN/PROC.\n");
 		printf("                    V|v - Warn of unused|missing variables.\n");
+#ifdef LINUX
+		printf(" -watch                 Tokenize again whenever the source files change.\n");
+#endif
 
 		return (output_help) ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	/* Run the tokenisation. */
+	/* Run the tokenisation. Any cache is only valid for the same version
+	 * of Tokenize, run with the same parameters and SWI names; the
+	 * parameters were added to the signature as they were scanned.
+	 */
 
-	if (!tokenize_run_job(output_file, &parse_options) || msg_errors()) {
-		if (delete_failures)
-			remove(output_file);
-		return EXIT_FAILURE;
+	signature = cache_hash(signature, BUILD_VERSION, strlen(BUILD_VERSION) + 1);
+	signature = cache_hash(signature, BUILD_DATE, strlen(BUILD_DATE) + 1);
+
+	/* If preloading, any files given on the command line can start loading
+	 * straight away. If the threads can't be started, the files are simply
+	 * loaded as they are needed.
+	 */
+
+	if (preload)
+		library_start_preload();
+
+	/* When watching, the memo is kept between runs so that only the lines
+	 * which have changed need to be parsed again. Every line is kept, since
+	 * the next run will see most of them again.
+	 */
+
+	if (watch) {
+		parse_options.memo_lines = true;
+		memo_set_keep_all(true);
 	}
 
-	/* Run any reports. */
+	initial_options = parse_options;
+
+	while (true) {
+		/* The job's messages are collected, and written out together
+		 * once it and its reports have finished.
+		 */
+
+		msg_start_buffer();
+
+		/* When watching, the SWI headers and bundle are watched from
+		 * before the job starts, so that changes made while it runs
+		 * are seen.
+		 */
+
+		if (watch) {
+			for (option_data = swi_files; option_data != NULL; option_data = option_data->next)
+				watch_add_file(option_data->value.string);
+
+			if (bundle_file != NULL)
+				watch_add_file(bundle_file);
+		}
+
+		/* The SWI names used come from the contents of the -swis
+		 * files, which can change between runs when watching.
+		 */
+
+		job_signature = signature;
+
+		if (cache_file != NULL) {
+			for (option_data = swi_files; option_data != NULL; option_data = option_data->next)
+				job_signature = cache_hash_contents(job_signature, option_data->value.string);
+		}
+
+		success = tokenize_run_job(output_file, cache_file, job_signature, watch, &parse_options) && !msg_errors();
+
+		if (!success && delete_failures && strcmp(output_file, OUTPUT_STDOUT) != 0)
+			remove(output_file);
+
+		/* Run any reports. */
+
+		if (success && report_vars)
+			variable_report(report_unused_vars);
+
+		if (success && report_procs)
+			proc_report(report_unused_procs);
+
+		msg_flush();
+
+		profile_report();
+		stats_report();
+
+		/* The trace is written out again after every run, so that it
+		 * is complete even if a watch is never ended cleanly.
+		 */
+
+		if (trace_file != NULL && !trace_write(trace_file)) {
+			msg_report(MSG_TRACE_WRITE_FAIL, trace_file);
+			success = false;
+		}
+
+		if (!watch)
+			break;
+
+		/* Wait for something to change, then start again from the
+		 * options as they were given on the command line.
+		 */
+
+		if (parse_options.verbose_output)
+			printf("Waiting for changes to source files\n");
+
+		fflush(stdout);
+
+		trace_begin(TRACE_TRACK_MAIN, "phase", "Wait for changes");
+		success = tokenize_wait_for_changes(source_files, swi_files, bundle_file);
+		trace_end(TRACE_TRACK_MAIN);
+
+		if (!success)
+			break;
+
+		parse_options = initial_options;
+	}
 
-	if (report_vars)
-		variable_report(report_unused_vars);
+	/* Stop any preloading threads, and release the files they held. */
 
-	if (report_procs)
-		proc_report(report_unused_procs);
+	library_stop_preload();
 
-	return EXIT_SUCCESS;
+	return (success) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 
 /**
  * Run a tokenisation job, writing data to the specified output file. Input
  * files are taken from the library module, so as to handle any linked libraries
- * found during parsing.
+ * found during parsing. An output file of - is taken to be stdout.
  *
  * \param *output_file	Pointer to the name of the file to write to.
+ * \param *cache_file	Pointer to the name of the cache file, or NULL for none.
+ * \param signature	A hash of the options, to validate the cache file.
+ * \param watch		True to record the files used, so that they can be
+ *			watched for changes.
  * \param *options	Pointer to the tokenisation options.
  * \return		True on success; false on failure.
  */
 
-static bool tokenize_run_job(char *output_file, struct parse_options *options)
+static bool tokenize_run_job(char *output_file, char *cache_file, unsigned long long signature, bool watch, struct parse_options *options)
 {
 	FILE		*in, *out;
 	int		line_number = -1;
-	bool		success = true;
+	bool		success = true, replayed = false, to_stdout;
 
 	if (output_file == NULL || options == NULL)
 		return false;
@@ -360,28 +746,180 @@ static bool tokenize_run_job(char *output_file, struct parse_options *options)
 	if (options->verbose_output)
 		printf("Creating tokenized file '%s'\n", output_file);
 
-	out = fopen(output_file, "w");
+	to_stdout = (strcmp(output_file, OUTPUT_STDOUT) == 0) ? true : false;
+
+	out = (to_stdout) ? stdout : fopen(output_file, "w");
 	if (out == NULL)
 		return false;
 
-	while ((success == true) && ((in = library_get_file()) != NULL)) {
-		success = tokenize_parse_file(in, out, &line_number, options);
-		fclose(in);
+	trace_begin(TRACE_TRACK_MAIN, "job", output_file);
+
+	setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+	if (cache_file != NULL && !cache_open(cache_file, signature)) {
+		msg_report(MSG_CACHE_WRITE_FAIL, cache_file);
+		cache_close(false);
+		if (!to_stdout)
+			fclose(out);
+		trace_end(TRACE_TRACK_MAIN);
+		return false;
+	}
+
+	while (success == true) {
+		profile_start(PROFILE_FILE_IO);
+		in = library_get_file();
+		profile_stop(PROFILE_FILE_IO);
+
+		if (in == NULL)
+			break;
+
+		if (watch)
+			watch_add_file(library_get_filename());
+
+		trace_begin(TRACE_TRACK_MAIN, "file", library_get_filename());
+
+		if (cache_file != NULL) {
+			trace_begin(TRACE_TRACK_MAIN, "phase", "Replay from cache");
+			success = cache_replay_file(in, out, &line_number, options, &replayed);
+			trace_end(TRACE_TRACK_MAIN);
+		}
+
+		if (success && !replayed) {
+			trace_begin(TRACE_TRACK_MAIN, "phase", "Tokenize");
+			success = tokenize_parse_file(in, out, &line_number, options);
+			trace_end(TRACE_TRACK_MAIN);
+
+			if (success && cache_file != NULL)
+				cache_end_file(line_number, options);
+		}
+
+		trace_end(TRACE_TRACK_MAIN);
+
+		profile_start(PROFILE_FILE_IO);
+		if (in != stdin)
+			fclose(in);
+		profile_stop(PROFILE_FILE_IO);
 	}
 
+	/* If a file couldn't be opened, watch for it to appear. */
+
+	if (watch)
+		watch_add_file(library_get_filename());
+
+	if (success && options->crunch_dead_code) {
+		trace_begin(TRACE_TRACK_MAIN, "phase", "Remove dead code");
+		success = program_remove_dead_code();
+		trace_end(TRACE_TRACK_MAIN);
+	}
+
+	if (success && options->order_definitions) {
+		trace_begin(TRACE_TRACK_MAIN, "phase", "Order definitions");
+		success = program_order_definitions();
+		trace_end(TRACE_TRACK_MAIN);
+	}
+
+	if (success && options->crunch_merge_lines) {
+		trace_begin(TRACE_TRACK_MAIN, "phase", "Merge lines");
+		success = program_merge_lines();
+		trace_end(TRACE_TRACK_MAIN);
+	}
+
+	profile_start(PROFILE_OUTPUT);
+	trace_begin(TRACE_TRACK_MAIN, "phase", "Write output");
+
+	if (success && (options->crunch_dead_code || options->order_definitions || options->crunch_merge_lines))
+		success = program_write(out);
+
 	fputc(0x0d, out);
 	fputc(0xff, out);
 
-	fclose(out);
+	if (to_stdout)
+		fflush(out);
+	else
+		fclose(out);
+
+	trace_end(TRACE_TRACK_MAIN);
+	profile_stop(PROFILE_OUTPUT);
+
+	if (cache_file != NULL)
+		cache_close(success && !msg_errors());
 
 #if RISCOS
-	osfile_set_type(output_file, osfile_TYPE_BASIC);
+	if (!to_stdout)
+		osfile_set_type(output_file, osfile_TYPE_BASIC);
 #endif
 
+	trace_end(TRACE_TRACK_MAIN);
+
 	return success;
 }
 
 
+/**
+ * Wait for any of the files used by the last tokenisation job to change,
+ * then reset everything ready for the job to be run again. The SWI tables
+ * and bundle are only reloaded if their files have changed.
+ *
+ * \param *source_files	Pointer to the source files given on the command line.
+ * \param *swi_files	Pointer to the SWI header files, or NULL for none.
+ * \param *bundle_file	Pointer to the name of the bundle file, or NULL for none.
+ * \return		True if successful; False on error.
+ */
+
+static bool tokenize_wait_for_changes(struct args_data *source_files, struct args_data *swi_files, char *bundle_file)
+{
+	struct args_data	*file;
+	bool			reload_swis = false, reload_bundle;
+
+	if (!watch_wait())
+		return false;
+
+	reload_bundle = watch_file_changed(bundle_file);
+
+	for (file = swi_files; file != NULL; file = file->next)
+		reload_swis = reload_swis || watch_file_changed(file->value.string);
+
+	watch_clear();
+
+	library_clear_files();
+	program_clear();
+	proc_reset_counts();
+	variable_reset_counts();
+	msg_clear_errors();
+
+	/* Lines in the memo may hold SWI numbers from the old names, so it
+	 * must be emptied if these change; otherwise, only the lines used in
+	 * the last run are kept.
+	 */
+
+	if (reload_swis)
+		memo_clear();
+	else
+		memo_end_run();
+
+	if (reload_swis) {
+		profile_start(PROFILE_SWI_LOAD);
+
+		swi_clear();
+
+		for (file = swi_files; file != NULL; file = file->next) {
+			if (!swi_add_header_file(file->value.string))
+				msg_report(MSG_SWI_LOAD_FAIL, file->value.string);
+		}
+
+		profile_stop(PROFILE_SWI_LOAD);
+	}
+
+	if (reload_bundle && !bundle_open(bundle_file))
+		msg_report(MSG_BUNDLE_LOAD_FAIL, bundle_file);
+
+	for (file = source_files; file != NULL; file = file->next)
+		library_add_file(file->value.string);
+
+	return true;
+}
+
+
 /**
  * Tokenise the contents of a file, sending the results to the output.
  *
@@ -394,9 +932,9 @@ static bool tokenize_run_job(char *output_file, struct parse_options *options)
 
 static bool tokenize_parse_file(FILE *in, FILE *out, int *line_number, struct parse_options *options)
 {
-	char		line[MAX_INPUT_LINE_LENGTH], *tokenised, *file;
-	bool		assembler = false;
-	unsigned	input_line = 0;
+	char		line[MAX_INPUT_LINE_LENGTH], *read, *tokenised, *file;
+	bool		assembler = false, assembler_line;
+	unsigned	input_line = 0, libraries;
 
 	if (in == NULL || out == NULL || line_number == NULL || options == NULL)
 		return false;
@@ -408,10 +946,24 @@ static bool tokenize_parse_file(FILE *in, FILE *out, int *line_number, struct pa
 	if (options->verbose_output)
 		printf("Processing source file '%s'\n", file);
 
-	while (tokenize_fgets(line, MAX_INPUT_LINE_LENGTH - 1, in) != NULL) {
+	while (true) {
+		profile_start(PROFILE_FILE_IO);
+		read = tokenize_fgets(line, MAX_INPUT_LINE_LENGTH - 1, in);
+		profile_stop(PROFILE_FILE_IO);
+
+		if (read == NULL)
+			break;
+
 		msg_set_location(++input_line, file);
 
+		assembler_line = assembler;
+		libraries = library_get_count();
+
+		profile_start(PROFILE_PARSE);
 		tokenised = parse_process_line(line, options, &assembler, line_number);
+		profile_stop(PROFILE_PARSE);
+		profile_count(PROFILE_LINES, 1);
+
 		if (tokenised != NULL) {
 			/* The line tokeniser requests a line be deleted (ie. not
 			 * written to the output) by setting the leading \r to be
@@ -419,8 +971,26 @@ static bool tokenize_parse_file(FILE *in, FILE *out, int *line_number, struct pa
 			 * an error).
 			 */
 
-			if (*tokenised != '\0')
+			if (*tokenised == '\0')
+				continue;
+
+			/* A line which queued a library for linking will have
+			 * had the LIBRARY statement removed, so can't be checked.
+			 */
+
+			if (options->verify_lines && library_get_count() == libraries)
+				tokenize_verify_line(line, tokenised, options);
+
+			cache_add_line(tokenised, assembler_line || assembler);
+
+			if (options->crunch_dead_code || options->order_definitions || options->crunch_merge_lines) {
+				if (!program_add_line(tokenised, assembler_line || assembler))
+					return false;
+			} else {
+				profile_start(PROFILE_OUTPUT);
 				fwrite(tokenised, sizeof(char), *((unsigned char *) tokenised + 3), out);
+				profile_stop(PROFILE_OUTPUT);
+			}
 		} else {
 			return false;
 		}
@@ -430,6 +1000,43 @@ static bool tokenize_parse_file(FILE *in, FILE *out, int *line_number, struct pa
 }
 
 
+/**
+ * Check a tokenised line against the source line that it came from, reporting
+ * an error if they don't match. Any line number at the start of the source is
+ * ignored, as it has been moved into the line's header.
+ *
+ * \param *line		Pointer to the \n terminated source line.
+ * \param *tokenised	Pointer to the tokenised line.
+ * \param *options	Pointer to the tokenisation options.
+ */
+
+static void tokenize_verify_line(char *line, char *tokenised, struct parse_options *options)
+{
+	char		*start = line, *end, listing[VERIFY_LISTING_LENGTH];
+	unsigned	column;
+
+	while (*start != '\n' && isspace(*start))
+		start++;
+
+	if (isdigit(*start)) {
+		while (isdigit(*start))
+			start++;
+	} else {
+		start = line;
+	}
+
+	for (end = start; *end != '\n'; end++);
+
+	if (!detok_verify_line(tokenised, start, end - start, options->tab_indent, &column)) {
+		if (!detok_line(tokenised, listing, VERIFY_LISTING_LENGTH))
+			*listing = '\0';
+
+		msg_set_column(column + (unsigned) (start - line));
+		msg_report(MSG_VERIFY_FAIL, listing);
+	}
+}
+
+
 /**
  * Perform as fgets(), but ensures that even the last line of the file has a
  * terminating \n even if there wasn't one in the file itself.
@@ -459,3 +1066,52 @@ static char *tokenize_fgets(char *line, size_t len, FILE *file)
 	return (c == EOF && cs == line) ? NULL : line;
 }
 
+
+/**
+ * Add a command line option to the signature used to validate the cache, if
+ * it is one which can change the tokenised output. Options which only
+ * affect where the output goes, or what is reported along the way, are
+ * left out so that they can be changed without losing the cache. The
+ * contents of the -calls files are included along with their names.
+ *
+ * \param hash		The signature so far.
+ * \param *option	Pointer to the option to add.
+ * \return		The updated signature.
+ */
+
+static unsigned long long tokenize_hash_option(unsigned long long hash, struct args_option *option)
+{
+	static char		*outputs[] = {"bundle", "calls", "crunch", "define", "increment", "link", "order",
+					"path", "start", "swi", "swis", "tab", NULL};
+	struct args_data	*data;
+	int			i;
+
+	for (i = 0; outputs[i] != NULL && strcmp(outputs[i], option->name) != 0; i++);
+
+	if (outputs[i] == NULL)
+		return hash;
+
+	hash = cache_hash(hash, option->name, strlen(option->name) + 1);
+
+	for (data = option->data; data != NULL; data = data->next) {
+		switch (option->type) {
+		case ARGS_TYPE_STRING:
+			if (data->value.string != NULL)
+				hash = cache_hash(hash, data->value.string, strlen(data->value.string) + 1);
+
+			if (data->value.string != NULL && strcmp(option->name, "calls") == 0)
+				hash = cache_hash_contents(hash, data->value.string);
+			break;
+		case ARGS_TYPE_INT:
+			hash = cache_hash(hash, (char *) &(data->value.integer), sizeof(int));
+			break;
+		case ARGS_TYPE_BOOL:
+			hash = cache_hash(hash, (data->value.boolean) ? "1" : "0", 1);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return hash;
+}
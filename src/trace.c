@@ -0,0 +1,312 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file trace.c
+ *
+ * Trace Event Recording, implementation.
+ *
+ * Events are held in memory until the trace is written, as they can arrive
+ * from the preload threads as well as the main one. The file uses the JSON
+ * Array form of the trace event format read by chrome://tracing and
+ * Perfetto, with each track appearing as a thread of the process.
+ *
+ * Timestamps are taken from the monotonic clock without adjustment, so that
+ * traces from several processes on the same machine line up with each other.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LINUX
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/* Local source headers. */
+
+#include "trace.h"
+
+/**
+ * An event, forming one entry in a linked list.
+ */
+
+struct trace_event {
+	char			phase;		/**< The trace event phase: B, E, i or M.			*/
+	unsigned		track;		/**< The track that the event is on.				*/
+	double			time;		/**< The time of the event, in microseconds.			*/
+	char			*category;	/**< Pointer to the category, or NULL.				*/
+	char			*name;		/**< Pointer to a copy of the name, or NULL.			*/
+
+	struct trace_event	*next;		/**< Pointer to the next event in the list, or NULL.		*/
+};
+
+static bool			trace_enabled = false;
+static struct trace_event	*trace_head = NULL;
+static struct trace_event	*trace_tail = NULL;
+
+#ifdef LINUX
+static pthread_mutex_t		trace_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void trace_add_event(char phase, unsigned track, char *category, char *name);
+static void trace_write_string(FILE *file, char *text);
+static double trace_read_clock(void);
+
+
+/**
+ * Start recording events. Until this is called, the other calls do nothing.
+ */
+
+void trace_enable(void)
+{
+	trace_enabled = true;
+}
+
+
+/**
+ * Give a name to a track, so that it can be identified in the trace.
+ *
+ * \param track		The track to name.
+ * \param *name		Pointer to the name to give it.
+ */
+
+void trace_name_track(unsigned track, char *name)
+{
+	trace_add_event('M', track, NULL, name);
+}
+
+
+/**
+ * Record the start of a span on a track. Spans on the same track must
+ * be nested properly.
+ *
+ * \param track		The track that the span is on.
+ * \param *category	Pointer to the category of the span.
+ * \param *name		Pointer to the name of the span.
+ */
+
+void trace_begin(unsigned track, char *category, char *name)
+{
+	trace_add_event('B', track, category, name);
+}
+
+
+/**
+ * Record the end of the last span to be started on a track.
+ *
+ * \param track		The track that the span is on.
+ */
+
+void trace_end(unsigned track)
+{
+	trace_add_event('E', track, NULL, NULL);
+}
+
+
+/**
+ * Record an event which happens at a single moment.
+ *
+ * \param track		The track that the event is on.
+ * \param *category	Pointer to the category of the event.
+ * \param *name		Pointer to the name of the event.
+ */
+
+void trace_instant(unsigned track, char *category, char *name)
+{
+	trace_add_event('i', track, category, name);
+}
+
+
+/**
+ * Write all of the events recorded so far to a file, in the JSON trace
+ * event format. Any spans which are still open are left open.
+ *
+ * \param *filename	Pointer to the name of the file to write.
+ * \return		True if successful; False on failure.
+ */
+
+bool trace_write(char *filename)
+{
+	FILE			*file;
+	struct trace_event	*event;
+	long			process = 0;
+	bool			success;
+
+	if (!trace_enabled || filename == NULL)
+		return false;
+
+	file = fopen(filename, "w");
+	if (file == NULL)
+		return false;
+
+#ifdef LINUX
+	process = (long) getpid();
+
+	pthread_mutex_lock(&trace_lock);
+#endif
+
+	fprintf(file, "[\n");
+
+	for (event = trace_head; event != NULL; event = event->next) {
+		if (event->phase == 'M') {
+			fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,\"args\":{\"name\":",
+					process, event->track);
+			trace_write_string(file, event->name);
+			fprintf(file, "}}");
+		} else {
+			fprintf(file, "{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%ld,\"tid\":%u", event->phase, event->time, process, event->track);
+
+			if (event->category != NULL) {
+				fprintf(file, ",\"cat\":");
+				trace_write_string(file, event->category);
+			}
+
+			if (event->name != NULL) {
+				fprintf(file, ",\"name\":");
+				trace_write_string(file, event->name);
+			}
+
+			if (event->phase == 'i')
+				fprintf(file, ",\"s\":\"t\"");
+
+			fprintf(file, "}");
+		}
+
+		fprintf(file, "%s\n", (event->next != NULL) ? "," : "");
+	}
+
+	fprintf(file, "]\n");
+
+#ifdef LINUX
+	pthread_mutex_unlock(&trace_lock);
+#endif
+
+	success = (ferror(file) == 0) ? true : false;
+
+	if (fclose(file) != 0)
+		success = false;
+
+	return success;
+}
+
+
+/**
+ * Add an event to the end of the list.
+ *
+ * \param phase		The trace event phase of the event.
+ * \param track		The track that the event is on.
+ * \param *category	Pointer to the category, which must remain valid, or NULL.
+ * \param *name		Pointer to the name, which will be copied, or NULL.
+ */
+
+static void trace_add_event(char phase, unsigned track, char *category, char *name)
+{
+	struct trace_event	*event;
+
+	if (!trace_enabled)
+		return;
+
+	event = malloc(sizeof(struct trace_event));
+	if (event == NULL)
+		return;
+
+	event->phase = phase;
+	event->track = track;
+	event->time = trace_read_clock();
+	event->category = category;
+	event->name = NULL;
+	event->next = NULL;
+
+	if (name != NULL) {
+		event->name = strdup(name);
+		if (event->name == NULL) {
+			free(event);
+			return;
+		}
+	}
+
+#ifdef LINUX
+	pthread_mutex_lock(&trace_lock);
+#endif
+
+	if (trace_tail == NULL)
+		trace_head = event;
+	else
+		trace_tail->next = event;
+
+	trace_tail = event;
+
+#ifdef LINUX
+	pthread_mutex_unlock(&trace_lock);
+#endif
+}
+
+
+/**
+ * Write a string to a file as a quoted JSON string.
+ *
+ * \param *file		The file to write to.
+ * \param *text		Pointer to the string to write.
+ */
+
+static void trace_write_string(FILE *file, char *text)
+{
+	fputc('"', file);
+
+	for (; *text != '\0'; text++) {
+		if (*text == '"' || *text == '\\')
+			fprintf(file, "\\%c", *text);
+		else if ((unsigned char) *text < 0x20)
+			fprintf(file, "\\u%04x", (unsigned char) *text);
+		else
+			fputc(*text, file);
+	}
+
+	fputc('"', file);
+}
+
+
+/**
+ * Read the monotonic clock.
+ *
+ * \return		The time from the clock, in microseconds.
+ */
+
+static double trace_read_clock(void)
+{
+#ifdef LINUX
+	struct timespec	now;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+		return 0.0;
+
+	return (double) now.tv_sec * 1000000.0 + (double) now.tv_nsec / 1000.0;
+#else
+	return 0.0;
+#endif
+}
+
@@ -0,0 +1,108 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file trace.h
+ *
+ * Trace Event Recording, interface.
+ */
+
+#ifndef TOKENIZE_TRACE_H
+#define TOKENIZE_TRACE_H
+
+#include <stdbool.h>
+
+/**
+ * The track used by the main thread.
+ */
+
+#define TRACE_TRACK_MAIN 1
+
+/**
+ * The track used by the first preload thread; the others follow on.
+ */
+
+#define TRACE_TRACK_PRELOAD 2
+
+
+/**
+ * Start recording events. Until this is called, the other calls do nothing.
+ */
+
+void trace_enable(void);
+
+
+/**
+ * Give a name to a track, so that it can be identified in the trace.
+ *
+ * \param track		The track to name.
+ * \param *name		Pointer to the name to give it.
+ */
+
+void trace_name_track(unsigned track, char *name);
+
+
+/**
+ * Record the start of a span on a track. Spans on the same track must
+ * be nested properly.
+ *
+ * \param track		The track that the span is on.
+ * \param *category	Pointer to the category of the span.
+ * \param *name		Pointer to the name of the span.
+ */
+
+void trace_begin(unsigned track, char *category, char *name);
+
+
+/**
+ * Record the end of the last span to be started on a track.
+ *
+ * \param track		The track that the span is on.
+ */
+
+void trace_end(unsigned track);
+
+
+/**
+ * Record an event which happens at a single moment.
+ *
+ * \param track		The track that the event is on.
+ * \param *category	Pointer to the category of the event.
+ * \param *name		Pointer to the name of the event.
+ */
+
+void trace_instant(unsigned track, char *category, char *name);
+
+
+/**
+ * Write all of the events recorded so far to a file, in the JSON trace
+ * event format. Any spans which are still open are left open.
+ *
+ * \param *filename	Pointer to the name of the file to write.
+ * \return		True if successful; False on failure.
+ */
+
+bool trace_write(char *filename);
+
+#endif
+
@@ -38,6 +38,8 @@
 #include "variable.h"
 
 #include "msg.h"
+#include "number.h"
+#include "profile.h"
 
 enum variable_mode {
 	VARIABLE_UNSET = 0,			/**< Variable has not yet been set up.				*/
@@ -77,6 +79,8 @@ struct variable_entry {
 };
 
 #define VARIABLE_INDEXES 128
+#define VARIABLE_MAX_LITERAL 64
+#define VARIABLE_MAX_COUNT_LINE 1024
 static struct variable_entry	*variable_list[VARIABLE_INDEXES];
 
 static void variable_substitute_constant(struct variable_entry *variable, char *name, char **write);
@@ -99,6 +103,26 @@ void variable_initialise(void)
 }
 
 
+/**
+ * Clear the assignment and read counts for all of the known variables, ready
+ * for the source to be processed again. Constants given with -define keep
+ * their values.
+ */
+
+void variable_reset_counts(void)
+{
+	int			index;
+	struct variable_entry	*list;
+
+	for (index = 0; index < VARIABLE_INDEXES; index++) {
+		for (list = variable_list[index]; list != NULL; list = list->next) {
+			list->assignments = 0;
+			list->reads = 0;
+		}
+	}
+}
+
+
 /**
  * Generate a report on the variable information.
  *
@@ -149,8 +173,11 @@ bool variable_add_constant_combined(char *constant)
 	if (name == NULL)
 		return false;
 
+	profile_add_memory(PROFILE_MEMORY_VARIABLE, name);
+
 	value = strchr(name, '=');
 	if (value == NULL) {
+		profile_remove_memory(PROFILE_MEMORY_VARIABLE, name);
 		free(name);
 		return false;
 	}
@@ -158,6 +185,7 @@ bool variable_add_constant_combined(char *constant)
 	*value++ = '\0';
 
 	result = variable_add_constant(name, value);
+	profile_remove_memory(PROFILE_MEMORY_VARIABLE, name);
 	free(name);
 
 	return result;
@@ -204,6 +232,7 @@ bool variable_add_constant(char *name, char *value)
 		break;
 	case VARIABLE_STRING:
 		variable->value.string = strdup(value);
+		profile_add_memory(PROFILE_MEMORY_VARIABLE, variable->value.string);
 		break;
 	case VARIABLE_REAL:
 		variable->value.real = atof(value);
@@ -271,6 +300,108 @@ bool variable_process(char *name, char **write, bool is_array, bool statement_le
 }
 
 
+/**
+ * Write the assignment and read counts for all of the known variables to a
+ * file, in a form which can be read back by variable_load_counts().
+ *
+ * \param *out			The handle of the file to write to.
+ * \return			True if successful; False on error.
+ */
+
+bool variable_save_counts(FILE *out)
+{
+	int			index, entries, entry;
+	unsigned		count = 0;
+	struct variable_entry	*list, **chain;
+
+	for (index = 0; index < VARIABLE_INDEXES; index++) {
+		for (list = variable_list[index]; list != NULL; list = list->next) {
+			if (list->name != NULL)
+				count++;
+		}
+	}
+
+	if (fprintf(out, "Variables %u\n", count) < 0)
+		return false;
+
+	/* Write each chain out from its tail, so that variable_load_counts()
+	 * rebuilds it in the same order.
+	 */
+
+	for (index = 0; index < VARIABLE_INDEXES; index++) {
+		for (entries = 0, list = variable_list[index]; list != NULL; list = list->next)
+			entries++;
+
+		if (entries == 0)
+			continue;
+
+		chain = malloc(sizeof(struct variable_entry *) * entries);
+		if (chain == NULL)
+			return false;
+
+		profile_add_memory(PROFILE_MEMORY_VARIABLE, chain);
+
+		for (entry = 0, list = variable_list[index]; list != NULL; list = list->next)
+			chain[entry++] = list;
+
+		for (entry = entries - 1; entry >= 0; entry--) {
+			if (chain[entry]->name != NULL && fprintf(out, "%d %u %u %s\n", (chain[entry]->array) ? 1 : 0,
+					chain[entry]->assignments, chain[entry]->reads, chain[entry]->name) < 0) {
+				profile_remove_memory(PROFILE_MEMORY_VARIABLE, chain);
+				free(chain);
+				return false;
+			}
+		}
+
+		profile_remove_memory(PROFILE_MEMORY_VARIABLE, chain);
+		free(chain);
+	}
+
+	return true;
+}
+
+
+/**
+ * Read the assignment and read counts for a set of variables from a file
+ * written by variable_save_counts(), replacing the counts held for them.
+ *
+ * \param *in			The handle of the file to read from.
+ * \return			True if successful; False on error.
+ */
+
+bool variable_load_counts(FILE *in)
+{
+	char			line[VARIABLE_MAX_COUNT_LINE], *name;
+	unsigned		count, assignments, reads;
+	int			array, length;
+	struct variable_entry	*variable;
+
+	if (fgets(line, VARIABLE_MAX_COUNT_LINE, in) == NULL || sscanf(line, "Variables %u", &count) != 1)
+		return false;
+
+	while (count-- > 0) {
+		if (fgets(line, VARIABLE_MAX_COUNT_LINE, in) == NULL ||
+				sscanf(line, "%d %u %u %n", &array, &assignments, &reads, &length) != 3)
+			return false;
+
+		name = line + length;
+		name[strcspn(name, "\r\n")] = '\0';
+
+		variable = variable_find(name, array != 0);
+		if (variable == NULL)
+			variable = variable_create(name, array != 0);
+
+		if (variable == NULL)
+			return false;
+
+		variable->assignments = assignments;
+		variable->reads = reads;
+	}
+
+	return true;
+}
+
+
 /**
  * Write a variable's value out into a buffer, starting at the specified point
  * and updating the line pointer when done.
@@ -283,24 +414,28 @@ bool variable_process(char *name, char **write, bool is_array, bool statement_le
 
 static void variable_substitute_constant(struct variable_entry *variable, char *name, char **write)
 {
-	int	written;
-	char	*read;
+	struct number_value	number;
+	int			written;
+	char			*read;
 
 	if (variable == NULL)
 		return;
 
+	profile_count(PROFILE_CONSTANTS, 1);
+
 	/* The variable was on the right, so we can replace it in the
 	 * output with the constant that it contains.
 	 */
 
 	switch (variable->type) {
 	case VARIABLE_INTEGER:
-		written = sprintf(name, "%d", variable->value.integer);
-		if (written > 0)
-			*write = name + written;
-		break;
 	case VARIABLE_REAL:
-		written = sprintf(name, "%f", variable->value.real);
+		number.type = (variable->type == VARIABLE_INTEGER) ? NUMBER_INTEGER : NUMBER_REAL;
+		number.integer = (variable->type == VARIABLE_INTEGER) ? variable->value.integer : 0;
+		number.real = (variable->type == VARIABLE_REAL) ? variable->value.real : 0;
+		number.exact = (variable->type == VARIABLE_INTEGER || number_is_exact(number.real)) ? true : false;
+
+		written = number_write(&number, name, VARIABLE_MAX_LITERAL, true, true);
 		if (written > 0)
 			*write = name + written;
 		break;
@@ -345,6 +480,9 @@ static struct variable_entry *variable_create(char *name, bool array)
 
 	variable->name = strdup(name);
 	variable->array = array;
+
+	profile_add_memory(PROFILE_MEMORY_VARIABLE, variable);
+	profile_add_memory(PROFILE_MEMORY_VARIABLE, variable->name);
 	variable->type = variable_find_type(variable->name);
 	switch (variable->type) {
 	case VARIABLE_INTEGER:
@@ -426,8 +564,16 @@ static struct variable_entry *variable_find(char *name, bool array)
 	index = variable_find_index(name);
 	list = variable_list[index];
 
-	while (list != NULL && list->name != NULL && (list->array != array || strcmp(list->name, name) != 0))
+	profile_count(PROFILE_VARIABLE_LOOKUPS, 1);
+
+	while (list != NULL && list->name != NULL) {
+		profile_count(PROFILE_VARIABLE_STEPS, 1);
+
+		if (list->array == array && strcmp(list->name, name) == 0)
+			break;
+
 		list = list->next;
+	}
 
 	if (list == NULL || list->name == NULL)
 		return NULL;
@@ -31,6 +31,7 @@
 #define TOKENIZE_VARIABLE_H
 
 #include <stdbool.h>
+#include <stdio.h>
 
 
 /**
@@ -40,6 +41,14 @@
 void variable_initialise(void);
 
 
+/**
+ * Clear the assignment and read counts for all of the known variables, ready
+ * for the source to be processed again.
+ */
+
+void variable_reset_counts(void);
+
+
 /**
  * Generate a report on the variable information.
  *
@@ -92,5 +101,27 @@ bool variable_add_constant(char *name, char *value);
 
 bool variable_process(char *name, char **write, bool is_array, bool statement_left);
 
+
+/**
+ * Write the assignment and read counts for all of the known variables to a
+ * file, in a form which can be read back by variable_load_counts().
+ *
+ * \param *out			The handle of the file to write to.
+ * \return			True if successful; False on error.
+ */
+
+bool variable_save_counts(FILE *out);
+
+
+/**
+ * Read the assignment and read counts for a set of variables from a file
+ * written by variable_save_counts(), replacing the counts held for them.
+ *
+ * \param *in			The handle of the file to read from.
+ * \return			True if successful; False on error.
+ */
+
+bool variable_load_counts(FILE *in);
+
 #endif
 
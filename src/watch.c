@@ -0,0 +1,298 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file watch.c
+ *
+ * Source File Watching, implementation.
+ *
+ * Editors often save a file by writing a new copy and renaming it over the
+ * old one, which would lose a watch set on the file itself. Instead, each
+ * file's directory is watched, and events are matched against the leaf
+ * names of the files that we're interested in. Watches are set as soon as
+ * files are added, so that saves made while a job is running are not lost.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LINUX
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/* Local source headers. */
+
+#include "watch.h"
+
+/**
+ * The time to wait for a burst of changes to finish, in milliseconds.
+ */
+
+#define WATCH_SETTLE_TIME 100
+
+/**
+ * The size of the buffer used to read inotify events.
+ */
+
+#define WATCH_EVENT_BUFFER 4096
+
+/**
+ * A file being watched, forming one entry in a linked list.
+ */
+
+struct watch_file {
+	char			*name;		/**< Pointer to the name of the file, as given.			*/
+	char			*directory;	/**< Pointer to the name of the directory holding the file.	*/
+	char			*leaf;		/**< Pointer to the leaf name of the file.			*/
+	int			descriptor;	/**< The watch descriptor for the directory, or -1.		*/
+	bool			changed;	/**< True if the file changed during the last wait.		*/
+
+	struct watch_file	*next;		/**< Pointer to the next file in the chain, or NULL.		*/
+};
+
+static struct watch_file	*watch_files = NULL;
+
+#ifdef LINUX
+/**
+ * The inotify file descriptor, or -1 if there isn't one.
+ */
+
+static int			watch_fd = -1;
+#endif
+
+#ifdef LINUX
+static bool watch_read_events(int fd);
+#endif
+
+
+/**
+ * Add a file to the list of files to be watched for changes. Files which
+ * are already on the list are ignored.
+ *
+ * \param *file		Pointer to the name of the file to watch.
+ * \return		True if successful; False on failure.
+ */
+
+bool watch_add_file(char *file)
+{
+	struct watch_file	*entry;
+	char			*slash;
+
+	if (file == NULL)
+		return false;
+
+	for (entry = watch_files; entry != NULL; entry = entry->next) {
+		if (strcmp(entry->name, file) == 0)
+			return true;
+	}
+
+	entry = malloc(sizeof(struct watch_file));
+	if (entry == NULL)
+		return false;
+
+	entry->name = strdup(file);
+	entry->directory = strdup(file);
+	if (entry->name == NULL || entry->directory == NULL) {
+		free(entry->name);
+		free(entry->directory);
+		free(entry);
+		return false;
+	}
+
+	/* Split the name into directory and leaf, using the current
+	 * directory if there's no path.
+	 */
+
+	slash = strrchr(entry->directory, '/');
+	if (slash == NULL) {
+		entry->leaf = entry->name;
+		strcpy(entry->directory, ".");
+	} else {
+		entry->leaf = entry->name + (slash - entry->directory) + 1;
+		if (slash == entry->directory)
+			slash++;
+		*slash = '\0';
+	}
+
+	entry->descriptor = -1;
+	entry->changed = false;
+
+	/* Start watching straight away, so that any changes made while the
+	 * file is being used are caught by the next call to watch_wait().
+	 */
+
+#ifdef LINUX
+	if (watch_fd == -1)
+		watch_fd = inotify_init();
+
+	if (watch_fd != -1)
+		entry->descriptor = inotify_add_watch(watch_fd, entry->directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+#endif
+
+	entry->next = watch_files;
+	watch_files = entry;
+
+	return true;
+}
+
+
+/**
+ * Remove all of the files from the list of files to be watched, and stop
+ * watching for changes.
+ */
+
+void watch_clear(void)
+{
+	struct watch_file	*entry;
+
+	while (watch_files != NULL) {
+		entry = watch_files;
+		watch_files = entry->next;
+		free(entry->name);
+		free(entry->directory);
+		free(entry);
+	}
+
+#ifdef LINUX
+	if (watch_fd != -1) {
+		close(watch_fd);
+		watch_fd = -1;
+	}
+#endif
+}
+
+
+/**
+ * Wait until one or more of the watched files is changed, then return once
+ * things have settled down. Changes made since the files were added to the
+ * list are included. The files which changed can be identified with
+ * watch_file_changed().
+ *
+ * \return		True if a change was seen; False on error.
+ */
+
+bool watch_wait(void)
+{
+#ifdef LINUX
+	struct watch_file	*entry;
+	struct pollfd		poll_data;
+	bool			changed = false;
+
+	if (watch_fd == -1)
+		return false;
+
+	/* Block until something that we're interested in happens, then
+	 * keep reading events until none have arrived for a short while,
+	 * so that a multi-file save results in a single rebuild. Any events
+	 * queued while the last job was running are read first.
+	 */
+
+	while (!changed) {
+		if (!watch_read_events(watch_fd))
+			return false;
+
+		for (entry = watch_files; entry != NULL && !changed; entry = entry->next)
+			changed = entry->changed;
+	}
+
+	poll_data.fd = watch_fd;
+	poll_data.events = POLLIN;
+
+	while (poll(&poll_data, 1, WATCH_SETTLE_TIME) > 0) {
+		if (!watch_read_events(watch_fd))
+			break;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+/**
+ * Test whether a file changed during the last call to watch_wait().
+ *
+ * \param *file		Pointer to the name of the file, as given to
+ *			watch_add_file().
+ * \return		True if the file changed; else False.
+ */
+
+bool watch_file_changed(char *file)
+{
+	struct watch_file	*entry;
+
+	if (file == NULL)
+		return false;
+
+	for (entry = watch_files; entry != NULL; entry = entry->next) {
+		if (strcmp(entry->name, file) == 0)
+			return entry->changed;
+	}
+
+	return false;
+}
+
+
+#ifdef LINUX
+/**
+ * Read a block of events from inotify, marking any watched files which
+ * they refer to as having changed.
+ *
+ * \param fd		The inotify file descriptor to read from.
+ * \return		True if successful; False on error.
+ */
+
+static bool watch_read_events(int fd)
+{
+	char			buffer[WATCH_EVENT_BUFFER] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event	*event;
+	struct watch_file	*entry;
+	ssize_t			length;
+	char			*next;
+
+	length = read(fd, buffer, WATCH_EVENT_BUFFER);
+	if (length <= 0)
+		return false;
+
+	for (next = buffer; next < buffer + length; next += sizeof(struct inotify_event) + event->len) {
+		event = (struct inotify_event *) next;
+
+		if (event->len == 0)
+			continue;
+
+		for (entry = watch_files; entry != NULL; entry = entry->next) {
+			if (entry->descriptor == event->wd && strcmp(entry->leaf, event->name) == 0)
+				entry->changed = true;
+		}
+	}
+
+	return true;
+}
+#endif
+
@@ -0,0 +1,79 @@
+/* Copyright 2014, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Tokenize:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file watch.h
+ *
+ * Source File Watching, interface.
+ */
+
+#ifndef TOKENIZE_WATCH_H
+#define TOKENIZE_WATCH_H
+
+#include <stdbool.h>
+
+
+/**
+ * Add a file to the list of files to be watched for changes. Files which
+ * are already on the list are ignored.
+ *
+ * \param *file		Pointer to the name of the file to watch.
+ * \return		True if successful; False on failure.
+ */
+
+bool watch_add_file(char *file);
+
+
+/**
+ * Remove all of the files from the list of files to be watched, and stop
+ * watching for changes.
+ */
+
+void watch_clear(void);
+
+
+/**
+ * Wait until one or more of the watched files is changed, then return once
+ * things have settled down. Changes made since the files were added to the
+ * list are included. The files which changed can be identified with
+ * watch_file_changed().
+ *
+ * \return		True if a change was seen; False on error.
+ */
+
+bool watch_wait(void);
+
+
+/**
+ * Test whether a file changed during the last call to watch_wait().
+ *
+ * \param *file		Pointer to the name of the file, as given to
+ *			watch_add_file().
+ * \return		True if the file changed; else False.
+ */
+
+bool watch_file_changed(char *file);
+
+#endif
+